@@ -35,11 +35,24 @@ import org.slf4j.LoggerFactory;
 public class DeltaDiff extends OldDiff {
 public static
 #endif
+#if !defined(__JAVA__) && !defined(BUILD_IOS)
+// Total of the block times (with bad times replaced, as in the loops below) over the window of blocks after pindexFirst upto and including pindexLast.
+// Taken from the running sums kept in the block index, instead of walking the window.
+static int64_t GetDeltaWindowTimespan(const INDEX_TYPE pindexLast, const INDEX_TYPE pindexFirst, int64_t nBadTimeReplace)
+{
+    return (pindexLast->nDeltaTimeSum - pindexFirst->nDeltaTimeSum) + nBadTimeReplace * (int64_t)(pindexLast->nDeltaBadTimeCount - pindexFirst->nDeltaBadTimeCount);
+}
+
+// fUseTimeSums selects between the running sums in the block index and walking back through every block of each window.
+// Both give identical results, the walk is kept as the reference the sums are tested against (and is what the mobile ports use).
+static unsigned int GetNextWorkRequired_DELTA_Impl(const INDEX_TYPE pindexLast, const BLOCK_TYPE block, int nPowTargetSpacing, unsigned int nPowLimit, unsigned int nFirstDeltaBlock, bool fUseTimeSums)
+#else
 unsigned int GetNextWorkRequired_DELTA (const INDEX_TYPE pindexLast, const BLOCK_TYPE block, int nPowTargetSpacing, unsigned int nPowLimit, unsigned int nFirstDeltaBlock
 #ifdef __JAVA__
 ,final BlockStore blockStore
 #endif
 )
+#endif
 {
     #ifndef BUILD_IOS
     #ifndef __JAVA__
@@ -173,6 +186,12 @@ unsigned int GetNextWorkRequired_DELTA (const INDEX_TYPE pindexLast, const BLOCK
     {
         nMiddleWeight = nMiddleTimespan = 0;
     }
+    #if !defined(__JAVA__) && !defined(BUILD_IOS)
+    else if (fUseTimeSums)
+    {
+        nMiddleTimespan = GetDeltaWindowTimespan(pindexLast, pindexLast->GetAncestor(INDEX_HEIGHT(pindexLast) - (int)nMiddleFrame), nBadTimeReplace);
+    }
+    #endif
     else
     {
         pindexFirst = pindexLast;
@@ -199,6 +218,12 @@ unsigned int GetNextWorkRequired_DELTA (const INDEX_TYPE pindexLast, const BLOCK
     {
         nLongWeight = nLongTimespan = 0;
     }
+    #if !defined(__JAVA__) && !defined(BUILD_IOS)
+    else if (fUseTimeSums)
+    {
+        nLongTimespan = INDEX_TIME(pindexLast) - INDEX_TIME(pindexLast->GetAncestor(INDEX_HEIGHT(pindexLast) - (int)nLongFrame));
+    }
+    #endif
     else
     {
         pindexFirst = pindexLast;
@@ -353,6 +378,19 @@ unsigned int GetNextWorkRequired_DELTA (const INDEX_TYPE pindexLast, const BLOCK
     }
     #endif
 }
+
+#if !defined(__JAVA__) && !defined(BUILD_IOS)
+unsigned int GetNextWorkRequired_DELTA (const INDEX_TYPE pindexLast, const BLOCK_TYPE block, int nPowTargetSpacing, unsigned int nPowLimit, unsigned int nFirstDeltaBlock)
+{
+    return GetNextWorkRequired_DELTA_Impl(pindexLast, block, nPowTargetSpacing, nPowLimit, nFirstDeltaBlock, true);
+}
+
+unsigned int GetNextWorkRequired_DELTA_Walk (const INDEX_TYPE pindexLast, const BLOCK_TYPE block, int nPowTargetSpacing, unsigned int nPowLimit, unsigned int nFirstDeltaBlock)
+{
+    return GetNextWorkRequired_DELTA_Impl(pindexLast, block, nPowTargetSpacing, nPowLimit, nFirstDeltaBlock, false);
+}
+#endif
+
 #ifdef __JAVA__
 }//class DeltaDiff
 #endif
@@ -17,6 +17,11 @@
 
 #ifndef __JAVA__
 extern unsigned int GetNextWorkRequired_DELTA (const INDEX_TYPE pindexLast, const BLOCK_TYPE block, int nPowTargetSpacing, unsigned int nPowLimit, unsigned int nFirstDeltaBlock);
+#ifndef BUILD_IOS
+// Same result as GetNextWorkRequired_DELTA but walks back through every block of each window instead of using the running
+// time sums in the block index; the original form of the algorithm, kept to verify the sums against.
+extern unsigned int GetNextWorkRequired_DELTA_Walk (const INDEX_TYPE pindexLast, const BLOCK_TYPE block, int nPowTargetSpacing, unsigned int nPowLimit, unsigned int nFirstDeltaBlock);
+#endif
 #endif
 
 #endif
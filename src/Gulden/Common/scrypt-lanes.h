@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef SCRYPT_LANES_H
+#define SCRYPT_LANES_H
+
+#include "scrypt.h"
+#include <string.h>
+
+// Interleaved multi-lane scrypt(1024,1,1,256) ROMix core, the PBKDF2 stages are done per lane by the caller in scrypt.cpp.
+// 'V' is a compiler vector type of N 32 bit words; word k of every lane is stored side by side in V[k] so that
+// salsa20/8 runs for all N headers at once without any of the shuffling the single lane sse2 kernel needs.
+// Each including translation unit is compiled with the instruction set flags matching the width of 'V'.
+
+#define SCRYPT_LANES_ROTL(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
+
+template <typename V>
+static inline void xor_salsa8_lanes(V B[16], const V Bx[16])
+{
+    V x[16];
+    for (int k = 0; k < 16; ++k)
+        x[k] = (B[k] ^= Bx[k]);
+
+    for (int i = 0; i < 8; i += 2)
+    {
+        /* Operate on columns. */
+        x[ 4] ^= SCRYPT_LANES_ROTL(x[ 0] + x[12],  7);  x[ 9] ^= SCRYPT_LANES_ROTL(x[ 5] + x[ 1],  7);
+        x[14] ^= SCRYPT_LANES_ROTL(x[10] + x[ 6],  7);  x[ 3] ^= SCRYPT_LANES_ROTL(x[15] + x[11],  7);
+
+        x[ 8] ^= SCRYPT_LANES_ROTL(x[ 4] + x[ 0],  9);  x[13] ^= SCRYPT_LANES_ROTL(x[ 9] + x[ 5],  9);
+        x[ 2] ^= SCRYPT_LANES_ROTL(x[14] + x[10],  9);  x[ 7] ^= SCRYPT_LANES_ROTL(x[ 3] + x[15],  9);
+
+        x[12] ^= SCRYPT_LANES_ROTL(x[ 8] + x[ 4], 13);  x[ 1] ^= SCRYPT_LANES_ROTL(x[13] + x[ 9], 13);
+        x[ 6] ^= SCRYPT_LANES_ROTL(x[ 2] + x[14], 13);  x[11] ^= SCRYPT_LANES_ROTL(x[ 7] + x[ 3], 13);
+
+        x[ 0] ^= SCRYPT_LANES_ROTL(x[12] + x[ 8], 18);  x[ 5] ^= SCRYPT_LANES_ROTL(x[ 1] + x[13], 18);
+        x[10] ^= SCRYPT_LANES_ROTL(x[ 6] + x[ 2], 18);  x[15] ^= SCRYPT_LANES_ROTL(x[11] + x[ 7], 18);
+
+        /* Operate on rows. */
+        x[ 1] ^= SCRYPT_LANES_ROTL(x[ 0] + x[ 3],  7);  x[ 6] ^= SCRYPT_LANES_ROTL(x[ 5] + x[ 4],  7);
+        x[11] ^= SCRYPT_LANES_ROTL(x[10] + x[ 9],  7);  x[12] ^= SCRYPT_LANES_ROTL(x[15] + x[14],  7);
+
+        x[ 2] ^= SCRYPT_LANES_ROTL(x[ 1] + x[ 0],  9);  x[ 7] ^= SCRYPT_LANES_ROTL(x[ 6] + x[ 5],  9);
+        x[ 8] ^= SCRYPT_LANES_ROTL(x[11] + x[10],  9);  x[13] ^= SCRYPT_LANES_ROTL(x[12] + x[15],  9);
+
+        x[ 3] ^= SCRYPT_LANES_ROTL(x[ 2] + x[ 1], 13);  x[ 4] ^= SCRYPT_LANES_ROTL(x[ 7] + x[ 6], 13);
+        x[ 9] ^= SCRYPT_LANES_ROTL(x[ 8] + x[11], 13);  x[14] ^= SCRYPT_LANES_ROTL(x[13] + x[12], 13);
+
+        x[ 0] ^= SCRYPT_LANES_ROTL(x[ 3] + x[ 2], 18);  x[ 5] ^= SCRYPT_LANES_ROTL(x[ 4] + x[ 7], 18);
+        x[10] ^= SCRYPT_LANES_ROTL(x[ 9] + x[ 8], 18);  x[15] ^= SCRYPT_LANES_ROTL(x[14] + x[13], 18);
+    }
+
+    for (int k = 0; k < 16; ++k)
+        B[k] += x[k];
+}
+
+// ROMix for N lanes at once; 'B' holds the N PBKDF2 outputs of 128 bytes each back to back and is mixed in place.
+template <typename V>
+static void scrypt_romix_lanes_impl(uint8_t *B, char *scratchpad)
+{
+    static const unsigned int N = sizeof(V) / sizeof(uint32_t);
+    union {
+        V v[32];
+        uint32_t u32[32 * N];
+    } X;
+    V *Vp;
+    uint32_t i, j, k, l;
+
+    Vp = (V *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+    for (k = 0; k < 32; k++)
+        for (l = 0; l < N; l++)
+            X.u32[k * N + l] = le32dec(&B[128 * l + 4 * k]);
+
+    for (i = 0; i < 1024; i++) {
+        memcpy(&Vp[i * 32], X.v, sizeof(X.v));
+        xor_salsa8_lanes<V>(&X.v[0], &X.v[16]);
+        xor_salsa8_lanes<V>(&X.v[16], &X.v[0]);
+    }
+    for (i = 0; i < 1024; i++) {
+        // Every lane reads from its own random row, so the mixing step has to be done lane by lane.
+        for (l = 0; l < N; l++) {
+            j = 32 * (X.u32[16 * N + l] & 1023);
+            const uint32_t *row = (const uint32_t *)&Vp[j] + l;
+            for (k = 0; k < 32; k++)
+                X.u32[k * N + l] ^= row[k * N];
+        }
+        xor_salsa8_lanes<V>(&X.v[0], &X.v[16]);
+        xor_salsa8_lanes<V>(&X.v[16], &X.v[0]);
+    }
+
+    for (k = 0; k < 32; k++)
+        for (l = 0; l < N; l++)
+            le32enc(&B[128 * l + 4 * k], X.u32[k * N + l]);
+}
+
+#endif
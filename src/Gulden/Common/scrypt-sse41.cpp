@@ -0,0 +1,15 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// 4 lane scrypt ROMix kernel, this file is compiled with SSE4.1 code generation enabled.
+// It must only be called after scrypt_detect() has confirmed CPU support.
+
+#include "scrypt-lanes.h"
+
+typedef uint32_t scrypt_vec_sse41 __attribute__((vector_size(16)));
+
+void scrypt_romix_sse41_4way(uint8_t *B, char *scratchpad)
+{
+    scrypt_romix_lanes_impl<scrypt_vec_sse41>(B, scratchpad);
+}
@@ -34,7 +34,8 @@
 #include <string.h>
 #include <openssl/sha.h>
 
-#if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__) || defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86)
+#define HAVE_SCRYPT_CPUID 1
 #ifdef _MSC_VER
 // MSVC 64bit is unable to use inline asm
 #include <intrin.h>
@@ -44,6 +45,20 @@
 #endif
 #endif
 
+// ROMix kernels, these mix the 128 byte PBKDF2 output of each lane in place.
+#if defined(USE_SSE2)
+void scrypt_romix_sse2(uint8_t *B, char *scratchpad);
+#endif
+#if defined(ENABLE_SSE41)
+void scrypt_romix_sse41_4way(uint8_t *B, char *scratchpad);
+#endif
+#if defined(ENABLE_AVX2)
+void scrypt_romix_avx2_8way(uint8_t *B, char *scratchpad);
+#endif
+#if defined(ENABLE_AVX512)
+void scrypt_romix_avx512_16way(uint8_t *B, char *scratchpad);
+#endif
+
 /* unused keeping it around as it's the counterpart of be32enc below
 static inline uint32_t be32dec(const void *pp)
 {
@@ -187,6 +202,47 @@ PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 	memset(&PShctx, 0, sizeof(HMAC_SHA256_CTX));
 }
 
+/**
+ * PBKDF2_SHA256_1(keyed, salt, saltlen, buf, dkLen):
+ * As PBKDF2_SHA256 with c = 1, for an HMAC-SHA256 context that has already
+ * been initialised with the password. This lets scrypt share one keyed
+ * context between its two PBKDF2 passes.
+ */
+static void
+PBKDF2_SHA256_1(const HMAC_SHA256_CTX *keyed, const uint8_t *salt,
+    size_t saltlen, uint8_t *buf, size_t dkLen)
+{
+	HMAC_SHA256_CTX PShctx, hctx;
+	size_t i;
+	uint8_t ivec[4];
+	uint8_t U[32];
+	size_t clen;
+
+	/* Compute HMAC state after processing P and S. */
+	memcpy(&PShctx, keyed, sizeof(HMAC_SHA256_CTX));
+	HMAC_SHA256_Update(&PShctx, salt, saltlen);
+
+	/* Iterate through the blocks. */
+	for (i = 0; i * 32 < dkLen; i++) {
+		/* Generate INT(i + 1). */
+		be32enc(ivec, (uint32_t)(i + 1));
+
+		/* Compute U_1 = PRF(P, S || INT(i)). */
+		memcpy(&hctx, &PShctx, sizeof(HMAC_SHA256_CTX));
+		HMAC_SHA256_Update(&hctx, ivec, 4);
+		HMAC_SHA256_Final(U, &hctx);
+
+		/* Copy as many bytes as necessary into buf. */
+		clen = dkLen - i * 32;
+		if (clen > 32)
+			clen = 32;
+		memcpy(&buf[i * 32], U, clen);
+	}
+
+	/* Clean PShctx, since we never called _Final on it. */
+	memset(&PShctx, 0, sizeof(HMAC_SHA256_CTX));
+}
+
 #define ROTL(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
 
 static inline void xor_salsa8(uint32_t B[16], const uint32_t Bx[16])
@@ -255,17 +311,14 @@ static inline void xor_salsa8(uint32_t B[16], const uint32_t Bx[16])
 	B[15] += x15;
 }
 
-void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad)
+static void scrypt_romix_generic(uint8_t *B, char *scratchpad)
 {
-	uint8_t B[128];
 	uint32_t X[32];
 	uint32_t *V;
 	uint32_t i, j, k;
 
 	V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
 
-	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
-
 	for (k = 0; k < 32; k++)
 		X[k] = le32dec(&B[4 * k]);
 
@@ -284,45 +337,266 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 
 	for (k = 0; k < 32; k++)
 		le32enc(&B[4 * k], X[k]);
+}
 
+void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+
+	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
+	scrypt_romix_generic(B, scratchpad);
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
+enum ScryptImpl
+{
+    SCRYPT_IMPL_GENERIC,
+    SCRYPT_IMPL_SSE2,
+    SCRYPT_IMPL_SSE41_4WAY,
+    SCRYPT_IMPL_AVX2_8WAY,
+    SCRYPT_IMPL_AVX512_16WAY
+};
+
+// Until scrypt_detect() runs we only use what the build guarantees is present, so hashing before detection is safe.
 #if defined(USE_SSE2)
-// By default, set to generic scrypt function. This will prevent crash in case when scrypt_detect_sse2() wasn't called
-void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
+static ScryptImpl scryptSingleImpl = SCRYPT_IMPL_SSE2;
+#else
+static ScryptImpl scryptSingleImpl = SCRYPT_IMPL_GENERIC;
+#endif
+static ScryptImpl scryptMultiImpl = scryptSingleImpl;
+static bool scryptHaveSSE41 = false;
+static bool scryptHaveAVX2 = false;
+static bool scryptHaveAVX512 = false;
 
-void scrypt_detect_sse2()
+#if defined(HAVE_SCRYPT_CPUID)
+static void scrypt_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
 {
-#if defined(USE_SSE2_ALWAYS)
-    printf("scrypt: using scrypt-sse2 as built.\n");
-#else // USE_SSE2_ALWAYS
-    // 32bit x86 Linux or Windows, detect cpuid features
-    unsigned int cpuid_edx=0;
 #if defined(_MSC_VER)
-    // MSVC
-    int x86cpuid[4];
-    __cpuid(x86cpuid, 1);
-    cpuid_edx = (unsigned int)buffer[3];
-#else // _MSC_VER
-    // Linux or i686-w64-mingw32 (gcc-4.6.3)
-    unsigned int eax, ebx, ecx;
-    __get_cpuid(1, &eax, &ebx, &ecx, &cpuid_edx);
-#endif // _MSC_VER
-
-    if (cpuid_edx & 1<<26)
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    a = info[0]; b = info[1]; c = info[2]; d = info[3];
+#else
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+#endif
+}
+
+// Extended register state the OS saves on context switch (XCR0), required before AVX registers may be used.
+static uint64_t scrypt_xgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile (".byte 0x0f, 0x01, 0xd0" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+#endif
+
+const char* scrypt_detect()
+{
+#if defined(HAVE_SCRYPT_CPUID)
+    uint32_t eax, ebx, ecx, edx;
+    scrypt_cpuid(0, 0, eax, ebx, ecx, edx);
+    uint32_t maxLeaf = eax;
+    scrypt_cpuid(1, 0, eax, ebx, ecx, edx);
+
+    bool haveSSE2 = (edx >> 26) & 1;
+    scryptHaveSSE41 = (ecx >> 19) & 1;
+    bool haveOSXSAVE = (ecx >> 27) & 1;
+    uint64_t xcr0 = haveOSXSAVE ? scrypt_xgetbv() : 0;
+    if (maxLeaf >= 7)
     {
-        scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_sse2;
-        printf("scrypt: using scrypt-sse2 as detected.\n");
+        scrypt_cpuid(7, 0, eax, ebx, ecx, edx);
+        scryptHaveAVX2 = ((ebx >> 5) & 1) && (xcr0 & 0x6) == 0x6;
+        scryptHaveAVX512 = ((ebx >> 16) & 1) && (xcr0 & 0xe6) == 0xe6;
     }
-    else
+
+    #if defined(USE_SSE2)
+    scryptSingleImpl = haveSSE2 ? SCRYPT_IMPL_SSE2 : SCRYPT_IMPL_GENERIC;
+    #else
+    (void)haveSSE2;
+    #endif
+    scryptMultiImpl = scryptSingleImpl;
+    #if defined(ENABLE_SSE41)
+    if (scryptHaveSSE41)
+        scryptMultiImpl = SCRYPT_IMPL_SSE41_4WAY;
+    #endif
+    #if defined(ENABLE_AVX2)
+    if (scryptHaveAVX2)
+        scryptMultiImpl = SCRYPT_IMPL_AVX2_8WAY;
+    #endif
+    #if defined(ENABLE_AVX512)
+    if (scryptHaveAVX512)
+        scryptMultiImpl = SCRYPT_IMPL_AVX512_16WAY;
+    #endif
+#endif
+
+    switch (scryptMultiImpl)
+    {
+        case SCRYPT_IMPL_AVX512_16WAY: return scryptSingleImpl == SCRYPT_IMPL_SSE2 ? "scrypt: using sse2, avx512 16-way for batches" : "scrypt: using generic, avx512 16-way for batches";
+        case SCRYPT_IMPL_AVX2_8WAY: return scryptSingleImpl == SCRYPT_IMPL_SSE2 ? "scrypt: using sse2, avx2 8-way for batches" : "scrypt: using generic, avx2 8-way for batches";
+        case SCRYPT_IMPL_SSE41_4WAY: return scryptSingleImpl == SCRYPT_IMPL_SSE2 ? "scrypt: using sse2, sse4.1 4-way for batches" : "scrypt: using generic, sse4.1 4-way for batches";
+        case SCRYPT_IMPL_SSE2: return "scrypt: using sse2";
+        default: return "scrypt: using generic";
+    }
+}
+
+void scrypt_1024_1_1_256_sp(const char *input, char *output, char *scratchpad)
+{
+#if defined(USE_SSE2)
+    if (scryptSingleImpl == SCRYPT_IMPL_SSE2)
+        return scrypt_1024_1_1_256_sp_sse2(input, output, scratchpad);
+#endif
+    scrypt_1024_1_1_256_sp_generic(input, output, scratchpad);
+}
+
+unsigned int scrypt_1024_1_1_256_multi_lanes()
+{
+    switch (scryptMultiImpl)
     {
-        scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_generic;
-        printf("scrypt: using scrypt-generic, SSE2 unavailable.\n");
+        case SCRYPT_IMPL_AVX512_16WAY: return 16;
+        case SCRYPT_IMPL_AVX2_8WAY: return 8;
+        case SCRYPT_IMPL_SSE41_4WAY: return 4;
+        default: return 1;
     }
-#endif // USE_SSE2_ALWAYS
 }
+
+static void scrypt_romix(uint8_t *B, char *scratchpad)
+{
+#if defined(USE_SSE2)
+    if (scryptSingleImpl == SCRYPT_IMPL_SSE2)
+        return scrypt_romix_sse2(B, scratchpad);
 #endif
+    scrypt_romix_generic(B, scratchpad);
+}
+
+static bool scrypt_lanes_supported(unsigned int lanes)
+{
+    switch (lanes)
+    {
+        #if defined(ENABLE_SSE41)
+        case 4: return scryptHaveSSE41;
+        #endif
+        #if defined(ENABLE_AVX2)
+        case 8: return scryptHaveAVX2;
+        #endif
+        #if defined(ENABLE_AVX512)
+        case 16: return scryptHaveAVX512;
+        #endif
+        default: return false;
+    }
+}
+
+static void scrypt_romix_lanes(unsigned int lanes, uint8_t *B, char *scratchpad)
+{
+    switch (lanes)
+    {
+        #if defined(ENABLE_SSE41)
+        case 4: return scrypt_romix_sse41_4way(B, scratchpad);
+        #endif
+        #if defined(ENABLE_AVX2)
+        case 8: return scrypt_romix_avx2_8way(B, scratchpad);
+        #endif
+        #if defined(ENABLE_AVX512)
+        case 16: return scrypt_romix_avx512_16way(B, scratchpad);
+        #endif
+        default:
+            for (unsigned int l = 0; l < lanes; ++l)
+                scrypt_romix(B + 128 * l, scratchpad);
+    }
+}
+
+bool scrypt_1024_1_1_256_sp_lanes(unsigned int lanes, const char *input, char *output, char *scratchpad)
+{
+    if (!scrypt_lanes_supported(lanes))
+        return false;
+
+    uint8_t B[SCRYPT_MULTI_MAX_LANES * 128];
+    for (unsigned int l = 0; l < lanes; ++l)
+        PBKDF2_SHA256((const uint8_t *)input + 80 * l, 80, (const uint8_t *)input + 80 * l, 80, 1, B + 128 * l, 128);
+    scrypt_romix_lanes(lanes, B, scratchpad);
+    for (unsigned int l = 0; l < lanes; ++l)
+        PBKDF2_SHA256((const uint8_t *)input + 80 * l, 80, B + 128 * l, 128, 1, (uint8_t *)output + 32 * l, 32);
+    return true;
+}
+
+void scrypt_1024_1_1_256_sp_multi(const char *input, char *output, unsigned int count, char *scratchpad)
+{
+    // Fill the widest kernel first, then step down so that a short tail does not waste whole passes of idle lanes.
+    unsigned int lanes = scrypt_1024_1_1_256_multi_lanes();
+    while (count > 0)
+    {
+        if (lanes > 1)
+        {
+            if (count < lanes || !scrypt_1024_1_1_256_sp_lanes(lanes, input, output, scratchpad))
+            {
+                lanes /= 2;
+                continue;
+            }
+        }
+        else
+        {
+            scrypt_1024_1_1_256_sp(input, output, scratchpad);
+        }
+        input += 80 * lanes;
+        output += 32 * lanes;
+        count -= lanes;
+    }
+}
+
+void scrypt_1024_1_1_256_multi(const char *input, char *output, unsigned int count)
+{
+    // Too large for the stack of non-main threads.
+    char* scratchpad = (char*)malloc(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    scrypt_1024_1_1_256_sp_multi(input, output, count, scratchpad);
+    free(scratchpad);
+}
+
+void scrypt_header_template_init(scrypt_header_template *tmpl, const char *header)
+{
+    memcpy(tmpl->header, header, 80);
+    SHA256_Init(&tmpl->midstate);
+    SHA256_Update(&tmpl->midstate, tmpl->header, 64);
+}
+
+void scrypt_1024_1_1_256_sp_template(const scrypt_header_template *tmpl, uint32_t nonce, unsigned int count, char *output, char *scratchpad)
+{
+    uint8_t header[SCRYPT_MULTI_MAX_LANES][80];
+    HMAC_SHA256_CTX keyed[SCRYPT_MULTI_MAX_LANES];
+    uint8_t B[SCRYPT_MULTI_MAX_LANES * 128];
+
+    unsigned int lanes = scrypt_1024_1_1_256_multi_lanes();
+    while (count > 0)
+    {
+        while (lanes > 1 && (count < lanes || !scrypt_lanes_supported(lanes)))
+            lanes /= 2;
+
+        for (unsigned int l = 0; l < lanes; ++l)
+        {
+            memcpy(header[l], tmpl->header, 76);
+            le32enc(&header[l][76], nonce + l);
+
+            // The password is longer than a SHA256 block so HMAC uses SHA256(header) as key, only the last 16 bytes
+            // (nTime, nBits, nNonce and the tail of the merkle root) have to be hashed on top of the cached midstate.
+            // The resulting keyed context serves both PBKDF2 passes.
+            unsigned char khash[32];
+            SHA256_CTX keyctx = tmpl->midstate;
+            SHA256_Update(&keyctx, &header[l][64], 16);
+            SHA256_Final(khash, &keyctx);
+            HMAC_SHA256_Init(&keyed[l], khash, 32);
+
+            PBKDF2_SHA256_1(&keyed[l], header[l], 80, B + 128 * l, 128);
+        }
+        scrypt_romix_lanes(lanes, B, scratchpad);
+        for (unsigned int l = 0; l < lanes; ++l)
+            PBKDF2_SHA256_1(&keyed[l], B + 128 * l, 128, (uint8_t *)output + 32 * l, 32);
+
+        nonce += lanes;
+        output += 32 * lanes;
+        count -= lanes;
+    }
+}
 
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
@@ -1,28 +1,55 @@
 #ifndef SCRYPT_H
 #define SCRYPT_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/gulden-config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdint.h>
+#include <openssl/sha.h>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
+// Multi-lane kernels hash several independent 80 byte headers at once, each lane needs its own 128k of scratchpad.
+static const unsigned int SCRYPT_MULTI_MAX_LANES = 16;
+static const int SCRYPT_MULTI_SCRATCHPAD_SIZE = 131072 * SCRYPT_MULTI_MAX_LANES + 63;
+
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
+void scrypt_1024_1_1_256_sp(const char *input, char *output, char *scratchpad);
 
 #if defined(USE_SSE2)
-#if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
-#define USE_SSE2_ALWAYS 1
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_sse2((input), (output), (scratchpad))
-#else
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_detected((input), (output), (scratchpad))
-#endif
-
-void scrypt_detect_sse2();
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
-extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
-#else
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
 #endif
 
+// Select the fastest single and multi-lane implementations supported by the CPU, returns a description for the log.
+const char* scrypt_detect();
+
+// Number of headers the detected multi-lane kernel processes per pass (1 if no multi-lane kernel is usable).
+unsigned int scrypt_1024_1_1_256_multi_lanes();
+
+// Hash 'count' consecutive 80 byte headers from 'input' into 'count' consecutive 32 byte hashes in 'output'.
+// 'scratchpad' must be at least SCRYPT_MULTI_SCRATCHPAD_SIZE bytes.
+void scrypt_1024_1_1_256_sp_multi(const char *input, char *output, unsigned int count, char *scratchpad);
+void scrypt_1024_1_1_256_multi(const char *input, char *output, unsigned int count);
+
+// Hashing state for one 80 byte header template of which only the trailing nonce varies, as in a mining loop.
+// Holds the SHA256 midstate over the first 64 header bytes; re-initialise whenever any other header field changes.
+typedef struct scrypt_header_template {
+    SHA256_CTX midstate;
+    uint8_t header[80];
+} scrypt_header_template;
+
+void scrypt_header_template_init(scrypt_header_template *tmpl, const char *header);
+
+// Hash 'count' consecutive nonces starting at 'nonce' into 'count' consecutive 32 byte hashes in 'output'.
+// 'scratchpad' must be at least SCRYPT_MULTI_SCRATCHPAD_SIZE bytes.
+void scrypt_1024_1_1_256_sp_template(const scrypt_header_template *tmpl, uint32_t nonce, unsigned int count, char *output, char *scratchpad);
+
+// Run exactly one pass of the 'lanes' wide kernel (4, 8 or 16); returns false if this build or CPU lacks it.
+bool scrypt_1024_1_1_256_sp_lanes(unsigned int lanes, const char *input, char *output, char *scratchpad);
+
 void PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt, size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen);
 
 void PBKDF2_SHA512(const char* pass, size_t passwdlen, const unsigned char* salt,  size_t saltlen, int32_t iterations, unsigned char* digest, uint32_t outputbytes);
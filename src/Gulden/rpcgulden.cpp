@@ -242,7 +242,6 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
         showMineOnly = request.params[2].get_bool();
 
     CBlockIndex* pTipIndex_ = nullptr;
-    //fixme: (2.0.x) - Fix this to only do a shallow clone of whats needed (need to fix recursive cloning mess first)
     CCloneChain tempChain(chainActive, GetPow2ValidationCloneHeight(), pTipIndex, pTipIndex_);
 
     if (!pTipIndex_)
@@ -458,6 +457,52 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
     return witnessInfoForBlock;
 }
 
+static UniValue getnetworkweighthistory(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getnetworkweighthistory start_height ( count )\n"
+            "\nReturns the number of witness addresses and the total witness weight of the network for a range of blocks in the current chain.\n"
+            "\nArguments:\n"
+            "1. start_height     (numeric) The height of the first block to return.\n"
+            "2. count            (numeric, optional, default=100) The number of blocks to return, going forwards from start_height.\n"
+            "\nResult:\n"
+            "[{\n"
+            "     \"height\": n                         (number) The height of the block.\n"
+            "     \"hash\": \"hash\"                     (string) The hash of the block.\n"
+            "     \"number_of_witnesses_raw\": n        (number) The number of funded witness addresses on the network as of this block.\n"
+            "     \"total_witness_weight_raw\": n       (number) The total weight of those addresses.\n"
+            "}]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetworkweighthistory 400000 1000", "")
+            + HelpExampleRpc("getnetworkweighthistory", "400000, 1000"));
+
+    int nStartHeight = request.params[0].get_int();
+    int nCount = request.params.size() > 1 ? request.params[1].get_int() : 100;
+    if (nStartHeight < 0 || nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "start_height and count must be non-negative");
+
+    LOCK(cs_main);
+
+    UniValue result(UniValue::VARR);
+    for (int nHeight = nStartHeight; nHeight - nStartHeight < nCount && nHeight <= chainActive.Height(); ++nHeight)
+    {
+        CBlockIndex* pIndex = chainActive[nHeight];
+        int64_t nNumWitnessAddresses = 0;
+        int64_t nTotalWeight = 0;
+        if (!GetPow2NetworkWeight(pIndex, Params(), nNumWitnessAddresses, nTotalWeight, chainActive))
+            throw JSONRPCError(RPC_DATABASE_ERROR, strprintf("Could not determine network weight for block at height %d", nHeight));
+
+        UniValue rec(UniValue::VOBJ);
+        rec.push_back(Pair("height", nHeight));
+        rec.push_back(Pair("hash", pIndex->GetBlockHashPoW2().ToString()));
+        rec.push_back(Pair("number_of_witnesses_raw", nNumWitnessAddresses));
+        rec.push_back(Pair("total_witness_weight_raw", nTotalWeight));
+        result.push_back(rec);
+    }
+    return result;
+}
+
 static UniValue disablewitnessing(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0) {
@@ -484,6 +529,62 @@ static UniValue enablewitnessing(const JSONRPCRequest& request)
     return true;
 }
 
+static UniValue LatencyHistogramToJSON(const CWitnessLatencyHistogram& histogram)
+{
+    UniValue rec(UniValue::VOBJ);
+    rec.push_back(Pair("count", histogram.nCount));
+    rec.push_back(Pair("mean_ms", histogram.nCount ? double(histogram.nTotal) / histogram.nCount / 1000 : 0.0));
+    rec.push_back(Pair("max_ms", double(histogram.nMax) / 1000));
+    UniValue buckets(UniValue::VARR);
+    for (int i = 0; i < CWitnessLatencyHistogram::NUM_BUCKETS; ++i)
+    {
+        UniValue bucket(UniValue::VOBJ);
+        if (i < CWitnessLatencyHistogram::NUM_BUCKETS - 1)
+            bucket.push_back(Pair("below_ms", CWitnessLatencyHistogram::BucketLimitMillis(i)));
+        else
+            bucket.push_back(Pair("below_ms", NullUniValue));
+        bucket.push_back(Pair("count", histogram.buckets[i]));
+        buckets.push_back(bucket);
+    }
+    rec.push_back(Pair("buckets", buckets));
+    return rec;
+}
+
+static UniValue getwitnesslatency(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getwitnesslatency\n"
+            "\nReturns histograms of how long this node took to witness blocks, measured from the moment the header of the block was first received.\n"
+            "\nResult:\n"
+            "{\n"
+            "     \"header_to_wakeup\": {         Until the witness thread started working on the block\n"
+            "         \"count\": n                (number) The number of blocks measured.\n"
+            "         \"mean_ms\": n              (number) The mean latency in milliseconds.\n"
+            "         \"max_ms\": n               (number) The largest latency in milliseconds.\n"
+            "         \"buckets\": [\n"
+            "             {\n"
+            "                 \"below_ms\": n     (number) Upper limit of the bucket, null for the last bucket which has no limit.\n"
+            "                 \"count\": n        (number) The number of blocks that fall in the bucket.\n"
+            "             }\n"
+            "             ...\n"
+            "         ]\n"
+            "     }\n"
+            "     \"header_to_signed\": {...}     Until the witness block was signed\n"
+            "     \"header_to_broadcast\": {...}  Until the signed witness block was processed and relayed to peers\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getwitnesslatency", "")
+            + HelpExampleRpc("getwitnesslatency", ""));
+
+    CWitnessLatencyStats stats = GetWitnessLatencyStats();
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("header_to_wakeup", LatencyHistogramToJSON(stats.headerToWakeup)));
+    result.push_back(Pair("header_to_signed", LatencyHistogramToJSON(stats.headerToSigned)));
+    result.push_back(Pair("header_to_broadcast", LatencyHistogramToJSON(stats.headerToBroadcast)));
+    return result;
+}
+
 static UniValue dumpdiffarray(const JSONRPCRequest& request)
 {
     CWallet* const pwallet = GetWalletForJSONRPCRequest(request);
@@ -3016,6 +3117,7 @@ static const CRPCCommand commands[] =
     { "witness",                 "getwitnessaccountkeys",           &getwitnessaccountkeys,          true,    {"witness_account"} },
     { "witness",                 "getwitnessaddresskeys",           &getwitnessaddresskeys,          true,    {"witness_address"} },
     { "witness",                 "getwitnesscompound",              &getwitnesscompound,             true,    {"witness_account"} },
+    { "witness",                 "getnetworkweighthistory",         &getnetworkweighthistory,        true,    {"start_height", "count"} },
     { "witness",                 "getwitnessinfo",                  &getwitnessinfo,                 true,    {"block_specifier", "verbose", "mine_only"} },
     { "witness",                 "getwitnessrewardscript",          &getwitnessrewardscript,         true,    {"witness_account"} },
     { "witness",                 "importwitnesskeys",               &importwitnesskeys,              true,    {"account_name", "encoded_key_url", "create_account"} },
@@ -3028,6 +3130,7 @@ static const CRPCCommand commands[] =
     { "witness",                 "splitwitnessaccount",             &splitwitnessaccount,            true,    {"funding_account", "witness_account", "amounts"} },
     { "witness",                 "enablewitnessing",                &enablewitnessing,               true,    {} },
     { "witness",                 "disablewitnessing",               &disablewitnessing,              true,    {} },
+    { "witness",                 "getwitnesslatency",               &getwitnesslatency,              true,    {} },
 
     { "developer",               "dumpblockgaps",                   &dumpblockgaps,                  true,    {"start_height", "count"} },
     { "developer",               "dumptransactionstats",            &dumptransactionstats,           true,    {"start_height", "count"} },
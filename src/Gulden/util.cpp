@@ -166,37 +166,31 @@ bool IsPow2Phase4Active(const CBlockIndex* pIndex, const CChainParams& chainpara
     if (phase3ActivationHash == uint256())
         return false;
 
-    // Now we try make use of the activation hash (if phase 3 is already active) to speed up testing.
-    if (phase4ActivationHash == uint256())
-        phase4ActivationHash = ppow2witdbview->GetPhase4ActivationHash();
-    if (phase4ActivationHash != uint256())
-    {
-        const CBlockIndex* pIndexPrev = pIndex;
-        while (pIndexPrev)
-        {
-            if (pIndexPrev->GetBlockHashPoW2() == phase4ActivationHash)
-                return true;
-            // No point searching any further as we won't find any true matches below this depth.
-            if (pIndexPrev->nHeight < checkDepth)
-                break;
-            pIndexPrev = pIndexPrev->pprev;
-        }
-    }
+    // The phase of a block never changes, so once it is known it is recorded in the block index.
+    if (pIndex->nStatus & BLOCK_POW2_PHASE4_KNOWN)
+        return (pIndex->nStatus & BLOCK_POW2_PHASE4_ACTIVE) != 0;
 
     {
         LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
+        // Once active phase 4 stays active, so a block whose parent is active is active as well.
+        bool fParentActive = (pIndex->pprev->nStatus & (BLOCK_POW2_PHASE4_KNOWN|BLOCK_POW2_PHASE4_ACTIVE)) == (BLOCK_POW2_PHASE4_KNOWN|BLOCK_POW2_PHASE4_ACTIVE);
         // Version bits - mined by PoW but controlled by witnesses.
-        bool ret = (VersionBitsState(pIndex, chainparams.GetConsensus(), Consensus::DEPLOYMENT_POW2_PHASE4, versionbitscache) == THRESHOLD_ACTIVE);
+        bool ret = fParentActive || (VersionBitsState(pIndex, chainparams.GetConsensus(), Consensus::DEPLOYMENT_POW2_PHASE4, versionbitscache) == THRESHOLD_ACTIVE);
+        MarkBlockIndexStatus(pIndex, ret ? BLOCK_POW2_PHASE4_KNOWN|BLOCK_POW2_PHASE4_ACTIVE : BLOCK_POW2_PHASE4_KNOWN);
         // If we are the first ever block to test as active, or if the previous active block is not our parent (can happen in the case of a fork from before activation)
         // Then set ourselves as the activation hash.
-        if (ret)
+        if (ret && !fParentActive)
         {
-            phase4ActivationHash = pIndex->GetBlockHashPoW2();
-            ppow2witdbview->SetPhase4ActivationHash(phase4ActivationHash);
-            return true;
+            if (phase4ActivationHash == uint256())
+                phase4ActivationHash = ppow2witdbview->GetPhase4ActivationHash();
+            if (phase4ActivationHash != pIndex->GetBlockHashPoW2())
+            {
+                phase4ActivationHash = pIndex->GetBlockHashPoW2();
+                ppow2witdbview->SetPhase4ActivationHash(phase4ActivationHash);
+            }
         }
+        return ret;
     }
-    return false;
 }
 
 
@@ -215,29 +209,26 @@ bool IsPow2Phase5Active(const CBlockIndex* pIndex, const CChainParams& params, C
         return false;
 
     // Optimisation - If we have never activated phase 4 then phase 5 can't possibly be active either.
+    if (phase4ActivationHash == uint256())
+        phase4ActivationHash = ppow2witdbview->GetPhase4ActivationHash();
     if (phase4ActivationHash == uint256())
         return false;
 
-    // Now we try make use of the activation hash (if phase 3 is already active) to speed up testing.
-    if (phase5ActivationHash == uint256())
-        phase5ActivationHash = ppow2witdbview->GetPhase5ActivationHash();
-    if (phase5ActivationHash != uint256())
+    // The phase of a block never changes, so once it is known it is recorded in the block index.
+    if (pIndex->nStatus & BLOCK_POW2_PHASE5_KNOWN)
+        return (pIndex->nStatus & BLOCK_POW2_PHASE5_ACTIVE) != 0;
+
+    // Once active phase 5 stays active, so a block whose parent is active is active as well.
+    if ((pIndex->pprev->nStatus & (BLOCK_POW2_PHASE5_KNOWN|BLOCK_POW2_PHASE5_ACTIVE)) == (BLOCK_POW2_PHASE5_KNOWN|BLOCK_POW2_PHASE5_ACTIVE))
     {
-        const CBlockIndex* pIndexPrev = pIndex;
-        while (pIndexPrev)
-        {
-            if (pIndexPrev->GetBlockHashPoW2() == phase5ActivationHash)
-                return true;
-            // No point searching any further as we won't find any true matches below this depth.
-            if (pIndexPrev->nHeight < checkDepth)
-                break;
-            pIndexPrev = pIndexPrev->pprev;
-        }
+        MarkBlockIndexStatus(pIndex, BLOCK_POW2_PHASE5_KNOWN|BLOCK_POW2_PHASE5_ACTIVE);
+        return true;
     }
 
     // Phase 5 can't be active if phase 4 is not.
     if (!IsPow2Phase4Active(pIndex, params, chain, viewOverride))
     {
+        MarkBlockIndexStatus(pIndex, BLOCK_POW2_PHASE5_KNOWN);
         return false;
     }
 
@@ -249,11 +240,15 @@ bool IsPow2Phase5Active(const CBlockIndex* pIndex, const CChainParams& params, C
     for (auto iter : allWitnessCoins)
     {
         if (iter.second.out.GetType() != CTxOutType::PoW2WitnessOutput)
+        {
+            MarkBlockIndexStatus(pIndex, BLOCK_POW2_PHASE5_KNOWN);
             return false;
+        }
     }
 
     // If we are the first ever block to test as active, or if the previous active block is not our parent (can happen in the case of a fork from before activation)
     // Then set ourselves as the activation hash.
+    MarkBlockIndexStatus(pIndex, BLOCK_POW2_PHASE5_KNOWN|BLOCK_POW2_PHASE5_ACTIVE);
     phase5ActivationHash = pIndex->GetBlockHashPoW2();
     ppow2witdbview->SetPhase5ActivationHash(phase5ActivationHash);
     return true;
@@ -380,6 +375,17 @@ bool GetPow2NetworkWeight(const CBlockIndex* pIndex, const CChainParams& chainpa
         return true;
     }
 
+    // Blocks on the active chain (or that once were) have their weight recorded in the witness database.
+    // Below the clone height there are no witnesses as far as the rest of the witness code is concerned, so leave that to the code below.
+    CNetworkWeightRecord record;
+    if (pIndex->nHeight >= GetPow2ValidationCloneHeight() && ppow2witdbview && ppow2witdbview->ReadNetworkWeight(blockHash, record))
+    {
+        nNumWitnessAddresses = record.nReportedNumWitnessAddresses;
+        nTotalWeight = record.nReportedTotalWeight;
+        networkWeightCache.insert(blockHash, std::pair(nNumWitnessAddresses, nTotalWeight));
+        return true;
+    }
+
     {
         LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
 
@@ -5,6 +5,7 @@
 #include "bench.h"
 #include "coins.h"
 #include "policy/policy.h"
+#include "random.h"
 #include "wallet/crypter.h"
 
 #include <vector>
@@ -20,7 +21,7 @@ static std::vector<CMutableTransaction>
 SetupDummyInputs(CBasicKeyStore& keystoreRet, CCoinsViewCache& coinsRet)
 {
     std::vector<CMutableTransaction> dummyTransactions;
-    dummyTransactions.resize(2);
+    dummyTransactions.resize(2, CMutableTransaction(CTransaction::CURRENT_VERSION));
 
     // Add some keys to the keystore:
     CKey key[4];
@@ -32,16 +33,16 @@ SetupDummyInputs(CBasicKeyStore& keystoreRet, CCoinsViewCache& coinsRet)
     // Create some dummy input transactions
     dummyTransactions[0].vout.resize(2);
     dummyTransactions[0].vout[0].nValue = 11 * CENT;
-    dummyTransactions[0].vout[0].scriptPubKey << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG;
+    dummyTransactions[0].vout[0].output.scriptPubKey << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG;
     dummyTransactions[0].vout[1].nValue = 50 * CENT;
-    dummyTransactions[0].vout[1].scriptPubKey << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG;
+    dummyTransactions[0].vout[1].output.scriptPubKey << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG;
     AddCoins(coinsRet, dummyTransactions[0], 0);
 
     dummyTransactions[1].vout.resize(2);
     dummyTransactions[1].vout[0].nValue = 21 * CENT;
-    dummyTransactions[1].vout[0].scriptPubKey = GetScriptForDestination(key[2].GetPubKey().GetID());
+    dummyTransactions[1].vout[0].output.scriptPubKey = GetScriptForDestination(key[2].GetPubKey().GetID());
     dummyTransactions[1].vout[1].nValue = 22 * CENT;
-    dummyTransactions[1].vout[1].scriptPubKey = GetScriptForDestination(key[3].GetPubKey().GetID());
+    dummyTransactions[1].vout[1].output.scriptPubKey = GetScriptForDestination(key[3].GetPubKey().GetID());
     AddCoins(coinsRet, dummyTransactions[1], 0);
 
     return dummyTransactions;
@@ -60,20 +61,20 @@ static void CCoinsCaching(benchmark::State& state)
     CCoinsViewCache coins(&coinsDummy);
     std::vector<CMutableTransaction> dummyTransactions = SetupDummyInputs(keystore, coins);
 
-    CMutableTransaction t1;
+    CMutableTransaction t1(CTransaction::CURRENT_VERSION);
     t1.vin.resize(3);
-    t1.vin[0].prevout.hash = dummyTransactions[0].GetHash();
+    t1.vin[0].prevout.setHash(dummyTransactions[0].GetHash());
     t1.vin[0].prevout.n = 1;
     t1.vin[0].scriptSig << std::vector<unsigned char>(65, 0);
-    t1.vin[1].prevout.hash = dummyTransactions[1].GetHash();
+    t1.vin[1].prevout.setHash(dummyTransactions[1].GetHash());
     t1.vin[1].prevout.n = 0;
     t1.vin[1].scriptSig << std::vector<unsigned char>(65, 0) << std::vector<unsigned char>(33, 4);
-    t1.vin[2].prevout.hash = dummyTransactions[1].GetHash();
+    t1.vin[2].prevout.setHash(dummyTransactions[1].GetHash());
     t1.vin[2].prevout.n = 1;
     t1.vin[2].scriptSig << std::vector<unsigned char>(65, 0) << std::vector<unsigned char>(33, 4);
     t1.vout.resize(2);
     t1.vout[0].nValue = 90 * CENT;
-    t1.vout[0].scriptPubKey << OP_1;
+    t1.vout[0].output.scriptPubKey << OP_1;
 
     // Benchmark.
     while (state.KeepRunning()) {
@@ -85,3 +86,86 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching);
+
+// Insert, lookup and flush (the erase everything pass of BatchWrite) throughput of the coins cache map with its pooled node allocator
+// against the same map with plain malloc allocated nodes, on a cache of COINS_MAP_BENCH_ENTRIES P2PKH coins.
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMapMalloc;
+static const unsigned int COINS_MAP_BENCH_ENTRIES = 100000;
+
+static const std::vector<std::pair<COutPoint, Coin>>& CoinsMapBenchCoins()
+{
+    static std::vector<std::pair<COutPoint, Coin>> coins;
+    if (coins.empty())
+    {
+        FastRandomContext rand(true);
+        for (unsigned int i = 0; i < COINS_MAP_BENCH_ENTRIES; ++i)
+        {
+            CTxOut out(rand.randrange(100 * COIN), GetScriptForDestination(CKeyID(uint160(rand.randbytes(20)))));
+            coins.emplace_back(COutPoint(rand.rand256(), rand.randrange(4)), Coin(std::move(out), 100000 + i / 10, false, false));
+        }
+    }
+    return coins;
+}
+
+template <typename Map>
+static void FillCoinsMap(Map& map)
+{
+    for (const auto& coin : CoinsMapBenchCoins())
+    {
+        CCoinsCacheEntry& entry = map[coin.first];
+        entry.coin = coin.second;
+        entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+    }
+}
+
+template <typename Map>
+static void CoinsMapInsert(benchmark::State& state)
+{
+    while (state.KeepRunning())
+    {
+        Map map;
+        FillCoinsMap(map);
+        assert(map.size() == COINS_MAP_BENCH_ENTRIES);
+    }
+}
+
+template <typename Map>
+static void CoinsMapLookup(benchmark::State& state)
+{
+    Map map;
+    FillCoinsMap(map);
+    while (state.KeepRunning())
+    {
+        unsigned int nFound = 0;
+        for (const auto& coin : CoinsMapBenchCoins())
+            nFound += map.count(coin.first);
+        assert(nFound == COINS_MAP_BENCH_ENTRIES);
+    }
+}
+
+template <typename Map>
+static void CoinsMapFlush(benchmark::State& state)
+{
+    Map map;
+    while (state.KeepRunning())
+    {
+        FillCoinsMap(map);
+        for (auto it = map.begin(); it != map.end();)
+            it = map.erase(it);
+        assert(map.empty());
+    }
+}
+
+static void CCoinsMapInsert(benchmark::State& state) { CoinsMapInsert<CCoinsMap>(state); }
+static void CCoinsMapInsert_Malloc(benchmark::State& state) { CoinsMapInsert<CCoinsMapMalloc>(state); }
+static void CCoinsMapLookup(benchmark::State& state) { CoinsMapLookup<CCoinsMap>(state); }
+static void CCoinsMapLookup_Malloc(benchmark::State& state) { CoinsMapLookup<CCoinsMapMalloc>(state); }
+static void CCoinsMapFlush(benchmark::State& state) { CoinsMapFlush<CCoinsMap>(state); }
+static void CCoinsMapFlush_Malloc(benchmark::State& state) { CoinsMapFlush<CCoinsMapMalloc>(state); }
+
+BENCHMARK(CCoinsMapInsert);
+BENCHMARK(CCoinsMapInsert_Malloc);
+BENCHMARK(CCoinsMapLookup);
+BENCHMARK(CCoinsMapLookup_Malloc);
+BENCHMARK(CCoinsMapFlush);
+BENCHMARK(CCoinsMapFlush_Malloc);
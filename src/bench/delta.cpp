@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "bench.h"
+#include "chain.h"
+#include "Gulden/Common/diff_common.h"
+#include "Gulden/Common/diff_delta.h"
+
+#include <memory>
+#include <vector>
+
+// Delta is evaluated once for every header that is accepted, these cases time that call with the window times taken
+// from the running sums in the block index against walking back through the 576 block long window each time.
+static const int DELTA_TARGET_SPACING = 150;
+static const unsigned int DELTA_POW_LIMIT = 0x1e0fffff;
+static const unsigned int DELTA_CHAIN_LENGTH = 2000;
+
+// Index entries are allocated one by one as they are in mapBlockIndex, so the walk pays for the pointer chasing it does on a node.
+static const std::vector<std::unique_ptr<CBlockIndex>>& DeltaChain()
+{
+    static std::vector<std::unique_ptr<CBlockIndex>> chain;
+    if (chain.empty())
+    {
+        for (unsigned int i = 0; i < DELTA_CHAIN_LENGTH; ++i)
+        {
+            CBlockIndex* pprev = i ? chain.back().get() : NULL;
+            chain.emplace_back(new CBlockIndex());
+            CBlockIndex* pindex = chain.back().get();
+            pindex->pprev = pprev;
+            pindex->nHeight = i;
+            pindex->nTime = 1500000000 + i * DELTA_TARGET_SPACING + (i % 7) * 20;
+            pindex->nBits = DELTA_POW_LIMIT;
+            pindex->BuildSkip();
+            pindex->BuildDeltaTimeSums();
+        }
+    }
+    return chain;
+}
+
+static void DeltaDiff(benchmark::State& state, bool fUseTimeSums)
+{
+    const std::vector<std::unique_ptr<CBlockIndex>>& chain = DeltaChain();
+    CBlockHeader header;
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 600; i < chain.size(); ++i)
+        {
+            header.nTime = chain[i]->nTime + DELTA_TARGET_SPACING;
+            if (fUseTimeSums)
+                GetNextWorkRequired_DELTA(chain[i].get(), &header, DELTA_TARGET_SPACING, DELTA_POW_LIMIT, 0);
+            else
+                GetNextWorkRequired_DELTA_Walk(chain[i].get(), &header, DELTA_TARGET_SPACING, DELTA_POW_LIMIT, 0);
+        }
+    }
+}
+
+static void DeltaDiff_Walk(benchmark::State& state)
+{
+    DeltaDiff(state, false);
+}
+
+static void DeltaDiff_TimeSums(benchmark::State& state)
+{
+    DeltaDiff(state, true);
+}
+
+BENCHMARK(DeltaDiff_Walk);
+BENCHMARK(DeltaDiff_TimeSums);
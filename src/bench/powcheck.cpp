@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "bench.h"
+#include "checkqueue.h"
+#include "consensus/params.h"
+#include "Gulden/Common/scrypt.h"
+#include "pow.h"
+#include "primitives/block.h"
+#include "util.h"
+
+#include <vector>
+#include <boost/thread/thread.hpp>
+
+// Header sync verifies the PoW of a full HEADERS message (2000 headers) before the contextual checks.
+// These cases compare doing that one header at a time against the batched multi-lane/multi-thread CPoWCheck path.
+static const unsigned int HEADERS_PER_MESSAGE = 2000;
+static const int MIN_CORES = 2;
+
+static const Consensus::Params& PoWCheckParams()
+{
+    static Consensus::Params params;
+    params.powLimit = uint256S("0x7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+    return params;
+}
+
+// A chain of headers that all pass CheckProofOfWork against PoWCheckParams(), mined once and shared by all cases.
+static const std::vector<CBlockHeader>& PoWCheckHeaders()
+{
+    static std::vector<CBlockHeader> headers;
+    if (headers.empty())
+    {
+        scrypt_detect();
+        // Keep the PoW cache at its minimum so that every iteration really hashes all headers.
+        ForceSetArg("-maxpowcachesize", "0");
+        InitPoWCache();
+        CBlock block;
+        block.nVersion = 4;
+        block.nBits = 0x207fffff;
+        for (unsigned int i = 0; i < HEADERS_PER_MESSAGE; ++i)
+        {
+            block.nTime = i;
+            while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, PoWCheckParams()))
+                ++block.nNonce;
+            headers.push_back(block.GetBlockHeader());
+            block.hashPrevBlock = block.GetHashLegacy();
+        }
+    }
+    return headers;
+}
+
+static void HeaderSync_PoWSerial(benchmark::State& state)
+{
+    const std::vector<CBlockHeader>& headers = PoWCheckHeaders();
+    while (state.KeepRunning())
+    {
+        for (const CBlockHeader& header : headers)
+        {
+            CBlock block(header);
+            assert(CheckProofOfWork(block.GetPoWHash(), block.nBits, PoWCheckParams()));
+        }
+    }
+}
+
+static void HeaderSync_PoWBatch(benchmark::State& state)
+{
+    const std::vector<CBlockHeader>& headers = PoWCheckHeaders();
+    std::vector<const CBlockHeader*> pHeaders;
+    for (const CBlockHeader& header : headers)
+        pHeaders.push_back(&header);
+    const unsigned int nLanes = std::max(1U, scrypt_1024_1_1_256_multi_lanes());
+
+    CCheckQueue<CPoWCheck> queue(4);
+    boost::thread_group tg;
+    for (auto x = 1; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning())
+    {
+        CCheckQueueControl<CPoWCheck> control(&queue);
+        std::vector<CPoWCheck> vChecks;
+        for (size_t i = 0; i < pHeaders.size(); i += nLanes)
+            vChecks.emplace_back(&pHeaders[i], std::min((size_t)nLanes, pHeaders.size() - i), PoWCheckParams());
+        control.Add(vChecks);
+        assert(control.Wait());
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BENCHMARK(HeaderSync_PoWSerial);
+BENCHMARK(HeaderSync_PoWBatch);
@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "bench.h"
+#include "key.h"
+#include "random.h"
+#include "wallet/wallet.h"
+
+#include <assert.h>
+#include <memory>
+#include <vector>
+
+// The part of the witness loop that scales with the number of accounts in the wallet: for every new tip the witness coins are matched
+// against the wallet to prepare coinbase templates, and for every candidate block the selected witness is matched and its key fetched
+// to sign with. Run on a wallet that hosts the given number of witness only accounts (plus a few ordinary ones), with and without the
+// -witnesshosting key index.
+static const unsigned int WITNESS_HOSTING_BENCH_COINS = 100;
+static const unsigned int WITNESS_HOSTING_BENCH_OTHER_ACCOUNTS = 5;
+
+struct CWitnessHostingBenchWallet
+{
+    std::unique_ptr<CWallet> wallet;
+    std::vector<CTxOut> witnessCoins;
+    unsigned int nAccounts = 0;
+};
+
+static CKey DeterministicKey(FastRandomContext& rand)
+{
+    CKey key;
+    uint256 keyData = rand.rand256();
+    key.Set(keyData.begin(), keyData.end(), true);
+    return key;
+}
+
+static CKeyID RandomKeyID(FastRandomContext& rand)
+{
+    return CKeyID(uint160(rand.randbytes(20)));
+}
+
+static CTxOut WitnessOutput(const CKeyID& spendingKeyID, const CKeyID& witnessKeyID)
+{
+    CTxOutPoW2Witness details;
+    details.spendingKeyID = spendingKeyID;
+    details.witnessKeyID = witnessKeyID;
+    details.lockFromBlock = 1;
+    details.lockUntilBlock = 100000;
+    return CTxOut(10000 * COIN, details);
+}
+
+// Only one wallet is kept around at a time; the accounts are added directly as the wallet database is not needed.
+static CWitnessHostingBenchWallet& WitnessHostingBenchWallet(unsigned int nAccounts)
+{
+    static CWitnessHostingBenchWallet benchWallet;
+    if (benchWallet.nAccounts != nAccounts)
+    {
+        benchWallet.wallet.reset();
+        benchWallet.wallet.reset(new CWallet());
+        benchWallet.witnessCoins.clear();
+        benchWallet.nAccounts = nAccounts;
+
+        FastRandomContext rand(true);
+        LOCK(benchWallet.wallet->cs_wallet);
+        std::vector<CKeyID> witnessKeyIDs;
+        for (unsigned int i = 0; i < nAccounts + WITNESS_HOSTING_BENCH_OTHER_ACCOUNTS; ++i)
+        {
+            CAccount* account = new CAccount();
+            account->m_Type = i < nAccounts ? WitnessOnlyWitnessAccount : Desktop;
+            CKey key = DeterministicKey(rand);
+            CPubKey pubKey = key.GetPubKey();
+            account->AddKeyPubKey(key, pubKey, KEYCHAIN_EXTERNAL);
+            benchWallet.wallet->mapAccounts[account->getUUID()] = account;
+            if (i < nAccounts)
+                witnessKeyIDs.push_back(pubKey.GetID());
+        }
+        benchWallet.wallet->witnessKeyIndex.SetDirty();
+
+        // One in ten witness coins belongs to one of our accounts.
+        for (unsigned int i = 0; i < WITNESS_HOSTING_BENCH_COINS; ++i)
+        {
+            CKeyID witnessKeyID = (i % 10 == 0) ? witnessKeyIDs[rand.randrange(witnessKeyIDs.size())] : RandomKeyID(rand);
+            benchWallet.witnessCoins.push_back(WitnessOutput(RandomKeyID(rand), witnessKeyID));
+        }
+    }
+    return benchWallet;
+}
+
+static void WitnessHosting(benchmark::State& state, unsigned int nAccounts, bool fHosting)
+{
+    CWitnessHostingBenchWallet& benchWallet = WitnessHostingBenchWallet(nAccounts);
+    CWallet& wallet = *benchWallet.wallet;
+    fWitnessHosting = fHosting;
+
+    while (state.KeepRunning())
+    {
+        // Coinbase templates for the new tip.
+        unsigned int nOurs = 0;
+        for (const auto& coin : benchWallet.witnessCoins)
+        {
+            if (wallet.IsMine(coin) != ISMINE_SPENDABLE)
+                continue;
+            bool fFound = wallet.FindAccountForTransaction(coin) != nullptr;
+            assert(fFound);
+            ++nOurs;
+        }
+        assert(nOurs == WITNESS_HOSTING_BENCH_COINS / 10);
+
+        // Selected witness for the candidate block, and the key to sign it with.
+        const CTxOut& selectedWitness = benchWallet.witnessCoins[0];
+        bool fMine = wallet.IsMine(selectedWitness) == ISMINE_SPENDABLE && wallet.FindAccountForTransaction(selectedWitness) != nullptr;
+        CKey key;
+        bool fHaveKey = wallet.GetKey(selectedWitness.output.witnessDetails.witnessKeyID, key);
+        assert(fMine && fHaveKey);
+    }
+
+    fWitnessHosting = DEFAULT_WITNESS_HOSTING;
+}
+
+static void WitnessHosting_10k(benchmark::State& state) { WitnessHosting(state, 10000, true); }
+static void WitnessHosting_10k_Linear(benchmark::State& state) { WitnessHosting(state, 10000, false); }
+static void WitnessHosting_50k(benchmark::State& state) { WitnessHosting(state, 50000, true); }
+static void WitnessHosting_50k_Linear(benchmark::State& state) { WitnessHosting(state, 50000, false); }
+static void WitnessHosting_100k(benchmark::State& state) { WitnessHosting(state, 100000, true); }
+static void WitnessHosting_100k_Linear(benchmark::State& state) { WitnessHosting(state, 100000, false); }
+
+BENCHMARK(WitnessHosting_10k);
+BENCHMARK(WitnessHosting_10k_Linear);
+BENCHMARK(WitnessHosting_50k);
+BENCHMARK(WitnessHosting_50k_Linear);
+BENCHMARK(WitnessHosting_100k);
+BENCHMARK(WitnessHosting_100k_Linear);
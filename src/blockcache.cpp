@@ -0,0 +1,87 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "blockcache.h"
+
+#include "core_memusage.h"
+#include "primitives/block.h"
+
+CBlockCache blockCache;
+
+CBlockCache::CBlockCache()
+: nMaxUsage(DEFAULT_BLOCK_CACHE_SIZE << 20)
+, nUsage(0)
+, nHits(0)
+, nMisses(0)
+{
+}
+
+void CBlockCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    Evict(nMaxUsage);
+}
+
+std::shared_ptr<const CBlock> CBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    if (nMaxUsage == 0)
+        return nullptr;
+    auto findIter = mapEntries.find(hash);
+    if (findIter == mapEntries.end())
+    {
+        ++nMisses;
+        return nullptr;
+    }
+    ++nHits;
+    entries.splice(entries.begin(), entries, findIter->second);
+    return findIter->second->pblock;
+}
+
+void CBlockCache::Insert(const uint256& hash, std::shared_ptr<const CBlock> pblock)
+{
+    if (!pblock)
+        return;
+    size_t nBlockUsage = RecursiveDynamicUsage(pblock);
+
+    LOCK(cs);
+    // The list node and the map node.
+    nBlockUsage += memusage::MallocUsage(sizeof(CEntry) + 2 * sizeof(void*)) + memusage::IncrementalDynamicUsage(mapEntries);
+    if (nBlockUsage > nMaxUsage)
+        return;
+    auto findIter = mapEntries.find(hash);
+    if (findIter != mapEntries.end())
+    {
+        entries.splice(entries.begin(), entries, findIter->second);
+        return;
+    }
+    Evict(nMaxUsage - nBlockUsage);
+    entries.push_front(CEntry{hash, std::move(pblock), nBlockUsage});
+    mapEntries.emplace(hash, entries.begin());
+    nUsage += nBlockUsage;
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    Evict(0);
+}
+
+CBlockCache::Stats CBlockCache::GetStats()
+{
+    LOCK(cs);
+    return Stats{nUsage, nMaxUsage, entries.size(), nHits, nMisses};
+}
+
+void CBlockCache::Evict(size_t nMaxUsageAfter)
+{
+    AssertLockHeld(cs);
+    while (nUsage > nMaxUsageAfter && !entries.empty())
+    {
+        nUsage -= entries.back().nUsage;
+        mapEntries.erase(entries.back().hash);
+        entries.pop_back();
+    }
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_BLOCKCACHE_H
+#define GULDEN_BLOCKCACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+
+class CBlock;
+
+/** Default for -blockcachesize, the memory budget of the decoded block cache in MiB */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 16;
+/** Upper limit for -blockcachesize in MiB */
+static const int64_t MAX_BLOCK_CACHE_SIZE = 4096;
+
+/**
+ * Least recently used cache of decoded blocks, keyed by the hash the block index knows them by (GetBlockHashPoW2).
+ * The same few blocks around the tip are read over and over (the witness thread and its orphans, GetPoWBlockForPoSBlock, getwitnessinfo,
+ * peers fetching the tip) and each read deserializes the block again; with the cache they share one immutable copy instead.
+ * Memory use is estimated with RecursiveDynamicUsage and kept under the budget by evicting the least recently used blocks.
+ */
+class CBlockCache
+{
+public:
+    struct Stats
+    {
+        size_t nUsage;
+        size_t nMaxUsage;
+        size_t nBlocks;
+        uint64_t nHits;
+        uint64_t nMisses;
+    };
+
+    CBlockCache();
+
+    //! Set the memory budget in bytes, evicting blocks that no longer fit. A budget of 0 disables the cache.
+    void SetMaxUsage(size_t nMaxUsageIn);
+
+    //! The block with index hash 'hash' if it is cached (and mark it as most recently used), nullptr otherwise.
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+
+    //! Cache 'pblock' under 'hash'. Blocks larger than the whole budget are not cached.
+    void Insert(const uint256& hash, std::shared_ptr<const CBlock> pblock);
+
+    void Clear();
+
+    Stats GetStats();
+
+private:
+    struct CEntry
+    {
+        uint256 hash;
+        std::shared_ptr<const CBlock> pblock;
+        size_t nUsage;
+    };
+    typedef std::list<CEntry> EntryList;
+
+    void Evict(size_t nMaxUsageAfter);
+
+    CCriticalSection cs;
+    //! Most recently used first.
+    EntryList entries;
+    std::map<uint256, EntryList::iterator> mapEntries;
+    size_t nMaxUsage;
+    size_t nUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+};
+
+/** Global cache of decoded blocks, filled by ConnectTip (once synced) and ReadBlockFromDiskCached */
+extern CBlockCache blockCache;
+
+#endif // GULDEN_BLOCKCACHE_H
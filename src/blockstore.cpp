@@ -13,11 +13,75 @@
 #include "blockstore.h"
 #include "streams.h"
 #include "clientversion.h"
+#include "crypto/common.h"
 #include "validation/validation.h" //For cs_main
 #include "util.h" // For DO_BENCHMARK
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 CBlockStore blockStore;
 
+CMappedBlockFile::CMappedBlockFile(const fs::path& path, size_t nReserveSize)
+: data(nullptr)
+, nMappedSize(0)
+, fd(-1)
+, nFileSize(0)
+{
+#ifndef WIN32
+    fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        size_t nSize = std::max((size_t)fileStat.st_size, nReserveSize);
+        void* mapped = mmap(nullptr, nSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED)
+        {
+            data = (const unsigned char*)mapped;
+            nMappedSize = nSize;
+            nFileSize = fileStat.st_size;
+        }
+    }
+#else
+    // Windows does not allow a mapped file to be truncated (FlushBlockFile) or deleted (pruning), so block files are not mapped there
+    // and readers take the ReadBlockFromDisk path.
+    (unused)path;
+    (unused)nReserveSize;
+#endif
+}
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    if (data)
+        munmap((void*)data, nMappedSize);
+    if (fd >= 0)
+        close(fd);
+#endif
+}
+
+bool CMappedBlockFile::Contains(size_t nEnd) const
+{
+    if (nEnd <= nFileSize)
+        return true;
+    if (IsNull() || nEnd > nMappedSize)
+        return false;
+#ifndef WIN32
+    // The file may have grown into the mapping since it was last looked at.
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+        return false;
+    nFileSize = fileStat.st_size;
+#endif
+    return nEnd <= nFileSize;
+}
+
 fs::path CBlockStore::GetBlockPosFilename(const CDiskBlockPos &pos, BlockFileType fileType)
 {
     std::string basename = mainPrefix + (fileType == BlockFileType::block ? "blk" : "rev");
@@ -76,6 +140,7 @@ FILE* CBlockStore::GetUndoFile(const CDiskBlockPos &pos, bool fNoCreate) {
 void CBlockStore::CloseBlockFiles()
 {
     vBlockfiles.clear();
+    ForgetMappedBlockFiles();
     LogPrintStr("Block and undo files closed\n");
 }
 
@@ -102,6 +167,9 @@ bool CBlockStore::WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, cons
     pos.nPos = (unsigned int)fileOutPos;
     fileout << block;
 
+    // Hand the block to the OS so that readers of the mapped block files (GetBlockSpan) see all of it once it is in the index.
+    fflush(fileout.Get());
+
     return true;
 }
 
@@ -138,9 +206,16 @@ bool CBlockStore::ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, con
         // the expensive PoW check does not need be done
         fPOW_ok = true;
     }
+    else if (index && (index->nStatus & BLOCK_POW_VERIFIED) != 0)
+    {
+        // block header data equals that in our index and its PoW was already checked
+        fPOW_ok = true;
+    }
     else
     {
-        fPOW_ok = CheckProofOfWork(block.GetPoWHash(), block.nBits, params.GetConsensus());
+        fPOW_ok = CheckBlockProofOfWork(block, params.GetConsensus());
+        if (fPOW_ok && index)
+            MarkBlockIndexPoWVerified(index);
     }
 
     if (fPOW_ok)
@@ -151,6 +226,113 @@ bool CBlockStore::ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, con
     return true;
 }
 
+std::shared_ptr<const CMappedBlockFile> CBlockStore::GetMappedBlockFile(int nFile, size_t nMinSize)
+{
+    LOCK(cs_mappedBlockFiles);
+
+    auto iter = std::find_if(listMappedBlockFiles.begin(), listMappedBlockFiles.end(), [nFile](const std::pair<int, std::shared_ptr<const CMappedBlockFile>>& entry) { return entry.first == nFile; });
+    if (iter != listMappedBlockFiles.end())
+    {
+        listMappedBlockFiles.splice(listMappedBlockFiles.begin(), listMappedBlockFiles, iter);
+        if (iter->second->Contains(nMinSize))
+            return iter->second;
+        // The mapping reaches far enough for the file that is being written to, so only a file that grew beyond it is mapped again;
+        // readers that still hold the old mapping keep it alive until they are done.
+        if (nMinSize <= iter->second->nMappedSize)
+            return nullptr;
+        listMappedBlockFiles.erase(iter);
+    }
+
+    // Block files stay below MAX_BLOCKFILE_SIZE, reserving that much lets the file that is being written to grow without a new mapping per block.
+    std::shared_ptr<const CMappedBlockFile> file = std::make_shared<const CMappedBlockFile>(GetBlockPosFilename(CDiskBlockPos(nFile, 0), BlockFileType::block), MAX_BLOCKFILE_SIZE);
+    if (file->IsNull() || !file->Contains(nMinSize))
+        return nullptr;
+    listMappedBlockFiles.emplace_front(nFile, file);
+    if (listMappedBlockFiles.size() > MAX_MAPPED_BLOCK_FILES)
+        listMappedBlockFiles.pop_back();
+    return file;
+}
+
+void CBlockStore::ForgetMappedBlockFile(int nFile)
+{
+    LOCK(cs_mappedBlockFiles);
+    listMappedBlockFiles.remove_if([nFile](const std::pair<int, std::shared_ptr<const CMappedBlockFile>>& entry) { return entry.first == nFile; });
+}
+
+void CBlockStore::ForgetMappedBlockFiles()
+{
+    LOCK(cs_mappedBlockFiles);
+    listMappedBlockFiles.clear();
+}
+
+size_t CBlockStore::NumMappedBlockFiles()
+{
+    LOCK(cs_mappedBlockFiles);
+    return listMappedBlockFiles.size();
+}
+
+bool CBlockStore::GetBlockSpan(const CDiskBlockPos& pos, CBlockSpan& span)
+{
+    // Every block is preceded by the message start and its size.
+    static const unsigned int nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return false;
+
+    std::shared_ptr<const CMappedBlockFile> file = GetMappedBlockFile(pos.nFile, pos.nPos);
+    if (!file)
+        return false;
+    const unsigned char* header = file->data + pos.nPos - nHeaderSize;
+    if (memcmp(header, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0)
+        return false;
+    uint32_t nSize = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+    if (nSize == 0)
+        return false;
+    if (!file->Contains((size_t)pos.nPos + nSize))
+    {
+        file = GetMappedBlockFile(pos.nFile, (size_t)pos.nPos + nSize);
+        if (!file)
+            return false;
+    }
+
+    span.file = file;
+    span.data = file->data + pos.nPos;
+    span.size = nSize;
+    return true;
+}
+
+bool CBlockStore::ReadBlockFromDiskMapped(CBlock& block, const CDiskBlockPos& pos, const uint256& hashBlock, const CChainParams& params)
+{
+    DO_BENCHMARK("CBlockStore: ReadBlockFromDiskMapped", BCLog::BENCH|BCLog::IO);
+
+    block.SetNull();
+
+    CBlockSpan span;
+    if (GetBlockSpan(pos, span))
+    {
+        try
+        {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION | (isLegacy ? SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS : 0), span.data, span.size);
+            reader >> block;
+            // The index only points at blocks whose header (and so PoW) was accepted before they were written, so a matching hash is all that is needed here.
+            if (block.GetHashPoW2() == hashBlock)
+                return true;
+        }
+        catch (const std::exception&)
+        {
+        }
+        block.SetNull();
+    }
+
+    // Not mapped, or not what was expected; the ordinary path reports any real problem.
+    LOCK(cs_main);
+    if (!ReadBlockFromDisk(block, pos, params))
+        return false;
+    if (block.GetHashPoW2() != hashBlock)
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, hashBlock.ToString(), pos.ToString());
+    return true;
+}
+
 bool CBlockStore::UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     DO_BENCHMARK("CBlockStore: UndoWriteToDisk", BCLog::BENCH|BCLog::IO);
@@ -223,6 +405,7 @@ void CBlockStore::UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
             fclose(p.undofile);
             p.undofile = nullptr;
         }
+        ForgetMappedBlockFile(nFile);
         CDiskBlockPos pos(nFile, 0);
         fs::remove(GetBlockPosFilename(pos, BlockFileType::block));
         fs::remove(GetBlockPosFilename(pos, BlockFileType::undo));
@@ -20,8 +20,50 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
+#include "sync.h"
 #include "undo.h"
 
+#include <atomic>
+#include <list>
+#include <memory>
+
+/** Number of block files that CBlockStore keeps mapped; each mapping takes up to MAX_BLOCKFILE_SIZE of address space */
+static const size_t MAX_MAPPED_BLOCK_FILES = 8;
+
+/** Read only memory mapping of a block file, see CBlockStore::GetBlockSpan.
+    The mapping is made at least nReserveSize long so that the block file that is being written to can grow into it without being mapped again. */
+class CMappedBlockFile
+{
+public:
+    CMappedBlockFile(const fs::path& path, size_t nReserveSize);
+    ~CMappedBlockFile();
+
+    bool IsNull() const { return data == nullptr; }
+
+    //! Whether the first nEnd bytes of the file are on disk and inside the mapping, so that they can be read through data.
+    //! Only looks at the file again when nEnd is beyond what it was known to hold before.
+    bool Contains(size_t nEnd) const;
+
+    const unsigned char* data;
+    //! Length of the mapping, which can reach past the end of the file; pages past it must not be touched.
+    size_t nMappedSize;
+
+private:
+    CMappedBlockFile(const CMappedBlockFile&) = delete;
+    CMappedBlockFile& operator=(const CMappedBlockFile&) = delete;
+
+    int fd;
+    mutable std::atomic<size_t> nFileSize;
+};
+
+/** The serialised bytes of a block inside a mapped block file; holds on to the mapping so the bytes stay valid for as long as the span is kept. */
+struct CBlockSpan
+{
+    std::shared_ptr<const CMappedBlockFile> file;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
 class CBlockStore
 {
 public:
@@ -53,6 +95,21 @@ public:
     */
     bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const CChainParams& params, const CBlockIndex* index = nullptr);
 
+    /** Locate the serialised block at pos in a read only memory mapping of its block file, without copying it.
+        Does not need cs_main and does not use the shared file handles above, so any thread can read blocks that are already on disk;
+        pos has to be taken from the index by the caller (under cs_main). Mappings of the most recently used block files are cached and shared between callers.
+        Returns false if the block file can not be mapped or pos does not hold a block, callers then fall back to ReadBlockFromDisk.
+    */
+    bool GetBlockSpan(const CDiskBlockPos& pos, CBlockSpan& span);
+
+    /** Read a block through GetBlockSpan and check that it is the block with hash hashBlock, for callers that do not hold cs_main.
+        Falls back to ReadBlockFromDisk (taking cs_main) if the block can not be read from the mapping.
+    */
+    bool ReadBlockFromDiskMapped(CBlock& block, const CDiskBlockPos& pos, const uint256& hashBlock, const CChainParams& params);
+
+    /** Number of block files GetBlockSpan keeps mapped */
+    size_t NumMappedBlockFiles();
+
     bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart);
     bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
@@ -98,6 +155,15 @@ private:
 
     std::vector<BlockFilePair> vBlockfiles;
 
+    std::shared_ptr<const CMappedBlockFile> GetMappedBlockFile(int nFile, size_t nMinSize);
+    void ForgetMappedBlockFile(int nFile);
+    void ForgetMappedBlockFiles();
+
+    CCriticalSection cs_mappedBlockFiles;
+    //! The mapped block files that were used most recently (first), at most MAX_MAPPED_BLOCK_FILES of them. A mapping that is dropped
+    //! from the list is unmapped once the last reader holding on to it is done.
+    std::list<std::pair<int, std::shared_ptr<const CMappedBlockFile>>> listMappedBlockFiles;
+
     // more block store format conversion support:
     fs::path GetBlockPosNewFilename(const CDiskBlockPos &pos, BlockFileType fileType, const std::string& newPrefix);
     bool isLegacy;
@@ -98,17 +98,8 @@ void CCloneChain::FreeMemory()
 {
     for (auto index : vFree)
     {
-        if (vChain[index->nHeight - cloneFrom] == index)
-            vChain[index->nHeight - cloneFrom] = nullptr;
         delete index;
     }
-    for (auto index : vChain)
-    {
-        if (index)
-        {
-            delete index;
-        }
-    }
     vFree.clear();
     vChain.clear();
 }
@@ -116,7 +107,8 @@ void CCloneChain::FreeMemory()
 CCloneChain::CCloneChain(const CChain& _origin, unsigned int _cloneFrom, const CBlockIndex *retainIndexIn, CBlockIndex *&retainIndexOut) :
     CChain(),
     origin(_origin),
-    cloneFrom(_cloneFrom)
+    cloneFrom(_cloneFrom),
+    nSharedHeight(_origin.Height())
 {
     //fixme: (2.0.x) - Temporarily allow nested cloning 'getwitnessinfo' needs this; however we should fix this in the near future.
     // NB! Nested cloning is okay IFF we stick to a fixed clone height, the second we start trying to optimise by using a non-fixed clone height there will be problems.
@@ -126,66 +118,56 @@ CCloneChain::CCloneChain(const CChain& _origin, unsigned int _cloneFrom, const C
     assert(cloneFrom <= origin.Height());
     assert(cloneFrom >=0);
 
-    vChain.reserve(origin.Height() + 1 - cloneFrom);
-    vFree.reserve(origin.Height() + 1 - cloneFrom);
+    if (!retainIndexIn)
+        return;
 
-    CBlockIndex* pprev = nullptr;
-    for (int i=cloneFrom; i<=origin.Height(); i++)
+    // Blocks in origin are shared as is, ForceActivateChain only ever disconnects back to them.
+    if (origin.Contains(retainIndexIn))
     {
-        CBlockIndex* index = origin[i];
-        vChain.emplace_back(new CBlockIndex(*index));
-        vFree.push_back(vChain.back());
-        if (pprev)
-            vChain.back()->pprev = pprev;
-        vChain.back()->pskip = nullptr;
-        vChain.back()->BuildSkip();
-        pprev = vChain.back();
-        if (index == retainIndexIn)
-            retainIndexOut = pprev;
-    }
-
-    // case where retainIndexIn is in the chain before the part we've cloned
-    // you better know what you're doing!
-    if (!retainIndexOut && origin.Contains(retainIndexIn))
         retainIndexOut = const_cast<CBlockIndex*>(retainIndexIn);
+        return;
+    }
 
-    if (retainIndexIn && !retainIndexOut)
+    // Copy the retained block and every block between it and origin, so that connecting them on this chain leaves the real index untouched.
+    // We might be sitting multiple blocks ahead of the chain, in which case we need to copy those blocks as well.
+    std::vector<CBlockIndex*> vCopies;
+    vCopies.push_back(new CBlockIndex(*retainIndexIn));
+    while (true)
     {
-        // Link the pprev(s) of our new potential tip with a new pointer thats inside the cloned chain instead of the old pointer to the old chain.
-        retainIndexOut = new CBlockIndex(*retainIndexIn);
+        CBlockIndex* pCopy = vCopies.back();
+        if (!pCopy->pprev)
+            break;
+        // Origin may itself be a clone chain, so also match on hash and not only on pointer.
+        CBlockIndex* pInOrigin = origin[pCopy->pprev->nHeight];
+        if (pInOrigin && (pInOrigin == pCopy->pprev || pInOrigin->GetBlockHashPoW2() == pCopy->pprev->GetBlockHashPoW2()))
         {
-            //Don't worry about leaks, these become part of tempChain and are cleaned up along with tempChain.
-            CBlockIndex* pNotInChain = retainIndexOut;
-            // We might be sitting multiple blocks ahead of the chain, in which case we need to clone those blocks as well.
-            while (pNotInChain->pprev->nHeight > Tip()->nHeight || pNotInChain->pprev->GetBlockHashPoW2() != vChain[pNotInChain->pprev->nHeight - cloneFrom]->GetBlockHashPoW2())
-            {
-                pNotInChain->pskip = nullptr;
-                pNotInChain->pprev = new CBlockIndex(*pNotInChain->pprev);
-                pNotInChain = pNotInChain->pprev;
-            }
-            while (pNotInChain->pprev != vChain[pNotInChain->pprev->nHeight - cloneFrom])
-            {
-                pNotInChain->pskip = nullptr;
-                pNotInChain->pprev = vChain[pNotInChain->pprev->nHeight - cloneFrom];
-                pNotInChain = pNotInChain->pprev;
-            }
+            pCopy->pprev = pInOrigin;
+            break;
         }
+        pCopy->pprev = new CBlockIndex(*pCopy->pprev);
+        vCopies.push_back(pCopy->pprev);
     }
+    for (auto iter = vCopies.rbegin(); iter != vCopies.rend(); ++iter)
+    {
+        (*iter)->pskip = nullptr;
+        (*iter)->BuildSkip();
+        vFree.push_back(*iter);
+    }
+    retainIndexOut = vCopies.front();
 }
 
 CBlockIndex *CCloneChain::operator[](int nHeight) const
 {
-    if (nHeight >= cloneFrom && nHeight <= Height())
-    {
-        return vChain[nHeight - cloneFrom];
-    }
-    else
+    if (nHeight < 0 || nHeight > Height())
+        return nullptr;
+    if (nHeight <= nSharedHeight)
         return origin[nHeight];
+    return vChain[nHeight - nSharedHeight - 1];
 }
 
 int CCloneChain::Height() const
 {
-    return cloneFrom + vChain.size() - 1;
+    return nSharedHeight + vChain.size();
 }
 
 void CCloneChain::SetTip(CBlockIndex *pindex)
@@ -193,12 +175,26 @@ void CCloneChain::SetTip(CBlockIndex *pindex)
     // not allowed to modify origin chain
     assert(pindex != nullptr && pindex->nHeight >= cloneFrom);
 
-    vChain.resize(pindex->nHeight - cloneFrom + 1);
+    // Find the point where pindex joins what we currently have, origin entries below that point stay shared.
+    std::vector<CBlockIndex*> vConnect;
+    CBlockIndex* pindexFork = pindex;
+    while (pindexFork && operator[](pindexFork->nHeight) != pindexFork)
+    {
+        vConnect.push_back(pindexFork);
+        pindexFork = pindexFork->pprev;
+    }
+    int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
 
-    while (pindex && vChain[pindex->nHeight - cloneFrom] != pindex) {
-        vChain[pindex->nHeight - cloneFrom] = pindex;
-        pindex = pindex->pprev;
+    if (nForkHeight < nSharedHeight)
+    {
+        nSharedHeight = nForkHeight;
+        vChain.clear();
     }
+    else
+    {
+        vChain.resize(nForkHeight - nSharedHeight);
+    }
+    vChain.insert(vChain.end(), vConnect.rbegin(), vConnect.rend());
 }
 
 CBlockIndex* CChain::FindEarliestAtLeast(int64_t nTime) const
@@ -272,6 +268,31 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+void CBlockIndex::BuildDeltaTimeSums()
+{
+    nDeltaTimeSum = 0;
+    nDeltaBadTimeCount = 0;
+    if (pprev)
+    {
+        int64_t nGap = GetBlockTime() - pprev->GetBlockTime();
+        nDeltaTimeSum = pprev->nDeltaTimeSum + (nGap > 0 ? nGap : 0);
+        nDeltaBadTimeCount = pprev->nDeltaBadTimeCount + (nGap > 0 ? 0 : 1);
+    }
+}
+
+void CBlockIndexArena::Clear()
+{
+    for (size_t nSlab = 0; nSlab < vSlabs.size(); ++nSlab)
+    {
+        size_t nUsed = (nSlab + 1 == vSlabs.size()) ? nUsedInLastSlab : SLAB_SIZE;
+        for (size_t i = 0; i < nUsed; ++i)
+            vSlabs[nSlab][i].~CBlockIndex();
+        ::operator delete(vSlabs[nSlab]);
+    }
+    vSlabs.clear();
+    nUsedInLastSlab = SLAB_SIZE;
+}
+
 arith_uint256 GetBlockProof(const CBlockIndex& block)
 {
     arith_uint256 bnTarget;
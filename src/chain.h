@@ -19,6 +19,7 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <algorithm>
 #include <vector>
 #include <valarray>
 /**
@@ -167,6 +168,58 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_POW_VERIFIED      =   256, //!< header PoW has been computed and found to satisfy nBits, no need to compute scrypt again
+
+    //! Memoized PoW² phase of the block, see IsPow2Phase4Active/IsPow2Phase5Active. The *_ACTIVE bits only mean something if the matching *_KNOWN bit is set.
+    BLOCK_POW2_PHASE4_KNOWN  =   512,
+    BLOCK_POW2_PHASE4_ACTIVE =  1024,
+    BLOCK_POW2_PHASE5_KNOWN  =  2048,
+    BLOCK_POW2_PHASE5_ACTIVE =  4096,
+};
+
+/** Witness header signature of a block index, held inline: it is either empty or exactly 65 bytes, so a vector would only add a separate heap allocation to every index. */
+class CBlockIndexWitnessSig
+{
+public:
+    static const unsigned int SIZE = 65;
+
+    CBlockIndexWitnessSig() : nSize(0) {}
+
+    bool empty() const { return nSize == 0; }
+    unsigned int size() const { return nSize; }
+    void clear() { nSize = 0; }
+
+    CBlockIndexWitnessSig& operator=(const std::vector<unsigned char>& vchSig)
+    {
+        // Block headers always carry either no signature or a full compact one, anything else would be kept broken in the index.
+        assert(vchSig.empty() || vchSig.size() == SIZE);
+        nSize = vchSig.size();
+        std::copy(vchSig.begin(), vchSig.end(), data);
+        return *this;
+    }
+
+    operator std::vector<unsigned char>() const
+    {
+        return std::vector<unsigned char>(data, data + nSize);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write((const char*)data, nSize);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s.read((char*)data, SIZE);
+        nSize = SIZE;
+    }
+
+private:
+    unsigned char data[SIZE];
+    uint8_t nSize;
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -177,6 +230,8 @@ enum BlockStatus: uint32_t {
 class CBlockIndex
 {
 public:
+    // Fields used when walking the index (pprev/pskip, GetAncestor, chain work and median time comparisons) come first so that they share a cache line.
+
     //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
     const uint256* phashBlock;
 
@@ -189,6 +244,15 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
+
+    unsigned int nTime;
+    unsigned int nBits;
+
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -198,9 +262,6 @@ public:
     //! Byte offset within rev?????.dat where this block's undo data is stored
     unsigned int nUndoPos;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
-
     //! Number of transactions in this block.
     //! Note: in a potential headers-first mode, this number cannot be relied upon
     unsigned int nTx;
@@ -210,22 +271,19 @@ public:
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    //! block header (nTime and nBits are with the fields above)
+    int nVersion;
+    unsigned int nNonce;
+    uint256 hashMerkleRoot;
 
     //! PoW2 witness block header
     int32_t nVersionPoW2Witness;
     uint32_t nTimePoW2Witness;
     uint256 hashMerkleRootPoW2Witness;
-    std::vector<unsigned char> witnessHeaderPoW2Sig; // 65 bytes
+    CBlockIndexWitnessSig witnessHeaderPoW2Sig;
 
-
-    //! block header
-    int nVersion;
-    uint256 hashMerkleRoot;
-    unsigned int nTime;
-    unsigned int nBits;
-    unsigned int nNonce;
+    //! pointer to the legacy hash of a witnessed block, if known. Memory is owned by mapBlockIndexLegacy
+    const uint256* phashBlockLegacy;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId;
@@ -233,6 +291,11 @@ public:
     //! (memory only) Maximum nTime in the chain upto and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) Sum of the positive time gaps between consecutive blocks in the chain upto and including this block,
+    //! and the number of zero/negative gaps. Lets Delta total the block times of a window from the window end points alone.
+    int64_t nDeltaTimeSum;
+    uint32_t nDeltaBadTimeCount;
+
     void SetNull()
     {
         phashBlock = NULL;
@@ -248,11 +311,14 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        nDeltaTimeSum = 0;
+        nDeltaBadTimeCount = 0;
 
         nVersionPoW2Witness = 0;
         nTimePoW2Witness = 0;
         hashMerkleRootPoW2Witness = uint256();
         witnessHeaderPoW2Sig.clear();
+        phashBlockLegacy = NULL;
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -322,6 +388,8 @@ public:
     {
         if (nVersionPoW2Witness == 0)
             return *phashBlock;
+        else if (phashBlockLegacy)
+            return *phashBlockLegacy;
         else
             return GetBlockHeader().GetHashLegacy();
     }
@@ -460,6 +528,9 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Set nDeltaTimeSum and nDeltaBadTimeCount from pprev (which must already have them set).
+    void BuildDeltaTimeSums();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
@@ -474,13 +545,17 @@ class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashPrev;
+    //! Legacy hash of a witnessed block; null for blocks without a witness and for entries written before it was stored.
+    uint256 hashLegacy;
 
     CDiskBlockIndex() {
         hashPrev = uint256();
+        hashLegacy = uint256();
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHashPoW2() : uint256());
+        hashLegacy = (nVersionPoW2Witness != 0 ? pindex->GetBlockHashLegacy() : uint256());
     }
 
     ADD_SERIALIZE_METHODS;
@@ -516,9 +591,8 @@ public:
             {
                 READWRITE(nTimePoW2Witness);
                 READWRITE(hashMerkleRootPoW2Witness);
-                if (ser_action.ForRead())
-                    witnessHeaderPoW2Sig.resize(65);
-                READWRITENOSIZEVECTOR(witnessHeaderPoW2Sig);
+                READWRITE(witnessHeaderPoW2Sig);
+                READWRITE(hashLegacy);
             }
         }
         catch (...)
@@ -528,6 +602,9 @@ public:
 
     uint256 GetBlockHashLegacy() const
     {
+        if (nVersionPoW2Witness != 0 && !hashLegacy.IsNull())
+            return hashLegacy;
+
         CBlockHeader block;
         block.nVersionPoW2Witness = nVersionPoW2Witness;
         block.nTimePoW2Witness = nTimePoW2Witness;
@@ -571,6 +648,47 @@ public:
     }
 };
 
+/**
+ * Slab storage for the entries of mapBlockIndex. Entries are placed in large contiguous slabs instead of being allocated one by one, which saves
+ * the per allocation overhead and keeps entries that are created one after the other (mostly a block and its parent) close together in memory.
+ * Entries are never freed individually, Clear destroys all of them at once.
+ */
+class CBlockIndexArena
+{
+public:
+    CBlockIndexArena() : nUsedInLastSlab(SLAB_SIZE) {}
+    ~CBlockIndexArena() { Clear(); }
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+
+    template<typename... Args>
+    CBlockIndex* Create(Args&&... args)
+    {
+        if (nUsedInLastSlab == SLAB_SIZE)
+        {
+            vSlabs.push_back(static_cast<CBlockIndex*>(::operator new(SLAB_SIZE * sizeof(CBlockIndex))));
+            nUsedInLastSlab = 0;
+        }
+        CBlockIndex* pindex = new (vSlabs.back() + nUsedInLastSlab) CBlockIndex(std::forward<Args>(args)...);
+        ++nUsedInLastSlab;
+        return pindex;
+    }
+
+    //! Destroy all entries, any pointer handed out by Create is invalid afterwards.
+    void Clear();
+
+    //! Number of entries.
+    size_t Size() const { return vSlabs.empty() ? 0 : (vSlabs.size() - 1) * SLAB_SIZE + nUsedInLastSlab; }
+
+    //! Memory held by the slabs.
+    size_t DynamicMemoryUsage() const { return vSlabs.size() * SLAB_SIZE * sizeof(CBlockIndex); }
+
+private:
+    static const size_t SLAB_SIZE = 16384;
+    std::vector<CBlockIndex*> vSlabs;
+    size_t nUsedInLastSlab;
+};
+
 class CCloneChain;
 /** An in-memory indexed chain of blocks. */
 class CChain {
@@ -649,7 +767,11 @@ public:
     virtual ~CChain(){};
 };
 
-// Simple helper class to control memory of cloned chains.
+/** A temporary chain that can be moved around (ForceActivateChain) without touching the chain it is created from.
+ * The part it has in common with 'origin' is not copied, heights up to nSharedHeight are answered by origin itself.
+ * Only blocks that are not part of origin (the retained index and the branch leading to it) are materialized as copies,
+ * the copies are owned by the chain and freed along with it.
+ */
 class CCloneChain : public CChain
 {
 public:
@@ -672,6 +794,8 @@ private:
 
     const CChain& origin;
     int cloneFrom;
+    //! Highest height at which this chain still agrees with origin, vChain holds our own entries above it.
+    int nSharedHeight;
     std::vector<CBlockIndex*> vFree;
 };
 
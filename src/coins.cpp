@@ -38,17 +38,28 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), pChainedWitView(nullptr) {}
-CCoinsViewCache::CCoinsViewCache(CCoinsViewCache *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), pChainedWitView(baseIn->pChainedWitView?std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(baseIn->pChainedWitView.get())):nullptr) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), cachedDirtyCount(0), nCacheHits(0), nCacheMisses(0), fTrackUse(false), pChainedWitView(nullptr) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsViewCache *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), cachedDirtyCount(0), nCacheHits(0), nCacheMisses(0), fTrackUse(false), pChainedWitView(baseIn->pChainedWitView?std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(baseIn->pChainedWitView.get())):nullptr) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
 }
 
+size_t CCoinsViewCache::InUseMemoryUsage() const {
+    const auto& resource = *cacheCoins.get_allocator().GetResource();
+    size_t nFreePooled = resource.NumAllocatedChunks() * resource.ChunkSizeBytes() - resource.NumBytesInUse();
+    return memusage::DynamicUsage(cacheCoins) - nFreePooled + cachedCoinsUsage;
+}
+
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        ++nCacheHits;
+        if (fTrackUse)
+            it->second.flags |= CCoinsCacheEntry::RECENT;
         return it;
+    }
+    ++nCacheMisses;
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
@@ -58,6 +69,8 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
+    if (fTrackUse)
+        ret->second.flags |= CCoinsCacheEntry::RECENT;
     cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
     return ret;
 }
@@ -99,10 +112,21 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
         fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
     }
     it->second.coin = std::move(coin);
+    if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+        ++cachedDirtyCount;
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
+void CCoinsViewCache::CacheFetchedCoin(const COutPoint& outpoint, Coin&& coin) {
+    assert(!coin.IsSpent());
+    CCoinsMap::iterator it;
+    bool inserted;
+    std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (inserted)
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+}
+
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight) {
     bool fCoinbase = tx.IsCoinBase();
     const uint256& txid = tx.GetHash();
@@ -128,8 +152,12 @@ void CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout, bool n
         *moveout = std::move(it->second.coin);
     }
     if (!nodeletefresh && it->second.flags & CCoinsCacheEntry::FRESH) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            --cachedDirtyCount;
         cacheCoins.erase(it);
     } else {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            ++cachedDirtyCount;
         it->second.flags |= CCoinsCacheEntry::DIRTY;
         it->second.coin.Clear();
     }
@@ -180,6 +208,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     entry.coin = std::move(it->second.coin);
                     cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
+                    ++cachedDirtyCount;
                     // We can mark it FRESH in the parent if it was FRESH in the child
                     // Otherwise it might have just been flushed from the parent's cache
                     // and already exist in the grandparent
@@ -200,12 +229,16 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
                     cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
+                    if (itUs->second.flags & CCoinsCacheEntry::DIRTY)
+                        --cachedDirtyCount;
                     cacheCoins.erase(itUs);
                 } else {
                     // A normal modification.
                     cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
                     itUs->second.coin = std::move(it->second.coin);
                     cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
+                    if (!(itUs->second.flags & CCoinsCacheEntry::DIRTY))
+                        ++cachedDirtyCount;
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                     // NOTE: It is possible the child has a FRESH flag here in
                     // the event the entry we found in the parent is pruned. But
@@ -229,16 +262,69 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    cachedDirtyCount = 0;
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    if (pChainedWitView)
+        pChainedWitView->Sync();
+
+    CCoinsMap mapWrite;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+            ++it;
+            continue;
+        }
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            // The base does not need to hear about a coin that was created and spent since the previous write.
+            if (!(it->second.flags & CCoinsCacheEntry::FRESH)) {
+                CCoinsCacheEntry& entry = mapWrite[it->first];
+                entry.coin = std::move(it->second.coin);
+                entry.flags = CCoinsCacheEntry::DIRTY;
+            }
+            it = cacheCoins.erase(it);
+        } else {
+            CCoinsCacheEntry& entry = mapWrite[it->first];
+            entry.coin = it->second.coin;
+            entry.flags = it->second.flags & (CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+            // The base has it now, the modification itself counts as a use.
+            it->second.flags = fTrackUse ? CCoinsCacheEntry::RECENT : 0;
+            ++it;
+        }
+    }
+    cachedDirtyCount = 0;
+    return base->BatchWrite(mapWrite, hashBlock);
+}
+
+size_t CCoinsViewCache::EvictUnused(size_t nTargetUsage) {
+    size_t nEvicted = 0;
+    // A coin that was used since the previous pass gets a second chance, which it loses in the next pass.
+    for (int nPass = 0; nPass < 2 && InUseMemoryUsage() > nTargetUsage; ++nPass) {
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end() && InUseMemoryUsage() > nTargetUsage;) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                ++it;
+            } else if (it->second.flags & CCoinsCacheEntry::RECENT) {
+                it->second.flags &= ~CCoinsCacheEntry::RECENT;
+                ++it;
+            } else {
+                cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+                it = cacheCoins.erase(it);
+                ++nEvicted;
+            }
+        }
+    }
+    return nEvicted;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     if (pChainedWitView)
         pChainedWitView->Uncache(hash);
 
     CCoinsMap::iterator it = cacheCoins.find(hash);
-    if (it != cacheCoins.end() && it->second.flags == 0) {
+    if (it != cacheCoins.end() && (it->second.flags & ~CCoinsCacheEntry::RECENT) == 0) {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
         cacheCoins.erase(it);
     }
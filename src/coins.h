@@ -19,6 +19,7 @@
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <assert.h>
@@ -96,8 +97,8 @@ public:
 class SaltedOutpointHasher
 {
 private:
-    /** Salt */
-    const uint64_t k0, k1;
+    /** Salt (not const, so that coins maps can be swapped) */
+    uint64_t k0, k1;
 
 public:
     SaltedOutpointHasher();
@@ -120,6 +121,7 @@ struct CCoinsCacheEntry
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
+        RECENT = (1 << 2), // Used since the previous eviction pass; only set by a cache that tracks use (see SetTrackUse).
         /* Note that FRESH is a performance optimization with which we can
          * erase coins that are fully spent if we know we do not need to
          * flush the changes to the parent cache.  It is always safe to
@@ -131,7 +133,12 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The coins cache holds millions of small entries during initial sync, so its nodes come from a pool (see PoolResource) instead of
+ * one malloc each. The pooled block size leaves room for the node's next pointer and cached hash next to the entry itself.
+ */
+typedef PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>, sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4> CCoinsMapAllocator;
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -228,6 +235,16 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Number of DIRTY entries, the coins the next Flush or Sync writes. */
+    size_t cachedDirtyCount;
+
+    /* Lookups that were answered from the cache, and those that had to go to the backing view. */
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
+    /* Mark entries RECENT when they are used, for EvictUnused. */
+    bool fTrackUse;
+
 public:
     CCoinsViewCache(CCoinsViewCache *baseIn);
     CCoinsViewCache(CCoinsView *baseIn);
@@ -262,6 +279,13 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool potential_overwrite);
 
+    /**
+     * Cache a coin that was read from the backing view ahead of time, as FetchCoin would have cached it, so that
+     * looking it up later does not go to the backing view. 'coin' must be the unspent coin the backing view has
+     * for 'outpoint'. Has no effect if the outpoint is cached already.
+     */
+    void CacheFetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -276,6 +300,22 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base like Flush, but keep the unmodified coins and the
+     * ones just written in the cache so that it stays warm; only spent coins leave the cache.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Remove unmodified coins that were not used since the previous call (an approximation of the least recently
+     * used ones, see SetTrackUse) until InUseMemoryUsage is at most nTargetUsage. Returns the number of coins removed.
+     */
+    size_t EvictUnused(size_t nTargetUsage);
+
+    //! Keep track of which coins are used, so that EvictUnused removes the unused ones first.
+    void SetTrackUse(bool fTrackUseIn) { fTrackUse = fTrackUseIn; }
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -288,6 +328,15 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Like DynamicMemoryUsage, without the memory of removed entries that new entries reuse before the cache grows
+    size_t InUseMemoryUsage() const;
+
+    //! Number of modified coins that have not been written to the base yet
+    size_t GetDirtyCount() const { return cachedDirtyCount; }
+
+    //! Number of lookups answered from the cache, and of those that went to the base
+    void GetHitStats(uint64_t& nHits, uint64_t& nMisses) const { nHits = nCacheHits; nMisses = nCacheMisses; }
+
     /** 
      * Amount of Gulden coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -0,0 +1,183 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/sha256.h"
+
+Num3072::Num3072()
+{
+    SetToOne();
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i)
+    {
+        limbs[i] = 0;
+        for (int j = LIMB_SIZE / 8; j-- > 0;)
+            limbs[i] = (limbs[i] << 8) | data[i * LIMB_SIZE / 8 + j];
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i)
+        limbs[i] = 0;
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    Num3072 reduced = *this;
+    if (reduced.IsOverflow())
+        reduced.FullReduce();
+    for (int i = 0; i < LIMBS; ++i)
+    {
+        limb_t limb = reduced.limbs[i];
+        for (int j = 0; j < LIMB_SIZE / 8; ++j)
+        {
+            out[i * LIMB_SIZE / 8 + j] = (unsigned char)limb;
+            limb >>= 8;
+        }
+    }
+}
+
+// Whether the number is at least the modulus (it is always below 2^3072).
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= (limb_t)(-1) - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; ++i)
+    {
+        if (limbs[i] != (limb_t)(-1))
+            return false;
+    }
+    return true;
+}
+
+// Subtract the modulus, i.e. add 2^3072 - modulus and drop the carry out of the top limb. Only when IsOverflow.
+void Num3072::FullReduce()
+{
+    double_limb_t carry = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS && carry; ++i)
+    {
+        carry += limbs[i];
+        limbs[i] = (limb_t)carry;
+        carry >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook product into twice the number of limbs.
+    limb_t product[2 * LIMBS];
+    for (int i = 0; i < 2 * LIMBS; ++i)
+        product[i] = 0;
+    for (int i = 0; i < LIMBS; ++i)
+    {
+        double_limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j)
+        {
+            carry += (double_limb_t)limbs[i] * a.limbs[j] + product[i + j];
+            product[i + j] = (limb_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+        product[i + LIMBS] = (limb_t)carry;
+    }
+
+    // 2^3072 is MAX_PRIME_DIFF modulo the modulus, so the high half folds into the low half multiplied by it.
+    double_limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i)
+    {
+        carry += (double_limb_t)product[i + LIMBS] * MAX_PRIME_DIFF + product[i];
+        limbs[i] = (limb_t)carry;
+        carry >>= LIMB_SIZE;
+    }
+    // What is left over is small, folding it in again carries out at most once more.
+    while (carry)
+    {
+        carry *= MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && carry; ++i)
+        {
+            carry += limbs[i];
+            limbs[i] = (limb_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+    }
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // The exponent (modulus - 2) has all bits set, except for those of MAX_PRIME_DIFF + 1 in the lowest limb.
+    const limb_t lowLimb = (limb_t)(-1) - MAX_PRIME_DIFF - 1;
+    Num3072 result;
+    for (int i = LIMBS; i-- > 0;)
+    {
+        const limb_t exponent = i == 0 ? lowLimb : (limb_t)(-1);
+        for (int bit = LIMB_SIZE; bit-- > 0;)
+        {
+            result.Multiply(result);
+            if ((exponent >> bit) & 1)
+                result.Multiply(*this);
+        }
+    }
+    return result;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+// Hash the element to 32 bytes, and expand those with ChaCha20 to a 3072 bit number.
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(bytes, sizeof(bytes));
+    return Num3072(bytes);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    // Copy first, as dividing a set hash by itself is allowed.
+    const Num3072 divNumerator = div.numerator;
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(divNumerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char (&out)[32])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
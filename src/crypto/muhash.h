@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_CRYPTO_MUHASH_H
+#define GULDEN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717, the group MuHash3072 works in. */
+class Num3072
+{
+public:
+#ifdef __SIZEOF_INT128__
+    typedef uint64_t limb_t;
+    typedef unsigned __int128 double_limb_t;
+    static const int LIMB_SIZE = 64;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+    static const int LIMB_SIZE = 32;
+#endif
+    static const int BYTE_SIZE = 384;
+    static const int LIMBS = BYTE_SIZE * 8 / LIMB_SIZE;
+    //! 2^3072 minus the modulus.
+    static const limb_t MAX_PRIME_DIFF = 1103717;
+
+    limb_t limbs[LIMBS];
+
+    //! Construct the number 1.
+    Num3072();
+    //! Construct from little endian bytes (any 3072 bit number, the operations reduce their result).
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    //! The multiplicative inverse, by exponentiation to the power of the modulus minus 2.
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+};
+
+/**
+ * Hash of a set of byte strings that does not depend on the order in which they were added, and that can be updated in place:
+ * every element is hashed to a number modulo a 3072 bit prime, and the set hash is the product of those numbers (MuHash, see
+ * "Incremental Multiple Hashing" by Bellare and Micciancio). Removed elements go to a separate product (the denominator), so that
+ * adding and removing elements are both a single multiplication; the expensive division only happens in Finalize.
+ *
+ * Sets can be combined with *= and /=, e.g. to apply the changes of a block to the hash of the set before it.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    //! The hash of the empty set.
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    MuHash3072& operator*=(const MuHash3072& mul);
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    //! Write the 32 byte hash of the set to out. Leaves the hash in a normalized state (that serializes to 768 bytes as always).
+    void Finalize(unsigned char (&out)[32]);
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char data[Num3072::BYTE_SIZE];
+        numerator.ToBytes(data);
+        s.write((const char*)data, sizeof(data));
+        denominator.ToBytes(data);
+        s.write((const char*)data, sizeof(data));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char data[Num3072::BYTE_SIZE];
+        s.read((char*)data, sizeof(data));
+        numerator = Num3072(data);
+        s.read((char*)data, sizeof(data));
+        denominator = Num3072(data);
+    }
+};
+
+#endif // GULDEN_CRYPTO_MUHASH_H
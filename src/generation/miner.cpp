@@ -204,7 +204,7 @@ static bool InsertPoW2WitnessIntoCoinbase(CBlock& block, const CBlockIndex* pind
             ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->nVersionPoW2Witness); //4 bytes
             ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->nTimePoW2Witness); //4 bytes
             ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->hashMerkleRootPoW2Witness); // 32 bytes
-            ::Serialize(serialisedWitnessHeaderInfoStream, NOSIZEVECTOR(pWitnessBlockToEmbed->witnessHeaderPoW2Sig)); //65 bytes
+            ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->witnessHeaderPoW2Sig); //65 bytes
             ::Serialize(serialisedWitnessHeaderInfoStream, pindexPrev->GetBlockHashLegacy()); //32 bytes
         }
 
@@ -1026,6 +1026,10 @@ void static GuldenMiner(const CChainParams& chainparams)
     std::shared_ptr<CReserveKeyOrScript> coinbaseScript;
     GetMainSignals().ScriptForMining(coinbaseScript, NULL);
 
+    CBlockHeaderPoWHasher powHasher;
+    const unsigned int nBatchSize = powHasher.BatchSize();
+    std::vector<uint256> batchHashes(nBatchSize);
+
      // Meter hashes/sec
     if (nHPSTimerStart == 0)
     {
@@ -1110,6 +1114,7 @@ void static GuldenMiner(const CChainParams& chainparams)
             }
             CBlock *pblock = &pblocktemplate->block;
             IncrementExtraNonce(pblock, pindexParent, nExtraNonce);
+            powHasher.Prepare(*pblock);
 
             //LogPrintf("Running GuldenMiner with %u transactions in block (%u bytes)\n", pblock->vtx.size(), ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
 
@@ -1144,6 +1149,7 @@ void static GuldenMiner(const CChainParams& chainparams)
                     // Update nTime every few seconds
                     if (UpdateTime(pblock, chainparams.GetConsensus(), pindexParent) < 0)
                         break; // Recreate the block if the clock has run backwards,so that we can use the correct time.
+                    powHasher.Prepare(*pblock);
                 }
                 if (nHashThrottle != -1 && nHashCounter > nHashThrottle)
                 {
@@ -1151,10 +1157,22 @@ void static GuldenMiner(const CChainParams& chainparams)
                     continue;
                 }
 
-                hashMined = UintToArith256(pblock->GetPoWHash());
+                powHasher.Hash(pblock->nNonce, nBatchSize, batchHashes.data());
+                unsigned int nFound = nBatchSize;
+                for (unsigned int i = 0; i < nBatchSize; ++i)
+                {
+                    if (UintToArith256(batchHashes[i]) <= hashTarget)
+                    {
+                        nFound = i;
+                        break;
+                    }
+                }
 
-                if (hashMined <= hashTarget)
+                if (nFound < nBatchSize)
                 {
+                    pblock->nNonce += nFound;
+                    hashMined = UintToArith256(batchHashes[nFound]);
+
                     TRY_LOCK(processBlockCS, lockProcessBlock);
                     if(!lockProcessBlock)
                         break;
@@ -1173,8 +1191,8 @@ void static GuldenMiner(const CChainParams& chainparams)
                         break;
                     }
                 }
-                pblock->nNonce += 1;
-                ++nHashCounter;
+                pblock->nNonce += nBatchSize;
+                nHashCounter += nBatchSize;
 
                 if (pblock->nNonce >= 0xffff0000)
                     break;
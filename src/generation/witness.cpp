@@ -36,6 +36,8 @@
 #include "validation/validationinterface.h"
 
 #include <algorithm>
+#include <deque>
+#include <limits>
 #include <queue>
 #include <utility>
 
@@ -52,7 +54,7 @@
 
 CCriticalSection processBlockCS;
 
-static bool SignBlockAsWitness(std::shared_ptr<CBlock> pBlock, CTxOut fittestWitnessOutput)
+bool SignBlockAsWitness(std::shared_ptr<CBlock> pBlock, CTxOut fittestWitnessOutput)
 {
     assert(pBlock->nVersionPoW2Witness != 0);
 
@@ -247,11 +249,10 @@ static bool CreateWitnessSubsidyOutputs(CMutableTransaction& coinbaseTx, std::sh
     return true;
 }
 
-static std::pair<bool, CMutableTransaction> CreateWitnessCoinbase(int nWitnessHeight, CBlockIndex* pIndexPrev, int nPoW2PhaseParent, std::shared_ptr<CReserveKeyOrScript> coinbaseScript, const CAmount witnessBlockSubsidy, const CAmount witnessFeeSubsidy, CTxOut& selectedWitnessOutput, COutPoint& selectedWitnessOutPoint, unsigned int nSelectedWitnessBlockHeight, CAccount* selectedWitnessAccount)
+// The part of the witness coinbase that does not depend on the fees in the block: both inputs, signed (the reward outputs are only added after signing).
+static bool CreateSignedWitnessCoinbaseInputs(CMutableTransaction& coinbaseTx, int nWitnessHeight, bool bSegSigIsEnabled, const COutPoint& selectedWitnessOutPoint, CAccount* selectedWitnessAccount)
 {
-    bool bSegSigIsEnabled = IsSegSigEnabled(pIndexPrev);
-
-    CMutableTransaction coinbaseTx(bSegSigIsEnabled ? CTransaction::SEGSIG_ACTIVATION_VERSION : CTransaction::CURRENT_VERSION);
+    coinbaseTx = CMutableTransaction(bSegSigIsEnabled ? CTransaction::SEGSIG_ACTIVATION_VERSION : CTransaction::CURRENT_VERSION);
     coinbaseTx.vin.resize(2);
     coinbaseTx.vin[0].prevout.SetNull();
     coinbaseTx.vin[0].SetSequence(0, coinbaseTx.nVersion, CTxInFlags::None);
@@ -274,15 +275,25 @@ static std::pair<bool, CMutableTransaction> CreateWitnessCoinbase(int nWitnessHe
     }
 
     // Sign witness coinbase.
+    LOCK(pactiveWallet->cs_wallet);
+    return pactiveWallet->SignTransaction(selectedWitnessAccount, coinbaseTx, Witness);
+}
+
+std::pair<bool, CMutableTransaction> CreateWitnessCoinbase(int nWitnessHeight, CBlockIndex* pIndexPrev, int nPoW2PhaseParent, std::shared_ptr<CReserveKeyOrScript> coinbaseScript, const CAmount witnessBlockSubsidy, const CAmount witnessFeeSubsidy, CTxOut& selectedWitnessOutput, COutPoint& selectedWitnessOutPoint, unsigned int nSelectedWitnessBlockHeight, CAccount* selectedWitnessAccount, const CMutableTransaction* pSignedInputs)
+{
+    bool bSegSigIsEnabled = IsSegSigEnabled(pIndexPrev);
+
+    CMutableTransaction coinbaseTx(bSegSigIsEnabled ? CTransaction::SEGSIG_ACTIVATION_VERSION : CTransaction::CURRENT_VERSION);
+    if (pSignedInputs)
     {
-        LOCK(pactiveWallet->cs_wallet);
-        if (!pactiveWallet->SignTransaction(selectedWitnessAccount, coinbaseTx, Witness))
-        {
-            std::string strErrorMessage = strprintf("Failed to sign witness coinbase: height[%d] chain-tip-height[%d]", nWitnessHeight, chainActive.Tip()? chainActive.Tip()->nHeight : 0);
-            CAlert::Notify(strErrorMessage, true, true);
-            LogPrintf("%s", strErrorMessage.c_str());
-            return std::pair(false, coinbaseTx);
-        }
+        coinbaseTx = *pSignedInputs;
+    }
+    else if (!CreateSignedWitnessCoinbaseInputs(coinbaseTx, nWitnessHeight, bSegSigIsEnabled, selectedWitnessOutPoint, selectedWitnessAccount))
+    {
+        std::string strErrorMessage = strprintf("Failed to sign witness coinbase: height[%d] chain-tip-height[%d]", nWitnessHeight, chainActive.Tip()? chainActive.Tip()->nHeight : 0);
+        CAlert::Notify(strErrorMessage, true, true);
+        LogPrintf("%s", strErrorMessage.c_str());
+        return std::pair(false, coinbaseTx);
     }
 
     // Output for subsidy and refresh witness address.
@@ -313,6 +324,199 @@ std::set<CBlockIndex*, CBlockIndexCacheComparator> cacheAlreadySeenWitnessCandid
 bool witnessScriptsAreDirty = false;
 bool witnessingEnabled = true;
 
+// How long the witness thread sleeps if nothing happens; it is woken up straight away by new tips and new PoW blocks so this is only a fallback.
+static const int64_t WITNESS_THREAD_IDLE_WAIT_MS = 1000;
+// Number of most recent headers for which we remember when they arrived.
+static const unsigned int WITNESS_HEADER_TIMES_TO_KEEP = 100;
+
+void CWitnessLatencyHistogram::Add(int64_t nMicros)
+{
+    int nBucket = 0;
+    while (nBucket < NUM_BUCKETS - 1 && nMicros >= BucketLimitMillis(nBucket) * 1000)
+        ++nBucket;
+    ++buckets[nBucket];
+    ++nCount;
+    nTotal += nMicros;
+    nMax = std::max(nMax, nMicros);
+}
+
+/** Wakes up the witness thread whenever there may be a new block for it to sign, and keeps track of when recent headers arrived for the latency statistics. */
+class CWitnessThreadNotifier : public CValidationInterface
+{
+public:
+    CWitnessThreadNotifier() : nEvents(0) {}
+
+    //! Wait until there has been an event after the first 'nEventsSeen' (or until the timeout expires) and return the number of events so far.
+    //! This is an interruption point.
+    uint64_t WaitForEvent(uint64_t nEventsSeen, int64_t nTimeoutMillis)
+    {
+        boost::unique_lock<boost::mutex> lock(csEvents);
+        if (nEvents == nEventsSeen)
+            condEvents.timed_wait(lock, boost::posix_time::milliseconds(nTimeoutMillis));
+        return nEvents;
+    }
+
+    //! Time (in microseconds) the header for 'pindex' was first received, or 0 if unknown.
+    int64_t GetHeaderTime(const CBlockIndex* pindex)
+    {
+        boost::unique_lock<boost::mutex> lock(csEvents);
+        auto findIter = headerTimes.find(pindex);
+        return findIter == headerTimes.end() ? 0 : findIter->second;
+    }
+
+    void RecordLatency(CWitnessLatencyHistogram CWitnessLatencyStats::* histogram, const CBlockIndex* pindex)
+    {
+        int64_t nHeaderTime = GetHeaderTime(pindex);
+        if (nHeaderTime == 0)
+            return;
+        boost::unique_lock<boost::mutex> lock(csEvents);
+        (latencyStats.*histogram).Add(GetTimeMicros() - nHeaderTime);
+    }
+
+    CWitnessLatencyStats GetLatencyStats()
+    {
+        boost::unique_lock<boost::mutex> lock(csEvents);
+        return latencyStats;
+    }
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex*, const CBlockIndex*, bool fInitialDownload) override
+    {
+        if (!fInitialDownload)
+            Notify();
+    }
+
+    // Also fired for PoW blocks at the height of the tip, which we may have to witness if the tip's witness is absent.
+    void NewPoWValidBlock(const CBlockIndex*, const std::shared_ptr<const CBlock>&) override
+    {
+        Notify();
+    }
+
+    void AcceptedBlockHeader(const CBlockIndex* pindex) override
+    {
+        boost::unique_lock<boost::mutex> lock(csEvents);
+        if (headerTimes.emplace(pindex, GetTimeMicros()).second)
+            headerOrder.push_back(pindex);
+        while (headerOrder.size() > WITNESS_HEADER_TIMES_TO_KEEP)
+        {
+            headerTimes.erase(headerOrder.front());
+            headerOrder.pop_front();
+        }
+    }
+
+private:
+    void Notify()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(csEvents);
+            ++nEvents;
+        }
+        condEvents.notify_all();
+    }
+
+    boost::mutex csEvents;
+    CConditionVariable condEvents;
+    uint64_t nEvents;
+    std::map<const CBlockIndex*, int64_t> headerTimes;
+    std::deque<const CBlockIndex*> headerOrder;
+    CWitnessLatencyStats latencyStats;
+};
+static CWitnessThreadNotifier witnessThreadNotifier;
+
+//! Upper limit on the number of our own witness outputs that get a witness coinbase prepared ahead of the next block; the heaviest (most likely to be selected) go first.
+static const unsigned int MAX_WITNESS_COINBASE_TEMPLATES = 200;
+
+typedef std::map<boost::uuids::uuid, std::shared_ptr<CReserveKeyOrScript>> CWitnessReserveKeyMap;
+
+static std::shared_ptr<CReserveKeyOrScript> GetWitnessCoinbaseScript(CWitnessReserveKeyMap& reserveKeys, CAccount* account)
+{
+    auto findIter = reserveKeys.find(account->getUUID());
+    if (findIter != reserveKeys.end())
+        return findIter->second;
+
+    std::shared_ptr<CReserveKeyOrScript> coinbaseScript = nullptr;
+    GetMainSignals().ScriptForWitnessing(coinbaseScript, account);
+    // If there is nowhere to pay the rewards ScriptForWitnessing will have alerted the user.
+    if (coinbaseScript != nullptr)
+        reserveKeys[account->getUUID()] = coinbaseScript;
+    return coinbaseScript;
+}
+
+bool CreateWitnessCoinbaseTemplate(CWitnessCoinbaseTemplate& coinbaseTemplate, int nWitnessHeight, bool bSegSigIsEnabled, const COutPoint& outpoint, CAccount* account, std::shared_ptr<CReserveKeyOrScript> coinbaseScript)
+{
+    coinbaseTemplate.accountUUID = account->getUUID();
+    coinbaseTemplate.coinbaseScript = coinbaseScript;
+    return CreateSignedWitnessCoinbaseInputs(coinbaseTemplate.coinbaseTx, nWitnessHeight, bSegSigIsEnabled, outpoint, account);
+}
+
+// Prepare witness coinbase templates for our witness outputs, for whichever block ends up following 'pindexTip'.
+// Only the snapshot of the witness coins is taken under cs_main; the wallet checks and the signing run without it so that block processing never waits on them.
+static void PrepareWitnessCoinbaseTemplates(CBlockIndex* pindexTip, const CChainParams& chainparams, CWitnessReserveKeyMap& reserveKeys, std::map<COutPoint, CWitnessCoinbaseTemplate>& templates)
+{
+    DO_BENCHMARK("WIT: PrepareWitnessCoinbaseTemplates", BCLog::BENCH|BCLog::WITNESS);
+
+    templates.clear();
+
+    std::map<COutPoint, Coin> allWitnessCoins;
+    bool bSegSigIsEnabled;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexTip)
+            return;
+        if (!getAllUnspentWitnessCoins(chainActive, chainparams, pindexTip, allWitnessCoins))
+            return;
+        bSegSigIsEnabled = IsSegSigEnabled(pindexTip);
+    }
+
+    // Only outputs that can be selected for the next block get a template, the same minimums apply as for the witness selection pool.
+    std::vector<std::tuple<int64_t, COutPoint, CAccount*>> ownWitnessOutputs;
+    {
+        LOCK(pactiveWallet->cs_wallet);
+        for (const auto& [outpoint, coin] : allWitnessCoins)
+        {
+            if (coin.out.nValue < (gMinimumWitnessAmount*COIN))
+                continue;
+            uint64_t nUnused1, nUnused2;
+            int64_t nWeight = GetPoW2RawWeightForAmount(coin.out.nValue, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nUnused1, nUnused2));
+            if (nWeight < gMinimumWitnessWeight)
+                continue;
+            //fixme: (2.1) (ISMINE_WITNESS)
+            if (pactiveWallet->IsMine(coin.out) != ISMINE_SPENDABLE)
+                continue;
+            CAccount* account = pactiveWallet->FindAccountForTransaction(coin.out);
+            if (!account)
+                continue;
+            ownWitnessOutputs.emplace_back(nWeight, outpoint, account);
+        }
+    }
+    std::sort(ownWitnessOutputs.begin(), ownWitnessOutputs.end(), [](const auto& a, const auto& b){ return std::get<0>(a) > std::get<0>(b); });
+    if (ownWitnessOutputs.size() > MAX_WITNESS_COINBASE_TEMPLATES)
+        ownWitnessOutputs.resize(MAX_WITNESS_COINBASE_TEMPLATES);
+
+    // Each template takes cs_wallet for its own signature only.
+    for (const auto& ownWitnessOutput : ownWitnessOutputs)
+    {
+        boost::this_thread::interruption_point();
+
+        const COutPoint& outpoint = std::get<1>(ownWitnessOutput);
+        CAccount* account = std::get<2>(ownWitnessOutput);
+
+        std::shared_ptr<CReserveKeyOrScript> coinbaseScript = GetWitnessCoinbaseScript(reserveKeys, account);
+        if (coinbaseScript == nullptr)
+            continue;
+        CWitnessCoinbaseTemplate coinbaseTemplate;
+        if (!CreateWitnessCoinbaseTemplate(coinbaseTemplate, pindexTip->nHeight + 1, bSegSigIsEnabled, outpoint, account, coinbaseScript))
+            continue;
+        templates.emplace(outpoint, std::move(coinbaseTemplate));
+    }
+    LogPrint(BCLog::WITNESS, "GuldenWitness: prepared %u witness coinbase templates for height %d\n", templates.size(), pindexTip->nHeight + 1);
+}
+
+CWitnessLatencyStats GetWitnessLatencyStats()
+{
+    return witnessThreadNotifier.GetLatencyStats();
+}
+
 void static GuldenWitness()
 {
     LogPrintf("GuldenWitness started\n");
@@ -324,12 +528,16 @@ void static GuldenWitness()
     CChainParams chainparams = Params();
     try
     {
-        std::map<boost::uuids::uuid, std::shared_ptr<CReserveKeyOrScript>> reserveKeys;
+        CWitnessReserveKeyMap reserveKeys;
+        std::map<COutPoint, CWitnessCoinbaseTemplate> coinbaseTemplates;
+        const CBlockIndex* pindexCoinbaseTemplates = nullptr;
+        // Force the first pass through the loop to look at the tip without waiting.
+        uint64_t nEventsSeen = std::numeric_limits<uint64_t>::max();
         while (true)
         {
             if (!regTest)
             {
-                // Busy-wait for the network to come online so we don't waste time mining
+                // Wait for the network to come online so we don't waste time mining
                 // on an obsolete chain. In regtest mode we expect to fly solo.
                 do
                 {
@@ -338,15 +546,27 @@ void static GuldenWitness()
                         if(!IsInitialBlockDownload())
                             break;
                     }
-                    MilliSleep(5000);
+                    nEventsSeen = witnessThreadNotifier.WaitForEvent(nEventsSeen, 5000);
                 } while (true);
             }
             while (!witnessingEnabled)
             {
-                MilliSleep(200);
+                nEventsSeen = witnessThreadNotifier.WaitForEvent(nEventsSeen, 200);
             }
+
+            // Sleep until a new tip or a new PoW block comes in, unless one already did since we last looked.
+            // The count is taken before the tip is read so that nothing that happens after this point can be missed.
+            nEventsSeen = witnessThreadNotifier.WaitForEvent(nEventsSeen, WITNESS_THREAD_IDLE_WAIT_MS);
             DO_BENCHMARK("WIT: GuldenWitness", BCLog::BENCH|BCLog::WITNESS);
 
+            if (witnessScriptsAreDirty)
+            {
+                witnessScriptsAreDirty = false;
+                reserveKeys.clear();
+                coinbaseTemplates.clear();
+                pindexCoinbaseTemplates = nullptr;
+            }
+
             CBlockIndex* pindexTip = chainActive.Tip();
             Consensus::Params pParams = chainparams.GetConsensus();
 
@@ -358,16 +578,22 @@ void static GuldenWitness()
             }
             int nPoW2PhasePrev = GetPoW2Phase(pindexTip->pprev, chainparams, chainActive);
 
-            //fixme: (2.1)
-            //Ideally instead of just sleeping/busy polling rather wait on a signal that gets triggered only when new blocks come in??
-            MilliSleep(100);
-
             // Check for stop or if block needs to be rebuilt
             boost::this_thread::interruption_point();
 
             // If we already have a witnessed block at the tip don't bother looking at any orphans, just patiently wait for next unsigned tip.
-            if (nPoW2PhasePrev < 3 || pindexTip->nVersionPoW2Witness != 0)
+            // In the meantime get the witness coinbases for our own witness outputs ready, so that if one of them is selected for the next block it can be signed straight away.
+            if (nPoW2PhasePrev < 3)
+                continue;
+            if (pindexTip->nVersionPoW2Witness != 0)
+            {
+                if (pactiveWallet && pindexCoinbaseTemplates != pindexTip)
+                {
+                    PrepareWitnessCoinbaseTemplates(pindexTip, chainparams, reserveKeys, coinbaseTemplates);
+                    pindexCoinbaseTemplates = pindexTip;
+                }
                 continue;
+            }
 
             // Use a cache to prevent trying the same blocks over and over.
             // Look for all potential signable blocks at same height as the index tip - don't limit ourselves to just the tip
@@ -412,6 +638,7 @@ void static GuldenWitness()
                     boost::this_thread::interruption_point();
 
                     cacheAlreadySeenWitnessCandidates.insert(candidateIter);
+                    witnessThreadNotifier.RecordLatency(&CWitnessLatencyStats::headerToWakeup, candidateIter);
 
                     //Create new block
                     std::shared_ptr<CBlock> pWitnessBlock(new CBlock);
@@ -433,10 +660,26 @@ void static GuldenWitness()
                         CAmount witnessBlockSubsidy = GetBlockSubsidyWitness(candidateIter->nHeight);
                         CAmount witnessFeesSubsidy = 0;
 
+                        // A prepared template already tells us that the output is ours and which account it belongs to.
+                        const CWitnessCoinbaseTemplate* pCoinbaseTemplate = nullptr;
+                        CAccount* selectedWitnessAccount = nullptr;
+                        auto templateIter = coinbaseTemplates.find(witnessInfo.selectedWitnessOutpoint);
+                        if (pindexCoinbaseTemplates == candidateIter->pprev && templateIter != coinbaseTemplates.end())
+                        {
+                            LOCK(pactiveWallet->cs_wallet);
+                            auto accountIter = pactiveWallet->mapAccounts.find(templateIter->second.accountUUID);
+                            if (accountIter != pactiveWallet->mapAccounts.end())
+                            {
+                                pCoinbaseTemplate = &templateIter->second;
+                                selectedWitnessAccount = accountIter->second;
+                            }
+                        }
+
                         //fixme: (2.1) (ISMINE_WITNESS)
-                        if (pactiveWallet->IsMine(witnessInfo.selectedWitnessTransaction) == ISMINE_SPENDABLE)
+                        if (pCoinbaseTemplate || pactiveWallet->IsMine(witnessInfo.selectedWitnessTransaction) == ISMINE_SPENDABLE)
                         {
-                            CAccount* selectedWitnessAccount = pactiveWallet->FindAccountForTransaction(witnessInfo.selectedWitnessTransaction);
+                            if (!selectedWitnessAccount)
+                                selectedWitnessAccount = pactiveWallet->FindAccountForTransaction(witnessInfo.selectedWitnessTransaction);
                             if (selectedWitnessAccount)
                             {
                                 //We must do this before we add the blank coinbase otherwise GetBlockWeight crashes on a NULL pointer dereference.
@@ -448,25 +691,10 @@ void static GuldenWitness()
                                 unsigned int nWitnessCoinbaseIndex = pWitnessBlock->vtx.size()-1;
                                 nStartingBlockWeight += 200;
 
-                                std::shared_ptr<CReserveKeyOrScript> coinbaseScript = nullptr;
-                                if (witnessScriptsAreDirty)
-                                {
-                                    reserveKeys.clear();
-                                }
-                                auto findIter = reserveKeys.find(selectedWitnessAccount->getUUID());
-                                if (findIter != reserveKeys.end())
-                                {
-                                    coinbaseScript = findIter->second;
-                                }
-                                else
-                                {
-                                    GetMainSignals().ScriptForWitnessing(coinbaseScript, selectedWitnessAccount);
-                                    // Don't attempt to witness if we have nowhere to pay the rewards.
-                                    // ScriptForWitnessing will have alerted the user.
-                                    if (coinbaseScript == nullptr)
-                                        continue;
-                                    reserveKeys[selectedWitnessAccount->getUUID()] = coinbaseScript;
-                                }
+                                std::shared_ptr<CReserveKeyOrScript> coinbaseScript = pCoinbaseTemplate ? pCoinbaseTemplate->coinbaseScript : GetWitnessCoinbaseScript(reserveKeys, selectedWitnessAccount);
+                                // Don't attempt to witness if we have nowhere to pay the rewards.
+                                if (coinbaseScript == nullptr)
+                                    continue;
 
                                 int nPoW2PhaseParent = GetPoW2Phase(candidateIter->pprev, chainparams, chainActive);
 
@@ -513,7 +741,7 @@ void static GuldenWitness()
 
 
                                 /** Populate witness coinbase placeholder with real information now that we have it **/
-                                const auto& [result, coinbaseTx] = CreateWitnessCoinbase(candidateIter->nHeight, candidateIter->pprev, nPoW2PhaseParent, coinbaseScript, witnessBlockSubsidy, witnessFeesSubsidy, witnessInfo.selectedWitnessTransaction, witnessInfo.selectedWitnessOutpoint, witnessInfo.selectedWitnessBlockHeight, selectedWitnessAccount);
+                                const auto& [result, coinbaseTx] = CreateWitnessCoinbase(candidateIter->nHeight, candidateIter->pprev, nPoW2PhaseParent, coinbaseScript, witnessBlockSubsidy, witnessFeesSubsidy, witnessInfo.selectedWitnessTransaction, witnessInfo.selectedWitnessOutpoint, witnessInfo.selectedWitnessBlockHeight, selectedWitnessAccount, pCoinbaseTemplate ? &pCoinbaseTemplate->coinbaseTx : nullptr);
                                 if (result)
                                 {
                                     pWitnessBlock->vtx[nWitnessCoinbaseIndex] = MakeTransactionRef(std::move(coinbaseTx));
@@ -536,8 +764,10 @@ void static GuldenWitness()
                                     /** Do the witness operation (Sign the block using our witness key) and broadcast the final product to the network. **/
                                     if (SignBlockAsWitness(pWitnessBlock, witnessInfo.selectedWitnessTransaction))
                                     {
+                                        witnessThreadNotifier.RecordLatency(&CWitnessLatencyStats::headerToSigned, candidateIter);
                                         LogPrint(BCLog::WITNESS, "GuldenWitness: witness found %s", pWitnessBlock->GetHashPoW2().ToString());
                                         ProcessBlockFound(pWitnessBlock, chainparams);
+                                        witnessThreadNotifier.RecordLatency(&CWitnessLatencyStats::headerToBroadcast, candidateIter);
                                         coinbaseScript->keepScriptOnDestroy();
                                         continue;
                                     }
@@ -566,5 +796,6 @@ void static GuldenWitness()
 
 void StartPoW2WitnessThread(boost::thread_group& threadGroup)
 {
+    RegisterValidationInterface(&witnessThreadNotifier);
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "pow2_witness", &GuldenWitness));
 }
@@ -6,7 +6,20 @@
 #ifndef GULDEN_WITNESS_H
 #define GULDEN_WITNESS_H
 
+#include "amount.h"
+#include "primitives/transaction.h"
+
 #include <boost/thread/thread.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <array>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+
+class CAccount;
+class CBlock;
+class CBlockIndex;
+class CReserveKeyOrScript;
 
 //fixme: (2.1) This is non-ideal; we should rather use a signal or something for this.
 //! Indicate to the witness thread that it must erase the witness script cache and recalculate it.
@@ -14,6 +27,60 @@ extern bool witnessScriptsAreDirty;
 
 extern bool witnessingEnabled;
 
+//! Distribution of the latencies (in microseconds) of one stage of witnessing a block.
+//! Bucket i counts latencies below 2^i milliseconds (that are not in a lower bucket), the last bucket counts everything else.
+class CWitnessLatencyHistogram
+{
+public:
+    static const int NUM_BUCKETS = 16;
+
+    CWitnessLatencyHistogram() : nCount(0), nTotal(0), nMax(0) { buckets.fill(0); }
+
+    void Add(int64_t nMicros);
+    static int64_t BucketLimitMillis(int nBucket) { return int64_t(1) << nBucket; }
+
+    uint64_t nCount;
+    int64_t nTotal;
+    int64_t nMax;
+    std::array<uint64_t, NUM_BUCKETS> buckets;
+};
+
+//! Latency histograms of the witness thread, all measured from the moment the header of the block that gets witnessed was first received.
+struct CWitnessLatencyStats
+{
+    //! Until the witness thread picked the block up as a candidate.
+    CWitnessLatencyHistogram headerToWakeup;
+    //! Until the witness block was signed.
+    CWitnessLatencyHistogram headerToSigned;
+    //! Until the signed block was processed and relayed.
+    CWitnessLatencyHistogram headerToBroadcast;
+};
+
+CWitnessLatencyStats GetWitnessLatencyStats();
+
+/** Witness coinbase for one of our own witness outputs, prepared while the witness thread waits for the next PoW block.
+ *  Holds everything CreateWitnessCoinbase needs that does not depend on the block itself, so once the output is selected only the reward outputs are left to add. */
+struct CWitnessCoinbaseTemplate
+{
+    CWitnessCoinbaseTemplate() : coinbaseTx(CTransaction::CURRENT_VERSION) {}
+
+    boost::uuids::uuid accountUUID;
+    std::shared_ptr<CReserveKeyOrScript> coinbaseScript;
+    //! Signed inputs, the reward outputs are added by CreateWitnessCoinbase.
+    CMutableTransaction coinbaseTx;
+};
+
+//! Prepare the template for witness output 'outpoint' of 'account', for the block at 'nWitnessHeight' whose parent does (or does not) have segsig enabled.
+//! Takes cs_wallet for the signature only, cs_main is not needed.
+bool CreateWitnessCoinbaseTemplate(CWitnessCoinbaseTemplate& coinbaseTemplate, int nWitnessHeight, bool bSegSigIsEnabled, const COutPoint& outpoint, CAccount* account, std::shared_ptr<CReserveKeyOrScript> coinbaseScript);
+
+//! Create the witness coinbase that spends the selected witness output and pays the subsidy and fees.
+//! If 'pSignedInputs' is set it has to be the coinbaseTx of a template for the same height, parent, witness output and account; the result is then identical to building it from scratch.
+std::pair<bool, CMutableTransaction> CreateWitnessCoinbase(int nWitnessHeight, CBlockIndex* pIndexPrev, int nPoW2PhaseParent, std::shared_ptr<CReserveKeyOrScript> coinbaseScript, const CAmount witnessBlockSubsidy, const CAmount witnessFeeSubsidy, CTxOut& selectedWitnessOutput, COutPoint& selectedWitnessOutPoint, unsigned int nSelectedWitnessBlockHeight, CAccount* selectedWitnessAccount, const CMutableTransaction* pSignedInputs);
+
+//! Sign the witness header of 'pBlock' with the witness key of 'fittestWitnessOutput', which has to be in the active wallet.
+bool SignBlockAsWitness(std::shared_ptr<CBlock> pBlock, CTxOut fittestWitnessOutput);
+
 //! Run the main witnessing thread; On wallets with no witnessing accounts this will just sleep permanently.
 void StartPoW2WitnessThread(boost::thread_group& threadGroup);
 
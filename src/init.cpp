@@ -19,6 +19,7 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockcache.h"
 #include "blockstore.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -27,6 +28,7 @@
 #include "compat/sanity.h"
 #include "consensus/validation.h"
 #include "validation/validation.h"
+#include "validation/utxosnapshot.h"
 #include "validation/witnessvalidation.h"
 #include "validation/validationinterface.h"
 #include "validation/versionbitsvalidation.h"
@@ -42,6 +44,7 @@
 #include "policy/feerate.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
+#include "pow.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "rpc/blockchain.h"
@@ -405,6 +408,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", helptr("Print version and exit"));
     strUsage += HelpMessageOpt("-alerts", strprintf(helptr("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", helptr("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockcachesize=<n>", strprintf(helptr("Keep up to <n> megabytes of recently used blocks decoded in memory (0 to disable, default: %d)"), DEFAULT_BLOCK_CACHE_SIZE));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", helptr("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(helptr("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -418,9 +422,14 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", helptr("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(helptr("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-dbflushbatch=<n>", strprintf("With -incrementalflush, write the modified coins to disk once there are <n> thousand of them (default: %u)", DEFAULT_COINS_FLUSH_BATCH));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt("-incrementalflush", strprintf(helptr("Write the UTXO set cache to disk in the background and keep it in memory, evicting the least used entries when it is full, instead of emptying it on every write (default: %u)"), DEFAULT_INCREMENTAL_FLUSH));
     strUsage += HelpMessageOpt("-loadblock=<file>", helptr("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadsnapshot=<file>", helptr("Start validating from the block of a UTXO snapshot file (see dumptxoutset) once its header is known, instead of from the genesis block. Only use snapshots from a source you trust"));
+    strUsage += HelpMessageOpt("-loadsnapshottimeout=<n>", strprintf(helptr("Give up on the -loadsnapshot block and sync normally when its header is not known after <n> seconds (default: %u)"), DEFAULT_LOADSNAPSHOT_TIMEOUT));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(helptr("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(helptr("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(helptr("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
@@ -428,6 +437,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(helptr("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(helptr("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-powpar=<n>", strprintf(helptr("Set the number of threads used to verify header proof-of-work during header sync and reindex (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+        -GetNumCores(), MAX_POWCHECK_THREADS, DEFAULT_POWCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(helptr("Specify pid file (default: %s)"), GULDEN_PID_FILENAME));
 #endif
@@ -530,6 +541,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxpowcachesize=<n>", strprintf("Limit size of the cache of headers with verified PoW to <n> MiB (default: %u)", DEFAULT_MAX_POW_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(helptr("Maximum total fees (in %s) to use in a single wallet transaction or raw transaction; setting this too low may abort large transactions (default: %s)"),
@@ -770,6 +782,74 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
         GuldenAppManager::gApp->shutdown();
     }
     } // End scope of CImportingNow
+
+    // -loadsnapshot=
+    if (gArgs.IsArgSet("-loadsnapshot"))
+    {
+        fs::path pathSnapshot = fs::absolute(GetArg("-loadsnapshot", ""), GetDataDir());
+        CUTXOSnapshotMetadata metadata;
+        std::string strError;
+        if (!ReadUTXOSnapshotMetadata(pathSnapshot, metadata, strError))
+        {
+            LogPrintf("Warning: Could not load UTXO snapshot: %s\n", strError);
+        }
+        else
+        {
+            // The snapshot block can only be made the tip once its header came in from our peers.
+            {
+                LOCK(cs_main);
+                nSnapshotPendingHeight = metadata.nHeight;
+            }
+            bool fKnown = false;
+            bool fBeyond = false;
+            bool fMismatch = false;
+            bool fTimedOut = false;
+            int64_t nTimeout = GetTime() + GetArg("-loadsnapshottimeout", DEFAULT_LOADSNAPSHOT_TIMEOUT);
+            while (!ShutdownRequested())
+            {
+                {
+                    LOCK(cs_main);
+                    fBeyond = chainActive.Height() >= metadata.nHeight;
+                    BlockMap::iterator mi = mapBlockIndex.find(metadata.hashBlock);
+                    CBlockIndex* pindexSnapshot = (mi == mapBlockIndex.end()) ? NULL : mi->second;
+                    fKnown = pindexSnapshot != NULL;
+                    // Once the best header is past the snapshot height without the snapshot block, the snapshot is not of the chain our peers follow.
+                    if (pindexBestHeader && pindexBestHeader->nHeight >= metadata.nHeight && pindexBestHeader->GetAncestor(metadata.nHeight) != pindexSnapshot)
+                    {
+                        fKnown = false;
+                        fMismatch = true;
+                    }
+                }
+                fTimedOut = GetTime() >= nTimeout;
+                if (fKnown || fBeyond || fMismatch || fTimedOut)
+                    break;
+                MilliSleep(500);
+            }
+            if (fBeyond)
+            {
+                LogPrintf("Ignoring UTXO snapshot %s, the active chain is at or beyond its height %d already\n", pathSnapshot.string(), metadata.nHeight);
+            }
+            else if (fMismatch)
+            {
+                LogPrintf("Error: Ignoring UTXO snapshot %s, its block %s is not on the best header chain at height %d, syncing normally instead\n", pathSnapshot.string(), metadata.hashBlock.ToString(), metadata.nHeight);
+            }
+            else if (fTimedOut)
+            {
+                LogPrintf("Error: Ignoring UTXO snapshot %s, the header of its block %s did not come in within %d seconds, syncing normally instead\n", pathSnapshot.string(), metadata.hashBlock.ToString(), GetArg("-loadsnapshottimeout", DEFAULT_LOADSNAPSHOT_TIMEOUT));
+            }
+            else if (fKnown)
+            {
+                CUTXOSnapshotStats stats;
+                if (LoadUTXOSnapshot(pathSnapshot, stats, strError))
+                    LogPrintf("Loaded UTXO snapshot %s at height %d\n", pathSnapshot.string(), stats.metadata.nHeight);
+                else
+                    LogPrintf("Warning: Could not load UTXO snapshot: %s\n", strError);
+            }
+            LOCK(cs_main);
+            nSnapshotPendingHeight = -1;
+        }
+    }
+
     if (GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         LoadMempool();
         fDumpMempoolLater = !ShutdownRequested();
@@ -1097,6 +1177,15 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -powpar=0 means autodetect, but nPoWCheckThreads==0 means no concurrency
+    nPoWCheckThreads = GetArg("-powpar", DEFAULT_POWCHECK_THREADS);
+    if (nPoWCheckThreads <= 0)
+        nPoWCheckThreads += GetNumCores();
+    if (nPoWCheckThreads <= 1)
+        nPoWCheckThreads = 0;
+    else if (nPoWCheckThreads > MAX_POWCHECK_THREADS)
+        nPoWCheckThreads = MAX_POWCHECK_THREADS;
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1320,11 +1409,21 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     InitSignatureCache();
+    InitPoWCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // The inputs of the next block are read before its scripts are checked, so the same number of threads does both.
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+    }
+
+    LogPrintf("Using %u threads for proof-of-work verification\n", nPoWCheckThreads);
+    if (nPoWCheckThreads) {
+        for (int i=0; i<nPoWCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadPoWCheck);
     }
 
     //Gulden - private key for checkpoint system.
@@ -1359,9 +1458,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     int64_t nStart;
 
-#if defined(USE_SSE2)
-    scrypt_detect_sse2();
-#endif
+    LogPrintf("%s\n", scrypt_detect());
 
     // ********************************************************* Step 5: verify wallet database integrity
 #ifdef ENABLE_WALLET
@@ -1567,6 +1664,13 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    fIncrementalFlush = GetBoolArg("-incrementalflush", DEFAULT_INCREMENTAL_FLUSH);
+    nCoinsFlushBatch = std::max((int64_t)1, GetArg("-dbflushbatch", DEFAULT_COINS_FLUSH_BATCH)) * 1000;
+    if (fIncrementalFlush)
+        LogPrintf("* Writing the UTXO set in the background every %u modified coins\n", nCoinsFlushBatch);
+    int64_t nBlockCacheSize = std::min(std::max((int64_t)0, GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE)), MAX_BLOCK_CACHE_SIZE) << 20;
+    blockCache.SetMaxUsage(nBlockCacheSize);
+    LogPrintf("* Using %.1fMiB for decoded block cache\n", nBlockCacheSize * (1.0 / 1024 / 1024));
 
     if (fReverseHeaders)
     {
@@ -1592,7 +1696,18 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pblocktree;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+
+                // A UTXO snapshot load that did not finish leaves the coin databases half written, start them over.
+                bool fSnapshotLoading = false;
+                pblocktree->ReadFlag("snapshotloading", fSnapshotLoading);
+                if (fSnapshotLoading || fReindexChainState) {
+                    if (fSnapshotLoading)
+                        LogPrintf("Loading a UTXO snapshot was interrupted, rebuilding the chainstate\n");
+                    pblocktree->EraseSnapshotBase();
+                    pblocktree->WriteFlag("snapshotloading", false);
+                }
+
+                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState || fSnapshotLoading);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
@@ -1600,12 +1715,20 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete ppow2witcatcher;
                 ppow2witTip = nullptr;
 
-                ppow2witdbview = new CWitViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+                ppow2witdbview = new CWitViewDB(nCoinDBCache, false, fReindex || fReindexChainState || fSnapshotLoading);
                 ppow2witcatcher = new CCoinsViewErrorCatcher(ppow2witdbview);
                 ppow2witTip = std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(ppow2witcatcher));
 
                 pcoinsTip->SetSiblingView(ppow2witTip);
 
+                pcoinsdbview->SetBackgroundWrites(fIncrementalFlush);
+                ppow2witdbview->SetBackgroundWrites(fIncrementalFlush);
+                // Shut down right away instead of at the next flush, blocks connected in the meantime would be lost anyway.
+                pcoinsdbview->SetWriteFailedHandler([](const std::string& strMessage) { AbortNode(strMessage); });
+                ppow2witdbview->SetWriteFailedHandler([](const std::string& strMessage) { AbortNode(strMessage); });
+                pcoinsTip->SetTrackUse(fIncrementalFlush);
+                ppow2witTip->SetTrackUse(fIncrementalFlush);
+
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
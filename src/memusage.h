@@ -6,6 +6,7 @@
 #define GULDEN_MEMUSAGE_H
 
 #include "indirectmap.h"
+#include "support/allocators/pool.h"
 
 #include <stdlib.h>
 
@@ -165,6 +166,16 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+// Maps with a PoolAllocator own every chunk of their pool, used or not, which is what this counts instead of the nodes.
+template<typename X, typename Y, typename Z, typename P, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, P, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    const auto& resource = *m.get_allocator().GetResource();
+    return MallocUsage(resource.ChunkSizeBytes()) * resource.NumAllocatedChunks() + MallocUsage(sizeof(void*) * resource.ChunkListCapacity())
+        + MallocUsage(sizeof(typename PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::ResourceType))
+        + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 }
 
 #endif // GULDEN_MEMUSAGE_H
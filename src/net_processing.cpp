@@ -16,8 +16,10 @@
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockstore.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "init.h"
 #include "validation/validation.h"
@@ -514,6 +516,10 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     if (count == 0)
         return;
 
+    // The blocks up to a pending UTXO snapshot are not needed; it is loaded as soon as its header is in.
+    if (nSnapshotPendingHeight > chainActive.Height())
+        return;
+
     vBlocks.reserve(vBlocks.size() + count);
     CNodeState *state = State(nodeid);
     assert(state != NULL);
@@ -1066,6 +1072,56 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connma
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+static std::atomic<uint64_t> nRawBlocksServed(0);
+static std::atomic<uint64_t> nRawBlockBytesServed(0);
+static std::atomic<uint64_t> nDecodedBlocksServed(0);
+static std::atomic<uint64_t> nDecodedBlockBytesServed(0);
+
+void GetBlockServingStats(CBlockServingStats& stats)
+{
+    stats.nRawBlocks = nRawBlocksServed;
+    stats.nRawBytes = nRawBlockBytesServed;
+    stats.nDecodedBlocks = nDecodedBlocksServed;
+    stats.nDecodedBytes = nDecodedBlockBytesServed;
+}
+
+bool MakeRawBlockMessage(const CBlockIndex* pindex, bool fPoW2Header, CSerializedNetMsg& msg)
+{
+    // Stored as: nVersionPoW2Witness, nTimePoW2Witness, hashMerkleRootPoW2Witness (40 bytes), the 80 byte legacy header,
+    // the 65 byte witness signature if nVersionPoW2Witness is set, then the transactions.
+    static const size_t nPoW2FieldsSize = 40;
+    static const size_t nLegacyHeaderSize = 80;
+    static const size_t nWitnessSigSize = 65;
+
+    CBlockSpan span;
+    if (!blockStore.GetBlockSpan(pindex->GetBlockPos(), span) || span.size < nPoW2FieldsSize + nLegacyHeaderSize)
+        return false;
+    const unsigned char* pHeader = span.data + nPoW2FieldsSize;
+    bool fWitnessed = ReadLE32(span.data) != 0;
+    bool fWitnessTime = ReadLE32(span.data + 4) != 0;
+    size_t nTransactionsOffset = nPoW2FieldsSize + nLegacyHeaderSize + (fWitnessed ? nWitnessSigSize : 0);
+    if (span.size < nTransactionsOffset)
+        return false;
+
+    // Hashing the header is cheap, unlike the PoW check ReadBlockFromDisk may do; it catches pos pointing at the wrong or a damaged block.
+    uint256 hashStored = (fWitnessed && fWitnessTime) ? Hash(span.data, pHeader + nLegacyHeaderSize) : Hash(pHeader, pHeader + nLegacyHeaderSize);
+    if (hashStored != pindex->GetBlockHashPoW2())
+        return false;
+
+    msg.command = NetMsgType::BLOCK;
+    if (fPoW2Header)
+    {
+        msg.data.assign(span.data, span.data + span.size);
+    }
+    else
+    {
+        msg.data.reserve(span.size - nTransactionsOffset + nLegacyHeaderSize);
+        msg.data.assign(pHeader, pHeader + nLegacyHeaderSize);
+        msg.data.insert(msg.data.end(), span.data + nTransactionsOffset, span.data + span.size);
+    }
+    return true;
+}
+
 void static ProcessGetData(CNode* pfrom, const CChainParams& params, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -1156,16 +1212,23 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& params, CConnman& c
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
                     std::shared_ptr<const CBlock> pblock;
-                    if (pfrom->IsPoW2Capable())
+                    // Full blocks are stored in the serialization MSG_WITNESS_BLOCK asks for, so they go out without being decoded and serialized again.
+                    // MSG_BLOCK leaves out segregated signatures, which only decoding the transactions can do.
+                    CSerializedNetMsg rawBlockMsg;
+                    bool fRawBlock = (inv.type == MSG_WITNESS_BLOCK) && MakeRawBlockMessage(mi->second, pfrom->IsPoW2Capable(), rawBlockMsg);
+                    if (fRawBlock)
+                    {
+                        // Nothing to read, the message is ready to go.
+                    }
+                    else if (pfrom->IsPoW2Capable())
                     {
                         if (a_recent_block && a_recent_block->GetHashPoW2() == (*mi).second->GetBlockHashPoW2()) {
                             pblock = a_recent_block;
                         } else {
-                            // Send block from disk
-                            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-                            if (!ReadBlockFromDisk(*pblockRead, (*mi).second, params))
+                            // Send block from the block cache or disk
+                            pblock = ReadBlockFromDiskCached((*mi).second, params);
+                            if (!pblock)
                                 assert(!"cannot load pow2 block from disk");
-                            pblock = pblockRead;
                         }
                     }
                     else
@@ -1173,17 +1236,25 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& params, CConnman& c
                         if (a_recent_block && a_recent_block->GetHashLegacy() == (*mi).second->GetBlockHashLegacy()) {
                             pblock = a_recent_block;
                         } else {
-                            // Send block from disk
-                            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-                            if (!ReadBlockFromDisk(*pblockRead, (*mi).second, params))
+                            // Send block from the block cache or disk
+                            pblock = ReadBlockFromDiskCached((*mi).second, params);
+                            if (!pblock)
                                 assert(!"cannot load block from disk");
-                            pblock = pblockRead;
                         }
                     }
-                    if (inv.type == MSG_BLOCK)
-                        connman.PushMessage(pfrom, (pfrom->IsPoW2Capable()?msgMaker:msgMakerHeadersCompat).Make(SERIALIZE_TRANSACTION_NO_SEGREGATED_SIGNATURES, NetMsgType::BLOCK, *pblock));
-                    else if (inv.type == MSG_WITNESS_BLOCK)
-                        connman.PushMessage(pfrom, (pfrom->IsPoW2Capable()?msgMaker:msgMakerHeadersCompat).Make(NetMsgType::BLOCK, *pblock));
+                    if (fRawBlock)
+                    {
+                        nRawBlocksServed++;
+                        nRawBlockBytesServed += rawBlockMsg.data.size();
+                        connman.PushMessage(pfrom, std::move(rawBlockMsg));
+                    }
+                    else if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK)
+                    {
+                        CSerializedNetMsg blockMsg = (pfrom->IsPoW2Capable()?msgMaker:msgMakerHeadersCompat).Make(inv.type == MSG_BLOCK ? SERIALIZE_TRANSACTION_NO_SEGREGATED_SIGNATURES : 0, NetMsgType::BLOCK, *pblock);
+                        nDecodedBlocksServed++;
+                        nDecodedBlockBytesServed += blockMsg.data.size();
+                        connman.PushMessage(pfrom, std::move(blockMsg));
+                    }
                     else if (inv.type == MSG_FILTERED_BLOCK)
                     {
                         bool sendMerkleBlock = false;
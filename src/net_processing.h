@@ -68,6 +68,21 @@ struct CNodeStateStats {
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+
+/** Blocks (and their size in bytes) sent to peers in reply to GETDATA, copied as stored or decoded and serialized again */
+struct CBlockServingStats {
+    uint64_t nRawBlocks;
+    uint64_t nRawBytes;
+    uint64_t nDecodedBlocks;
+    uint64_t nDecodedBytes;
+};
+
+/** Get statistics on blocks served to peers */
+void GetBlockServingStats(CBlockServingStats& stats);
+/** Build the BLOCK message for a MSG_WITNESS_BLOCK request for 'pindex' from the bytes in its block file, without decoding the block.
+ *  The stored serialization is what PoW² capable peers expect, for other peers ('fPoW2Header' false) the PoW² header fields are left out.
+ *  Returns false if the stored block can not be used, the caller then has to read, decode and serialize it. */
+bool MakeRawBlockMessage(const CBlockIndex* pindex, bool fPoW2Header, CSerializedNetMsg& msg);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
@@ -14,8 +14,14 @@
 
 #include "arith_uint256.h"
 #include "chain.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "primitives/block.h"
+#include "random.h"
 #include "uint256.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
 /*GULDEN - We  use our own calculation from elsewhere in the source
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
@@ -97,3 +103,122 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&
 
     return true;
 }
+
+namespace {
+/** Entries are already nonced hashes, so as with the signature cache they can be split directly into the 8 cuckoo hashes. */
+class PoWCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select <8, "PoWCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin()+4*hash_select, 4);
+        return u;
+    }
+};
+
+/**
+ * Headers that have passed CheckProofOfWork, to avoid computing scrypt for the same header again when a block is
+ * read back from disk (rescans, getblock, witness selection...) or when a header arrives again from another peer.
+ */
+class CPoWCache
+{
+private:
+    //! Entries are SHA256(nonce || 80 byte PoW header); nBits is part of the header so a hit means the PoW satisfies it.
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, PoWCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_powcache;
+
+public:
+    CPoWCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const CBlockHeader& header)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write((const unsigned char*)BEGIN(header.nVersion), 80).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_powcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_powcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CPoWCache powCache;
+}
+
+void InitPoWCache()
+{
+    // As with the signature cache -maxpowcachesize=0 gives the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxpowcachesize", DEFAULT_MAX_POW_CACHE_SIZE)), MAX_MAX_POW_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = powCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for PoW cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+bool IsProofOfWorkCached(const CBlockHeader& header)
+{
+    uint256 entry;
+    powCache.ComputeEntry(entry, header);
+    return powCache.Get(entry);
+}
+
+bool CheckBlockProofOfWork(const CBlock& block, const Consensus::Params& params)
+{
+    uint256 entry;
+    powCache.ComputeEntry(entry, block);
+    if (powCache.Get(entry))
+        return true;
+    if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params))
+        return false;
+    powCache.Set(entry);
+    return true;
+}
+
+bool CPoWCheck::operator()()
+{
+    // Only hash the headers the cache doesn't vouch for yet.
+    std::vector<const CBlockHeader*> vHeaders;
+    std::vector<uint256> vEntries;
+    vHeaders.reserve(nCount);
+    vEntries.reserve(nCount);
+    for (unsigned int i = 0; i < nCount; ++i)
+    {
+        uint256 entry;
+        powCache.ComputeEntry(entry, *ppHeaders[i]);
+        if (!powCache.Get(entry))
+        {
+            vHeaders.push_back(ppHeaders[i]);
+            vEntries.push_back(entry);
+        }
+    }
+    if (vHeaders.empty())
+        return true;
+
+    std::vector<uint256> hashes(vHeaders.size());
+    GetPoWHashes(vHeaders.data(), vHeaders.size(), hashes.data());
+    for (unsigned int i = 0; i < vHeaders.size(); ++i)
+    {
+        if (!CheckProofOfWork(hashes[i], vHeaders[i]->nBits, *pParams))
+            return false;
+        powCache.Set(vEntries[i]);
+    }
+    return true;
+}
@@ -16,10 +16,19 @@
 #include "consensus/params.h"
 
 #include <stdint.h>
+#include <algorithm>
 
+class CBlock;
 class CBlockHeader;
 class CBlockIndex;
 class uint256;
+
+// Headers whose PoW is known to be good are remembered so that scrypt is computed at most once per header.
+// Entries are 32 bytes, so the default of 8 MiB holds ~250000 headers; more than a full header sync has in flight.
+static const unsigned int DEFAULT_MAX_POW_CACHE_SIZE = 8;
+// Maximum PoW cache size allowed
+static const int64_t MAX_MAX_POW_CACHE_SIZE = 1024;
+
 /*GULDEN - our own version of this software from elsewhere in the source is used
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params&);
@@ -28,4 +37,39 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
+/** Check the proof-of-work of a block header, scrypt is skipped if the header is already in the PoW cache and a passing header is added to it */
+bool CheckBlockProofOfWork(const CBlock& block, const Consensus::Params&);
+
+/** Whether the header is in the PoW cache, i.e. its PoW has already been found to satisfy nBits */
+bool IsProofOfWorkCached(const CBlockHeader& header);
+
+/** Size the PoW cache according to -maxpowcachesize, to be called once at startup */
+void InitPoWCache();
+
+/** Closure representing the proof-of-work check of a run of unrelated headers, which are hashed together
+ * through the multi-lane scrypt kernels. Used with CCheckQueue to verify a whole HEADERS message (or a run of
+ * blocks read from disk) on several threads before the serial contextual checks.
+ * The headers pointed to must stay alive until the check has run.
+ */
+class CPoWCheck
+{
+private:
+    const CBlockHeader* const* ppHeaders;
+    unsigned int nCount;
+    const Consensus::Params* pParams;
+
+public:
+    CPoWCheck() : ppHeaders(nullptr), nCount(0), pParams(nullptr) {}
+    CPoWCheck(const CBlockHeader* const* ppHeadersIn, unsigned int nCountIn, const Consensus::Params& paramsIn) : ppHeaders(ppHeadersIn), nCount(nCountIn), pParams(&paramsIn) {}
+
+    bool operator()();
+
+    void swap(CPoWCheck& check)
+    {
+        std::swap(ppHeaders, check.ppHeaders);
+        std::swap(nCount, check.nCount);
+        std::swap(pParams, check.pParams);
+    }
+};
+
 #endif // GULDEN_POW_H
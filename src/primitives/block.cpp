@@ -17,6 +17,8 @@
 #include "utilstrencodings.h"
 #include "crypto/common.h"
 
+#include <memory>
+
 uint256 CBlockHeader::GetHashLegacy() const
 {
     //if (!cachedHash.IsNull())
@@ -38,6 +40,13 @@ uint256 CBlockHeader::GetHashPoW2(bool force) const
     return SerializeHash(*this, SER_GETHASH, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS_SIG);
 }
 
+//CBSU - maybe use a static functor or something here instead of having the branch
+static bool UseHashCity()
+{
+    static bool hashCity = IsArgSet("-testnet") ? ( GetArg("-testnet", "")[0] == 'C' ? true : false ) : false;
+    return hashCity;
+}
+
 uint256 CBlock::GetPoWHash() const
 {
     //if (!cachedPOWHash.IsNull())
@@ -45,9 +54,7 @@ uint256 CBlock::GetPoWHash() const
 
     uint256 hashRet;
 
-    //CBSU - maybe use a static functor or something here instead of having the branch 
-    static bool hashCity = IsArgSet("-testnet") ? ( GetArg("-testnet", "")[0] == 'C' ? true : false ) : false;
-    if (hashCity)
+    if (UseHashCity())
     {
         arith_uint256 thash;
         hash_city(BEGIN(nVersion), thash);
@@ -63,6 +70,63 @@ uint256 CBlock::GetPoWHash() const
     return hashRet;
 }
 
+CBlockHeaderPoWHasher::CBlockHeaderPoWHasher()
+: scratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE)
+{
+    memset(&headerTemplate, 0, sizeof(headerTemplate));
+}
+
+void CBlockHeaderPoWHasher::Prepare(const CBlockHeader& header)
+{
+    // nVersion through nNonce are laid out as the 80 byte serialised PoW header, as GetPoWHash relies on as well.
+    scrypt_header_template_init(&headerTemplate, BEGIN(header.nVersion));
+}
+
+unsigned int CBlockHeaderPoWHasher::BatchSize() const
+{
+    return UseHashCity() ? 1 : scrypt_1024_1_1_256_multi_lanes();
+}
+
+void CBlockHeaderPoWHasher::Hash(uint32_t nNonceStart, unsigned int count, uint256* hashes)
+{
+    static_assert(sizeof(uint256) == 32, "hashes are written as consecutive 32 byte scrypt outputs");
+
+    if (UseHashCity())
+    {
+        unsigned char header[80];
+        memcpy(header, headerTemplate.header, 80);
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            WriteLE32(&header[76], nNonceStart + i);
+            arith_uint256 thash;
+            hash_city(header, thash);
+            hashes[i] = ArithToUint256(thash);
+        }
+        return;
+    }
+    scrypt_1024_1_1_256_sp_template(&headerTemplate, nNonceStart, count, (char*)hashes, scratchpad.data());
+}
+
+void GetPoWHashes(const CBlockHeader* const* headers, unsigned int count, uint256* hashes)
+{
+    if (UseHashCity())
+    {
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            arith_uint256 thash;
+            hash_city(BEGIN(headers[i]->nVersion), thash);
+            hashes[i] = ArithToUint256(thash);
+        }
+        return;
+    }
+
+    std::vector<char> input(80 * count);
+    for (unsigned int i = 0; i < count; ++i)
+        memcpy(&input[80 * i], BEGIN(headers[i]->nVersion), 80);
+    std::unique_ptr<char[]> scratchpad(new char[SCRYPT_MULTI_SCRATCHPAD_SIZE]);
+    scrypt_1024_1_1_256_sp_multi(input.data(), (char*)hashes, count, scratchpad.get());
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
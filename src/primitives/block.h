@@ -188,6 +188,33 @@ public:
     std::string ToString() const;
 };
 
+/** Reusable PoW hashing state for a block header template of which only nNonce varies, as in a mining loop.
+ * Prepare() once per template and again whenever any other header field changes (e.g. nTime/nBits from UpdateTime).
+ * Hash() then only redoes the nonce dependent part of scrypt and hashes BatchSize() nonces per pass.
+ */
+class CBlockHeaderPoWHasher
+{
+public:
+    CBlockHeaderPoWHasher();
+
+    void Prepare(const CBlockHeader& header);
+
+    //! Number of nonces that are hashed together per pass on this machine.
+    unsigned int BatchSize() const;
+
+    //! Write the PoW hashes for nonces nNonceStart...nNonceStart+count-1 to hashes[0]...hashes[count-1].
+    void Hash(uint32_t nNonceStart, unsigned int count, uint256* hashes);
+
+private:
+    scrypt_header_template headerTemplate;
+    std::vector<char> scratchpad;
+};
+
+/** Compute the PoW hash of 'count' unrelated headers at once (e.g. a HEADERS message) into hashes[0]...hashes[count-1].
+ * Gives the same result as CBlock::GetPoWHash for each header but uses all lanes of the multi-lane scrypt kernels.
+ */
+void GetPoWHashes(const CBlockHeader* const* headers, unsigned int count, uint256* hashes);
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
@@ -11,6 +11,7 @@
 // file COPYING
 
 #include "chain.h"
+#include "blockstore.h"
 #include "chainparams.h"
 #include "core_io.h"
 #include "primitives/block.h"
@@ -232,19 +233,19 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = NULL;
+    CDiskBlockPos blockPos;
     {
+        LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
         pblockindex = mapBlockIndex[hash];
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
-        {
-            LOCK(cs_main); // Required for ReadBlockFromDisk.
-            if (!ReadBlockFromDisk(block, pblockindex, Params()))
-                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
-        }
+        blockPos = pblockindex->GetBlockPos();
     }
+    if (!blockStore.ReadBlockFromDiskMapped(block, blockPos, hash, Params()))
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     ssBlock << block;
@@ -266,6 +267,7 @@ static bool rest_block(HTTPRequest* req,
         }
 
         case RF_JSON: {
+            LOCK(cs_main);
             UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
             std::string strJSON = objBlock.write() + "\n";
             req->WriteHeader("Content-Type", "application/json");
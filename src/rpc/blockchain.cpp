@@ -13,13 +13,16 @@
 #include "rpc/blockchain.h"
 
 #include "amount.h"
+#include "blockstore.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
 #include "consensus/validation.h"
 #include "validation/validation.h"
+#include "validation/utxosnapshot.h"
 #include "validation/versionbitsvalidation.h"
+#include "validation/witnessvalidation.h"
 #include "core_io.h"
 #include "policy/feerate.h"
 #include "policy/policy.h"
@@ -744,8 +747,6 @@ static UniValue getblock(const JSONRPCRequest& request)
             + HelpExampleRpc("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main); // Required for ReadBlockFromDisk.
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -757,16 +758,23 @@ static UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex = NULL;
+    CDiskBlockPos blockPos;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+        pblockindex = mapBlockIndex[hash];
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+        blockPos = pblockindex->GetBlockPos();
+    }
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params()))
+    // The block itself is read without holding cs_main.
+    if (!blockStore.ReadBlockFromDiskMapped(block, blockPos, hash, Params()))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
         // non-whitelisted node sends us an unrequested long chain of valid
@@ -782,6 +790,7 @@ static UniValue getblock(const JSONRPCRequest& request)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
@@ -914,49 +923,237 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
     return uint64_t(height);
 }
 
+//! Compute the unspent output statistics record of a coin database from scratch, at the block the database is at.
+static bool ComputeCoinsStatsRecord(CCoinsView *view, CCoinsStatsRecord &record, uint256 &hashBlock)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    hashBlock = pcursor->GetBestBlock();
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            return error("%s: unable to read value", __func__);
+        record.AddCoin(key, coin);
+        pcursor->Next();
+    }
+    return true;
+}
+
+static UniValue CoinsStatsRecordToJSON(CCoinsStatsRecord &record, bool fHash)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("txouts", (int64_t)record.nTransactionOutputs));
+    ret.push_back(Pair("bogosize", (int64_t)record.nBogoSize));
+    if (fHash) {
+        unsigned char hash[32];
+        record.muhash.Finalize(hash);
+        ret.push_back(Pair("muhash", uint256(std::vector<unsigned char>(hash, hash + sizeof(hash))).GetHex()));
+    }
+    ret.push_back(Pair("total_amount", ValueFromAmount(record.nTotalAmount)));
+    return ret;
+}
+
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "With hash_type \"hash_serialized_2\" the whole set is read, note this call may take some time.\n"
+            "The other hash types return the statistics that are kept for every block of the active chain, including those of the witness coins.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"       (string, optional, default=\"hash_serialized_2\") Which UTXO set hash to calculate: \"hash_serialized_2\" (the whole set, at the tip only), \"muhash\" or \"none\".\n"
+            "2. hash_or_height    (string or numeric, optional) The block hash or height of the block to return the statistics for, instead of the tip (not for \"hash_serialized_2\").\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions (hash_serialized_2 only)\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (hash_serialized_2 only)\n"
+            "  \"muhash\": \"hash\",       (string) The order independent hash of the set (muhash only)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (hash_serialized_2 only)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"witness\": {            (json object) The same statistics for the witness coins (muhash and none only)\n"
+            "    \"txouts\": n,\n"
+            "    \"bogosize\": n,\n"
+            "    \"muhash\": \"hash\",\n"
+            "    \"total_amount\": x.xxx\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\" 1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleRpc("gettxoutsetinfo", "\"muhash\", 1000")
         );
 
+    std::string hashType = request.params.size() > 0 && !request.params[0].isNull() ? request.params[0].get_str() : "hash_serialized_2";
+    bool haveBlock = request.params.size() > 1 && !request.params[1].isNull();
+
     UniValue ret(UniValue::VOBJ);
 
-    CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview, stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
-        ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("disk_size", stats.nDiskSize));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
-        for (auto& item : stats.nTypeCount)
-        {
-            ret.push_back(Pair(GetTxnOutputType((txnouttype)item.first), item.second));
+    if (hashType == "hash_serialized_2") {
+        if (haveBlock)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized_2 can only be calculated for the tip");
+
+        CCoinsStats stats;
+        FlushStateToDisk();
+        if (GetUTXOStats(pcoinsdbview, stats)) {
+            ret.push_back(Pair("height", (int64_t)stats.nHeight));
+            ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+            ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+            ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
+            ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+            ret.push_back(Pair("disk_size", stats.nDiskSize));
+            ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+            for (auto& item : stats.nTypeCount)
+            {
+                ret.push_back(Pair(GetTxnOutputType((txnouttype)item.first), item.second));
+            }
+        } else {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
         }
-    } else {
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        return ret;
+    }
+    if (hashType != "muhash" && hashType != "none")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hashType));
+
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        if (!haveBlock) {
+            pindex = chainActive.Tip();
+        } else if (request.params[1].isNum()) {
+            int nHeight = request.params[1].get_int();
+            if (nHeight < 0 || nHeight > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+            pindex = chainActive[nHeight];
+        } else {
+            auto it = mapBlockIndex.find(ParseHashV(request.params[1], "hash_or_height"));
+            if (it == mapBlockIndex.end())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            pindex = it->second;
+            if (!chainActive.Contains(pindex))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block is not in main chain");
+        }
+    }
+
+    const uint256 hashBlock = pindex->GetBlockHashPoW2();
+    CCoinsStatsRecord record, witnessRecord;
+    if (!pcoinsdbview->ReadCoinsStats(hashBlock, record) || !ppow2witdbview->ReadCoinsStats(hashBlock, witnessRecord)) {
+        if (haveBlock && pindex != chainActive.Tip())
+            throw JSONRPCError(RPC_MISC_ERROR, "Statistics are not available for this block, they are kept from the first time they were requested for the tip on");
+
+        // The node was upgraded, compute the records once from the databases; connecting blocks keeps them from now on.
+        FlushStateToDisk();
+        uint256 hashCoins, hashWitness;
+        record = CCoinsStatsRecord();
+        witnessRecord = CCoinsStatsRecord();
+        if (!ComputeCoinsStatsRecord(pcoinsdbview, record, hashCoins) || !ComputeCoinsStatsRecord(ppow2witdbview, witnessRecord, hashWitness))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        if (hashCoins != hashBlock || hashWitness != hashBlock)
+            throw JSONRPCError(RPC_MISC_ERROR, "The tip changed while reading the UTXO set, please try again");
+        pcoinsdbview->WriteCoinsStats(hashBlock, record);
+        ppow2witdbview->WriteCoinsStats(hashBlock, witnessRecord);
     }
+
+    ret.push_back(Pair("height", (int64_t)pindex->nHeight));
+    ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+    ret.pushKVs(CoinsStatsRecordToJSON(record, hashType == "muhash"));
+    ret.push_back(Pair("witness", CoinsStatsRecordToJSON(witnessRecord, hashType == "muhash")));
+    return ret;
+}
+
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction outputs and witness coins at the tip to a UTXO snapshot file, which another node can start from with loadtxoutset or -loadsnapshot.\n"
+            "\nArguments:\n"
+            "1. \"path\"            (string, required) The file to write, relative to the data directory unless it is absolute. It must not exist yet.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,         (numeric) The number of coins written\n"
+            "  \"witness_coins_written\": n, (numeric) The number of witness coins written\n"
+            "  \"base_hash\": \"hash\",        (string) The hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,           (numeric) The height of that block\n"
+            "  \"content_hash\": \"hash\",     (string) The hash of the file contents, as stored at its end\n"
+            "  \"path\": \"path\"              (string) The absolute path of the file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CUTXOSnapshotStats stats;
+    std::string strError;
+    if (!DumpUTXOSnapshot(path, stats, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", (int64_t)stats.nCoins));
+    ret.push_back(Pair("witness_coins_written", (int64_t)stats.nWitnessCoins));
+    ret.push_back(Pair("base_hash", stats.metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", stats.metadata.nHeight));
+    ret.push_back(Pair("content_hash", stats.hashContent.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+static UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "loadtxoutset \"path\"\n"
+            "\nReplace the unspent transaction outputs and witness coins with those of a UTXO snapshot file (see dumptxoutset), and continue validating from the block it was taken at.\n"
+            "The headers have to be synced up to that block, and the active chain must not be at or beyond it yet. The blocks below it are not downloaded or validated,\n"
+            "so only load a snapshot from a source you trust and compare the returned muhash with \"gettxoutsetinfo muhash <base_height>\" of a node you trust.\n"
+            "\nArguments:\n"
+            "1. \"path\"            (string, required) The snapshot file, relative to the data directory unless it is absolute.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_loaded\": n,          (numeric) The number of coins loaded\n"
+            "  \"witness_coins_loaded\": n,  (numeric) The number of witness coins loaded\n"
+            "  \"base_hash\": \"hash\",        (string) The hash of the block the snapshot was taken at, which is the tip now\n"
+            "  \"base_height\": n,           (numeric) The height of that block\n"
+            "  \"content_hash\": \"hash\",     (string) The hash of the file contents\n"
+            "  \"txoutset\": {               (json object) The statistics of the loaded coins, as gettxoutsetinfo \"muhash\" reports them\n"
+            "    \"txouts\": n,\n"
+            "    \"bogosize\": n,\n"
+            "    \"muhash\": \"hash\",\n"
+            "    \"total_amount\": x.xxx\n"
+            "  },\n"
+            "  \"witness\": { ... }          (json object) The same statistics for the witness coins\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+
+    CUTXOSnapshotStats stats;
+    std::string strError;
+    if (!LoadUTXOSnapshot(path, stats, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_loaded", (int64_t)stats.nCoins));
+    ret.push_back(Pair("witness_coins_loaded", (int64_t)stats.nWitnessCoins));
+    ret.push_back(Pair("base_hash", stats.metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", stats.metadata.nHeight));
+    ret.push_back(Pair("content_hash", stats.hashContent.GetHex()));
+    ret.push_back(Pair("txoutset", CoinsStatsRecordToJSON(stats.record, true)));
+    ret.push_back(Pair("witness", CoinsStatsRecordToJSON(stats.witnessRecord, true)));
     return ret;
 }
 
@@ -1578,9 +1775,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_type","hash_or_height"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           true,  {"path"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          true,  {"blockhash"} },
 
@@ -91,6 +91,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblock", 1, "verbosity" },
     { "getblockheader", 1, "verbose" },
     { "getchaintxstats", 0, "nblocks" },
+    { "gettxoutsetinfo", 1, "hash_or_height" },
     { "gettransaction", 1, "include_watchonly" },
     { "getrawtransaction", 1, "verbose" },
     { "createrawtransaction", 0, "inputs" },
@@ -152,6 +153,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "splitwitnessaccount", 2, "amounts" },
     { "setwitnesscompound", 1, "amount" },
     { "getwitnessinfo", 1, "verbose" },
+    { "getnetworkweighthistory", 0, "start_height" },
+    { "getnetworkweighthistory", 1, "count" },
     { "getwitnessinfo", 2, "mine_only" },
     { "fundwitnessaccount", 4, "force_multiple" },
     { "setwitnessrewardscript", 2, "force_pubkey" },
@@ -134,9 +134,20 @@ static UniValue generateBlocks(std::shared_ptr<CReserveKeyOrScript> coinbaseScri
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetPoWHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
+        CBlockHeaderPoWHasher powHasher;
+        powHasher.Prepare(*pblock);
+        std::vector<uint256> batchHashes(powHasher.BatchSize());
+        bool fFound = false;
+        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !fFound) {
+            unsigned int nCount = std::min<uint64_t>({(uint64_t)batchHashes.size(), nMaxTries, (uint64_t)(nInnerLoopCount - pblock->nNonce)});
+            powHasher.Hash(pblock->nNonce, nCount, batchHashes.data());
+            for (unsigned int i = 0; i < nCount && !fFound; ++i) {
+                fFound = CheckProofOfWork(batchHashes[i], pblock->nBits, Params().GetConsensus());
+                if (!fFound) {
+                    ++pblock->nNonce;
+                    --nMaxTries;
+                }
+            }
         }
         if (nMaxTries == 0) {
             break;
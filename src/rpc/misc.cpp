@@ -11,6 +11,7 @@
 // file COPYING
 
 #include "base58.h"
+#include "blockcache.h"
 #include "chain.h"
 #include "clientversion.h"
 #include "init.h"
@@ -508,6 +509,64 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCBlockCacheInfo()
+{
+    CBlockCache::Stats stats = blockCache.GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("used", uint64_t(stats.nUsage)));
+    obj.push_back(Pair("limit", uint64_t(stats.nMaxUsage)));
+    obj.push_back(Pair("blocks", uint64_t(stats.nBlocks)));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    return obj;
+}
+
+static UniValue RPCCoinsCacheInfo()
+{
+    CCoinsFlushStats stats;
+    GetCoinsFlushStats(stats);
+    UniValue obj(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        if (pcoinsTip)
+        {
+            uint64_t nHits, nMisses;
+            pcoinsTip->GetHitStats(nHits, nMisses);
+            obj.push_back(Pair("used", uint64_t(pcoinsTip->DynamicMemoryUsage())));
+            obj.push_back(Pair("in_use", uint64_t(pcoinsTip->InUseMemoryUsage())));
+            obj.push_back(Pair("limit", uint64_t(nCoinCacheUsage)));
+            obj.push_back(Pair("coins", uint64_t(pcoinsTip->GetCacheSize())));
+            obj.push_back(Pair("modified", uint64_t(pcoinsTip->GetDirtyCount())));
+            obj.push_back(Pair("hits", nHits));
+            obj.push_back(Pair("misses", nMisses));
+        }
+    }
+    obj.push_back(Pair("incremental", fIncrementalFlush));
+    obj.push_back(Pair("flushes", stats.nFlushes));
+    obj.push_back(Pair("last_flush_ms", stats.nLastFlushTime * 0.001));
+    obj.push_back(Pair("total_flush_ms", stats.nTotalFlushTime * 0.001));
+    obj.push_back(Pair("last_write_ms", stats.nLastWriteTime * 0.001));
+    obj.push_back(Pair("total_write_ms", stats.nTotalWriteTime * 0.001));
+    obj.push_back(Pair("last_written", stats.nLastWritten));
+    obj.push_back(Pair("evicted", stats.nEvicted));
+    return obj;
+}
+
+static UniValue RPCCoinsPrefetchInfo()
+{
+    CCoinsPrefetchStats stats;
+    GetCoinsPrefetchStats(stats);
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", stats.nBlocks));
+    obj.push_back(Pair("inputs", stats.nInputs));
+    obj.push_back(Pair("cached", stats.nCached));
+    obj.push_back(Pair("in_block", stats.nInBlock));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("witness_hits", stats.nWitnessHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -549,6 +608,39 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"blockcache\": {           (json object) Information about the cache of decoded blocks (see -blockcachesize)\n"
+            "    \"used\": xxxxx,          (numeric) Estimated number of bytes used by the cached blocks\n"
+            "    \"limit\": xxxxx,         (numeric) Number of bytes the cache may use\n"
+            "    \"blocks\": xxxxx,        (numeric) Number of blocks in the cache\n"
+            "    \"hits\": xxxxx,          (numeric) Number of block reads served from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Number of block reads that had to go to disk\n"
+            "  },\n"
+            "  \"coinscache\": {           (json object) Information about the UTXO set cache (see -dbcache and -incrementalflush)\n"
+            "    \"used\": xxxxx,          (numeric) Estimated number of bytes used by the cache\n"
+            "    \"in_use\": xxxxx,        (numeric) Part of it in use by cached coins, the rest is reused for new coins\n"
+            "    \"limit\": xxxxx,         (numeric) Number of bytes the cache may use (plus unused mempool space)\n"
+            "    \"coins\": xxxxx,         (numeric) Number of cached coins\n"
+            "    \"modified\": xxxxx,      (numeric) Number of cached coins that are not written to disk yet\n"
+            "    \"hits\": xxxxx,          (numeric) Number of coin lookups answered from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Number of coin lookups that went to the chainstate database\n"
+            "    \"incremental\": true|false, (boolean) Whether the cache is written in the background and kept warm\n"
+            "    \"flushes\": xxxxx,       (numeric) Number of times the cache was written to disk\n"
+            "    \"last_flush_ms\": x.xx,  (numeric) Time the most recent write held up validation, in milliseconds\n"
+            "    \"total_flush_ms\": x.xx, (numeric) Same, for all writes together\n"
+            "    \"last_write_ms\": x.xx,  (numeric) Time the most recent background write took, in milliseconds\n"
+            "    \"total_write_ms\": x.xx, (numeric) Same, for all background writes together\n"
+            "    \"last_written\": xxxxx,  (numeric) Number of modified coins in the most recent write\n"
+            "    \"evicted\": xxxxx,       (numeric) Number of unused coins evicted to stay within the limit\n"
+            "  },\n"
+            "  \"coinsprefetch\": {        (json object) Inputs of connected blocks read ahead into the coins cache (only with -par threads)\n"
+            "    \"blocks\": xxxxx,        (numeric) Number of blocks whose inputs were prefetched\n"
+            "    \"inputs\": xxxxx,        (numeric) Number of inputs of those blocks\n"
+            "    \"cached\": xxxxx,        (numeric) Number of inputs that were in the coins cache already\n"
+            "    \"in_block\": xxxxx,      (numeric) Number of inputs spending an output of the same block\n"
+            "    \"hits\": xxxxx,          (numeric) Number of inputs read ahead from the chainstate database\n"
+            "    \"witness_hits\": xxxxx,  (numeric) Number of inputs read ahead from the witness database\n"
+            "    \"misses\": xxxxx,        (numeric) Number of inputs not found in the chainstate database\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -562,6 +654,9 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("blockcache", RPCBlockCacheInfo()));
+        obj.push_back(Pair("coinscache", RPCCoinsCacheInfo()));
+        obj.push_back(Pair("coinsprefetch", RPCCoinsPrefetchInfo()));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -375,6 +375,13 @@ static UniValue getnettotals(const JSONRPCRequest& request)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"blockserving\":\n"
+            "  {\n"
+            "    \"raw_blocks\": n,          (numeric) Blocks sent to peers as stored on disk\n"
+            "    \"raw_bytes\": n,           (numeric) Bytes of blocks sent to peers as stored on disk\n"
+            "    \"decoded_blocks\": n,      (numeric) Blocks that had to be decoded and serialized again to send them\n"
+            "    \"decoded_bytes\": n        (numeric) Bytes of blocks that had to be decoded and serialized again to send them\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -397,6 +404,15 @@ static UniValue getnettotals(const JSONRPCRequest& request)
     outboundLimit.push_back(Pair("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft()));
     outboundLimit.push_back(Pair("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle()));
     obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    CBlockServingStats blockServingStats;
+    GetBlockServingStats(blockServingStats);
+    UniValue blockServing(UniValue::VOBJ);
+    blockServing.push_back(Pair("raw_blocks", blockServingStats.nRawBlocks));
+    blockServing.push_back(Pair("raw_bytes", blockServingStats.nRawBytes));
+    blockServing.push_back(Pair("decoded_blocks", blockServingStats.nDecodedBlocks));
+    blockServing.push_back(Pair("decoded_bytes", blockServingStats.nDecodedBytes));
+    obj.push_back(Pair("blockserving", blockServing));
     return obj;
 }
 
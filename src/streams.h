@@ -150,6 +150,72 @@ private:
     size_t nPos;
 };
 
+/* Minimal stream for reading from a block of memory that is owned elsewhere (e.g. a memory mapped file), without copying it first
+ *
+ * The referenced memory has to stay valid for as long as the reader is used
+ */
+class CSpanReader
+{
+ public:
+
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  pDataIn  Start of the memory to read from
+ * @param[in]  nSizeIn  Number of bytes that can be read
+*/
+    CSpanReader(int nTypeIn, int nVersionIn, const unsigned char* pDataIn, size_t nSizeIn) : nType(nTypeIn), nVersion(nVersionIn), pData(pDataIn), nDataSize(nSizeIn), nPos(0) {}
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > nDataSize - nPos)
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        memcpy(pch, pData + nPos, nSize);
+        nPos += nSize;
+    }
+    void peek(char* pch, size_t nSize)
+    {
+        if (nSize > nDataSize - nPos)
+            throw std::ios_base::failure("CSpanReader::peek(): end of data");
+        memcpy(pch, pData + nPos, nSize);
+    }
+    void ignore(size_t nSize)
+    {
+        if (nSize > nDataSize - nPos)
+            throw std::ios_base::failure("CSpanReader::ignore(): end of data");
+        nPos += nSize;
+    }
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    size_t size() const
+    {
+        return nDataSize - nPos;
+    }
+    bool empty() const
+    {
+        return nPos == nDataSize;
+    }
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pData;
+    size_t nDataSize;
+    size_t nPos;
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -0,0 +1,219 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_SUPPORT_ALLOCATORS_POOL_H
+#define GULDEN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Memory resource for node based containers that hands out small blocks carved from large chunks, and keeps freed blocks in a free list
+ * per block size for reuse. This saves the per allocation overhead of malloc (and the time spent in it) for containers with millions of
+ * small nodes, such as the coins cache. Allocations larger than MAX_BLOCK_SIZE_BYTES (e.g. the bucket array of a hash map) or with a
+ * stricter alignment than ALIGN_BYTES go straight to operator new.
+ *
+ * Freed blocks are reused for new allocations of the same size; the chunks (all but one) are only returned to the system once every
+ * pooled block has been given back (e.g. the container was cleared) or the resource is destroyed. Not thread safe, like the containers that use it.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource
+{
+    //! Blocks in a free list hold the pointer to the next free block of the same size.
+    struct ListNode
+    {
+        ListNode* next;
+    };
+
+    static constexpr std::size_t ELEM_ALIGN_BYTES = std::max(alignof(ListNode), ALIGN_BYTES);
+    static_assert((ELEM_ALIGN_BYTES & (ELEM_ALIGN_BYTES - 1)) == 0, "ELEM_ALIGN_BYTES must be a power of two");
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES, "a free list node must fit in the smallest block");
+
+    //! Block sizes are rounded up to a multiple of ELEM_ALIGN_BYTES, each multiple has its own free list.
+    static constexpr std::size_t NumElemAlignBytes(std::size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    static constexpr bool IsPooled(std::size_t bytes, std::size_t alignment)
+    {
+        return bytes <= MAX_BLOCK_SIZE_BYTES && alignment <= ELEM_ALIGN_BYTES;
+    }
+
+    const std::size_t nChunkSizeBytes;
+    std::vector<void*> vChunks;
+    //! Pooled blocks handed out and not given back yet, and their size rounded up to the alignment.
+    std::size_t nBlocksInUse;
+    std::size_t nBytesInUse;
+    std::array<ListNode*, NumElemAlignBytes(MAX_BLOCK_SIZE_BYTES) + 1> freeLists;
+    //! Not yet handed out part of the newest chunk.
+    std::byte* pAvailableBegin;
+    std::byte* pAvailableEnd;
+
+    void PushFree(void* p, std::size_t nElemAlignBytes)
+    {
+        ListNode* node = new (p) ListNode{freeLists[nElemAlignBytes]};
+        freeLists[nElemAlignBytes] = node;
+    }
+
+    //! Give back all chunks but 'nKeep' of them, which become free space again. Only when no pooled block is in use.
+    void ReleaseChunks(std::size_t nKeep)
+    {
+        while (vChunks.size() > nKeep)
+        {
+            ::operator delete(vChunks.back(), std::align_val_t{ELEM_ALIGN_BYTES});
+            vChunks.pop_back();
+        }
+        freeLists.fill(nullptr);
+        pAvailableBegin = vChunks.empty() ? nullptr : static_cast<std::byte*>(vChunks.front());
+        pAvailableEnd = vChunks.empty() ? nullptr : pAvailableBegin + nChunkSizeBytes;
+    }
+
+    void AllocateChunk()
+    {
+        // Whatever is left of the current chunk can still serve allocations of exactly that size.
+        if (pAvailableBegin != pAvailableEnd)
+            PushFree(pAvailableBegin, (pAvailableEnd - pAvailableBegin) / ELEM_ALIGN_BYTES);
+
+        void* chunk = ::operator new(nChunkSizeBytes, std::align_val_t{ELEM_ALIGN_BYTES});
+        vChunks.push_back(chunk);
+        pAvailableBegin = static_cast<std::byte*>(chunk);
+        pAvailableEnd = pAvailableBegin + nChunkSizeBytes;
+    }
+
+public:
+    //! Default chunk size, kept below the usual malloc threshold for mmap so that the many short lived caches stay cheap.
+    static const std::size_t DEFAULT_CHUNK_SIZE_BYTES = 64 * 1024;
+
+    explicit PoolResource(std::size_t nChunkSizeBytesIn = DEFAULT_CHUNK_SIZE_BYTES)
+    : nChunkSizeBytes(nChunkSizeBytesIn / ELEM_ALIGN_BYTES * ELEM_ALIGN_BYTES)
+    , nBlocksInUse(0)
+    , nBytesInUse(0)
+    , pAvailableBegin(nullptr)
+    , pAvailableEnd(nullptr)
+    {
+        assert(nChunkSizeBytes >= MAX_BLOCK_SIZE_BYTES);
+        freeLists.fill(nullptr);
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    ~PoolResource()
+    {
+        ReleaseChunks(0);
+    }
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsPooled(bytes, alignment))
+            return ::operator new(bytes, std::align_val_t{alignment});
+
+        ++nBlocksInUse;
+        const std::size_t nElemAlignBytes = NumElemAlignBytes(bytes);
+        nBytesInUse += nElemAlignBytes * ELEM_ALIGN_BYTES;
+        if (ListNode* node = freeLists[nElemAlignBytes])
+        {
+            freeLists[nElemAlignBytes] = node->next;
+            node->~ListNode();
+            return node;
+        }
+        const std::size_t nRoundedBytes = nElemAlignBytes * ELEM_ALIGN_BYTES;
+        if (static_cast<std::size_t>(pAvailableEnd - pAvailableBegin) < nRoundedBytes)
+            AllocateChunk();
+        void* p = pAvailableBegin;
+        pAvailableBegin += nRoundedBytes;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if (!IsPooled(bytes, alignment))
+        {
+            ::operator delete(p, std::align_val_t{alignment});
+            return;
+        }
+        nBytesInUse -= NumElemAlignBytes(bytes) * ELEM_ALIGN_BYTES;
+        // Keep one chunk around so that a container that is emptied and filled again all the time does not keep allocating it.
+        if (--nBlocksInUse == 0)
+            ReleaseChunks(1);
+        else
+            PushFree(p, NumElemAlignBytes(bytes));
+    }
+
+    std::size_t NumAllocatedChunks() const { return vChunks.size(); }
+    std::size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+    //! Bytes of the chunks that are handed out, the rest is free for reuse.
+    std::size_t NumBytesInUse() const { return nBytesInUse; }
+    //! Capacity of the list of chunks, for memory accounting.
+    std::size_t ChunkListCapacity() const { return vChunks.capacity(); }
+};
+
+/**
+ * Allocator for node based standard containers that allocates from a PoolResource. A default constructed allocator creates its own
+ * resource; copies (including the rebound copies a container makes for its nodes and buckets) share it. A copy of a container gets a
+ * resource of its own, and the resource goes along when a container is moved or swapped. A container that was moved from keeps
+ * sharing the resource with the one it was moved to though, and as the resource is not thread safe the two must then only be used
+ * from the same thread (or under the same lock). The resource is freed once the last container using it is gone.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+public:
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator() : pResource(std::make_shared<ResourceType>()) {}
+    // No move constructor or assignment: a moved from container must still be able to allocate, so moves share the resource as well.
+    PoolAllocator(const PoolAllocator& other) noexcept = default;
+    PoolAllocator& operator=(const PoolAllocator& other) noexcept = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : pResource(other.GetResource()) {}
+
+    PoolAllocator select_on_container_copy_construction() const { return PoolAllocator(); }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(pResource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        pResource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    const std::shared_ptr<ResourceType>& GetResource() const { return pResource; }
+
+private:
+    std::shared_ptr<ResourceType> pResource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.GetResource() == b.GetResource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // GULDEN_SUPPORT_ALLOCATORS_POOL_H
@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "blockcache.h"
+#include "core_memusage.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> TestBlock(unsigned int nTransactions)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    pblock->nVersion = 4;
+    pblock->hashPrevBlock = GetRandHash();
+    for (unsigned int i = 0; i < nTransactions; ++i)
+    {
+        CMutableTransaction tx(CTransaction::CURRENT_VERSION);
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        tx.vout.push_back(CTxOut(i * COIN, CScript() << i));
+        pblock->vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    CBlockCache cache;
+    std::vector<uint256> hashes;
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    for (int i = 0; i < 10; ++i)
+    {
+        blocks.push_back(TestBlock(20));
+        hashes.push_back(blocks.back()->GetHashPoW2());
+    }
+    // Room for a bit more than four blocks.
+    cache.SetMaxUsage(RecursiveDynamicUsage(blocks[0]) * 4 + RecursiveDynamicUsage(blocks[0]) / 2);
+
+    BOOST_CHECK(cache.Get(hashes[0]) == nullptr);
+    for (int i = 0; i < 4; ++i)
+        cache.Insert(hashes[i], blocks[i]);
+    BOOST_CHECK(cache.Get(hashes[0]) == blocks[0]);
+    BOOST_CHECK(cache.Get(hashes[2]) == blocks[2]);
+
+    // Block 1 is now the least recently used and makes way for block 4.
+    cache.Insert(hashes[4], blocks[4]);
+    BOOST_CHECK(cache.Get(hashes[1]) == nullptr);
+    BOOST_CHECK(cache.Get(hashes[0]) == blocks[0]);
+    BOOST_CHECK(cache.Get(hashes[4]) == blocks[4]);
+
+    CBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocks, 4U);
+    BOOST_CHECK_EQUAL(stats.nHits, 4U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+    BOOST_CHECK(stats.nUsage <= stats.nMaxUsage);
+
+    // Inserting a block that is already cached does not count it twice.
+    cache.Insert(hashes[4], blocks[4]);
+    BOOST_CHECK_EQUAL(cache.GetStats().nUsage, stats.nUsage);
+
+    for (int i = 5; i < 10; ++i)
+        cache.Insert(hashes[i], blocks[i]);
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocks, 4U);
+    BOOST_CHECK(stats.nUsage <= stats.nMaxUsage);
+    BOOST_CHECK(cache.Get(hashes[9]) == blocks[9]);
+    BOOST_CHECK(cache.Get(hashes[4]) == nullptr);
+
+    // A block that would not fit on its own is not cached at all.
+    std::shared_ptr<const CBlock> pblockLarge = TestBlock(200);
+    cache.Insert(pblockLarge->GetHashPoW2(), pblockLarge);
+    BOOST_CHECK(cache.Get(pblockLarge->GetHashPoW2()) == nullptr);
+    BOOST_CHECK(cache.Get(hashes[9]) == blocks[9]);
+
+    // Shrinking the budget evicts, a budget of zero turns the cache off.
+    cache.SetMaxUsage(stats.nUsage / 2);
+    BOOST_CHECK(cache.GetStats().nBlocks < 4U);
+    BOOST_CHECK(cache.Get(hashes[9]) == blocks[9]);
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 0U);
+    BOOST_CHECK_EQUAL(cache.GetStats().nUsage, 0U);
+    cache.Insert(hashes[0], blocks[0]);
+    BOOST_CHECK(cache.Get(hashes[0]) == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
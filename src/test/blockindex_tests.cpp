@@ -0,0 +1,140 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "chain.h"
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "txdb.h"
+#include "test/test_gulden.h"
+
+#include <map>
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindex_tests, BasicTestingSetup)
+
+static CBlockHeader WitnessedHeader(const uint256& hashPrev)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = hashPrev;
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1500000000;
+    header.nBits = 0x1d00ffff;
+    header.nNonce = 42;
+    header.nVersionPoW2Witness = 1;
+    header.nTimePoW2Witness = 1500000060;
+    header.hashMerkleRootPoW2Witness = GetRandHash();
+    header.witnessHeaderPoW2Sig = std::vector<unsigned char>(65, 0x33);
+    return header;
+}
+
+// The legacy hash of a witnessed block is stored with its index entry; entries written before that have to keep loading.
+BOOST_AUTO_TEST_CASE(blockindex_legacy_hash_on_disk)
+{
+    uint256 hashPrev = GetRandHash();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashPrev;
+
+    CBlockHeader header = WitnessedHeader(hashPrev);
+    uint256 hash = header.GetHashPoW2();
+    uint256 hashLegacy = header.GetHashLegacy();
+    BOOST_CHECK(hash != hashLegacy);
+
+    CBlockIndex index(header);
+    index.phashBlock = &hash;
+    index.pprev = &indexPrev;
+    BOOST_CHECK(index.GetBlockHashLegacy() == hashLegacy);
+    index.phashBlockLegacy = &hashLegacy;
+    BOOST_CHECK(index.GetBlockHashLegacy() == hashLegacy);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+
+    CDiskBlockIndex diskIndex;
+    CDataStream ssCopy(ss);
+    ssCopy >> diskIndex;
+    BOOST_CHECK(diskIndex.hashLegacy == hashLegacy);
+    BOOST_CHECK(diskIndex.GetBlockHashLegacy() == hashLegacy);
+    BOOST_CHECK(diskIndex.GetBlockHashPoW2() == hash);
+    BOOST_CHECK(std::vector<unsigned char>(diskIndex.witnessHeaderPoW2Sig) == header.witnessHeaderPoW2Sig);
+
+    // Entry as written before the legacy hash was stored.
+    std::vector<char> vOld(ss.begin(), ss.end() - 32);
+    CDataStream ssOld(vOld, SER_DISK, CLIENT_VERSION);
+    CDiskBlockIndex diskIndexOld;
+    ssOld >> diskIndexOld;
+    BOOST_CHECK(diskIndexOld.hashLegacy.IsNull());
+    BOOST_CHECK(diskIndexOld.GetBlockHashLegacy() == hashLegacy);
+    BOOST_CHECK(diskIndexOld.GetBlockHashPoW2() == hash);
+}
+
+// Loading the index on several threads has to give exactly the same index as loading it on one.
+BOOST_AUTO_TEST_CASE(blockindex_load_threads)
+{
+    CBlockTreeDB blockTree(1 << 20, true);
+    const int nBlocks = 2000;
+    std::vector<uint256> vHash(nBlocks);
+    std::vector<std::unique_ptr<CBlockIndex>> vIndex;
+    std::vector<const CBlockIndex*> vWrite;
+    for (int i = 0; i < nBlocks; ++i)
+    {
+        CBlockHeader header = WitnessedHeader(i ? vHash[i - 1] : uint256());
+        if (i % 2 == 0)
+        {
+            header.nVersionPoW2Witness = 0;
+            header.nTimePoW2Witness = 0;
+            header.hashMerkleRootPoW2Witness = uint256();
+            header.witnessHeaderPoW2Sig.clear();
+        }
+        vHash[i] = header.GetHashPoW2();
+        vIndex.emplace_back(new CBlockIndex(header));
+        vIndex.back()->phashBlock = &vHash[i];
+        vIndex.back()->pprev = i ? vIndex[i - 1].get() : nullptr;
+        vIndex.back()->nHeight = i;
+        vWrite.push_back(vIndex.back().get());
+    }
+    BOOST_CHECK(blockTree.WriteBatchSync({}, 0, vWrite));
+
+    for (int nThreads : {1, 4})
+    {
+        std::map<uint256, std::unique_ptr<CBlockIndex>> mapLoaded;
+        std::map<uint256, uint256> mapLegacy;
+        int nComputed = 0;
+        auto insertBlockIndex = [&](const uint256& hash) -> CBlockIndex*
+        {
+            if (hash.IsNull())
+                return nullptr;
+            std::unique_ptr<CBlockIndex>& pindex = mapLoaded[hash];
+            if (!pindex)
+            {
+                pindex.reset(new CBlockIndex());
+                pindex->phashBlock = &mapLoaded.find(hash)->first;
+            }
+            return pindex.get();
+        };
+        auto insertBlockIndexLegacy = [&](CBlockIndex* pindex, const uint256& hashLegacy, bool fStored)
+        {
+            mapLegacy[*pindex->phashBlock] = hashLegacy;
+            if (!fStored)
+                ++nComputed;
+        };
+        BOOST_CHECK(blockTree.LoadBlockIndexGuts(insertBlockIndex, insertBlockIndexLegacy, nThreads));
+        BOOST_CHECK_EQUAL(mapLoaded.size(), (size_t)nBlocks);
+        BOOST_CHECK_EQUAL(mapLegacy.size(), (size_t)nBlocks / 2);
+        BOOST_CHECK_EQUAL(nComputed, 0);
+        for (const auto& index : vIndex)
+        {
+            const CBlockIndex* pindexLoaded = mapLoaded[*index->phashBlock].get();
+            BOOST_CHECK_EQUAL(pindexLoaded->nHeight, index->nHeight);
+            BOOST_CHECK(pindexLoaded->pprev == (index->pprev ? mapLoaded[*index->pprev->phashBlock].get() : nullptr));
+            if (index->nVersionPoW2Witness != 0)
+                BOOST_CHECK(mapLegacy[*index->phashBlock] == index->GetBlockHashLegacy());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,172 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "blockstore.h"
+#include "clientversion.h"
+#include "net_processing.h"
+#include "netmessagemaker.h"
+#include "random.h"
+#include "streams.h"
+#include "validation/validation.h"
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstore_tests, TestingSetup)
+
+static CBlock TestBlock(unsigned int nTransactions)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = 1500000000;
+    for (unsigned int i = 0; i < nTransactions; ++i)
+    {
+        CMutableTransaction tx(CTransaction::CURRENT_VERSION);
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        tx.vout.push_back(CTxOut(i * COIN, CScript() << i));
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+// Blocks read through the mapped block files, without cs_main, have to be exactly the blocks that were written.
+BOOST_AUTO_TEST_CASE(blockstore_mapped_read)
+{
+    const CChainParams& params = Params();
+    std::vector<CBlock> blocks;
+    std::vector<CDiskBlockPos> positions;
+    unsigned int nNextPos = 0;
+    auto writeBlock = [&](const CBlock& block)
+    {
+        LOCK(cs_main);
+        CDiskBlockPos pos(99, nNextPos);
+        BOOST_CHECK(blockStore.WriteBlockToDisk(block, pos, params.MessageStart()));
+        nNextPos = pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        blocks.push_back(block);
+        positions.push_back(pos);
+    };
+    for (unsigned int i = 0; i < 5; ++i)
+        writeBlock(TestBlock(1 + i * 20));
+
+    CBlockSpan span;
+    BOOST_CHECK(blockStore.GetBlockSpan(positions[2], span));
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << blocks[2];
+    BOOST_CHECK_EQUAL(span.size, ssBlock.size());
+    BOOST_CHECK(memcmp(span.data, ssBlock.data(), span.size) == 0);
+
+    // Written after the file was mapped; the file grows into the mapping instead of being mapped again.
+    writeBlock(TestBlock(100));
+    CBlockSpan spanGrown;
+    BOOST_CHECK(blockStore.GetBlockSpan(positions.back(), spanGrown));
+    BOOST_CHECK(spanGrown.file == span.file);
+
+    bool fAllRead = true;
+    boost::thread reader([&]()
+    {
+        for (unsigned int i = 0; i < blocks.size(); ++i)
+        {
+            CBlock block;
+            if (!blockStore.ReadBlockFromDiskMapped(block, positions[i], blocks[i].GetHashPoW2(), params) || block.GetHashPoW2() != blocks[i].GetHashPoW2() || block.vtx.size() != blocks[i].vtx.size())
+                fAllRead = false;
+        }
+    });
+    reader.join();
+    BOOST_CHECK(fAllRead);
+
+    // The span keeps its mapping alive even when the store lets go of it.
+    blockStore.CloseBlockFiles();
+    BOOST_CHECK(memcmp(span.data, ssBlock.data(), span.size) == 0);
+
+    CDiskBlockPos posBad(positions[1].nFile, positions[1].nPos + 1);
+    BOOST_CHECK(!blockStore.GetBlockSpan(posBad, span));
+}
+
+// Only the most recently used block files stay mapped, a mapping that is dropped stays valid for as long as a span holds on to it.
+BOOST_AUTO_TEST_CASE(blockstore_mapped_files_bounded)
+{
+    const CChainParams& params = Params();
+    std::vector<CBlock> blocks;
+    std::vector<CDiskBlockPos> positions;
+    for (unsigned int i = 0; i < MAX_MAPPED_BLOCK_FILES + 2; ++i)
+    {
+        LOCK(cs_main);
+        CDiskBlockPos pos(200 + i, 0);
+        blocks.push_back(TestBlock(5));
+        BOOST_CHECK(blockStore.WriteBlockToDisk(blocks.back(), pos, params.MessageStart()));
+        positions.push_back(pos);
+    }
+
+    CBlockSpan spanFirst;
+    BOOST_CHECK(blockStore.GetBlockSpan(positions[0], spanFirst));
+    for (unsigned int i = 1; i < positions.size(); ++i)
+    {
+        CBlockSpan span;
+        BOOST_CHECK(blockStore.GetBlockSpan(positions[i], span));
+        BOOST_CHECK(blockStore.NumMappedBlockFiles() <= MAX_MAPPED_BLOCK_FILES);
+    }
+    BOOST_CHECK_EQUAL(blockStore.NumMappedBlockFiles(), MAX_MAPPED_BLOCK_FILES);
+
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << blocks[0];
+    BOOST_CHECK_EQUAL(spanFirst.size, ssBlock.size());
+    BOOST_CHECK(memcmp(spanFirst.data, ssBlock.data(), spanFirst.size) == 0);
+
+    // Mapped again when it is needed again.
+    CBlock block;
+    BOOST_CHECK(blockStore.ReadBlockFromDiskMapped(block, positions[0], blocks[0].GetHashPoW2(), params));
+    BOOST_CHECK(block.GetHashPoW2() == blocks[0].GetHashPoW2());
+    BOOST_CHECK_EQUAL(blockStore.NumMappedBlockFiles(), MAX_MAPPED_BLOCK_FILES);
+    blockStore.CloseBlockFiles();
+}
+
+// Blocks served from their stored bytes have to be byte for byte what serializing the decoded block gives, for both kinds of peer.
+BOOST_AUTO_TEST_CASE(blockstore_raw_block_message)
+{
+    const CChainParams& params = Params();
+    CBlock blockPoW = TestBlock(10);
+    CBlock blockWitnessed = TestBlock(10);
+    blockWitnessed.nVersionPoW2Witness = 1;
+    blockWitnessed.nTimePoW2Witness = 1500000100;
+    blockWitnessed.hashMerkleRootPoW2Witness = GetRandHash();
+    blockWitnessed.witnessHeaderPoW2Sig.assign(65, 0x5a);
+
+    unsigned int nNextPos = 0;
+    for (const CBlock& block : {blockPoW, blockWitnessed})
+    {
+        CDiskBlockPos pos(98, nNextPos);
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(blockStore.WriteBlockToDisk(block, pos, params.MessageStart()));
+        }
+        nNextPos = pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+
+        uint256 hash = block.GetHashPoW2();
+        CBlockIndex index(block);
+        index.phashBlock = &hash;
+        index.nFile = pos.nFile;
+        index.nDataPos = pos.nPos;
+        index.nStatus |= BLOCK_HAVE_DATA;
+
+        CSerializedNetMsg msgRaw;
+        BOOST_CHECK(MakeRawBlockMessage(&index, true, msgRaw));
+        BOOST_CHECK_EQUAL(msgRaw.command, NetMsgType::BLOCK);
+        BOOST_CHECK(msgRaw.data == CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, block).data);
+
+        CSerializedNetMsg msgRawLegacy;
+        BOOST_CHECK(MakeRawBlockMessage(&index, false, msgRawLegacy));
+        BOOST_CHECK(msgRawLegacy.data == CNetMsgMaker(PROTOCOL_VERSION, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS).Make(NetMsgType::BLOCK, block).data);
+
+        // An index entry that does not match what is stored is refused, so the caller falls back to ReadBlockFromDisk.
+        uint256 hashOther = GetRandHash();
+        index.phashBlock = &hashOther;
+        CSerializedNetMsg msgWrong;
+        BOOST_CHECK(!MakeRawBlockMessage(&index, true, msgWrong));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,7 @@
 
 #include "coins.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -18,6 +19,9 @@
 #include "validation/validation.h"
 #include "consensus/validation.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 #include <map>
 
@@ -94,16 +98,21 @@ public:
         // Manually recompute the dynamic usage of the whole data, and compare it.
         size_t ret = memusage::DynamicUsage(cacheCoins);
         size_t count = 0;
+        size_t dirty = 0;
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
             ret += it->second.coin.DynamicMemoryUsage();
             ++count;
+            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+                ++dirty;
         }
         BOOST_CHECK_EQUAL(GetCacheSize(), count);
+        BOOST_CHECK_EQUAL(GetDirtyCount(), dirty);
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
 
     CCoinsMap& map() { return cacheCoins; }
     size_t& usage() { return cachedCoinsUsage; }
+    size_t& dirty() { return cachedDirtyCount; }
 };
 
 }
@@ -121,7 +130,10 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 //
 // During the process, booleans are kept to make sure that the randomized
 // operation hits all branches.
-BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
+//
+// With fSync set the intermediate caches are written with Sync instead of
+// Flush, so they keep their coins, and clean coins are evicted from them.
+static void SimulationTest(bool fSync)
 {
     // Various coverage trackers.
     bool removed_all_caches = false;
@@ -133,6 +145,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool found_an_entry = false;
     bool missed_an_entry = false;
     bool uncached_an_entry = false;
+    bool evicted_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
     std::map<COutPoint, Coin> result;
@@ -141,6 +154,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
     std::vector<CCoinsViewCacheTest*> stack; // A stack of CCoinsViewCaches on top.
     stack.push_back(new CCoinsViewCacheTest(&base)); // Start with one cache.
+    stack.back()->SetTrackUse(fSync);
 
     // Use a limited set of random transaction ids, so we do test overwriting entries.
     std::vector<uint256> txids;
@@ -209,7 +223,13 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                stack[flushIndex]->Flush();
+                if (fSync) {
+                    stack[flushIndex]->Sync();
+                    if (InsecureRandBool())
+                        evicted_an_entry |= stack[flushIndex]->EvictUnused(stack[flushIndex]->InUseMemoryUsage() / 2) > 0;
+                } else {
+                    stack[flushIndex]->Flush();
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -229,6 +249,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                     removed_all_caches = true;
                 }
                 stack.push_back(new CCoinsViewCacheTest(tip));
+                stack.back()->SetTrackUse(fSync);
                 if (stack.size() == 4) {
                     reached_4_caches = true;
                 }
@@ -252,6 +273,17 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
     BOOST_CHECK(uncached_an_entry);
+    BOOST_CHECK(evicted_an_entry == fSync);
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
+{
+    SimulationTest(false);
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_sync_simulation_test)
+{
+    SimulationTest(true);
 }
 
 // Store of all necessary tx and undo data for next test
@@ -598,6 +630,8 @@ public:
     {
         WriteCoinsViewEntry(base, base_value, base_value == ABSENT ? NO_ENTRY : DIRTY);
         cache.usage() += InsertCoinsMapEntry(cache.map(), cache_value, cache_flags);
+        if (cache_value != ABSENT && (cache_flags & DIRTY))
+            ++cache.dirty();
     }
 
     CCoinsView root;
@@ -855,4 +889,182 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_sync_evict)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    cache.SetTrackUse(true);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; ++i) {
+        outpoints.push_back(COutPoint(InsecureRand256(), 0));
+        Coin coin;
+        coin.out.nValue = i + 1;
+        coin.nHeight = 1;
+        coin.out.output.scriptPubKey.assign(20U, 0);
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    cache.SpendCoin(outpoints[0]);
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 99U);
+    cache.SelfTest();
+
+    // Sync writes the modifications but keeps the unspent coins, clean.
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 0U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 99U);
+    BOOST_CHECK(!base.HaveCoin(outpoints[0]));
+    for (int i = 1; i < 100; ++i) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+        BOOST_CHECK(base.HaveCoin(outpoints[i]));
+    }
+
+    // Spending a synced coin reaches the base with the next sync.
+    cache.SpendCoin(outpoints[1]);
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 1U);
+    BOOST_CHECK(base.HaveCoin(outpoints[1]));
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!base.HaveCoin(outpoints[1]));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[1]));
+
+    // Everything was just written, so a first pass only clears the use marks and the second one removes a coin.
+    size_t nUsage = cache.InUseMemoryUsage();
+    BOOST_CHECK_EQUAL(cache.EvictUnused(nUsage - 1), 1U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 97U);
+    const size_t nCoinUsage = nUsage - cache.InUseMemoryUsage();
+    std::vector<COutPoint> cached;
+    for (int i = 2; i < 100; ++i) {
+        if (cache.HaveCoinInCache(outpoints[i]))
+            cached.push_back(outpoints[i]);
+    }
+
+    // The coins used since then, and the modified ones, are the last to go.
+    for (int i = 0; i < 10; ++i)
+        BOOST_CHECK(cache.AccessCoin(cached[i]).out.nValue > 0);
+    cache.SpendCoin(cached[10]);
+    BOOST_CHECK_EQUAL(cache.EvictUnused(cache.InUseMemoryUsage() - 86 * nCoinUsage), 86U);
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 11U);
+    for (int i = 0; i < 11; ++i)
+        BOOST_CHECK(cache.HaveCoinInCache(cached[i]));
+
+    // Evicted coins are read back from the base.
+    uint64_t nHits, nMisses;
+    cache.GetHitStats(nHits, nMisses);
+    BOOST_CHECK(cache.AccessCoin(cached[50]).out.nValue > 0);
+    uint64_t nHitsAfter, nMissesAfter;
+    cache.GetHitStats(nHitsAfter, nMissesAfter);
+    BOOST_CHECK_EQUAL(nHitsAfter, nHits);
+    BOOST_CHECK_EQUAL(nMissesAfter, nMisses + 1);
+
+    // Without any limit left everything that is not modified goes.
+    BOOST_CHECK_EQUAL(cache.EvictUnused(0), 11U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.HaveCoinInCache(cached[10]));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!base.HaveCoin(cached[10]));
+}
+
+// Coin database whose background writes can be held up until released, or made to fail.
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+    ~CCoinsViewDBTest() { Hold(false); WaitForBackgroundWrite(); }
+
+    void Hold(bool fHoldIn)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fHold = fHoldIn;
+        cond.notify_all();
+    }
+
+    std::atomic<bool> fFail{false};
+
+protected:
+    bool WriteBackgroundBatch(CDBBatch& batch) override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this]{ return !fHold; });
+        if (fFail)
+            return false;
+        return CCoinsViewDB::WriteBackgroundBatch(batch);
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool fHold = false;
+};
+
+static Coin SimpleCoin(CAmount nValue)
+{
+    Coin coin;
+    coin.out.nValue = nValue;
+    coin.nHeight = 1;
+    coin.out.output.scriptPubKey.assign(20U, 0);
+    return coin;
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_background_write)
+{
+    std::atomic<int> nWriteFailed{0};
+    CCoinsViewDBTest db;
+    db.SetBackgroundWrites(true);
+    db.SetWriteFailedHandler([&nWriteFailed](const std::string&) { ++nWriteFailed; });
+    CCoinsViewCacheTest cache(&db);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 20; ++i) {
+        outpoints.push_back(COutPoint(InsecureRand256(), 0));
+        cache.AddCoin(outpoints.back(), SimpleCoin(i + 1), false);
+    }
+    uint256 hashFirst = InsecureRand256();
+    cache.SetBestBlock(hashFirst);
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(db.WaitForBackgroundWrite());
+    BOOST_CHECK(db.GetBestBlock() == hashFirst);
+
+    // While a write is in flight the database answers from the coins being written, spent ones included, and with their best block.
+    db.Hold(true);
+    cache.SpendCoin(outpoints[0]);
+    COutPoint added(InsecureRand256(), 1);
+    cache.AddCoin(added, SimpleCoin(100), false);
+    uint256 hashSecond = InsecureRand256();
+    cache.SetBestBlock(hashSecond);
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(db.GetBestBlock() == hashSecond);
+    BOOST_CHECK(!db.HaveCoin(outpoints[0]));
+    Coin coin;
+    BOOST_CHECK(!db.GetCoin(outpoints[0], coin));
+    BOOST_CHECK(db.HaveCoin(added));
+    BOOST_CHECK(db.GetCoin(added, coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 100);
+    BOOST_CHECK(db.GetCoin(outpoints[1], coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 2);
+
+    // Once it is on disk the answers stay the same.
+    db.Hold(false);
+    BOOST_CHECK(db.WaitForBackgroundWrite());
+    BOOST_CHECK(db.GetBestBlock() == hashSecond);
+    BOOST_CHECK(!db.HaveCoin(outpoints[0]));
+    BOOST_CHECK(db.GetCoin(added, coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 100);
+    BOOST_CHECK_EQUAL(nWriteFailed, 0);
+
+    // A failed write is reported from the write thread straight away, the coins of it stay available and later writes are refused.
+    db.fFail = true;
+    cache.SpendCoin(outpoints[1]);
+    uint256 hashThird = InsecureRand256();
+    cache.SetBestBlock(hashThird);
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!db.WaitForBackgroundWrite());
+    BOOST_CHECK_EQUAL(nWriteFailed, 1);
+    BOOST_CHECK(db.GetBestBlock() == hashThird);
+    BOOST_CHECK(!db.HaveCoin(outpoints[1]));
+    cache.SpendCoin(outpoints[2]);
+    BOOST_CHECK(!cache.Sync());
+    BOOST_CHECK_EQUAL(nWriteFailed, 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,173 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "coins.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "txdb.h"
+#include "validation/validation.h"
+#include "validation/witnessvalidation.h"
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, TestingSetup)
+
+static CTransactionRef SpendingTx(const std::vector<COutPoint>& prevouts, CAmount nValue)
+{
+    CMutableTransaction tx(CTransaction::CURRENT_VERSION);
+    for (const auto& prevout : prevouts)
+    {
+        tx.vin.push_back(CTxIn());
+        tx.vin.back().prevout = prevout;
+    }
+    tx.vout.push_back(CTxOut(nValue, CScript() << OP_TRUE));
+    return MakeTransactionRef(std::move(tx));
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_block_inputs)
+{
+    LOCK(cs_main);
+
+    // Coins on disk, and one in the tip cache only.
+    std::vector<COutPoint> onDisk;
+    for (int i = 0; i < 50; ++i)
+    {
+        onDisk.push_back(COutPoint(GetRandHash(), i % 3));
+        pcoinsTip->AddCoin(onDisk.back(), Coin(CTxOut(i * COIN, CScript() << i), 100 + i, false, false), false);
+    }
+    BOOST_CHECK(pcoinsTip->Flush());
+    COutPoint cached(GetRandHash(), 0);
+    pcoinsTip->AddCoin(cached, Coin(CTxOut(COIN, CScript() << OP_TRUE), 10, false, false), false);
+    COutPoint missing(GetRandHash(), 0);
+
+    CBlock block;
+    CMutableTransaction coinbase(CTransaction::CURRENT_VERSION);
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    block.vtx.push_back(SpendingTx(std::vector<COutPoint>(onDisk.begin(), onDisk.begin() + 25), COIN));
+    block.vtx.push_back(SpendingTx(std::vector<COutPoint>(onDisk.begin() + 25, onDisk.end()), COIN));
+    block.vtx.push_back(SpendingTx({cached, COutPoint(block.vtx[1]->GetHash(), 0), missing}, COIN));
+
+    CCoinsPrefetchStats before, after;
+    GetCoinsPrefetchStats(before);
+    CCoinsViewCache view(pcoinsTip);
+    PrefetchBlockInputs(block, view);
+    GetCoinsPrefetchStats(after);
+
+    BOOST_CHECK_EQUAL(after.nBlocks - before.nBlocks, 1U);
+    BOOST_CHECK_EQUAL(after.nInputs - before.nInputs, 53U);
+    BOOST_CHECK_EQUAL(after.nCached - before.nCached, 1U);
+    BOOST_CHECK_EQUAL(after.nInBlock - before.nInBlock, 1U);
+    BOOST_CHECK_EQUAL(after.nHits - before.nHits, 50U);
+    BOOST_CHECK_EQUAL(after.nWitnessHits - before.nWitnessHits, 0U);
+    BOOST_CHECK_EQUAL(after.nMisses - before.nMisses, 1U);
+
+    // The prefetched coins are in the block's cache, as read from disk, and the tip cache is left alone.
+    for (int i = 0; i < 50; ++i)
+    {
+        BOOST_CHECK(view.HaveCoinInCache(onDisk[i]));
+        BOOST_CHECK(!pcoinsTip->HaveCoinInCache(onDisk[i]));
+        const Coin& coin = view.AccessCoin(onDisk[i]);
+        BOOST_CHECK(coin.out == CTxOut(i * COIN, CScript() << i));
+        BOOST_CHECK_EQUAL(coin.nHeight, 100U + i);
+    }
+    BOOST_CHECK(!view.HaveCoinInCache(cached));
+    BOOST_CHECK(!view.HaveCoinInCache(missing));
+
+    // Spending a prefetched coin reaches the database when the block's cache is flushed.
+    view.SpendCoin(onDisk[0]);
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(!pcoinsTip->HaveCoin(onDisk[0]));
+    BOOST_CHECK(pcoinsTip->Flush());
+    BOOST_CHECK(!pcoinsdbview->HaveCoin(onDisk[0]));
+    BOOST_CHECK(pcoinsdbview->HaveCoin(onDisk[1]));
+}
+
+static CTxOut WitnessOutput(CAmount nValue, int nHeight)
+{
+    CTxOutPoW2Witness details;
+    details.lockFromBlock = nHeight;
+    details.lockUntilBlock = nHeight + 50000;
+    return CTxOut(nValue, details);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_witness_inputs)
+{
+    LOCK(cs_main);
+    pcoinsTip->SetSiblingView(ppow2witTip);
+
+    // Witness coins on disk, which go to both the coin and the witness database, and a plain coin next to them.
+    std::vector<COutPoint> witnessOnDisk;
+    for (int i = 0; i < 10; ++i)
+    {
+        witnessOnDisk.push_back(COutPoint(GetRandHash(), 1));
+        pcoinsTip->AddCoin(witnessOnDisk.back(), Coin(WitnessOutput((10000 + i) * COIN, 100 + i), 100 + i, false, true), false);
+    }
+    COutPoint plain(GetRandHash(), 0);
+    pcoinsTip->AddCoin(plain, Coin(CTxOut(COIN, CScript() << OP_TRUE), 100, false, false), false);
+    BOOST_CHECK(pcoinsTip->Flush());
+    BOOST_CHECK(ppow2witdbview->HaveCoin(witnessOnDisk[0]));
+    BOOST_CHECK(!ppow2witdbview->HaveCoin(plain));
+
+    // One of them is back in the tip cache but not in the witness tip cache, so only its witness state has to be read.
+    BOOST_CHECK(pcoinsTip->HaveCoin(witnessOnDisk[9]));
+    BOOST_CHECK(pcoinsTip->HaveCoinInCache(witnessOnDisk[9]));
+    BOOST_CHECK(!ppow2witTip->HaveCoinInCache(witnessOnDisk[9]));
+
+    CBlock block;
+    CMutableTransaction coinbase(CTransaction::SEGSIG_ACTIVATION_VERSION);
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    std::vector<COutPoint> spent(witnessOnDisk.begin() + 1, witnessOnDisk.end());
+    spent.push_back(plain);
+    block.vtx.push_back(SpendingTx(spent, COIN));
+    // The witness coinbase spends the remaining witness coin.
+    CMutableTransaction witnessCoinbase(CTransaction::SEGSIG_ACTIVATION_VERSION);
+    witnessCoinbase.vin.resize(2);
+    witnessCoinbase.vin[0].prevout.SetNull();
+    witnessCoinbase.vin[1].prevout = witnessOnDisk[0];
+    witnessCoinbase.vout.push_back(WitnessOutput(10000 * COIN, 200));
+    block.vtx.push_back(MakeTransactionRef(std::move(witnessCoinbase)));
+    BOOST_REQUIRE(block.vtx.back()->IsPoW2WitnessCoinBase());
+
+    CCoinsPrefetchStats before, after;
+    GetCoinsPrefetchStats(before);
+    CCoinsViewCache view(pcoinsTip);
+    BOOST_REQUIRE(view.pChainedWitView);
+    PrefetchBlockInputs(block, view);
+    GetCoinsPrefetchStats(after);
+
+    BOOST_CHECK_EQUAL(after.nInputs - before.nInputs, 11U);
+    BOOST_CHECK_EQUAL(after.nCached - before.nCached, 1U);
+    BOOST_CHECK_EQUAL(after.nHits - before.nHits, 10U);
+    BOOST_CHECK_EQUAL(after.nWitnessHits - before.nWitnessHits, 10U);
+    BOOST_CHECK_EQUAL(after.nMisses - before.nMisses, 0U);
+
+    // The witness coins are in the block's witness cache, the plain coin is not, and the witness tip cache is left alone.
+    BOOST_CHECK(!view.HaveCoinInCache(witnessOnDisk[9]));
+    for (const auto& outpoint : witnessOnDisk)
+    {
+        BOOST_CHECK(view.pChainedWitView->HaveCoinInCache(outpoint));
+        BOOST_CHECK(!ppow2witTip->HaveCoinInCache(outpoint));
+        BOOST_CHECK(view.pChainedWitView->AccessCoin(outpoint).out == view.AccessCoin(outpoint).out);
+    }
+    BOOST_CHECK(view.HaveCoinInCache(plain));
+    BOOST_CHECK(!view.pChainedWitView->HaveCoinInCache(plain));
+
+    // Spending through the block's cache spends the witness coin as well.
+    view.SpendCoin(witnessOnDisk[0]);
+    BOOST_CHECK(!view.pChainedWitView->HaveCoin(witnessOnDisk[0]));
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(!ppow2witTip->HaveCoin(witnessOnDisk[0]));
+    BOOST_CHECK(ppow2witTip->HaveCoin(witnessOnDisk[1]));
+
+    pcoinsTip->SetSiblingView(nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,196 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "coins.h"
+#include "consensus/validation.h"
+#include "Gulden/util.h"
+#include "script/sign.h"
+#include "txdb.h"
+#include "undo.h"
+#include "validation/validation.h"
+#include "validation/witnessvalidation.h"
+#include "test/test_gulden.h"
+
+#include <map>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinsstats_tests, TestChain100Setup)
+
+static uint256 FinalizedMuHash(const CCoinsStatsRecord& record)
+{
+    MuHash3072 muhash = record.muhash;
+    unsigned char hash[32];
+    muhash.Finalize(hash);
+    return uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+}
+
+// The statistics computed from scratch over a set of coins, as gettxoutsetinfo does for the databases.
+static CCoinsStatsRecord ComputeCoinsStats(const std::map<COutPoint, Coin>& coins, bool fWitnessOnly)
+{
+    CCoinsStatsRecord record;
+    for (const auto& coinIter : coins)
+    {
+        if (!fWitnessOnly || IsPow2WitnessOutput(coinIter.second.out))
+            record.AddCoin(coinIter.first, coinIter.second);
+    }
+    return record;
+}
+
+static void CheckSameCoinsStats(const CCoinsStatsRecord& record, const CCoinsStatsRecord& expected)
+{
+    BOOST_CHECK_EQUAL(record.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(record.nBogoSize, expected.nBogoSize);
+    BOOST_CHECK_EQUAL(record.nTotalAmount, expected.nTotalAmount);
+    BOOST_CHECK(FinalizedMuHash(record) == FinalizedMuHash(expected));
+}
+
+static CTxIn SpendOf(const COutPoint& outpoint)
+{
+    CTxIn txin;
+    txin.prevout = outpoint;
+    return txin;
+}
+
+static CTxOut WitnessOutput(CAmount nValue, int nLockUntilBlock)
+{
+    CTxOutPoW2Witness details;
+    details.lockFromBlock = 0;
+    details.lockUntilBlock = nLockUntilBlock;
+    details.failCount = 0;
+    details.actionNonce = 0;
+    details.witnessKeyID = CKeyID(uint160(InsecureRandBytes(20)));
+    details.spendingKeyID = CKeyID(uint160(InsecureRandBytes(20)));
+    return CTxOut(nValue, details);
+}
+
+// The records kept for every connected block have to match the statistics computed from scratch over both databases,
+// including for blocks that spend outputs they create themselves.
+BOOST_AUTO_TEST_CASE(coinsstats_records_match_databases)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::shared_ptr<CReserveKeyOrScript> reservedScript = std::make_shared<CReserveKeyOrScript>(scriptPubKey);
+    auto sign = [&](CMutableTransaction& tx)
+    {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+    };
+
+    for (int i = 0; i < 3; ++i)
+    {
+        CMutableTransaction spend(TEST_DEFAULT_TX_VERSION);
+        spend.nVersion = 1;
+        spend.vin.resize(1);
+        spend.vin[0].prevout.setHash(coinbaseTxns[i].GetHash());
+        spend.vin[0].prevout.n = 0;
+        spend.vout.resize(2);
+        spend.vout[0].nValue = 100 * COIN;
+        spend.vout[0].output.scriptPubKey = scriptPubKey;
+        spend.vout[1].nValue = 50 * COIN;
+        spend.vout[1].output.scriptPubKey = scriptPubKey;
+        sign(spend);
+
+        CMutableTransaction spendInBlock(TEST_DEFAULT_TX_VERSION);
+        spendInBlock.nVersion = 1;
+        spendInBlock.vin.resize(1);
+        spendInBlock.vin[0].prevout.setHash(spend.GetHash());
+        spendInBlock.vin[0].prevout.n = 0;
+        spendInBlock.vout.resize(1);
+        spendInBlock.vout[0].nValue = 99 * COIN;
+        spendInBlock.vout[0].output.scriptPubKey = scriptPubKey;
+        sign(spendInBlock);
+
+        CBlock block = CreateAndProcessBlock({spend, spendInBlock}, reservedScript);
+        BOOST_REQUIRE(chainActive.Tip()->GetBlockHashLegacy() == block.GetHashLegacy());
+    }
+
+    LOCK(cs_main);
+    CValidationState state;
+    BOOST_REQUIRE(FlushStateToDisk(Params(), state, FLUSH_STATE_ALWAYS));
+    const uint256 hashTip = chainActive.Tip()->GetBlockHashPoW2();
+    CCoinsStatsRecord record, witnessRecord;
+    BOOST_REQUIRE(pcoinsdbview->ReadCoinsStats(hashTip, record));
+    BOOST_REQUIRE(ppow2witdbview->ReadCoinsStats(hashTip, witnessRecord));
+
+    std::map<COutPoint, Coin> coins, witnessCoins;
+    pcoinsdbview->GetAllCoins(coins);
+    ppow2witdbview->GetAllCoins(witnessCoins);
+    BOOST_CHECK(!coins.empty());
+    CheckSameCoinsStats(record, ComputeCoinsStats(coins, false));
+    CheckSameCoinsStats(witnessRecord, ComputeCoinsStats(witnessCoins, false));
+}
+
+// Witness outputs can not be funded on the test chain, so apply a block with witness outputs and same block spends of both kinds
+// of output to a coins view, and check that the delta applied to the statistics of the parent gives the statistics of the result.
+BOOST_AUTO_TEST_CASE(coinsstats_delta_with_witness_outputs)
+{
+    const int nHeight = 1000;
+    CScript scriptPubKey = CScript() << OP_TRUE;
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    const COutPoint fundingOutpoint(InsecureRand256(), 0), fundingWitnessOutpoint(InsecureRand256(), 1);
+    view.AddCoin(fundingOutpoint, Coin(CTxOut(20000 * COIN, scriptPubKey), nHeight - 10, false, true), false);
+    view.AddCoin(fundingWitnessOutpoint, Coin(WitnessOutput(30000 * COIN, nHeight + 100000), nHeight - 10, false, true), false);
+    view.AddCoin(COutPoint(InsecureRand256(), 0), Coin(WitnessOutput(40000 * COIN, nHeight + 100000), nHeight - 20, false, true), false);
+
+    std::map<COutPoint, Coin> coinsParent;
+    view.GetAllCoins(coinsParent);
+    CCoinsStatsRecord record = ComputeCoinsStats(coinsParent, false);
+    CCoinsStatsRecord witnessRecord = ComputeCoinsStats(coinsParent, true);
+    BOOST_REQUIRE_EQUAL(witnessRecord.nTransactionOutputs, 2U);
+
+    CBlock block;
+    CMutableTransaction coinbase(CTransaction::CURRENT_VERSION);
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.push_back(CTxOut(1000 * COIN, scriptPubKey));
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+    // Funds a witness output and a plain one, and has an output that never enters the set.
+    CMutableTransaction fund(CTransaction::CURRENT_VERSION);
+    fund.vin.push_back(SpendOf(fundingOutpoint));
+    fund.vin.push_back(SpendOf(fundingWitnessOutpoint));
+    fund.vout.push_back(WitnessOutput(45000 * COIN, nHeight + 50000));
+    fund.vout.push_back(CTxOut(4000 * COIN, scriptPubKey));
+    fund.vout.push_back(CTxOut(0, CScript() << OP_RETURN));
+    const CTransactionRef fundRef = MakeTransactionRef(std::move(fund));
+    block.vtx.push_back(fundRef);
+
+    // Spends both outputs of the transaction before it, in the same block.
+    CMutableTransaction spendInBlock(CTransaction::CURRENT_VERSION);
+    spendInBlock.vin.push_back(SpendOf(COutPoint(fundRef->GetHash(), 0)));
+    spendInBlock.vin.push_back(SpendOf(COutPoint(fundRef->GetHash(), 1)));
+    spendInBlock.vout.push_back(WitnessOutput(44000 * COIN, nHeight + 60000));
+    spendInBlock.vout.push_back(CTxOut(4900 * COIN, scriptPubKey));
+    block.vtx.push_back(MakeTransactionRef(std::move(spendInBlock)));
+
+    // Connect it the way ConnectBlock does, keeping the spent coins as undo data.
+    CBlockUndo blockundo;
+    for (const CTransactionRef& tx : block.vtx)
+    {
+        if (!tx->IsCoinBase())
+        {
+            blockundo.vtxundo.push_back(CTxUndo());
+            for (const CTxIn& txin : tx->vin)
+            {
+                BOOST_REQUIRE(!view.AccessCoin(txin.prevout).IsSpent());
+                blockundo.vtxundo.back().vprevout.push_back(view.AccessCoin(txin.prevout));
+            }
+        }
+        UpdateCoins(*tx, view, nHeight);
+    }
+
+    AddCoinsStatsDelta(block, blockundo, nHeight, record, witnessRecord);
+
+    std::map<COutPoint, Coin> coins;
+    view.GetAllCoins(coins);
+    CheckSameCoinsStats(record, ComputeCoinsStats(coins, false));
+    CheckSameCoinsStats(witnessRecord, ComputeCoinsStats(coins, true));
+    BOOST_CHECK_EQUAL(witnessRecord.nTransactionOutputs, 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,13 +4,17 @@
 
 #include "crypto/aes.h"
 #include "crypto/chacha20.h"
+#include "crypto/muhash.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "Gulden/Common/scrypt.h"
+#include "primitives/block.h"
 #include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
 #include "test/test_gulden.h"
 
@@ -483,6 +487,64 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+static MuHash3072 FromInt(unsigned char i)
+{
+    unsigned char data[32] = {i, 0};
+    return MuHash3072().Insert(data, sizeof(data));
+}
+
+static uint256 FinalizeMuHash(MuHash3072 muhash)
+{
+    unsigned char out[32];
+    muhash.Finalize(out);
+    return uint256(std::vector<unsigned char>(out, out + sizeof(out)));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    // Same test vector as the Bitcoin Core implementation.
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    BOOST_CHECK_EQUAL(FinalizeMuHash(acc).GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+    // The order of insertions and removals does not matter, and a removal cancels an insertion.
+    FastRandomContext ctx;
+    std::vector<std::vector<unsigned char>> elements;
+    for (int i = 0; i < 8; ++i)
+        elements.push_back(ctx.randbytes(1 + ctx.randrange(100)));
+    MuHash3072 forward, backward, withRemoval;
+    for (size_t i = 0; i < elements.size(); ++i) {
+        forward.Insert(elements[i].data(), elements[i].size());
+        const std::vector<unsigned char>& reversed = elements[elements.size() - 1 - i];
+        backward.Insert(reversed.data(), reversed.size());
+        withRemoval.Insert(elements[i].data(), elements[i].size());
+        if (i % 2 == 1)
+            withRemoval.Remove(elements[i].data(), elements[i].size());
+    }
+    for (size_t i = 1; i < elements.size(); i += 2)
+        withRemoval.Insert(elements[i].data(), elements[i].size());
+    BOOST_CHECK(FinalizeMuHash(forward) == FinalizeMuHash(backward));
+    BOOST_CHECK(FinalizeMuHash(forward) == FinalizeMuHash(withRemoval));
+    BOOST_CHECK(FinalizeMuHash(forward) != FinalizeMuHash(FromInt(0)));
+
+    // Dividing a set by itself gives the empty set, combining sets is the same as inserting everything into one.
+    MuHash3072 empty = forward;
+    empty /= empty;
+    BOOST_CHECK(FinalizeMuHash(empty) == FinalizeMuHash(MuHash3072()));
+    MuHash3072 combined = FromInt(3);
+    combined *= FromInt(4);
+    BOOST_CHECK(FinalizeMuHash(combined) == FinalizeMuHash(FromInt(4) *= FromInt(3)));
+
+    // The hash survives serialization, also halfway.
+    CDataStream ss(SER_DISK, 0);
+    ss << withRemoval;
+    BOOST_CHECK_EQUAL(ss.size(), 768U);
+    MuHash3072 unserialized;
+    ss >> unserialized;
+    BOOST_CHECK(FinalizeMuHash(unserialized) == FinalizeMuHash(forward));
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
@@ -505,4 +567,92 @@ BOOST_AUTO_TEST_CASE(countbits_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_multi_lane_tests)
+{
+    scrypt_detect();
+
+    // An odd count so that every kernel width and the single lane tail get exercised.
+    const unsigned int count = 2 * SCRYPT_MULTI_MAX_LANES + 5;
+    std::vector<char> headers(80 * count);
+    FastRandomContext ctx(true);
+    for (auto& c : headers)
+        c = ctx.rand32() & 0xff;
+
+    std::vector<char> scratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    std::vector<char> expected(32 * count);
+    for (unsigned int i = 0; i < count; ++i)
+        scrypt_1024_1_1_256_sp_generic(&headers[80 * i], &expected[32 * i], scratchpad.data());
+
+    std::vector<char> single(32);
+    scrypt_1024_1_1_256_sp(&headers[0], single.data(), scratchpad.data());
+    BOOST_CHECK(memcmp(single.data(), &expected[0], 32) == 0);
+
+    std::vector<char> multi(32 * count);
+    scrypt_1024_1_1_256_sp_multi(headers.data(), multi.data(), count, scratchpad.data());
+    BOOST_CHECK(multi == expected);
+
+    for (unsigned int lanes : {4, 8, 16})
+    {
+        std::vector<char> out(32 * lanes);
+        if (scrypt_1024_1_1_256_sp_lanes(lanes, headers.data(), out.data(), scratchpad.data()))
+            BOOST_CHECK(memcmp(out.data(), expected.data(), 32 * lanes) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_header_template_tests)
+{
+    scrypt_detect();
+
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.hashMerkleRoot = GetRandHash();
+    block.nTime = 1500000000;
+    block.nBits = 0x1e0fffff;
+    // Start just below the wrap around so nonce overflow inside a batch is covered too.
+    block.nNonce = 0xfffffff8;
+
+    CBlockHeaderPoWHasher powHasher;
+    powHasher.Prepare(block);
+    const unsigned int count = SCRYPT_MULTI_MAX_LANES + 3;
+    std::vector<uint256> hashes(count);
+    powHasher.Hash(block.nNonce, count, hashes.data());
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        BOOST_CHECK(hashes[i] == block.GetPoWHash());
+        ++block.nNonce;
+    }
+
+    // Fields outside the cached midstate (nTime) only take effect after preparing again.
+    block.nTime += 1;
+    powHasher.Prepare(block);
+    powHasher.Hash(block.nNonce, 1, hashes.data());
+    BOOST_CHECK(hashes[0] == block.GetPoWHash());
+}
+
+BOOST_AUTO_TEST_CASE(pow_hash_batch_tests)
+{
+    scrypt_detect();
+
+    // Unrelated headers, more than one full batch so a partial tail batch is hashed as well.
+    const unsigned int count = SCRYPT_MULTI_MAX_LANES + 5;
+    std::vector<CBlock> blocks(count);
+    std::vector<const CBlockHeader*> headers;
+    for (CBlock& block : blocks)
+    {
+        block.nVersion = 4;
+        block.hashPrevBlock = GetRandHash();
+        block.hashMerkleRoot = GetRandHash();
+        block.nTime = 1500000000 + InsecureRandRange(100000);
+        block.nBits = 0x1e0fffff;
+        block.nNonce = InsecureRand32();
+        headers.push_back(&block);
+    }
+
+    std::vector<uint256> hashes(count);
+    GetPoWHashes(headers.data(), count, hashes.data());
+    for (unsigned int i = 0; i < count; ++i)
+        BOOST_CHECK(hashes[i] == blocks[i].GetPoWHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
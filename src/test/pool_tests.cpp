@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "coins.h"
+#include "memusage.h"
+#include "random.h"
+#include "script/standard.h"
+#include "support/allocators/pool.h"
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_resource_reuse)
+{
+    PoolResource<64, 8> resource(1024);
+
+    // Blocks of the same (rounded) size are handed out from the same chunk and reused once freed.
+    void* a = resource.Allocate(24, 8);
+    void* b = resource.Allocate(20, 8);
+    BOOST_CHECK(a != b);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    resource.Deallocate(a, 24, 8);
+    void* c = resource.Allocate(17, 8);
+    BOOST_CHECK(c == a);
+
+    // Too large or too strictly aligned for the pool.
+    void* large = resource.Allocate(65, 8);
+    void* aligned = resource.Allocate(16, 64);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(aligned) % 64, 0U);
+    resource.Deallocate(large, 65, 8);
+    resource.Deallocate(aligned, 16, 64);
+
+    // More chunks as needed; all but one are given back when nothing is in use anymore.
+    std::vector<void*> blocks;
+    for (int i = 0; i < 100; ++i)
+        blocks.push_back(resource.Allocate(64, 8));
+    BOOST_CHECK(resource.NumAllocatedChunks() > 1);
+    for (void* p : blocks)
+        resource.Deallocate(p, 64, 8);
+    resource.Deallocate(b, 20, 8);
+    resource.Deallocate(c, 17, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_coins_map_usage)
+{
+    CCoinsMap map;
+    size_t nEmptyUsage = memusage::DynamicUsage(map);
+    for (int i = 0; i < 10000; ++i)
+    {
+        CCoinsCacheEntry& entry = map[COutPoint(GetRandHash(), i)];
+        entry.coin = Coin(CTxOut(i, CScript() << i), 1, false, false);
+    }
+    // Everything the pool holds is counted, which is at least the size of the nodes.
+    const CCoinsMap::allocator_type::ResourceType& resource = *map.get_allocator().GetResource();
+    BOOST_CHECK(resource.NumAllocatedChunks() * resource.ChunkSizeBytes() >= map.size() * sizeof(CCoinsMap::value_type));
+    BOOST_CHECK(memusage::DynamicUsage(map) >= resource.NumAllocatedChunks() * resource.ChunkSizeBytes() + map.bucket_count() * sizeof(void*));
+
+    // A copy gets a pool of its own.
+    CCoinsMap mapCopy(map);
+    BOOST_CHECK(mapCopy.get_allocator() != map.get_allocator());
+    BOOST_CHECK(mapCopy.size() == map.size());
+    BOOST_CHECK(mapCopy.find(map.begin()->first) != mapCopy.end());
+
+    // Erasing everything (as BatchWrite does) gives the chunks back.
+    for (auto it = map.begin(); it != map.end();)
+        it = map.erase(it);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK(memusage::DynamicUsage(map) < memusage::DynamicUsage(mapCopy));
+
+    map.clear();
+    mapCopy.clear();
+    BOOST_CHECK(memusage::DynamicUsage(mapCopy) >= nEmptyUsage);
+}
+
+// The bytes per cached coin decide how many coins fit in -dbcache; the pooled map must need fewer of them than one with malloc allocated nodes.
+BOOST_AUTO_TEST_CASE(pool_coins_map_bytes_per_entry)
+{
+    typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMapMalloc;
+    CCoinsMap map;
+    CCoinsMapMalloc mapMalloc;
+    const size_t nEntries = 100000;
+    for (size_t i = 0; i < nEntries; ++i)
+    {
+        COutPoint outpoint(GetRandHash(), i % 4);
+        Coin coin(CTxOut(i, GetScriptForDestination(CKeyID(uint160(InsecureRandBytes(20))))), 1, false, false);
+        map[outpoint].coin = coin;
+        mapMalloc[outpoint].coin = coin;
+    }
+    BOOST_REQUIRE_EQUAL(map.size(), nEntries);
+    BOOST_REQUIRE_EQUAL(mapMalloc.size(), nEntries);
+
+    size_t nBytesPerEntry = memusage::DynamicUsage(map) / nEntries;
+    size_t nBytesPerEntryMalloc = memusage::DynamicUsage(mapMalloc) / nEntries;
+    BOOST_TEST_MESSAGE("CCoinsMap bytes per entry: " << nBytesPerEntry << ", with malloc allocated nodes: " << nBytesPerEntryMalloc);
+    BOOST_CHECK_LT(nBytesPerEntry, nBytesPerEntryMalloc);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -11,9 +11,14 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "consensus/validation.h"
 #include "pow.h"
+#include "Gulden/Common/diff_common.h"
+#include "Gulden/Common/diff_delta.h"
+#include "primitives/block.h"
 #include "random.h"
 #include "util.h"
+#include "validation/validation.h"
 #include "test/test_gulden.h"
 
 #include <boost/test/unit_test.hpp>
@@ -94,4 +99,116 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* Delta taking its window times from the running sums in the block index must match walking the windows, bit for bit */
+BOOST_AUTO_TEST_CASE(delta_time_sums_match_walk)
+{
+    const int nPowTargetSpacing = 150;
+    const unsigned int nPowLimit = 0x1e0fffff;
+    const unsigned int nFirstDeltaBlock = 10;
+
+    // Mostly on target times, with fast, slow, zero and negative gaps mixed in so every Delta rule is hit.
+    auto randomGap = [&]() -> int64_t {
+        switch (InsecureRandRange(8))
+        {
+            case 0: return -(int64_t)InsecureRandRange(300);
+            case 1: return 0;
+            case 2: return InsecureRandRange(30);
+            case 3: return 600 + InsecureRandRange(3000);
+            default: return 100 + InsecureRandRange(100);
+        }
+    };
+
+    auto checkNext = [&](const CBlockIndex* pindexLast) {
+        CBlockHeader header;
+        for (int64_t nWait : {(int64_t)0, (int64_t)nPowTargetSpacing, (int64_t)400, (int64_t)5000})
+        {
+            header.nTime = pindexLast->nTime + nWait;
+            BOOST_CHECK_EQUAL(GetNextWorkRequired_DELTA(pindexLast, &header, nPowTargetSpacing, nPowLimit, nFirstDeltaBlock),
+                              GetNextWorkRequired_DELTA_Walk(pindexLast, &header, nPowTargetSpacing, nPowLimit, nFirstDeltaBlock));
+        }
+    };
+
+    auto extend = [&](CBlockIndex& block, CBlockIndex* pprev) {
+        block.pprev = pprev;
+        block.nHeight = pprev ? pprev->nHeight + 1 : 0;
+        block.nTime = pprev ? pprev->nTime + randomGap() : 1500000000;
+        CBlockHeader header;
+        header.nTime = block.nTime;
+        block.nBits = pprev ? GetNextWorkRequired_DELTA_Walk(pprev, &header, nPowTargetSpacing, nPowLimit, nFirstDeltaBlock) : nPowLimit;
+        block.BuildSkip();
+        block.BuildDeltaTimeSums();
+    };
+
+    std::vector<CBlockIndex> blocks(2000);
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        extend(blocks[i], i ? &blocks[i - 1] : NULL);
+        checkNext(&blocks[i]);
+    }
+
+    // A fork off the middle of the chain has its own sums.
+    std::vector<CBlockIndex> fork(700);
+    for (size_t i = 0; i < fork.size(); ++i)
+    {
+        extend(fork[i], i ? &fork[i - 1] : &blocks[1000]);
+        checkNext(&fork[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pow_cache_test)
+{
+    Consensus::Params params;
+    params.powLimit = uint256S("0x7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff; /* target 0x7fffff000..., about half of all nonces pass */
+
+    // A header that fails is never cached.
+    while (CheckProofOfWork(block.GetPoWHash(), block.nBits, params))
+        ++block.nNonce;
+    BOOST_CHECK(!CheckBlockProofOfWork(block, params));
+    BOOST_CHECK(!IsProofOfWorkCached(block));
+
+    // A header that passes is cached after the first check, and still passes when checked again.
+    while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params))
+        ++block.nNonce;
+    BOOST_CHECK(!IsProofOfWorkCached(block));
+    BOOST_CHECK(CheckBlockProofOfWork(block, params));
+    BOOST_CHECK(IsProofOfWorkCached(block));
+    BOOST_CHECK(CheckBlockProofOfWork(block, params));
+
+    // Any change to the PoW header (here the claimed target) is a different cache entry.
+    block.nBits = 0x1e0fffff;
+    BOOST_CHECK(!IsProofOfWorkCached(block));
+}
+
+struct RegTestingSetup : public TestingSetup {
+    RegTestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+// Headers that do not connect to a block we know are rejected on the first one, before the PoW of the others is checked in parallel.
+BOOST_FIXTURE_TEST_CASE(process_headers_not_connecting_skips_pow, RegTestingSetup)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    std::vector<CBlockHeader> headers(20);
+    uint256 hashPrev = InsecureRand256();
+    for (CBlockHeader& header : headers)
+    {
+        header.nVersion = 4;
+        header.hashPrevBlock = hashPrev;
+        header.nTime = 1500000000;
+        header.nBits = UintToArith256(params.powLimit).GetCompact();
+        while (!CheckProofOfWork(CBlock(header).GetPoWHash(), header.nBits, params))
+            ++header.nNonce;
+        hashPrev = header.GetHashPoW2();
+    }
+
+    CValidationState state;
+    BOOST_CHECK(!ProcessNewBlockHeaders(headers, state, Params()));
+    for (size_t i = 1; i < headers.size(); ++i)
+        BOOST_CHECK(!IsProofOfWorkCached(headers[i]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
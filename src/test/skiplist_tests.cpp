@@ -184,4 +184,74 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_edge_test)
     BOOST_CHECK(!chain.FindEarliestAtLeast(int64_t(std::numeric_limits<unsigned int>::max()) + 1));
 }
 
+BOOST_AUTO_TEST_CASE(clonechain_test)
+{
+    // A main chain of 1000 blocks and a 300 block fork off of it at height 800.
+    std::vector<uint256> vHashMain(1000), vHashFork(300);
+    std::vector<CBlockIndex> vBlocksMain(1000), vBlocksFork(300);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vHashMain[i] = ArithToUint256(i);
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].phashBlock = &vHashMain[i];
+        vBlocksMain[i].BuildSkip();
+    }
+    for (unsigned int i=0; i<vBlocksFork.size(); i++) {
+        vHashFork[i] = ArithToUint256(i + 10000);
+        vBlocksFork[i].nHeight = 801 + i;
+        vBlocksFork[i].pprev = i ? &vBlocksFork[i - 1] : &vBlocksMain[800];
+        vBlocksFork[i].phashBlock = &vHashFork[i];
+        vBlocksFork[i].BuildSkip();
+    }
+    CChain chain;
+    chain.SetTip(&vBlocksMain.back());
+
+    // Retaining a block of the origin chain shares it, moving the tip never touches origin.
+    {
+        CBlockIndex* pRetained = nullptr;
+        CCloneChain tempChain(chain, 500, &vBlocksMain[900], pRetained);
+        BOOST_CHECK(pRetained == &vBlocksMain[900]);
+        BOOST_CHECK(tempChain == chain);
+        tempChain.SetTip(pRetained);
+        BOOST_CHECK_EQUAL(tempChain.Height(), 900);
+        BOOST_CHECK(tempChain.Tip() == pRetained);
+        BOOST_CHECK(tempChain[901] == NULL);
+        BOOST_CHECK(tempChain[600] == &vBlocksMain[600]);
+        BOOST_CHECK(chain.Tip() == &vBlocksMain.back());
+    }
+
+    // Retaining a fork block copies only the fork, which links back into the shared part of origin.
+    {
+        CBlockIndex* pRetained = nullptr;
+        CCloneChain tempChain(chain, 500, &vBlocksFork.back(), pRetained);
+        BOOST_CHECK(pRetained != &vBlocksFork.back());
+        BOOST_CHECK(pRetained->GetBlockHashPoW2() == vBlocksFork.back().GetBlockHashPoW2());
+        BOOST_CHECK(pRetained->GetAncestor(800) == &vBlocksMain[800]);
+        BOOST_CHECK(pRetained->GetAncestor(900) != &vBlocksFork[99]);
+        BOOST_CHECK(pRetained->GetAncestor(900)->GetBlockHashPoW2() == vBlocksFork[99].GetBlockHashPoW2());
+
+        tempChain.SetTip(&vBlocksMain[800]);
+        tempChain.SetTip(pRetained);
+        BOOST_CHECK_EQUAL(tempChain.Height(), 1100);
+        for (int i=0; i<=tempChain.Height(); i++) {
+            BOOST_CHECK(tempChain[i] == pRetained->GetAncestor(i));
+        }
+        BOOST_CHECK(tempChain.Contains(&vBlocksMain[800]));
+        BOOST_CHECK(!tempChain.Contains(&vBlocksMain[801]));
+        BOOST_CHECK(tempChain.FindFork(&vBlocksMain.back()) == &vBlocksMain[800]);
+
+        // Nested temporary chains share the copies of their origin.
+        CBlockIndex* pRetainedNested = nullptr;
+        CCloneChain nestedChain(tempChain, 500, pRetained, pRetainedNested);
+        BOOST_CHECK(pRetainedNested == pRetained);
+        BOOST_CHECK(nestedChain == tempChain);
+
+        tempChain.SetTip(&vBlocksMain[850]);
+        BOOST_CHECK_EQUAL(tempChain.Height(), 850);
+        BOOST_CHECK(tempChain[820] == &vBlocksMain[820]);
+        BOOST_CHECK(chain.Tip() == &vBlocksMain.back());
+        BOOST_CHECK(chain[900] == &vBlocksMain[900]);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "chain.h"
+#include "consensus/validation.h"
+#include "coins.h"
+#include "Gulden/util.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation/utxosnapshot.h"
+#include "validation/validation.h"
+#include "validation/witnessvalidation.h"
+#include "test/test_gulden.h"
+
+#include <algorithm>
+#include <map>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestChain100Setup)
+
+static void CheckSameCoins(const std::map<COutPoint, Coin>& coins, const std::map<COutPoint, Coin>& expected)
+{
+    BOOST_REQUIRE_EQUAL(coins.size(), expected.size());
+    auto expectedIter = expected.begin();
+    for (const auto& coinIter : coins)
+    {
+        BOOST_CHECK(coinIter.first == expectedIter->first);
+        BOOST_CHECK(coinIter.second.out == expectedIter->second.out);
+        BOOST_CHECK_EQUAL(coinIter.second.nHeight, expectedIter->second.nHeight);
+        BOOST_CHECK_EQUAL(coinIter.second.fCoinBase, expectedIter->second.fCoinBase);
+        ++expectedIter;
+    }
+}
+
+// Dump the chainstate, witness coins and phase activation hashes included, and load it back over databases that were changed meanwhile.
+BOOST_AUTO_TEST_CASE(utxosnapshot_round_trip)
+{
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(FlushStateToDisk(Params(), state, FLUSH_STATE_ALWAYS));
+        hashTip = chainActive.Tip()->GetBlockHashPoW2();
+    }
+
+    // The test chain has no witnesses, so put some in the witness database directly.
+    std::vector<std::pair<COutPoint, Coin>> witnessCoins;
+    for (int i = 0; i < 20; ++i)
+    {
+        CTxOutPoW2Witness details;
+        details.lockFromBlock = 50 + i;
+        details.lockUntilBlock = 50000 + i;
+        details.failCount = i % 3;
+        details.witnessKeyID = CKeyID(uint160(InsecureRandBytes(20)));
+        details.spendingKeyID = CKeyID(uint160(InsecureRandBytes(20)));
+        witnessCoins.emplace_back(COutPoint(InsecureRand256(), i % 4), Coin(CTxOut((10000 + i) * COIN, details), 50 + i, false, true));
+    }
+    std::sort(witnessCoins.begin(), witnessCoins.end(), [](const std::pair<COutPoint, Coin>& a, const std::pair<COutPoint, Coin>& b) { return a.first < b.first; });
+    BOOST_REQUIRE(ppow2witdbview->WriteCoinsBulk(witnessCoins, hashTip));
+    const uint256 hashPhase2 = InsecureRand256(), hashPhase3 = InsecureRand256(), hashPhase4 = InsecureRand256();
+    ppow2witdbview->SetPhase2ActivationHash(hashPhase2);
+    ppow2witdbview->SetPhase3ActivationHash(hashPhase3);
+    ppow2witdbview->SetPhase4ActivationHash(hashPhase4);
+    ppow2witdbview->SetPhase5ActivationHash(uint256());
+
+    std::map<COutPoint, Coin> coinsBefore, witnessCoinsBefore;
+    pcoinsdbview->GetAllCoins(coinsBefore);
+    ppow2witdbview->GetAllCoins(witnessCoinsBefore);
+    BOOST_REQUIRE_EQUAL(witnessCoinsBefore.size(), witnessCoins.size());
+
+    fs::path path = GetDataDir() / "utxo.dat";
+    CUTXOSnapshotStats dumpStats;
+    std::string strError;
+    BOOST_REQUIRE_MESSAGE(DumpUTXOSnapshot(path, dumpStats, strError), strError);
+    BOOST_CHECK_EQUAL(dumpStats.nCoins, coinsBefore.size());
+    BOOST_CHECK_EQUAL(dumpStats.nWitnessCoins, witnessCoins.size());
+    BOOST_CHECK(dumpStats.metadata.hashBlock == hashTip);
+    BOOST_CHECK(dumpStats.metadata.hashPhase3Activation == hashPhase3);
+
+    // Change the databases, and move the chain back one block so that the snapshot is ahead of it.
+    pcoinsdbview->WriteCoinsBulk({{COutPoint(InsecureRand256(), 0), Coin(CTxOut(COIN, CScript() << OP_TRUE), 1, false, false)}}, uint256());
+    ppow2witdbview->WriteCoinsBulk({{COutPoint(InsecureRand256(), 0), witnessCoins[0].second}}, uint256());
+    ppow2witdbview->SetPhase3ActivationHash(InsecureRand256());
+    ppow2witdbview->SetPhase5ActivationHash(InsecureRand256());
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(chainActive.Tip()->pprev);
+    }
+
+    CUTXOSnapshotStats loadStats;
+    BOOST_REQUIRE_MESSAGE(LoadUTXOSnapshot(path, loadStats, strError), strError);
+    BOOST_CHECK(loadStats.hashContent == dumpStats.hashContent);
+    BOOST_CHECK_EQUAL(loadStats.nCoins, dumpStats.nCoins);
+    BOOST_CHECK_EQUAL(loadStats.nWitnessCoins, dumpStats.nWitnessCoins);
+    BOOST_CHECK(!fSnapshotLoading);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHashPoW2() == hashTip);
+        BOOST_CHECK(pindexSnapshotBase == chainActive.Tip());
+    }
+    bool fLoading = true;
+    BOOST_CHECK(pblocktree->ReadFlag("snapshotloading", fLoading) && !fLoading);
+
+    std::map<COutPoint, Coin> coinsAfter, witnessCoinsAfter;
+    pcoinsdbview->GetAllCoins(coinsAfter);
+    ppow2witdbview->GetAllCoins(witnessCoinsAfter);
+    CheckSameCoins(coinsAfter, coinsBefore);
+    CheckSameCoins(witnessCoinsAfter, witnessCoinsBefore);
+    for (const auto& coinIter : witnessCoinsAfter)
+    {
+        CTxOutPoW2Witness details;
+        BOOST_CHECK(GetPow2WitnessOutput(coinIter.second.out, details));
+    }
+    BOOST_CHECK(pcoinsdbview->GetBestBlock() == hashTip);
+    BOOST_CHECK(ppow2witdbview->GetBestBlock() == hashTip);
+    BOOST_CHECK(ppow2witdbview->GetPhase2ActivationHash() == hashPhase2);
+    BOOST_CHECK(ppow2witdbview->GetPhase3ActivationHash() == hashPhase3);
+    BOOST_CHECK(ppow2witdbview->GetPhase4ActivationHash() == hashPhase4);
+    BOOST_CHECK(ppow2witdbview->GetPhase5ActivationHash().IsNull());
+
+    // The statistics of the snapshot block are there for gettxoutsetinfo.
+    CCoinsStatsRecord record, witnessRecord;
+    BOOST_CHECK(pcoinsdbview->ReadCoinsStats(hashTip, record));
+    BOOST_CHECK(ppow2witdbview->ReadCoinsStats(hashTip, witnessRecord));
+    BOOST_CHECK_EQUAL(record.nTransactionOutputs, coinsBefore.size());
+    BOOST_CHECK_EQUAL(witnessRecord.nTransactionOutputs, witnessCoins.size());
+    BOOST_CHECK_EQUAL(witnessRecord.nTotalAmount, loadStats.witnessRecord.nTotalAmount);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
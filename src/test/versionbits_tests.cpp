@@ -8,6 +8,11 @@
 #include "chainparams.h"
 #include "validation/validation.h"
 #include "consensus/params.h"
+#include "validation/versionbitsvalidation.h"
+#include "validation/witnessvalidation.h"
+#include "Gulden/util.h"
+
+#include <deque>
 
 #include <boost/test/unit_test.hpp>
 
@@ -341,5 +346,114 @@ BOOST_AUTO_TEST_CASE(versionbits_computeblockversion)
     //fixme: (2.0.1) - Add unit tests for new version bits functionality here.
 }
 
+// A branch of index entries at a height where PoW² phase 4 can activate. The entries are registered in mapBlockIndex, as only
+// those get their phase memoized; the first entry has no parent, so nothing may look below it.
+class Pow2PhaseTestChain
+{
+public:
+    std::deque<CBlockIndex> blocks;
+    std::deque<uint256> hashes;
+
+    CBlockIndex* Add(CBlockIndex* pprev, int nHeight, uint32_t nTime, int32_t nVersion, uint32_t nNonce)
+    {
+        blocks.emplace_back();
+        CBlockIndex* pindex = &blocks.back();
+        pindex->pprev = pprev;
+        pindex->nHeight = nHeight;
+        pindex->nTime = nTime;
+        pindex->nVersion = nVersion;
+        pindex->nNonce = nNonce;
+        pindex->nBits = 0x207fffff;
+        hashes.push_back(pindex->GetBlockHeader().GetHashPoW2());
+        pindex->phashBlock = &hashes.back();
+        mapBlockIndex[hashes.back()] = pindex;
+        return pindex;
+    }
+
+    ~Pow2PhaseTestChain()
+    {
+        for (const uint256& hash : hashes)
+            mapBlockIndex.erase(hash);
+    }
+};
+
+// The memoized phase 4 state must be what the version bits say for the block, whatever order blocks are asked for in and whichever branch is active.
+static void CheckPhase4Memo(const std::vector<CBlockIndex*>& vBlocks, const CChainParams& chainparams)
+{
+    VersionBitsCache referenceCache;
+    for (CBlockIndex* pindex : vBlocks)
+    {
+        bool fExpected = VersionBitsState(pindex, chainparams.GetConsensus(), Consensus::DEPLOYMENT_POW2_PHASE4, referenceCache) == THRESHOLD_ACTIVE;
+        BOOST_CHECK_EQUAL(IsPow2Phase4Active(pindex, chainparams, chainActive), fExpected);
+        BOOST_CHECK(pindex->nStatus & BLOCK_POW2_PHASE4_KNOWN);
+        BOOST_CHECK_EQUAL((pindex->nStatus & BLOCK_POW2_PHASE4_ACTIVE) != 0, fExpected);
+        BOOST_CHECK_EQUAL(IsPow2Phase4Active(pindex, chainparams, chainActive), fExpected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pow2_phase4_memoization)
+{
+    const CChainParams& chainparams = Params();
+    const Consensus::Params& consensus = chainparams.GetConsensus();
+    const int nPeriod = consensus.nMinerConfirmationWindow;
+    const int32_t nSignal = VERSIONBITS_TOP_BITS | (1 << consensus.vDeployments[Consensus::DEPLOYMENT_POW2_PHASE4].bit);
+    CBlockIndex* pindexOldTip = chainActive.Tip();
+
+    // The branch starts with the phase 3 activation block, at the end of a period. One block per 1000 seconds puts the start of
+    // phase 4 signalling (a month after phase 3) in the second period, so the third period signals, locks in and the fifth is active.
+    const int nBaseHeight = 796319;
+    const uint32_t nBaseTime = 1500000000;
+    const int nLength = 4 * nPeriod + 150;
+    BOOST_REQUIRE_EQUAL((nBaseHeight + 1) % nPeriod, 0);
+    Pow2PhaseTestChain chain;
+    std::vector<CBlockIndex*> vMain;
+    vMain.push_back(chain.Add(nullptr, nBaseHeight, nBaseTime, VERSIONBITS_TOP_BITS, 0));
+    for (int i = 1; i <= nLength; ++i)
+        vMain.push_back(chain.Add(vMain.back(), nBaseHeight + i, nBaseTime + i * 1000, i > 2 * nPeriod ? nSignal : VERSIONBITS_TOP_BITS, 0));
+
+    LOCK(cs_main);
+    versionbitscache.Clear();
+    ppow2witdbview->SetPhase3ActivationHash(vMain[0]->GetBlockHashPoW2());
+    chainActive.SetTip(vMain.back());
+    BOOST_CHECK_EQUAL(GetPoW2Phase3ActivationTime(chainActive), (int64_t)nBaseTime);
+
+    // A competing branch from within the signalling period that does not signal, so it never activates.
+    std::vector<CBlockIndex*> vFork(vMain.begin(), vMain.begin() + 2 * nPeriod + 500);
+    for (int i = 2 * nPeriod + 500; i <= nLength; ++i)
+        vFork.push_back(chain.Add(vFork.back(), nBaseHeight + i, nBaseTime + i * 1000, VERSIONBITS_TOP_BITS, 1));
+
+    // A branch from after activation.
+    std::vector<CBlockIndex*> vLate(vMain.begin(), vMain.begin() + 4 * nPeriod + 50);
+    for (int i = 4 * nPeriod + 50; i <= nLength; ++i)
+        vLate.push_back(chain.Add(vLate.back(), nBaseHeight + i, nBaseTime + i * 1000, nSignal, 2));
+
+    // Along the active chain every block is derived from its parent.
+    std::vector<CBlockIndex*> vCheck(vMain.begin() + 1, vMain.end());
+    CheckPhase4Memo(vCheck, chainparams);
+    BOOST_CHECK(!IsPow2Phase4Active(vMain[4 * nPeriod - 1], chainparams, chainActive));
+    BOOST_CHECK(IsPow2Phase4Active(vMain[4 * nPeriod], chainparams, chainActive));
+    BOOST_CHECK(ppow2witdbview->GetPhase4ActivationHash() == vMain[4 * nPeriod]->GetBlockHashPoW2());
+
+    // Reorganize to the branch that never activated, tips first so that no parent is known yet.
+    chainActive.SetTip(vFork.back());
+    versionbitscache.Clear();
+    vCheck.assign(vFork.rbegin(), vFork.rend() - 1);
+    CheckPhase4Memo(vCheck, chainparams);
+    BOOST_CHECK(!IsPow2Phase4Active(vFork.back(), chainparams, chainActive));
+
+    // And back, which crosses the activation again: the blocks of the first branch keep their state.
+    chainActive.SetTip(vMain.back());
+    versionbitscache.Clear();
+    vCheck.assign(vMain.begin() + 1, vMain.end());
+    CheckPhase4Memo(vCheck, chainparams);
+
+    // A block whose parent has no state yet, on a branch from after activation.
+    vCheck.assign(vLate.rbegin(), vLate.rbegin() + (nLength - 4 * nPeriod - 49));
+    CheckPhase4Memo(vCheck, chainparams);
+    BOOST_CHECK(IsPow2Phase4Active(vLate.back(), chainparams, chainActive));
+
+    chainActive.SetTip(pindexOldTip);
+    versionbitscache.Clear();
+}
 
 BOOST_AUTO_TEST_SUITE_END()
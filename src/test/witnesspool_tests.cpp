@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "chain.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "validation/validation.h"
+#include "validation/witnesspool.h"
+#include "test/test_gulden.h"
+
+#include <memory>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(witnesspool_tests, BasicTestingSetup)
+
+static CTxOut RandomWitnessOutput(int nHeight)
+{
+    CTxOutPoW2Witness details;
+    details.lockFromBlock = nHeight;
+    details.lockUntilBlock = nHeight + 1000 + InsecureRandRange(100000);
+    return CTxOut((5000 + InsecureRandRange(100000)) * COIN, details);
+}
+
+static void CheckPoolMatchesView(const std::vector<CWitnessPoolEntry>& entries, const std::map<COutPoint, Coin>& viewCoins)
+{
+    BOOST_REQUIRE_EQUAL(entries.size(), viewCoins.size());
+    auto viewIter = viewCoins.begin();
+    for (const auto& entry : entries)
+    {
+        BOOST_CHECK(entry.outpoint == viewIter->first);
+        BOOST_CHECK(entry.coin.out == viewIter->second.out);
+        BOOST_CHECK_EQUAL(entry.coin.nHeight, viewIter->second.nHeight);
+        ++viewIter;
+    }
+}
+
+// Connect random blocks to a coins view with a sibling witness view (as pcoinsTip/ppow2witTip are set up) and to the pool index, the two must always agree.
+BOOST_AUTO_TEST_CASE(witness_pool_matches_witness_view)
+{
+    const int nBlocks = 150;
+
+    std::vector<std::unique_ptr<CBlockIndex>> chain;
+    for (int i = 0; i <= nBlocks; ++i)
+    {
+        CBlockIndex* pprev = i ? chain.back().get() : nullptr;
+        chain.emplace_back(new CBlockIndex());
+        chain.back()->pprev = pprev;
+        chain.back()->nHeight = i;
+        chain.back()->BuildSkip();
+    }
+
+    CCoinsView coinsBase;
+    CCoinsView witnessBase;
+    CCoinsViewCache coins(&coinsBase);
+    std::shared_ptr<CCoinsViewCache> witnessView(new CCoinsViewCache(&witnessBase));
+    coins.SetSiblingView(witnessView);
+
+    CWitnessPoolIndex pool;
+    pool.Load(chain[0].get(), *witnessView);
+    BOOST_CHECK(pool.Entries().empty());
+
+    std::vector<COutPoint> unspent;
+    std::vector<CBlock> blocks(nBlocks + 1);
+    std::vector<std::map<COutPoint, Coin>> snapshots(nBlocks + 1);
+    for (int nHeight = 1; nHeight <= nBlocks; ++nHeight)
+    {
+        CBlock& block = blocks[nHeight];
+
+        CMutableTransaction coinbase(CTransaction::SEGSIG_ACTIVATION_VERSION);
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << nHeight;
+        coinbase.vout.push_back(CTxOut(20 * COIN, CScript()));
+        if (InsecureRandRange(2))
+            coinbase.vout.push_back(RandomWitnessOutput(nHeight));
+        block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+        for (int nTx = InsecureRandRange(4); nTx > 0; --nTx)
+        {
+            CMutableTransaction tx(CTransaction::SEGSIG_ACTIVATION_VERSION);
+            tx.nLockTime = nHeight * 10 + nTx;
+            for (int nIn = InsecureRandRange(3); nIn > 0 && !unspent.empty(); --nIn)
+            {
+                size_t nIndex = InsecureRandRange(unspent.size());
+                tx.vin.push_back(CTxIn());
+                tx.vin.back().prevout = unspent[nIndex];
+                unspent.erase(unspent.begin() + nIndex);
+            }
+            tx.vout.push_back(CTxOut(COIN, CScript()));
+            for (int nOut = InsecureRandRange(3); nOut > 0; --nOut)
+                tx.vout.push_back(RandomWitnessOutput(nHeight));
+            block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+
+            // Outputs of this transaction may be spent by a later one in the same block.
+            const CTransaction& added = *block.vtx.back();
+            for (unsigned int i = 1; i < added.vout.size(); ++i)
+                unspent.push_back(COutPoint(added.GetHash(), i));
+        }
+        const CTransaction& coinbaseTx = *block.vtx[0];
+        for (unsigned int i = 1; i < coinbaseTx.vout.size(); ++i)
+            unspent.push_back(COutPoint(coinbaseTx.GetHash(), i));
+
+        for (const auto& tx : block.vtx)
+            UpdateCoins(*tx, coins, nHeight);
+        pool.ConnectBlock(block, chain[nHeight].get());
+        BOOST_CHECK(pool.Tip() == chain[nHeight].get());
+
+        witnessView->GetAllCoins(snapshots[nHeight]);
+        CheckPoolMatchesView(pool.Entries(), snapshots[nHeight]);
+    }
+
+    // Recent ancestors are a lookup, anything further back than the history is refused.
+    for (int nDepth = 0; nDepth <= (int)WITNESS_POOL_HISTORY_DEPTH; ++nDepth)
+    {
+        std::vector<CWitnessPoolEntry> entries;
+        BOOST_REQUIRE(pool.GetWitnessEntries(chain[nBlocks - nDepth].get(), entries));
+        CheckPoolMatchesView(entries, snapshots[nBlocks - nDepth]);
+    }
+    std::vector<CWitnessPoolEntry> entries;
+    BOOST_CHECK(!pool.GetWitnessEntries(chain[nBlocks - WITNESS_POOL_HISTORY_DEPTH - 1].get(), entries));
+
+    // Disconnecting steps the pool back, connecting a block that does not build on the tip invalidates it.
+    pool.DisconnectBlock(blocks[nBlocks], chain[nBlocks].get(), *witnessView);
+    BOOST_CHECK(pool.Tip() == chain[nBlocks - 1].get());
+    CheckPoolMatchesView(pool.Entries(), snapshots[nBlocks - 1]);
+    pool.ConnectBlock(blocks[nBlocks - 1], chain[nBlocks - 1].get());
+    BOOST_CHECK(pool.Tip() == nullptr);
+    BOOST_CHECK(pool.Entries().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
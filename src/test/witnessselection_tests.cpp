@@ -0,0 +1,167 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "arith_uint256.h"
+#include "consensus/validation.h"
+#include "validation/witnessselection.h"
+#include "validation/witnessvalidation.h"
+#include "test/test_gulden.h"
+#include <Gulden/util.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(witnessselection_tests, BasicTestingSetup)
+
+// The list based implementation that GetWitnessHelper used before the selection tree, kept here as the reference that the tree has to reproduce exactly.
+static bool ReferenceWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+{
+    uint64_t nMinAge = gMinimumParticipationAge;
+    while (true)
+    {
+        witnessInfo.witnessSelectionPoolFiltered = witnessInfo.witnessSelectionPoolUnfiltered;
+        auto& filtered = witnessInfo.witnessSelectionPoolFiltered;
+        filtered.erase(std::remove_if(filtered.begin(), filtered.end(), [&](RouletteItem& x){ return (x.nAge <= nMinAge); }), filtered.end());
+        filtered.erase(std::remove_if(filtered.begin(), filtered.end(), [&](RouletteItem& x){ return witnessHasExpired(x.nAge, x.nWeight, witnessInfo.nTotalWeight); }), filtered.end());
+        filtered.erase(std::remove_if(filtered.begin(), filtered.end(), [&](RouletteItem& x){ CTxOutPoW2Witness details; GetPow2WitnessOutput(x.coin.out, details); return (GetPoW2RemainingLockLengthInBlocks(details.lockUntilBlock, nBlockHeight) <= nMinAge); }), filtered.end());
+        if (filtered.size() >= 100 || nMinAge == 0 || (nMinAge <= 10 && filtered.size() > 5))
+            break;
+        nMinAge -= 5;
+    }
+
+    if (witnessInfo.witnessSelectionPoolFiltered.size() == 0)
+        return false;
+
+    std::sort(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end());
+
+    witnessInfo.nMaxIndividualWeight = witnessInfo.nTotalWeight / 100;
+    witnessInfo.nReducedTotalWeight = 0;
+    for (auto& item : witnessInfo.witnessSelectionPoolFiltered)
+    {
+        if (item.nWeight > witnessInfo.nMaxIndividualWeight)
+            item.nWeight = witnessInfo.nMaxIndividualWeight;
+        witnessInfo.nReducedTotalWeight += item.nWeight;
+        item.nCumulativeWeight = witnessInfo.nReducedTotalWeight;
+    }
+
+    arith_uint256 rouletteSelectionSeed = UintToArith256(blockHash);
+    if (rouletteSelectionSeed > arith_uint256(witnessInfo.nReducedTotalWeight))
+        rouletteSelectionSeed = rouletteSelectionSeed - (arith_uint256(witnessInfo.nReducedTotalWeight) * arith_uint256(rouletteSelectionSeed/arith_uint256(witnessInfo.nReducedTotalWeight)));
+
+    auto selectedWitness = std::lower_bound(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), rouletteSelectionSeed.GetLow64());
+    witnessInfo.selectedWitnessTransaction = selectedWitness->coin.out;
+    witnessInfo.selectedWitnessBlockHeight = selectedWitness->coin.nHeight;
+    witnessInfo.selectedWitnessOutpoint = selectedWitness->outpoint;
+    return true;
+}
+
+static CGetWitnessInfo RandomWitnessPool(size_t nSize, uint64_t nBlockHeight)
+{
+    CGetWitnessInfo witnessInfo;
+    for (size_t i = 0; i < nSize; ++i)
+    {
+        CTxOutPoW2Witness details;
+        details.lockFromBlock = 1;
+        details.lockUntilBlock = nBlockHeight - 50 + InsecureRandRange(1000);
+        // Duplicate ages are common on the real network, make sure the outpoint tie break gets exercised.
+        uint64_t nAge = InsecureRandRange(4) == 0 ? 150 : InsecureRandRange(InsecureRandRange(8) ? 2000 : gMaximumParticipationAge + 100);
+        uint64_t nWeight = 100 + InsecureRandRange(InsecureRandRange(2) ? 1000 : 100000);
+        COutPoint outpoint(InsecureRand256(), InsecureRandRange(4));
+        witnessInfo.witnessSelectionPoolUnfiltered.push_back(RouletteItem(outpoint, Coin(CTxOut(nWeight * COIN, details), nBlockHeight - nAge, false, true), nWeight, nAge));
+        witnessInfo.nTotalWeight += nWeight;
+    }
+    return witnessInfo;
+}
+
+BOOST_AUTO_TEST_CASE(selection_tree_matches_prefix_sums)
+{
+    for (size_t nSize : {0, 1, 2, 7, 64, 100, 257})
+    {
+        std::vector<uint64_t> weights(nSize);
+        for (auto& weight : weights)
+            weight = InsecureRandRange(4) == 0 ? 0 : InsecureRandRange(1000);
+
+        CWitnessSelectionTree tree;
+        tree.Build(weights);
+        BOOST_REQUIRE_EQUAL(tree.Size(), nSize);
+
+        for (int nRound = 0; nRound < 50; ++nRound)
+        {
+            if (nSize > 0)
+            {
+                size_t nIndex = InsecureRandRange(nSize);
+                weights[nIndex] = InsecureRandRange(3) == 0 ? 0 : InsecureRandRange(1000);
+                tree.Update(nIndex, weights[nIndex]);
+                BOOST_CHECK_EQUAL(tree.Weight(nIndex), weights[nIndex]);
+            }
+
+            std::vector<uint64_t> cumulative;
+            uint64_t nSum = 0;
+            for (size_t i = 0; i < nSize; ++i)
+            {
+                BOOST_CHECK_EQUAL(tree.PrefixSum(i), nSum);
+                nSum += weights[i];
+                cumulative.push_back(nSum);
+            }
+            BOOST_CHECK_EQUAL(tree.Total(), nSum);
+
+            for (uint64_t nTarget = 1; nTarget <= nSum + 1; nTarget += 1 + InsecureRandRange(20))
+            {
+                size_t nExpected = std::lower_bound(cumulative.begin(), cumulative.end(), nTarget) - cumulative.begin();
+                BOOST_CHECK_EQUAL(tree.LowerBound(nTarget), nExpected);
+            }
+            BOOST_CHECK_EQUAL(tree.LowerBound(nSum + 1), nSize);
+        }
+    }
+}
+
+// GetWitnessHelper must select exactly the same witness (and report the same weights) as the original implementation, for large pools as well as for small ones that fall back to a lower minimum age.
+BOOST_AUTO_TEST_CASE(witness_selection_matches_reference)
+{
+    const uint64_t nBlockHeight = 200000;
+    for (size_t nSize : {1, 3, 6, 12, 40, 99, 100, 150, 400, 2000})
+    {
+        for (int nRound = 0; nRound < 20; ++nRound)
+        {
+            CGetWitnessInfo witnessInfo = RandomWitnessPool(nSize, nBlockHeight);
+            CGetWitnessInfo referenceInfo = witnessInfo;
+
+            // Mostly full size hashes, but also seeds that are already within the total weight, including zero.
+            uint256 blockHash = InsecureRand256();
+            if (nRound % 5 == 1)
+                blockHash = ArithToUint256(arith_uint256(InsecureRandRange(witnessInfo.nTotalWeight)));
+            else if (nRound % 5 == 2)
+                blockHash = uint256();
+
+            bool fReference = ReferenceWitnessHelper(blockHash, referenceInfo, nBlockHeight);
+            bool fResult = GetWitnessHelper(blockHash, witnessInfo, nBlockHeight);
+            BOOST_REQUIRE_EQUAL(fResult, fReference);
+            if (!fResult)
+                continue;
+
+            BOOST_CHECK(witnessInfo.selectedWitnessOutpoint == referenceInfo.selectedWitnessOutpoint);
+            BOOST_CHECK(witnessInfo.selectedWitnessTransaction == referenceInfo.selectedWitnessTransaction);
+            BOOST_CHECK_EQUAL(witnessInfo.selectedWitnessBlockHeight, referenceInfo.selectedWitnessBlockHeight);
+            BOOST_CHECK_EQUAL(witnessInfo.nMaxIndividualWeight, referenceInfo.nMaxIndividualWeight);
+            BOOST_CHECK_EQUAL(witnessInfo.nReducedTotalWeight, referenceInfo.nReducedTotalWeight);
+
+            BOOST_REQUIRE_EQUAL(witnessInfo.witnessSelectionPoolFiltered.size(), referenceInfo.witnessSelectionPoolFiltered.size());
+            for (size_t i = 0; i < witnessInfo.witnessSelectionPoolFiltered.size(); ++i)
+            {
+                BOOST_CHECK(witnessInfo.witnessSelectionPoolFiltered[i].outpoint == referenceInfo.witnessSelectionPoolFiltered[i].outpoint);
+                BOOST_CHECK_EQUAL(witnessInfo.witnessSelectionPoolFiltered[i].nWeight, referenceInfo.witnessSelectionPoolFiltered[i].nWeight);
+                BOOST_CHECK_EQUAL(witnessInfo.witnessSelectionPoolFiltered[i].nCumulativeWeight, referenceInfo.witnessSelectionPoolFiltered[i].nCumulativeWeight);
+            }
+
+            // Skipping the filtered pool must not change the outcome.
+            CGetWitnessInfo lightInfo;
+            lightInfo.witnessSelectionPoolUnfiltered = referenceInfo.witnessSelectionPoolUnfiltered;
+            lightInfo.nTotalWeight = referenceInfo.nTotalWeight;
+            BOOST_REQUIRE(GetWitnessHelper(blockHash, lightInfo, nBlockHeight, false));
+            BOOST_CHECK(lightInfo.selectedWitnessOutpoint == referenceInfo.selectedWitnessOutpoint);
+            BOOST_CHECK(lightInfo.witnessSelectionPoolFiltered.empty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
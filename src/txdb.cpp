@@ -15,11 +15,13 @@
 #include "chainparams.h"
 #include "hash.h"
 #include "pow.h"
+#include "sync.h"
 #include "uint256.h"
 
 #include <Gulden/util.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <boost/thread.hpp>
 
 #include <validation/witnessvalidation.h> //For ppow2witTip (remove in future)
@@ -34,6 +36,7 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_SNAPSHOT_BASE = 'S';
 
 static const char DB_VERSION     = '1';
 static const char DB_POW2_PHASE2 = '2';
@@ -41,6 +44,9 @@ static const char DB_POW2_PHASE3 = '3';
 static const char DB_POW2_PHASE4 = '4';
 static const char DB_POW2_PHASE5 = '5';
 
+static const char DB_NETWORK_WEIGHT = 'W';
+static const char DB_COINS_STATS = 'U';
+
 namespace {
 
 struct CoinEntry {
@@ -72,19 +78,109 @@ struct CoinEntry {
 
 }
 
+// The bytes that go into the set hash for a coin.
+static CDataStream CoinsStatsElement(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, 0);
+    //fixme: (2.1) (SEGSIG) - Implement handling of non-hash outpoints (as for CoinEntry).
+    ss << outpoint.getHash();
+    uint32_t nTemp = outpoint.n;
+    ss << VARINT(nTemp);
+    ss << coin;
+    return ss;
+}
+
+static uint64_t CoinsStatsBogoSize(const Coin& coin)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + coin.out.output.scriptPubKey.size() /* scriptPubKey */;
+}
+
+void CCoinsStatsRecord::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = CoinsStatsElement(outpoint, coin);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+    ++nTransactionOutputs;
+    nBogoSize += CoinsStatsBogoSize(coin);
+    nTotalAmount += coin.out.nValue;
+}
+
+void CCoinsStatsRecord::RemoveCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = CoinsStatsElement(outpoint, coin);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+    --nTransactionOutputs;
+    nBogoSize -= CoinsStatsBogoSize(coin);
+    nTotalAmount -= coin.out.nValue;
+}
+
 CWitViewDB::CWitViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : CCoinsViewDB(nCacheSize, fMemory, fWipe, "witstate")
 {
 }
 
+bool CWitViewDB::ReadNetworkWeight(const uint256& blockHash, CNetworkWeightRecord& record) const
+{
+    return db.Read(std::pair(DB_NETWORK_WEIGHT, blockHash), record);
+}
+
+bool CWitViewDB::WriteNetworkWeight(const uint256& blockHash, const CNetworkWeightRecord& record)
+{
+    return db.Write(std::pair(DB_NETWORK_WEIGHT, blockHash), record);
+}
+
+bool CWitViewDB::EraseNetworkWeight(const uint256& blockHash)
+{
+    return db.Erase(std::pair(DB_NETWORK_WEIGHT, blockHash));
+}
+
+bool CCoinsViewDB::ReadCoinsStats(const uint256& blockHash, CCoinsStatsRecord& record) const
+{
+    return db.Read(std::pair(DB_COINS_STATS, blockHash), record);
+}
+
+bool CCoinsViewDB::WriteCoinsStats(const uint256& blockHash, const CCoinsStatsRecord& record)
+{
+    return db.Write(std::pair(DB_COINS_STATS, blockHash), record);
+}
+
+bool CCoinsViewDB::EraseCoinsStats(const uint256& blockHash)
+{
+    return db.Erase(std::pair(DB_COINS_STATS, blockHash));
+}
+
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, std::string name) : db(GetDataDir() / name, nCacheSize, fMemory, fWipe, true)
+, fBackgroundWrites(false)
+, fPending(false)
+, fWriteFailed(false)
+, nLastWriteTime(0)
+, nTotalWriteTime(0)
 {
 }
 
+CCoinsViewDB::~CCoinsViewDB()
+{
+    WaitForBackgroundWrite();
+}
+
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (fPending) {
+        LOCK(csPending);
+        CCoinsMap::const_iterator it = mapPending.find(outpoint);
+        if (it != mapPending.end()) {
+            coin = it->second.coin;
+            return !coin.IsSpent();
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    if (fPending) {
+        LOCK(csPending);
+        CCoinsMap::const_iterator it = mapPending.find(outpoint);
+        if (it != mapPending.end())
+            return !it->second.coin.IsSpent();
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
@@ -141,6 +237,11 @@ uint256 CCoinsViewDB::GetPhase5ActivationHash()
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    if (fPending) {
+        LOCK(csPending);
+        if (fPending && !hashPending.IsNull())
+            return hashPending;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -148,6 +249,20 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (fBackgroundWrites) {
+        if (!WaitForBackgroundWrite())
+            return false;
+        {
+            LOCK(csPending);
+            mapPending.swap(mapCoins);
+            hashPending = hashBlock;
+            fPending = true;
+        }
+        LOCK(csWriteThread);
+        writeThread = std::thread(&CCoinsViewDB::ThreadBackgroundWrite, this);
+        return true;
+    }
+
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -172,6 +287,102 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+void CCoinsViewDB::ThreadBackgroundWrite()
+{
+    RenameThread("Gulden-coinswrite");
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    try {
+        // Nothing else touches mapPending until fPending is reset, readers only look entries up.
+        CDBBatch batch(db);
+        size_t changed = 0;
+        for (const auto& it : mapPending) {
+            if (it.second.flags & CCoinsCacheEntry::DIRTY) {
+                CoinEntry entry(&it.first);
+                if (it.second.coin.IsSpent())
+                    batch.Erase(entry);
+                else
+                    batch.Write(entry, it.second.coin);
+                changed++;
+            }
+        }
+        if (!hashPending.IsNull())
+            batch.Write(DB_BEST_BLOCK, hashPending);
+        fOk = WriteBackgroundBatch(batch);
+        LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database in the background...\n", (unsigned int)changed, (unsigned int)mapPending.size());
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    nLastWriteTime = GetTimeMicros() - nStart;
+    nTotalWriteTime += nLastWriteTime;
+    if (!fOk) {
+        // Keep serving the coins from memory until the node has shut down, any further BatchWrite fails.
+        fWriteFailed = true;
+        if (writeFailed)
+            writeFailed("Failed to write to coin database in the background");
+        return;
+    }
+    CCoinsMap mapWritten;
+    {
+        LOCK(csPending);
+        mapWritten.swap(mapPending);
+        fPending = false;
+    }
+}
+
+bool CCoinsViewDB::WaitForBackgroundWrite() const
+{
+    LOCK(csWriteThread);
+    if (writeThread.joinable())
+        writeThread.join();
+    return !fWriteFailed;
+}
+
+bool CCoinsViewDB::EraseAllCoins()
+{
+    if (!WaitForBackgroundWrite())
+        return false;
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COIN);
+    CDBBatch batch(db);
+    size_t batch_size = 1 << 24;
+    size_t count = 0;
+    batch.Erase(DB_BEST_BLOCK);
+    COutPoint outpoint;
+    CoinEntry entry(&outpoint);
+    while (pcursor->Valid())
+    {
+        boost::this_thread::interruption_point();
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN)
+            break;
+        batch.Erase(entry);
+        count++;
+        if (batch.SizeEstimate() > batch_size)
+        {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    LogPrint(BCLog::COINDB, "Erased %u transaction outputs from coin database...\n", (unsigned int)count);
+    return db.WriteBatch(batch);
+}
+
+bool CCoinsViewDB::WriteCoinsBulk(const std::vector<std::pair<COutPoint, Coin>>& vCoins, const uint256& hashBlock)
+{
+    if (!WaitForBackgroundWrite())
+        return false;
+
+    CDBBatch batch(db);
+    for (const auto& it : vCoins)
+        batch.Write(CoinEntry(&it.first), it.second);
+    if (!hashBlock.IsNull())
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+    return db.WriteBatch(batch);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -202,6 +413,8 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // The cursor iterates over the database only.
+    WaitForBackgroundWrite();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -277,8 +490,8 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
-    return Write(std::pair(DB_FLAG, name), fValue ? '1' : '0');
+bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue, bool fSync) {
+    return Write(std::pair(DB_FLAG, name), fValue ? '1' : '0', fSync);
 }
 
 bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
@@ -289,54 +502,144 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+namespace {
+
+//! A block index entry as read from disk, with the hashes that are expensive to compute already worked out.
+struct CDiskBlockIndexLoaded
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDiskBlockIndex diskindex;
+    uint256 hash;
+    uint256 hashLegacy;
+    bool fLegacyStored;
+};
 
-    pcursor->Seek(std::pair(DB_BLOCK_INDEX, uint256()));
+}
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHashPoW2());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                pindexNew->nVersionPoW2Witness = diskindex.nVersionPoW2Witness;
-                pindexNew->nTimePoW2Witness = diskindex.nTimePoW2Witness;
-                pindexNew->hashMerkleRootPoW2Witness = diskindex.hashMerkleRootPoW2Witness;
-                pindexNew->witnessHeaderPoW2Sig = diskindex.witnessHeaderPoW2Sig;
-
-                /** Scrypt is used for block proof-of-work, but for purposes of performance the index internally uses sha256.
-                *  This check was considered unneccessary given the other safeguards like the genesis and checkpoints. */
-                //if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    //return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+//! Number of entries a loader thread decodes before linking them into the index in one go.
+static const unsigned int BLOCK_INDEX_LOAD_BATCH = 1024;
 
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
+bool CBlockTreeDB::WriteSnapshotBase(const uint256 &hashBlock, uint64_t nChainTx) {
+    return Write(DB_SNAPSHOT_BASE, std::pair(hashBlock, nChainTx), true);
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(uint256 &hashBlock, uint64_t &nChainTx) {
+    std::pair<uint256, uint64_t> base;
+    if (!Read(DB_SNAPSHOT_BASE, base))
+        return false;
+    hashBlock = base.first;
+    nChainTx = base.second;
+    return true;
+}
+
+bool CBlockTreeDB::EraseSnapshotBase() {
+    return Erase(DB_SNAPSHOT_BASE, true);
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex, std::function<void(CBlockIndex*, const uint256&, bool fStored)> insertBlockIndexLegacy, int nThreads)
+{
+    // Block hashes are uniformly distributed, so splitting the key space on the first byte of the hash gives every thread a similar share.
+    // Decoding and hashing the entries happens on the threads themselves, linking them into the index (insertBlockIndex etc.) is serialised.
+    nThreads = std::max(1, std::min(nThreads, 256));
+    CCriticalSection csLink;
+    std::atomic<bool> fFailed(false);
+    std::atomic<bool> fInterrupted(false);
+
+    auto linkBatch = [&](std::vector<CDiskBlockIndexLoaded>& vBatch)
+    {
+        LOCK(csLink);
+        for (const auto& loaded : vBatch)
+        {
+            const CDiskBlockIndex& diskindex = loaded.diskindex;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(loaded.hash);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+            pindexNew->nVersionPoW2Witness = diskindex.nVersionPoW2Witness;
+            pindexNew->nTimePoW2Witness = diskindex.nTimePoW2Witness;
+            pindexNew->hashMerkleRootPoW2Witness = diskindex.hashMerkleRootPoW2Witness;
+            pindexNew->witnessHeaderPoW2Sig = diskindex.witnessHeaderPoW2Sig;
+            if (pindexNew->nVersionPoW2Witness != 0)
+                insertBlockIndexLegacy(pindexNew, loaded.hashLegacy, loaded.fLegacyStored);
+
+            /** Scrypt is used for block proof-of-work, but for purposes of performance the index internally uses sha256.
+            *  This check was considered unneccessary given the other safeguards like the genesis and checkpoints. */
+            //if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
+                //return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+        }
+        vBatch.clear();
+    };
+
+    auto loadRange = [&](int nRange)
+    {
+        uint256 hashStart;
+        *hashStart.begin() = (unsigned char)(nRange * 256 / nThreads);
+        int nEnd = (nRange + 1) * 256 / nThreads;
+
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(std::pair(DB_BLOCK_INDEX, hashStart));
+
+        std::vector<CDiskBlockIndexLoaded> vBatch;
+        vBatch.reserve(BLOCK_INDEX_LOAD_BATCH);
+        while (pcursor->Valid() && !fFailed && !fInterrupted)
+        {
+            if (nRange == 0)
+                boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
+                break;
+
+            vBatch.emplace_back();
+            CDiskBlockIndexLoaded& loaded = vBatch.back();
+            if (!pcursor->GetValue(loaded.diskindex))
+            {
+                fFailed = true;
+                error("LoadBlockIndex() : failed to read value");
+                return;
             }
-        } else {
-            break;
+            loaded.hash = loaded.diskindex.GetBlockHashPoW2();
+            loaded.fLegacyStored = !loaded.diskindex.hashLegacy.IsNull();
+            if (loaded.diskindex.nVersionPoW2Witness != 0)
+                loaded.hashLegacy = loaded.diskindex.GetBlockHashLegacy();
+
+            if (vBatch.size() >= BLOCK_INDEX_LOAD_BATCH)
+                linkBatch(vBatch);
+            pcursor->Next();
         }
+        if (!fFailed && !fInterrupted)
+            linkBatch(vBatch);
+    };
+
+    // The calling thread takes the first range itself, and is the one that notices a shutdown request.
+    boost::thread_group loaderThreads;
+    for (int nRange = 1; nRange < nThreads; ++nRange)
+        loaderThreads.create_thread([&, nRange]() { loadRange(nRange); });
+    try
+    {
+        loadRange(0);
+        loaderThreads.join_all();
+    }
+    catch (...)
+    {
+        // The other threads use state from this frame, so they have to be finished before the exception can leave it.
+        fInterrupted = true;
+        boost::this_thread::disable_interruption disableInterruption;
+        loaderThreads.join_all();
+        throw;
     }
 
-    return true;
+    return !fFailed;
 }
 
 namespace {
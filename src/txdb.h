@@ -13,12 +13,18 @@
 #ifndef GULDEN_TXDB_H
 #define GULDEN_TXDB_H
 
+#include "amount.h"
 #include "coins.h"
+#include "crypto/muhash.h"
 #include "dbwrapper.h"
 #include "chain.h"
+#include "sync.h"
 
+#include <atomic>
+#include <functional>
 #include <map>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -71,6 +77,33 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** Statistics of the unspent outputs in a coin database at a block, as kept per block in that database. */
+class CCoinsStatsRecord
+{
+public:
+    uint64_t nTransactionOutputs;
+    //! A meaningless metric for the size of the set (as reported by gettxoutsetinfo).
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+    //! Order independent hash of the serialized outpoints and coins.
+    MuHash3072 muhash;
+
+    CCoinsStatsRecord() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void RemoveCoin(const COutPoint& outpoint, const Coin& coin);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
@@ -78,6 +111,7 @@ protected:
     CDBWrapper db;
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, std::string name="chainstate");
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -85,6 +119,19 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * Let BatchWrite hand the coins to a background thread and return right away. Until they are on disk the coins
+     * are served from memory by GetCoin, HaveCoin and GetBestBlock. Each write is still a single batch, so the
+     * database is never partially updated, and a new write first waits for the previous one.
+     */
+    void SetBackgroundWrites(bool fBackgroundWritesIn) { fBackgroundWrites = fBackgroundWritesIn; }
+    //! Called from the background write thread, with an error message, as soon as a background write fails.
+    void SetWriteFailedHandler(std::function<void(const std::string&)> writeFailedIn) { writeFailed = writeFailedIn; }
+    //! Wait until the background write (if any) is on disk. Returns false if a background write failed.
+    bool WaitForBackgroundWrite() const;
+    //! Duration in microseconds of the most recent background write, and of all of them together.
+    void GetBackgroundWriteTimes(int64_t& nLast, int64_t& nTotal) const { nLast = nLastWriteTime; nTotal = nTotalWriteTime; }
+
     //fixme: (2.1) We can remove these for 2.1
     void SetPhase2ActivationHash(const uint256 &hashPhase2ActivationPoint);
     uint256 GetPhase2ActivationHash();
@@ -95,6 +142,16 @@ public:
     void SetPhase5ActivationHash(const uint256 &hashPhase5ActivationPoint);
     uint256 GetPhase5ActivationHash();
 
+    //! Unspent output statistics, one record per connected block of the active chain (keyed by block hash, like the network weight ledger).
+    bool ReadCoinsStats(const uint256& blockHash, CCoinsStatsRecord& record) const;
+    bool WriteCoinsStats(const uint256& blockHash, const CCoinsStatsRecord& record);
+    bool EraseCoinsStats(const uint256& blockHash);
+
+    //! For loading a UTXO snapshot: remove every coin and the best block, after which WriteCoinsBulk fills the database again.
+    bool EraseAllCoins();
+    //! Write coins that are not in the database yet in a single batch, and the best block if it is not null. Writing them in database key order (as a cursor returns them) keeps LevelDB compactions cheap.
+    bool WriteCoinsBulk(const std::vector<std::pair<COutPoint, Coin>>& vCoins, const uint256& hashBlock);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
@@ -102,6 +159,28 @@ public:
     uint32_t nCurrentVersion;
     uint32_t nPreviousVersion;
 
+protected:
+    //! Write the batch of a background write to the database; the tests override this to hold up or fail a write.
+    virtual bool WriteBackgroundBatch(CDBBatch& batch) { return db.WriteBatch(batch); }
+
+private:
+    void ThreadBackgroundWrite();
+
+    bool fBackgroundWrites;
+    //! The coins of the background write, until they are on disk.
+    mutable CCriticalSection csPending;
+    CCoinsMap mapPending;
+    uint256 hashPending;
+    std::atomic<bool> fPending;
+    mutable CCriticalSection csWriteThread;
+    mutable std::thread writeThread;
+    std::atomic<bool> fWriteFailed;
+    std::function<void(const std::string&)> writeFailed;
+    std::atomic<int64_t> nLastWriteTime;
+    std::atomic<int64_t> nTotalWriteTime;
+
+public:
+
     /*int GetDepth() const override
     {
         return 0;
@@ -131,11 +210,41 @@ public:
     }
 };
 
+/** Number of witness addresses and their total raw weight at a block, as kept per block in the witness database. */
+class CNetworkWeightRecord
+{
+public:
+    //! Totals over all unspent witness coins once the entire block is connected; the record of the next block builds on these.
+    int64_t nNumWitnessAddresses;
+    int64_t nTotalWeight;
+    //! Totals as GetPow2NetworkWeight reports them for the block.
+    //! Only differ from the above for witnessed phase 3 blocks, for which only the PoW part of the block counts.
+    int64_t nReportedNumWitnessAddresses;
+    int64_t nReportedTotalWeight;
+
+    CNetworkWeightRecord() : nNumWitnessAddresses(0), nTotalWeight(0), nReportedNumWitnessAddresses(0), nReportedTotalWeight(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nNumWitnessAddresses);
+        READWRITE(nTotalWeight);
+        READWRITE(nReportedNumWitnessAddresses);
+        READWRITE(nReportedTotalWeight);
+    }
+};
+
 /** CWitViewDB backed by the witness database (witstate/) */
 class CWitViewDB : public CCoinsViewDB
 {
 public:
     CWitViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    //! Network weight ledger, one record per connected block of the active chain (keyed by block hash, so a record stays valid for its block regardless of reorganisations).
+    bool ReadNetworkWeight(const uint256& blockHash, CNetworkWeightRecord& record) const;
+    bool WriteNetworkWeight(const uint256& blockHash, const CNetworkWeightRecord& record);
+    bool EraseNetworkWeight(const uint256& blockHash);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -176,9 +285,15 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
-    bool WriteFlag(const std::string &name, bool fValue);
+    bool WriteFlag(const std::string &name, bool fValue, bool fSync = false);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! The block a UTXO snapshot was loaded at, and the number of transactions up to and including it (the blocks below it are not known).
+    bool WriteSnapshotBase(const uint256 &hashBlock, uint64_t nChainTx);
+    bool ReadSnapshotBase(uint256 &hashBlock, uint64_t &nChainTx);
+    bool EraseSnapshotBase();
+    //! insertBlockIndexLegacy is called with the legacy hash of every witnessed block, fStored is false if it had to be computed because the entry predates it.
+    //! Entries are read on nThreads threads; the callbacks are never called concurrently.
+    bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex, std::function<void(CBlockIndex*, const uint256&, bool fStored)> insertBlockIndexLegacy, int nThreads = 1);
 };
 
 #endif // GULDEN_TXDB_H
@@ -0,0 +1,442 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/utxosnapshot.h"
+
+#include "validation/validation.h"
+#include "validation/witnessvalidation.h"
+#include <consensus/validation.h>
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "tinyformat.h"
+#include "ui_interface.h"
+#include "unity/appmanager.h"
+#include "util.h"
+
+#include <string.h>
+#include <memory>
+#include <vector>
+
+static const unsigned char SNAPSHOT_MAGIC[4] = { 'u', 't', 'x', 'o' };
+
+//! Number of coins that are written to a coin database in a single batch while loading a snapshot.
+static const size_t SNAPSHOT_LOAD_BATCH_COINS = 200000;
+
+CUTXOSnapshotMetadata::CUTXOSnapshotMetadata()
+: nVersion(CURRENT_VERSION)
+, hashBlock()
+, nHeight(0)
+, nChainTx(0)
+{
+    memcpy(pchMagic, SNAPSHOT_MAGIC, sizeof(pchMagic));
+    memset(pchMessageStart, 0, sizeof(pchMessageStart));
+}
+
+/** Writes data to an underlying stream, while hashing the written data (the counterpart of CHashVerifier). */
+template<typename Target>
+class CHashedWriter : public CHashWriter
+{
+private:
+    Target* target;
+
+public:
+    CHashedWriter(Target* target_) : CHashWriter(target_->GetType(), target_->GetVersion()), target(target_) {}
+
+    void write(const char* pch, size_t nSize)
+    {
+        target->write(pch, nSize);
+        CHashWriter::write(pch, nSize);
+    }
+
+    template<typename T>
+    CHashedWriter<Target>& operator<<(const T& obj)
+    {
+        // Serialize to this stream
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+};
+
+template<typename Stream>
+static void WriteSnapshotCoinGroup(Stream& s, const uint256& txid, std::vector<std::pair<uint32_t, Coin>>& vGroup)
+{
+    uint64_t nGroupSize = vGroup.size();
+    s << VARINT(nGroupSize);
+    s << txid;
+    for (auto& item : vGroup)
+    {
+        s << VARINT(item.first);
+        s << item.second;
+    }
+    vGroup.clear();
+}
+
+// Write the coins of a database cursor, grouped by transaction (the cursor returns them in database key order, so those of a transaction are adjacent).
+template<typename Stream>
+static void WriteSnapshotCoins(Stream& s, CCoinsViewCursor* pcursor, uint64_t& nCoins)
+{
+    uint256 txid;
+    std::vector<std::pair<uint32_t, Coin>> vGroup;
+    while (pcursor->Valid())
+    {
+        if (ShutdownRequested())
+            throw std::runtime_error("shutdown requested");
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin))
+            throw std::runtime_error("unable to read from coin database");
+        if (!vGroup.empty() && outpoint.getHash() != txid)
+            WriteSnapshotCoinGroup(s, txid, vGroup);
+        txid = outpoint.getHash();
+        vGroup.emplace_back((uint32_t)outpoint.n, std::move(coin));
+        ++nCoins;
+        pcursor->Next();
+    }
+    if (!vGroup.empty())
+        WriteSnapshotCoinGroup(s, txid, vGroup);
+    uint64_t nEnd = 0;
+    s << VARINT(nEnd);
+}
+
+// Read the coins of one database from a snapshot and write them to it in batches; they are in database key order already.
+// The order is checked as well, so that no coin can be in the snapshot twice and the statistics add up.
+template<typename Stream>
+static void LoadSnapshotCoins(Stream& s, CCoinsViewDB* pdb, CCoinsStatsRecord& record, uint64_t& nCoins)
+{
+    std::vector<std::pair<COutPoint, Coin>> vBatch;
+    vBatch.reserve(SNAPSHOT_LOAD_BATCH_COINS);
+    uint256 txidPrev;
+    while (true)
+    {
+        if (ShutdownRequested())
+            throw std::runtime_error("shutdown requested");
+        uint64_t nGroupSize;
+        s >> VARINT(nGroupSize);
+        if (nGroupSize == 0)
+            break;
+        uint256 txid;
+        s >> txid;
+        if (nCoins > 0 && !(txidPrev < txid))
+            throw std::runtime_error("coins are not in database order");
+        txidPrev = txid;
+        for (uint64_t i = 0; i < nGroupSize; ++i)
+        {
+            uint32_t n;
+            Coin coin;
+            s >> VARINT(n);
+            s >> coin;
+            if (n > UINT31_MAX)
+                throw std::runtime_error("output index out of range");
+            if (i > 0 && n <= vBatch.back().first.n)
+                throw std::runtime_error("coins are not in database order");
+            COutPoint outpoint(txid, n);
+            record.AddCoin(outpoint, coin);
+            vBatch.emplace_back(outpoint, std::move(coin));
+            ++nCoins;
+        }
+        if (vBatch.size() >= SNAPSHOT_LOAD_BATCH_COINS)
+        {
+            if (!pdb->WriteCoinsBulk(vBatch, uint256()))
+                throw std::runtime_error("unable to write to coin database");
+            vBatch.clear();
+            LogPrint(BCLog::COINDB, "Loaded %u coins from UTXO snapshot...\n", nCoins);
+        }
+    }
+    if (!vBatch.empty() && !pdb->WriteCoinsBulk(vBatch, uint256()))
+        throw std::runtime_error("unable to write to coin database");
+}
+
+// Once the coin databases are being replaced they no longer match the active chain, so a failure stops the node; the next start rebuilds the chainstate.
+static bool AbortSnapshotLoad(const std::string& strError)
+{
+    LogPrintf("*** %s\n", strError);
+    uiInterface.ThreadSafeMessageBox(_("Loading the UTXO snapshot failed, the chainstate will be rebuilt at the next start."), "", CClientUIInterface::MSG_ERROR);
+    GuldenAppManager::gApp->shutdown();
+    return false;
+}
+
+bool DumpUTXOSnapshot(const fs::path& path, CUTXOSnapshotStats& stats, std::string& strError)
+{
+    const CChainParams& chainparams = Params();
+    int64_t nStart = GetTimeMillis();
+
+    CUTXOSnapshotMetadata& metadata = stats.metadata;
+    CBlock block;
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::unique_ptr<CCoinsViewCursor> pwitcursor;
+    {
+        LOCK(cs_main);
+        // The cursors only see what is in the databases.
+        CValidationState state;
+        if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS))
+        {
+            strError = "Unable to flush the chainstate: " + FormatStateMessage(state);
+            return false;
+        }
+        CBlockIndex* pindex = chainActive.Tip();
+        if (!pindex || pcoinsdbview->GetBestBlock() != pindex->GetBlockHashPoW2() || ppow2witdbview->GetBestBlock() != pindex->GetBlockHashPoW2())
+        {
+            strError = "The coin databases are not at the tip of the active chain";
+            return false;
+        }
+        if (!ReadBlockFromDisk(block, pindex, chainparams))
+        {
+            strError = "Unable to read the tip block from disk";
+            return false;
+        }
+        memcpy(metadata.pchMessageStart, chainparams.MessageStart(), sizeof(metadata.pchMessageStart));
+        metadata.hashBlock = pindex->GetBlockHashPoW2();
+        metadata.nHeight = pindex->nHeight;
+        metadata.nChainTx = pindex->nChainTx;
+        metadata.hashPhase2Activation = ppow2witdbview->GetPhase2ActivationHash();
+        metadata.hashPhase3Activation = ppow2witdbview->GetPhase3ActivationHash();
+        metadata.hashPhase4Activation = ppow2witdbview->GetPhase4ActivationHash();
+        metadata.hashPhase5Activation = ppow2witdbview->GetPhase5ActivationHash();
+        // A database iterator reads from a snapshot of the database taken when it is created, so the node can go on while the file is written.
+        pcursor.reset(pcoinsdbview->Cursor());
+        pwitcursor.reset(ppow2witdbview->Cursor());
+    }
+
+    fs::path pathIncomplete = path;
+    pathIncomplete += ".incomplete";
+    try
+    {
+        FILE* filestr = fsbridge::fopen(pathIncomplete, "wb");
+        if (!filestr)
+        {
+            strError = strprintf("Unable to open %s for writing", pathIncomplete.string());
+            return false;
+        }
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashedWriter<CAutoFile> writer(&file);
+        writer << metadata;
+        writer << block;
+        WriteSnapshotCoins(writer, pcursor.get(), stats.nCoins);
+        WriteSnapshotCoins(writer, pwitcursor.get(), stats.nWitnessCoins);
+        stats.hashContent = writer.GetHash();
+        file << stats.hashContent;
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathIncomplete, path))
+        {
+            strError = strprintf("Unable to rename %s to %s", pathIncomplete.string(), path.string());
+            return false;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        fs::remove(pathIncomplete);
+        strError = strprintf("Unable to write UTXO snapshot: %s", e.what());
+        return false;
+    }
+
+    LogPrintf("Dumped UTXO snapshot at height %d (%u coins, %u witness coins) to %s in %dms\n", metadata.nHeight, stats.nCoins, stats.nWitnessCoins, path.string(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool ReadUTXOSnapshotMetadata(const fs::path& path, CUTXOSnapshotMetadata& metadata, std::string& strError)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+    {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+    try
+    {
+        file >> metadata;
+    }
+    catch (const std::exception& e)
+    {
+        strError = strprintf("Unable to read UTXO snapshot header: %s", e.what());
+        return false;
+    }
+    if (memcmp(metadata.pchMagic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+    {
+        strError = "Not a UTXO snapshot file";
+        return false;
+    }
+    if (metadata.nVersion != CUTXOSnapshotMetadata::CURRENT_VERSION)
+    {
+        strError = strprintf("Unsupported UTXO snapshot version %u", metadata.nVersion);
+        return false;
+    }
+    if (memcmp(metadata.pchMessageStart, Params().MessageStart(), sizeof(metadata.pchMessageStart)) != 0)
+    {
+        strError = "The UTXO snapshot is for a different network";
+        return false;
+    }
+    return true;
+}
+
+// Compute the double SHA256 of everything but the trailing hash, and compare it with that.
+static bool VerifyUTXOSnapshotContent(const fs::path& path, uint256& hashContent, std::string& strError)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+    {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+    try
+    {
+        uint64_t nRemaining = fs::file_size(path);
+        if (nRemaining < sizeof(uint256))
+            throw std::runtime_error("file too short");
+        nRemaining -= sizeof(uint256);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        std::vector<char> buffer(1 << 20);
+        while (nRemaining > 0)
+        {
+            if (ShutdownRequested())
+                throw std::runtime_error("shutdown requested");
+            size_t nRead = std::min<uint64_t>(nRemaining, buffer.size());
+            file.read(buffer.data(), nRead);
+            hasher.write(buffer.data(), nRead);
+            nRemaining -= nRead;
+        }
+        uint256 hashStored;
+        file >> hashStored;
+        hashContent = hasher.GetHash();
+        if (hashContent != hashStored)
+        {
+            strError = "The UTXO snapshot is damaged (content hash mismatch)";
+            return false;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        strError = strprintf("Unable to read UTXO snapshot: %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadUTXOSnapshot(const fs::path& path, CUTXOSnapshotStats& stats, std::string& strError)
+{
+    const CChainParams& chainparams = Params();
+    int64_t nStart = GetTimeMillis();
+
+    CUTXOSnapshotMetadata& metadata = stats.metadata;
+    if (!ReadUTXOSnapshotMetadata(path, metadata, strError))
+        return false;
+    // Nothing is touched before the whole file is known to be intact; reading it once more costs little next to writing the databases.
+    if (!VerifyUTXOSnapshotContent(path, stats.hashContent, strError))
+        return false;
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    CBlock block;
+    try
+    {
+        file >> metadata;
+        file >> block;
+    }
+    catch (const std::exception& e)
+    {
+        strError = strprintf("Unable to read UTXO snapshot block: %s", e.what());
+        return false;
+    }
+
+    CBlockIndex* pindex = nullptr;
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(metadata.hashBlock);
+        if (it == mapBlockIndex.end())
+        {
+            strError = strprintf("The header of snapshot block %s is not known yet, the headers have to be synced up to it first", metadata.hashBlock.ToString());
+            return false;
+        }
+        pindex = it->second;
+        if (pindex->nHeight != metadata.nHeight || block.GetHashPoW2() != metadata.hashBlock)
+        {
+            strError = "The UTXO snapshot does not match its block";
+            return false;
+        }
+        if (pindex->nStatus & BLOCK_FAILED_MASK)
+        {
+            strError = "The snapshot block is marked invalid";
+            return false;
+        }
+        if (fSnapshotLoading)
+        {
+            strError = "Another UTXO snapshot is being loaded";
+            return false;
+        }
+        if (chainActive.Height() >= pindex->nHeight || pindex->GetAncestor(chainActive.Height()) != chainActive.Tip())
+        {
+            strError = "The snapshot block is not ahead of the tip of the active chain";
+            return false;
+        }
+        if (!CheckBlock(block, state, chainparams.GetConsensus()))
+        {
+            strError = "The snapshot block is invalid: " + FormatStateMessage(state);
+            return false;
+        }
+
+        // From here on the coin databases are being replaced; should the node stop before the end, they are rebuilt at the next start.
+        // So the flag that says so has to be on disk before anything is erased.
+        if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS) || !pcoinsTip->Flush())
+        {
+            strError = "Unable to flush the chainstate";
+            return false;
+        }
+        if (!pblocktree->WriteFlag("snapshotloading", true, true))
+        {
+            strError = "Unable to write to the block index database";
+            return false;
+        }
+        // The chain stays where it is until the snapshot is in place, cs_main is not held for the (long) writes below.
+        fSnapshotLoading = true;
+    }
+
+    LogPrintf("Loading UTXO snapshot at height %d from %s...\n", metadata.nHeight, path.string());
+    try
+    {
+        if (!pcoinsdbview->EraseAllCoins() || !ppow2witdbview->EraseAllCoins())
+            throw std::runtime_error("unable to erase the coin databases");
+        LoadSnapshotCoins(file, pcoinsdbview, stats.record, stats.nCoins);
+        LoadSnapshotCoins(file, ppow2witdbview, stats.witnessRecord, stats.nWitnessCoins);
+
+        ppow2witdbview->SetPhase2ActivationHash(metadata.hashPhase2Activation);
+        ppow2witdbview->SetPhase3ActivationHash(metadata.hashPhase3Activation);
+        ppow2witdbview->SetPhase4ActivationHash(metadata.hashPhase4Activation);
+        ppow2witdbview->SetPhase5ActivationHash(metadata.hashPhase5Activation);
+        pcoinsdbview->WriteCoinsStats(metadata.hashBlock, stats.record);
+        ppow2witdbview->WriteCoinsStats(metadata.hashBlock, stats.witnessRecord);
+        if (!pcoinsdbview->WriteCoinsBulk({}, metadata.hashBlock) || !ppow2witdbview->WriteCoinsBulk({}, metadata.hashBlock))
+            throw std::runtime_error("unable to write to coin database");
+    }
+    catch (const std::exception& e)
+    {
+        // fSnapshotLoading stays set, nothing may write the half loaded databases before the node is down.
+        strError = strprintf("Loading the UTXO snapshot failed: %s", e.what());
+        return AbortSnapshotLoad(strError);
+    }
+
+    {
+        LOCK(cs_main);
+        // Coins that were looked up meanwhile (by the mempool for instance) may have come from the old databases.
+        pcoinsTip->EvictUnused(0);
+        ppow2witTip->EvictUnused(0);
+        fSnapshotLoading = false;
+        if (!ActivateSnapshotBase(block, pindex, metadata.nChainTx, chainparams, state))
+        {
+            strError = "Unable to activate the snapshot block: " + FormatStateMessage(state);
+            return AbortSnapshotLoad(strError);
+        }
+        pblocktree->WriteFlag("snapshotloading", false, true);
+    }
+
+    // Connect whatever blocks arrived while the snapshot was loading.
+    if (!ActivateBestChain(state, chainparams))
+        LogPrintf("%s: failed to activate the best chain after loading the UTXO snapshot: %s\n", __func__, FormatStateMessage(state));
+
+    LogPrintf("Loaded UTXO snapshot at height %d (%u coins, %u witness coins) in %dms\n", metadata.nHeight, stats.nCoins, stats.nWitnessCoins, GetTimeMillis() - nStart);
+    return true;
+}
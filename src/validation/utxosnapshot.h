@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_UTXO_SNAPSHOT_H
+#define GULDEN_UTXO_SNAPSHOT_H
+
+#include "fs.h"
+#include "protocol.h"
+#include "serialize.h"
+#include "txdb.h"
+#include "uint256.h"
+
+#include <string>
+
+/**
+ * Header of a UTXO snapshot file, which lets a node start validating from a trusted block instead of from genesis.
+ *
+ * After the header the file holds the snapshot block itself, then the coins of the chainstate and then those of the witness database
+ * (each in database key order, grouped by transaction: VARINT number of coins, txid, and VARINT output index and coin for each of them;
+ * a group of zero coins ends the list), and finally the double SHA256 of everything before it.
+ */
+class CUTXOSnapshotMetadata
+{
+public:
+    static const uint32_t CURRENT_VERSION = 1;
+
+    unsigned char pchMagic[4];
+    uint32_t nVersion;
+    CMessageHeader::MessageStartChars pchMessageStart;
+    uint256 hashBlock;
+    int32_t nHeight;
+    //! Number of transactions in the chain up to and including the snapshot block.
+    uint64_t nChainTx;
+    //! The PoW² phase activation blocks as recorded in the witness database.
+    uint256 hashPhase2Activation;
+    uint256 hashPhase3Activation;
+    uint256 hashPhase4Activation;
+    uint256 hashPhase5Activation;
+
+    CUTXOSnapshotMetadata();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(FLATDATA(pchMagic));
+        READWRITE(nVersion);
+        READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nChainTx);
+        READWRITE(hashPhase2Activation);
+        READWRITE(hashPhase3Activation);
+        READWRITE(hashPhase4Activation);
+        READWRITE(hashPhase5Activation);
+    }
+};
+
+/** What was written to or loaded from a UTXO snapshot file. */
+class CUTXOSnapshotStats
+{
+public:
+    CUTXOSnapshotMetadata metadata;
+    uint64_t nCoins;
+    uint64_t nWitnessCoins;
+    //! The double SHA256 at the end of the file.
+    uint256 hashContent;
+    //! Statistics of the loaded coins, as gettxoutsetinfo reports them for the snapshot block (only filled in when loading).
+    CCoinsStatsRecord record;
+    CCoinsStatsRecord witnessRecord;
+
+    CUTXOSnapshotStats() : nCoins(0), nWitnessCoins(0) {}
+};
+
+/** Write the coins of the chainstate and witness databases at the tip of the active chain to a snapshot file. */
+bool DumpUTXOSnapshot(const fs::path& path, CUTXOSnapshotStats& stats, std::string& strError);
+
+/** Read and check the header of a snapshot file (magic, version and network). */
+bool ReadUTXOSnapshotMetadata(const fs::path& path, CUTXOSnapshotMetadata& metadata, std::string& strError);
+
+/**
+ * Replace the coin databases with the coins of a snapshot file, and make the snapshot block the tip of the active chain.
+ * The header of the snapshot block has to be known and the tip of the active chain has to be one of its ancestors.
+ * The content hash of the file is verified before anything is changed. cs_main is not held while the coins are written, fSnapshotLoading
+ * keeps the chain from moving meanwhile.
+ */
+bool LoadUTXOSnapshot(const fs::path& path, CUTXOSnapshotStats& stats, std::string& strError);
+
+#endif // GULDEN_UTXO_SNAPSHOT_H
@@ -12,9 +12,11 @@
 
 #include "validation/validation.h"
 #include "validation/witnessvalidation.h"
+#include "validation/witnesspool.h"
 
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockcache.h"
 #include "blockstore.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -75,11 +77,17 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+BlockLegacyMap mapBlockIndexLegacy;
+CBlockIndexArena blockIndexArena;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
+CBlockIndex *pindexSnapshotBase = NULL;
+int nSnapshotPendingHeight = -1;
+std::atomic<bool> fSnapshotLoading(false);
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nPoWCheckThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fReverseHeaders = false;
@@ -91,6 +99,8 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+bool fIncrementalFlush = DEFAULT_INCREMENTAL_FLUSH;
+size_t nCoinsFlushBatch = DEFAULT_COINS_FLUSH_BATCH * 1000;
 uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -166,6 +176,13 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
                 return chain.Tip();
             }
         }
+        // Locators hold the legacy hash of witnessed blocks, under which mapBlockIndex only knows the (off chain) PoW block.
+        auto range = mapBlockIndexLegacy.equal_range(hash);
+        for (auto iter = range.first; iter != range.second; ++iter)
+        {
+            if (chain.Contains(iter->second))
+                return iter->second;
+        }
     }
     return chain.Genesis();
 }
@@ -302,8 +319,30 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
 // CBlock and CBlockIndex
 //
 
+std::shared_ptr<const CBlock> ReadBlockFromDiskCached(const CBlockIndex* pindex, const CChainParams& params)
+{
+    const uint256 hashBlock = pindex->GetBlockHashPoW2();
+    std::shared_ptr<const CBlock> pblock = blockCache.Get(hashBlock);
+    if (!pblock)
+    {
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!blockStore.ReadBlockFromDisk(*pblockRead, pindex->GetBlockPos(), params, pindex))
+            return nullptr;
+        pblock = pblockRead;
+        blockCache.Insert(hashBlock, pblock);
+    }
+    return pblock;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const CChainParams& params)
 {
+    // Copying a cached block is still cheaper than reading and decoding it, but a block read here is not cached: most of these
+    // reads (connecting blocks during initial sync, VerifyDB, rescans) are one-off and would only churn the cache.
+    if (std::shared_ptr<const CBlock> pblock = blockCache.Get(pindex->GetBlockHashPoW2()))
+    {
+        block = *pblock;
+        return true;
+    }
     return blockStore.ReadBlockFromDisk(block, pindex->GetBlockPos(), params, pindex);
 }
 
@@ -402,6 +441,28 @@ void static InvalidChainFound(CBlockIndex* pindexNew)
     CheckForkWarningConditions();
 }
 
+void MarkBlockIndexStatus(const CBlockIndex* pindex, uint32_t nFlags)
+{
+    AssertLockHeld(cs_main);
+    if ((pindex->nStatus & nFlags) == nFlags)
+        return;
+    // Temporary chains (CCloneChain) read blocks through copies of the index entries, those must never end up in setDirtyBlockIndex.
+    if (!pindex->phashBlock)
+        return;
+    BlockMap::iterator mi = mapBlockIndex.find(*pindex->phashBlock);
+    if (mi == mapBlockIndex.end() || mi->second != pindex)
+        return;
+    // Only status bits are changed, the index entry itself is otherwise left untouched.
+    CBlockIndex* pindexMutable = const_cast<CBlockIndex*>(pindex);
+    pindexMutable->nStatus |= nFlags;
+    setDirtyBlockIndex.insert(pindexMutable);
+}
+
+void MarkBlockIndexPoWVerified(const CBlockIndex* pindex)
+{
+    MarkBlockIndexStatus(pindex, BLOCK_POW_VERIFIED);
+}
+
 void static InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state) {
     if (!state.CorruptionPossible()) {
         LOCK(cs_main);
@@ -617,10 +678,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
     return true;
 }
 
-namespace {
-
-/** Abort with a message */
-bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
+bool AbortNode(const std::string& strMessage, const std::string& userMessage)
 {
     SetMiscWarning(strMessage);
     LogPrintf("*** %s\n", strMessage);
@@ -629,9 +687,11 @@ bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
     return false;
 }
 
+namespace {
+
 bool AbortNode(CValidationState& state, const std::string& strMessage, const std::string& userMessage="")
 {
-    AbortNode(strMessage, userMessage);
+    ::AbortNode(strMessage, userMessage);
     return state.Error(strMessage);
 }
 
@@ -784,6 +844,173 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CPoWCheck> powcheckqueue(4);
+
+void ThreadPoWCheck() {
+    RenameThread("Gulden-powcheck");
+    powcheckqueue.Thread();
+}
+
+static CCheckQueue<CCoinsPrefetchCheck> coinsprefetchqueue(16);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("Gulden-prefetch");
+    coinsprefetchqueue.Thread();
+}
+
+static std::atomic<uint64_t> nPrefetchBlocks(0);
+static std::atomic<uint64_t> nPrefetchInputs(0);
+static std::atomic<uint64_t> nPrefetchCached(0);
+static std::atomic<uint64_t> nPrefetchInBlock(0);
+static std::atomic<uint64_t> nPrefetchHits(0);
+static std::atomic<uint64_t> nPrefetchWitnessHits(0);
+static std::atomic<uint64_t> nPrefetchMisses(0);
+
+void GetCoinsPrefetchStats(CCoinsPrefetchStats& stats)
+{
+    stats.nBlocks = nPrefetchBlocks;
+    stats.nInputs = nPrefetchInputs;
+    stats.nCached = nPrefetchCached;
+    stats.nInBlock = nPrefetchInBlock;
+    stats.nHits = nPrefetchHits;
+    stats.nWitnessHits = nPrefetchWitnessHits;
+    stats.nMisses = nPrefetchMisses;
+}
+
+bool CCoinsPrefetchCheck::operator()()
+{
+    try
+    {
+        if (pEntry->fReadCoin)
+            pEntry->fCoinFound = pCoinsDB->GetCoin(pEntry->outpoint, pEntry->coin) && !pEntry->coin.IsSpent();
+        // A coin that is in the tip cache was only queued for the witness state if it is a witness output.
+        if (pEntry->fReadWitnessCoin && pWitnessDB && (!pEntry->fReadCoin || (pEntry->fCoinFound && IsPow2WitnessOutput(pEntry->coin.out))))
+            pEntry->fWitnessCoinFound = pWitnessDB->GetCoin(pEntry->outpoint, pEntry->witnessCoin) && !pEntry->witnessCoin.IsSpent();
+    }
+    catch (const std::exception&)
+    {
+        // Leave it to the serial path, which reads through the error catcher.
+        pEntry->fCoinFound = pEntry->fWitnessCoinFound = false;
+    }
+    return true;
+}
+
+void PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& view)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads || !pcoinsdbview)
+        return;
+
+    const CCoinsViewCache* pWitnessTip = view.pChainedWitView ? pcoinsTip->pChainedWitView.get() : nullptr;
+    const CCoinsView* pWitnessDB = pWitnessTip ? ppow2witdbview : nullptr;
+
+    std::set<uint256> setBlockTxids;
+    for (const auto& tx : block.vtx)
+        setBlockTxids.insert(tx->GetHash());
+
+    uint64_t nInputs = 0, nCached = 0, nInBlock = 0, nHits = 0, nWitnessHits = 0, nMisses = 0;
+    std::vector<CCoinsPrefetchEntry> vEntries;
+    for (const auto& tx : block.vtx)
+    {
+        // The plain coinbase has nothing to read, the witness coinbase spends the witness output.
+        if (tx->IsCoinBase() && !tx->IsPoW2WitnessCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin)
+        {
+            if (txin.prevout.IsNull())
+                continue;
+            ++nInputs;
+            if (txin.prevout.isHash && setBlockTxids.count(txin.prevout.getHash()))
+            {
+                ++nInBlock;
+                continue;
+            }
+            bool fReadWitnessCoin = pWitnessTip && !pWitnessTip->HaveCoinInCache(txin.prevout);
+            if (pcoinsTip->HaveCoinInCache(txin.prevout))
+            {
+                ++nCached;
+                if (fReadWitnessCoin && IsPow2WitnessOutput(pcoinsTip->AccessCoin(txin.prevout).out))
+                    vEntries.emplace_back(txin.prevout, false, true);
+                continue;
+            }
+            vEntries.emplace_back(txin.prevout, true, fReadWitnessCoin);
+        }
+    }
+
+    if (!vEntries.empty())
+    {
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&coinsprefetchqueue);
+        std::vector<CCoinsPrefetchCheck> vChecks;
+        vChecks.reserve(vEntries.size());
+        for (auto& entry : vEntries)
+        {
+            vChecks.push_back(CCoinsPrefetchCheck());
+            CCoinsPrefetchCheck(entry, pcoinsdbview, pWitnessDB).swap(vChecks.back());
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    for (auto& entry : vEntries)
+    {
+        if (entry.fCoinFound)
+        {
+            view.CacheFetchedCoin(entry.outpoint, std::move(entry.coin));
+            ++nHits;
+        }
+        else if (entry.fReadCoin)
+        {
+            ++nMisses;
+        }
+        if (entry.fWitnessCoinFound)
+        {
+            view.pChainedWitView->CacheFetchedCoin(entry.outpoint, std::move(entry.witnessCoin));
+            ++nWitnessHits;
+        }
+    }
+
+    ++nPrefetchBlocks;
+    nPrefetchInputs += nInputs;
+    nPrefetchCached += nCached;
+    nPrefetchInBlock += nInBlock;
+    nPrefetchHits += nHits;
+    nPrefetchWitnessHits += nWitnessHits;
+    nPrefetchMisses += nMisses;
+    LogPrint(BCLog::BENCH, "    - Prefetch: %u inputs, %u cached, %u in block, %u read (%u witness), %u missing\n", nInputs, nCached, nInBlock, nHits, nWitnessHits, nMisses);
+}
+
+/** Verify the proof-of-work of many unrelated headers at once, ahead of (and without holding cs_main for) the serial checks.
+ * Headers are split into runs as wide as the multi-lane scrypt kernels and the runs are spread over the -powpar threads.
+ * Every header that passes goes into the PoW cache, so the serial checks that follow are lookups; a failing header is
+ * still reported (and the peer punished) by those serial checks exactly as before.
+ * Returns true only if every header passes.
+ */
+static bool CheckProofOfWorkParallel(const std::vector<const CBlockHeader*>& headers, const Consensus::Params& consensusParams)
+{
+    if (headers.empty())
+        return true;
+
+    const unsigned int nLanes = std::max(1U, scrypt_1024_1_1_256_multi_lanes());
+    CCheckQueueControl<CPoWCheck> control(nPoWCheckThreads ? &powcheckqueue : NULL);
+    std::vector<CPoWCheck> vChecks;
+    for (size_t i = 0; i < headers.size(); i += nLanes)
+    {
+        CPoWCheck check(&headers[i], std::min((size_t)nLanes, headers.size() - i), consensusParams);
+        if (!nPoWCheckThreads)
+        {
+            if (!check())
+                return false;
+        }
+        else
+        {
+            vChecks.push_back(CPoWCheck());
+            check.swap(vChecks.back());
+        }
+    }
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 /**
  * Threshold condition checker that triggers when unknown versionbits are seen on the network.
  */
@@ -819,6 +1046,138 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+static int64_t GetWitnessCoinWeight(const CTxOut& out, uint64_t nHeight)
+{
+    uint64_t nUnused1, nUnused2;
+    return GetPoW2RawWeightForAmount(out.nValue, GetPoW2LockLengthInBlocksFromOutput(out, nHeight, nUnused1, nUnused2));
+}
+
+// Change in the number of witness addresses and their weight caused by transactions [nBegin, nEnd) of a block, taking the spent coins from its undo data.
+static void AddWitnessWeightDelta(const CBlock& block, const CBlockUndo& blockundo, unsigned int nBegin, unsigned int nEnd, int nHeight, int64_t& nNumWitnessAddresses, int64_t& nTotalWeight)
+{
+    for (unsigned int i = nBegin; i < nEnd; ++i)
+    {
+        // The first coinbase spends nothing so has no undo entry.
+        if (i > 0)
+        {
+            for (const Coin& coin : blockundo.vtxundo[i-1].vprevout)
+            {
+                if (IsPow2WitnessOutput(coin.out))
+                {
+                    --nNumWitnessAddresses;
+                    nTotalWeight -= GetWitnessCoinWeight(coin.out, coin.nHeight);
+                }
+            }
+        }
+        for (const CTxOut& out : block.vtx[i]->vout)
+        {
+            if (IsPow2WitnessOutput(out) && !out.IsUnspendable())
+            {
+                ++nNumWitnessAddresses;
+                nTotalWeight += GetWitnessCoinWeight(out, nHeight);
+            }
+        }
+    }
+}
+
+// Add the network weight record for a block that has just been connected to the active chain.
+// The record of its parent must exist; if it does not (because the node was upgraded) it is built once from the witness coin database, which is at the parent at this point.
+static void WriteNetworkWeightRecord(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, unsigned int nWitnessCoinbaseIndex, bool fPoWPartOnly)
+{
+    if (!ppow2witdbview)
+        return;
+
+    CNetworkWeightRecord record;
+    if (pindex->pprev && !ppow2witdbview->ReadNetworkWeight(pindex->pprev->GetBlockHashPoW2(), record))
+    {
+        if (!ppow2witTip || ppow2witTip->GetBestBlock() != pindex->pprev->GetBlockHashPoW2())
+            return;
+        std::map<COutPoint, Coin> allWitnessCoins;
+        ppow2witTip->GetAllCoins(allWitnessCoins);
+        for (const auto& coinIter : allWitnessCoins)
+        {
+            if (coinIter.second.IsSpent())
+                continue;
+            ++record.nNumWitnessAddresses;
+            record.nTotalWeight += GetWitnessCoinWeight(coinIter.second.out, coinIter.second.nHeight);
+        }
+        LogPrint(BCLog::WITNESS, "Network weight ledger: started at height %d with %d witness addresses\n", pindex->pprev->nHeight, record.nNumWitnessAddresses);
+    }
+
+    unsigned int nPoWPartEnd = nWitnessCoinbaseIndex == 0 ? block.vtx.size() : nWitnessCoinbaseIndex;
+    AddWitnessWeightDelta(block, blockundo, 0, nPoWPartEnd, pindex->nHeight, record.nNumWitnessAddresses, record.nTotalWeight);
+    int64_t nNumPoWPart = record.nNumWitnessAddresses;
+    int64_t nWeightPoWPart = record.nTotalWeight;
+    AddWitnessWeightDelta(block, blockundo, nPoWPartEnd, block.vtx.size(), pindex->nHeight, record.nNumWitnessAddresses, record.nTotalWeight);
+    record.nReportedNumWitnessAddresses = fPoWPartOnly ? nNumPoWPart : record.nNumWitnessAddresses;
+    record.nReportedTotalWeight = fPoWPartOnly ? nWeightPoWPart : record.nTotalWeight;
+
+    if (!ppow2witdbview->WriteNetworkWeight(pindex->GetBlockHashPoW2(), record))
+        LogPrintf("%s: failed to write the network weight record of block %s\n", __func__, pindex->GetBlockHashPoW2().ToString());
+}
+
+// Remove the network weight record of a block that is disconnected from the active chain.
+static void EraseNetworkWeightRecord(const CBlockIndex* pindex)
+{
+    if (!ppow2witdbview)
+        return;
+
+    if (!ppow2witdbview->EraseNetworkWeight(pindex->GetBlockHashPoW2()))
+        LogPrintf("%s: failed to erase the network weight record of block %s\n", __func__, pindex->GetBlockHashPoW2().ToString());
+}
+
+void AddCoinsStatsDelta(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CCoinsStatsRecord& record, CCoinsStatsRecord& witnessRecord)
+{
+    for (unsigned int i = 0; i < block.vtx.size(); ++i)
+    {
+        const CTransaction& tx = *block.vtx[i];
+        // Undo data holds the spent coins in input order, skipping the null input of a witness coinbase.
+        if (i > 0)
+        {
+            unsigned int nUndo = 0;
+            for (const CTxIn& txin : tx.vin)
+            {
+                if (txin.prevout.IsNull())
+                    continue;
+                const Coin& coin = blockundo.vtxundo[i-1].vprevout[nUndo++];
+                record.RemoveCoin(txin.prevout, coin);
+                if (IsPow2WitnessOutput(coin.out))
+                    witnessRecord.RemoveCoin(txin.prevout, coin);
+            }
+        }
+        for (unsigned int j = 0; j < tx.vout.size(); ++j)
+        {
+            if (tx.vout[j].IsUnspendable())
+                continue;
+            // As AddCoins creates them.
+            const COutPoint outpoint(tx.GetHash(), j);
+            const Coin coin(tx.vout[j], nHeight, tx.IsCoinBase(), !IsOldTransactionVersion(tx.nVersion));
+            record.AddCoin(outpoint, coin);
+            if (IsPow2WitnessOutput(coin.out))
+                witnessRecord.AddCoin(outpoint, coin);
+        }
+    }
+}
+
+// Add the unspent output statistics records of both coin databases for a block that has just been connected to the active chain.
+// They build on the records of its parent; without those (the node was upgraded) nothing is written until gettxoutsetinfo has computed them once from the databases.
+static void WriteCoinsStatsRecords(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    if (!pcoinsdbview || !ppow2witdbview)
+        return;
+
+    CCoinsStatsRecord record, witnessRecord;
+    if (pindex->pprev)
+    {
+        const uint256 hashPrev = pindex->pprev->GetBlockHashPoW2();
+        if (!pcoinsdbview->ReadCoinsStats(hashPrev, record) || !ppow2witdbview->ReadCoinsStats(hashPrev, witnessRecord))
+            return;
+        AddCoinsStatsDelta(block, blockundo, pindex->nHeight, record, witnessRecord);
+    }
+    pcoinsdbview->WriteCoinsStats(pindex->GetBlockHashPoW2(), record);
+    ppow2witdbview->WriteCoinsStats(pindex->GetBlockHashPoW2(), witnessRecord);
+}
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
@@ -847,7 +1206,11 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
     // (its coinbase is unspendable)
     if (block.GetHashLegacy() == chainparams.GetConsensus().hashGenesisBlock) {
         if (!fJustCheck)
+        {
+            if (&chain == &chainActive)
+                WriteCoinsStatsRecords(block, CBlockUndo(), pindex);
             view.SetBestBlock(pindex->GetBlockHashLegacy());
+        }
         return true;
     }
 
@@ -980,6 +1343,7 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
             CGetWitnessInfo witInfo;
             if (!GetWitness(chain, chainparams, &view, pindex->pprev, block, witInfo))
                 return state.DoS(100, false, REJECT_INVALID, "invalid-witness", false, "could not determine a valid witness for block");
+
             if (witInfo.selectedWitnessTransaction.GetType() <= CTxOutType::ScriptLegacyOutput)
             {
                 if (CKeyID(uint160(witInfo.selectedWitnessTransaction.output.scriptPubKey.GetPow2WitnessHash())) != pubkey.GetID())
@@ -1282,6 +1646,13 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    // Witnessed phase 3 blocks report the weight as it is without their witness part (see GetPow2NetworkWeight).
+    if (&chain == &chainActive)
+    {
+        WriteNetworkWeightRecord(block, blockundo, pindex, nWitnessCoinbaseIndex, nWitnessCoinbaseIndex != 0 && nPoW2PhaseParent < 4);
+        WriteCoinsStatsRecords(block, blockundo, pindex);
+    }
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHashPoW2());
 
@@ -1294,6 +1665,38 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
     return true;
 }
 
+// Protected by cs_main
+static CCoinsFlushStats coinsFlushStats = {};
+static uint64_t nCoinsHitsAtFlush = 0;
+static uint64_t nCoinsMissesAtFlush = 0;
+
+void GetCoinsFlushStats(CCoinsFlushStats& stats)
+{
+    LOCK(cs_main);
+    stats = coinsFlushStats;
+    int64_t nLast, nTotal;
+    if (pcoinsdbview)
+    {
+        pcoinsdbview->GetBackgroundWriteTimes(nLast, nTotal);
+        stats.nLastWriteTime += nLast;
+        stats.nTotalWriteTime += nTotal;
+    }
+    if (ppow2witdbview)
+    {
+        ppow2witdbview->GetBackgroundWriteTimes(nLast, nTotal);
+        stats.nLastWriteTime += nLast;
+        stats.nTotalWriteTime += nTotal;
+    }
+}
+
+static bool WaitForCoinsWrite()
+{
+    bool fOk = pcoinsdbview->WaitForBackgroundWrite();
+    if (ppow2witdbview && !ppow2witdbview->WaitForBackgroundWrite())
+        fOk = false;
+    return fOk;
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -1303,6 +1706,9 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
 bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state, FlushStateMode mode, int nManualPruneHeight) {
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
     LOCK2(cs_main, cs_LastBlockFile);
+    // The coin databases are being replaced, there is nothing of the old chainstate worth writing.
+    if (fSnapshotLoading)
+        return true;
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
@@ -1336,7 +1742,11 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
         nLastSetChain = nNow;
     }
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-    int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+    // In incremental flush mode the memory of evicted coins is reused by new ones instead of given back, so only what is in use counts.
+    // The witness coins are kept in a cache of their own next to the coins cache, which counts against the same budget.
+    int64_t nCoinsTipUsage = fIncrementalFlush ? pcoinsTip->InUseMemoryUsage() : pcoinsTip->DynamicMemoryUsage();
+    int64_t nWitnessTipUsage = ppow2witTip ? (fIncrementalFlush ? ppow2witTip->InUseMemoryUsage() : ppow2witTip->DynamicMemoryUsage()) : 0;
+    int64_t cacheSize = (nCoinsTipUsage + nWitnessTipUsage) * DB_PEAK_USAGE_FACTOR;
     int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
     // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -1346,8 +1756,10 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
     bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+    // Enough coins were modified to write them in the background (incremental flush mode only), which keeps every write bounded.
+    bool fDirtyLarge = fIncrementalFlush && (mode == FLUSH_STATE_IF_NEEDED || mode == FLUSH_STATE_PERIODIC) && pcoinsTip->GetDirtyCount() > nCoinsFlushBatch;
     // Combine all conditions that result in a full cache flush.
-    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune || fDirtyLarge;
     // Write blocks and block index to disk.
     if (fDoFullFlush || fPeriodicWrite) {
         // Depend on nMinDiskSpace to ensure we can write block index
@@ -1385,11 +1797,44 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * (fIncrementalFlush ? pcoinsTip->GetDirtyCount() : pcoinsTip->GetCacheSize())))
             return state.Error("out of disk space");
-        // Flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
-            return AbortNode(state, "Failed to write to coin database");
+        int64_t nFlushStart = GetTimeMicros();
+        uint64_t nWritten = pcoinsTip->GetDirtyCount();
+        uint64_t nEvicted = 0;
+        if (fIncrementalFlush) {
+            // Write the modified coins in the background and keep the cache warm, when it is over budget make room by evicting the coins that were not used lately.
+            if (!pcoinsTip->Sync())
+                return AbortNode(state, "Failed to write to coin database");
+            // At shutdown, and before block files are gone, the chainstate has to be on disk.
+            if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !WaitForCoinsWrite())
+                return AbortNode(state, "Failed to write to coin database");
+            if (fCacheLarge || fCacheCritical) {
+                // Both caches give up the same share of what they use.
+                int64_t nTargetUsage = nTotalSpace * 3 / 4 / DB_PEAK_USAGE_FACTOR;
+                int64_t nWitnessTargetUsage = nWitnessTipUsage ? nTargetUsage * nWitnessTipUsage / (nCoinsTipUsage + nWitnessTipUsage) : 0;
+                nEvicted = pcoinsTip->EvictUnused(nTargetUsage - nWitnessTargetUsage);
+                if (ppow2witTip)
+                    nEvicted += ppow2witTip->EvictUnused(nWitnessTargetUsage);
+            }
+        } else {
+            // Flush the chainstate (which may refer to block index entries).
+            if (!pcoinsTip->Flush())
+                return AbortNode(state, "Failed to write to coin database");
+        }
+        int64_t nFlushTime = GetTimeMicros() - nFlushStart;
+        coinsFlushStats.nFlushes++;
+        coinsFlushStats.nLastFlushTime = nFlushTime;
+        coinsFlushStats.nTotalFlushTime += nFlushTime;
+        coinsFlushStats.nLastWritten = nWritten;
+        coinsFlushStats.nEvicted += nEvicted;
+        uint64_t nHits, nMisses;
+        pcoinsTip->GetHitStats(nHits, nMisses);
+        uint64_t nLookups = (nHits - nCoinsHitsAtFlush) + (nMisses - nCoinsMissesAtFlush);
+        LogPrint(BCLog::COINDB, "Flushed %u modified coins in %.2fms, evicted %u, %u coins cached (%.1fMiB), cache hit rate since the previous flush %.1f%%\n",
+            nWritten, nFlushTime * 0.001, nEvicted, pcoinsTip->GetCacheSize(), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1<<20)), nLookups ? 100.0 * (nHits - nCoinsHitsAtFlush) / nLookups : 0.0);
+        nCoinsHitsAtFlush = nHits;
+        nCoinsMissesAtFlush = nMisses;
         nLastFlush = nNow;
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -1520,6 +1965,10 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHashPoW2().ToString());
         bool flushed = view.Flush();
         assert(flushed);
+        witnessPoolIndex.DisconnectBlock(block, pindexDelete, *ppow2witTip);
+        EraseNetworkWeightRecord(pindexDelete);
+        pcoinsdbview->EraseCoinsStats(pindexDelete->GetBlockHashPoW2());
+        ppow2witdbview->EraseCoinsStats(pindexDelete->GetBlockHashPoW2());
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
@@ -1548,6 +1997,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -1647,6 +2097,9 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CCoinsViewCache view(pcoinsTip);
+        PrefetchBlockInputs(blockConnecting, view);
+        int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+        LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * 0.001, nTimePrefetch * 0.000001);
         bool rv = ConnectBlock(chainActive, blockConnecting, state, pindexNew, view, chainparams);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
@@ -1658,6 +2111,10 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         bool flushed = view.Flush();
         assert(flushed);
+        witnessPoolIndex.ConnectBlock(blockConnecting, pindexNew);
+        // Once synced the new tip is the block everyone is going to ask for next; during initial sync no one asks for it again.
+        if (!IsInitialBlockDownload())
+            blockCache.Insert(pindexNew->GetBlockHashPoW2(), pthisBlock);
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
@@ -1863,6 +2320,9 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
         bool fInitialDownload;
         {
             LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
+            // LoadUTXOSnapshot activates the best chain itself once the snapshot is in place.
+            if (fSnapshotLoading)
+                return true;
             ConnectTrace connectTrace(mempool); // Destructed before cs_main is unlocked
 
             CBlockIndex *pindexOldTip = chainActive.Tip();
@@ -1956,6 +2416,8 @@ bool PreciousBlock(CValidationState& state, const CChainParams& params, CBlockIn
 bool InvalidateBlock(CValidationState& state, const CChainParams& chainparams, CBlockIndex *pindex)
 {
     AssertLockHeld(cs_main);
+    if (fSnapshotLoading)
+        return state.Error("a UTXO snapshot is being loaded");
 
     // Mark the block itself as invalid.
     pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -2030,14 +2492,14 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex) {
     return true;
 }
 
-static void SetChainWorkForIndex(CBlockIndex* pIndex, const CChainParams& chainparams)
+static void SetChainWorkForIndex(CBlockIndex* pIndex, const CChainParams& chainparams, const std::function<arith_uint256(const CBlockIndex&)>& getBlockProof = GetBlockProof)
 {
     LOCK(cs_main);
 
     // Check if we are an existing item in the set or not - NB! we must do this before we modify the index as with a custom comparator find might otherwise fail.
     const auto& findIter = setBlockIndexCandidates.find(pIndex);
 
-    arith_uint256 nBlockProof = GetBlockProof(*pIndex);
+    arith_uint256 nBlockProof = getBlockProof(*pIndex);
     pIndex->nChainWork = (pIndex->pprev ? pIndex->pprev->nChainWork : 0) + nBlockProof;
     if (pIndex->nVersionPoW2Witness != 0)
     {
@@ -2063,7 +2525,7 @@ static void SetChainWorkForIndex(CBlockIndex* pIndex, const CChainParams& chainp
             while (pprev && nCount < 10)
             {
                 ++nCount;
-                nBlockProof += GetBlockProof(*pprev);
+                nBlockProof += getBlockProof(*pprev);
                 pprev = pprev->pprev;
             }
             assert (nCount == 10);
@@ -2087,6 +2549,12 @@ static void SetChainWorkForIndex(CBlockIndex* pIndex, const CChainParams& chainp
     }
 }
 
+static void InsertBlockIndexLegacy(CBlockIndex* pindex, const uint256& hashLegacy)
+{
+    BlockLegacyMap::iterator mi = mapBlockIndexLegacy.insert(std::pair(hashLegacy, pindex));
+    pindex->phashBlockLegacy = &((*mi).first);
+}
+
 static CBlockIndex* AddToBlockIndex(const CChainParams& chainParams, const CBlockHeader& block)
 {
     // Check for duplicate
@@ -2096,14 +2564,15 @@ static CBlockIndex* AddToBlockIndex(const CChainParams& chainParams, const CBloc
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Create(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(std::pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
+    if (block.nVersionPoW2Witness != 0)
+        InsertBlockIndexLegacy(pindexNew, block.GetHashLegacy());
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
@@ -2112,6 +2581,7 @@ static CBlockIndex* AddToBlockIndex(const CChainParams& chainParams, const CBloc
         pindexNew->BuildSkip();
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
+    pindexNew->BuildDeltaTimeSums();
 
     // Gulden: PoW2
     {
@@ -2134,10 +2604,46 @@ static CBlockIndex* AddToBlockIndex(const CChainParams& chainParams, const CBloc
 }
 
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
+// Link a block whose parent has all its transactions linked (or that is the genesis block or the snapshot base), and the descendants that were waiting for it.
+static void LinkBlockTransactions(CBlockIndex *pindexNew)
+{
+    std::deque<CBlockIndex*> queue;
+    queue.push_back(pindexNew);
+
+    LOCK(cs_main);
+    // Recursively process any descendant blocks that now may be eligible to be connected.
+    while (!queue.empty()) {
+        CBlockIndex *pindex = queue.front();
+        queue.pop_front();
+        // The transaction count of a snapshot base came with the snapshot, the blocks below it are not known.
+        if (pindex != pindexSnapshotBase)
+            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+        {
+            LOCK(cs_nBlockSequenceId);
+            setBlockIndexCandidates.erase(pindex);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        if (pindex->nChainWork >= (chainActive.Tip() == NULL ? 0 : chainActive.Tip()->nChainWork) || pindex->nHeight >= (chainActive.Tip() == NULL ? 0 : chainActive.Tip()->nHeight))
+        {
+            if (!IsArgSet("-minimallogging"))
+                LogPrintf("ReceivedBlockTransactions: New index candidate: [%s] [%d]\n", pindex->GetBlockHashPoW2().ToString(), pindex->nHeight);
+            setBlockIndexCandidates.insert(pindex);
+        }
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
+            queue.push_back(it->second);
+            range.first++;
+            mapBlocksUnlinked.erase(it);
+        }
+    }
+}
+
 static bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     pindexNew->nTx = block.vtx.size();
-    pindexNew->nChainTx = 0;
+    if (pindexNew != pindexSnapshotBase)
+        pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
@@ -2148,36 +2654,9 @@ static bool ReceivedBlockTransactions(const CBlock &block, CValidationState& sta
     pindexNew->RaiseValidity(BLOCK_VALID_TRANSACTIONS);
     setDirtyBlockIndex.insert(pindexNew);
 
-    if (pindexNew->pprev == NULL || pindexNew->pprev->nChainTx) {
-        // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
-        std::deque<CBlockIndex*> queue;
-        queue.push_back(pindexNew);
-
-        LOCK(cs_main);
-        // Recursively process any descendant blocks that now may be eligible to be connected.
-        while (!queue.empty()) {
-            CBlockIndex *pindex = queue.front();
-            queue.pop_front();
-            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
-            {
-                LOCK(cs_nBlockSequenceId);
-                setBlockIndexCandidates.erase(pindex);
-                pindex->nSequenceId = nBlockSequenceId++;
-            }
-            if (pindex->nChainWork >= (chainActive.Tip() == NULL ? 0 : chainActive.Tip()->nChainWork) || pindex->nHeight >= (chainActive.Tip() == NULL ? 0 : chainActive.Tip()->nHeight))
-            {
-                if (!IsArgSet("-minimallogging"))
-                    LogPrintf("ReceivedBlockTransactions: New index candidate: [%s] [%d]\n", pindex->GetBlockHashPoW2().ToString(), pindex->nHeight);
-                setBlockIndexCandidates.insert(pindex);
-            }
-            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
-            while (range.first != range.second) {
-                std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
-                queue.push_back(it->second);
-                range.first++;
-                mapBlocksUnlinked.erase(it);
-            }
-        }
+    if (pindexNew->pprev == NULL || pindexNew->pprev->nChainTx || pindexNew == pindexSnapshotBase) {
+        // If pindexNew is the genesis block, the snapshot base or all parents are BLOCK_VALID_TRANSACTIONS.
+        LinkBlockTransactions(pindexNew);
     } else {
         if (pindexNew->pprev && pindexNew->pprev->IsValid(BLOCK_VALID_TREE)) {
             mapBlocksUnlinked.insert(std::pair(pindexNew->pprev, pindexNew));
@@ -2278,7 +2757,7 @@ static bool CheckBlockHeader(const CBlock& block, CValidationState& state, const
     // Check proof of work matches claimed amount
     if (fCheckPOW) {
         // Nested if statement for easier breakpoint management
-        if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+        if (!CheckBlockProofOfWork(block, consensusParams))
             return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
     }
 
@@ -2676,7 +3155,14 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
     }
     if (pindex == NULL)
+    {
         pindex = AddToBlockIndex(chainparams, block);
+        // Persist that the PoW has been checked so that reading the block back later doesn't need scrypt again.
+        if (!fAssumePOWGood && hash != chainparams.GetConsensus().hashGenesisBlock)
+            pindex->nStatus |= BLOCK_POW_VERIFIED;
+        if (!IsInitialBlockDownload())
+            GetMainSignals().AcceptedBlockHeader(pindex);
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -2689,11 +3175,46 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, bool fAssumePOWGood)
 {
+    size_t nFirstSerial = 0;
+    if (!fAssumePOWGood && headers.size() > 2)
+    {
+        // The first header goes through all the serial checks on its own, so headers that do not connect to a valid block we know,
+        // or that fail the checkpoint or contextual checks, are turned away before any PoW is spent on the rest of them.
+        {
+            LOCK(cs_main);
+            CBlockIndex *pindex = NULL;
+            if (!AcceptBlockHeader(headers[0], state, chainparams, &pindex, fAssumePOWGood)) {
+                return false;
+            }
+            if (ppindex) {
+                *ppindex = pindex;
+            }
+        }
+        nFirstSerial = 1;
+
+        // Verify the PoW of the headers after it that we don't know yet in one go, outside of cs_main; this fills the PoW cache so
+        // the checks in AcceptBlockHeader below become cache lookups and only the contextual checks remain. Only the run of
+        // headers that connect one to the next is batched, whatever follows a break is left to AcceptBlockHeader to reject.
+        std::vector<const CBlockHeader*> vUnknown;
+        vUnknown.reserve(headers.size() - 1);
+        {
+            LOCK(cs_main);
+            for (size_t i = 1; i < headers.size(); ++i) {
+                if (headers[i].hashPrevBlock != headers[i - 1].GetHashPoW2())
+                    break;
+                if (mapBlockIndex.count(headers[i].GetHashPoW2()) == 0)
+                    vUnknown.push_back(&headers[i]);
+            }
+        }
+        if (vUnknown.size() > 1)
+            CheckProofOfWorkParallel(vUnknown, chainparams.GetConsensus());
+    }
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = nFirstSerial; i < headers.size(); ++i) {
             CBlockIndex *pindex = NULL; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex, fAssumePOWGood)) {
+            if (!AcceptBlockHeader(headers[i], state, chainparams, &pindex, fAssumePOWGood)) {
                 return false;
             }
             if (ppindex) {
@@ -3015,9 +3536,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Create();
     mi = mapBlockIndex.insert(std::pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3028,12 +3547,25 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
     LOCK(cs_main);
 
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    // The decoding and hashing of the entries, and the block proofs for the chain work, are spread over the -par threads.
+    int nThreads = std::max(nScriptCheckThreads, 1);
+    int64_t nStart = GetTimeMillis();
+    int64_t nPhaseStart = nStart;
+    auto insertBlockIndexLegacy = [](CBlockIndex* pindex, const uint256& hashLegacy, bool fStored)
+    {
+        InsertBlockIndexLegacy(pindex, hashLegacy);
+        // Entries from before the legacy hash was stored are written again with it at the next flush.
+        if (!fStored)
+            setDirtyBlockIndex.insert(pindex);
+    };
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, insertBlockIndexLegacy, nThreads))
         return false;
+    LogPrintf("LoadBlockIndexDB: loaded %u block index entries on %d threads in %dms (%u MiB in block index slabs)\n", blockIndexArena.Size(), nThreads, GetTimeMillis() - nPhaseStart, blockIndexArena.DynamicMemoryUsage() >> 20);
 
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
+    nPhaseStart = GetTimeMillis();
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     for(const PAIRTYPE(uint256, CBlockIndex*)& item : mapBlockIndex)
@@ -3041,7 +3573,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         CBlockIndex* pindex = item.second;
         vSortedByHeight.push_back(std::pair(pindex->nHeight, pindex));
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end(), [](const std::pair<int, CBlockIndex*>& a, const std::pair<int, CBlockIndex*>& b) -> bool 
+    auto sortByHeight = [](const std::pair<int, CBlockIndex*>& a, const std::pair<int, CBlockIndex*>& b) -> bool
     {
         //Ensure PoW block always comes first in sort before witness block of same height.
         if (a.first == b.first)
@@ -3053,17 +3585,61 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
             return a.second < b.second;
         }
         return a.first < b.first;
+    };
+    sort(vSortedByHeight.begin(), vSortedByHeight.end(), sortByHeight);
+    LogPrintf("LoadBlockIndexDB: sorted block index by height in %dms\n", GetTimeMillis() - nPhaseStart);
+
+    // The block proofs do not depend on each other and are the expensive part of the chain work (witnessed blocks use those of the 10 blocks before them as well),
+    // so they are computed up front in parallel and the pass below only adds them up.
+    nPhaseStart = GetTimeMillis();
+    std::vector<arith_uint256> vBlockProof(vSortedByHeight.size());
+    {
+        auto computeBlockProofs = [&](int nSlice)
+        {
+            for (size_t i = nSlice; i < vSortedByHeight.size(); i += nThreads)
+                vBlockProof[i] = GetBlockProof(*vSortedByHeight[i].second);
+        };
+        boost::thread_group proofThreads;
+        for (int nSlice = 1; nSlice < nThreads; ++nSlice)
+            proofThreads.create_thread([&, nSlice]() { computeBlockProofs(nSlice); });
+        computeBlockProofs(0);
+        boost::this_thread::disable_interruption disableInterruption;
+        proofThreads.join_all();
+    }
+    auto getBlockProof = [&](const CBlockIndex& block) -> arith_uint256
+    {
+        auto iter = std::lower_bound(vSortedByHeight.begin(), vSortedByHeight.end(), std::pair(block.nHeight, const_cast<CBlockIndex*>(&block)), sortByHeight);
+        if (iter != vSortedByHeight.end() && iter->second == &block)
+            return vBlockProof[iter - vSortedByHeight.begin()];
+        return GetBlockProof(block);
+    };
+    LogPrintf("LoadBlockIndexDB: computed block proofs in %dms\n", GetTimeMillis() - nPhaseStart);
+
+    // A chain that was started from a UTXO snapshot is linked from the snapshot base on, with the transaction count that came with the snapshot.
+    uint256 hashSnapshotBase;
+    uint64_t nSnapshotChainTx = 0;
+    if (pblocktree->ReadSnapshotBase(hashSnapshotBase, nSnapshotChainTx))
+    {
+        BlockMap::iterator baseIter = mapBlockIndex.find(hashSnapshotBase);
+        if (baseIter == mapBlockIndex.end())
+            return error("%s: UTXO snapshot base %s is missing from the block index", __func__, hashSnapshotBase.ToString());
+        pindexSnapshotBase = baseIter->second;
+        LogPrintf("%s: chain starts from a UTXO snapshot at height %d\n", __func__, pindexSnapshotBase->nHeight);
     }
-    );
+
+    nPhaseStart = GetTimeMillis();
     for(const PAIRTYPE(int, CBlockIndex*)& item : vSortedByHeight)
     {
         CBlockIndex* pindex = item.second;
-        SetChainWorkForIndex(pindex, chainparams);
+        SetChainWorkForIndex(pindex, chainparams, getBlockProof);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        pindex->BuildDeltaTimeSums();
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
-            if (pindex->pprev) {
+            if (pindex == pindexSnapshotBase) {
+                pindex->nChainTx = nSnapshotChainTx;
+            } else if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
                 } else {
@@ -3087,8 +3663,10 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    LogPrintf("LoadBlockIndexDB: linked chain work, skip pointers and candidates in %dms\n", GetTimeMillis() - nPhaseStart);
 
     // Load block file info
+    nPhaseStart = GetTimeMillis();
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
     LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
@@ -3122,6 +3700,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
             return false;
         }
     }
+    LogPrintf("LoadBlockIndexDB: read block file info and checked block files in %dms\n", GetTimeMillis() - nPhaseStart);
 
     // Check whether we have ever pruned block & undo files
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
@@ -3159,6 +3738,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         chainActive.Tip()->GetBlockHashPoW2().ToString(), chainActive.Height(),
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
         GuessVerificationProgress(chainparams.TxData(), chainActive.Tip()));
+    LogPrintf("LoadBlockIndexDB: done in %dms\n", GetTimeMillis() - nStart);
 
     return true;
 }
@@ -3315,6 +3895,11 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
+        if (pindex == pindexSnapshotBase) {
+            // There is no block data below a snapshot base, and no undo data to disconnect the base itself with.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (UTXO snapshot base)\n", pindex->nHeight);
+            break;
+        }
         if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
             // If pruning, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
@@ -3382,7 +3967,8 @@ bool RewindBlockIndex(const CChainParams& params)
 {
     LOCK(cs_main);
 
-    int nHeight = 1;
+    // Blocks up to a snapshot base never had their data, the snapshot stands in for them.
+    int nHeight = pindexSnapshotBase ? pindexSnapshotBase->nHeight + 1 : 1;
     while (nHeight <= chainActive.Height())
     {
         if (IsSegSigEnabled(chainActive[nHeight - 1]) && !(chainActive[nHeight]->nStatus & BLOCK_OPT_WITNESS))
@@ -3466,6 +4052,46 @@ bool RewindBlockIndex(const CChainParams& params)
     return true;
 }
 
+bool ActivateSnapshotBase(const CBlock& block, CBlockIndex* pindex, uint64_t nChainTx, const CChainParams& chainparams, CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+
+    // Store the block itself, so that it can be served and the blocks on top of it can refer back to it.
+    unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    CDiskBlockPos blockPos;
+    if (!FindBlockPos(state, blockPos, nBlockSize+8, pindex->nHeight, block.GetBlockTime()))
+        return error("%s: FindBlockPos failed", __func__);
+    if (!blockStore.WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+        return AbortNode(state, "Failed to write block");
+
+    pindexSnapshotBase = pindex;
+    pindex->nChainTx = nChainTx;
+    if (!ReceivedBlockTransactions(block, state, pindex, blockPos, chainparams.GetConsensus()))
+        return error("%s: ReceivedBlockTransactions failed", __func__);
+    pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+    setDirtyBlockIndex.insert(pindex);
+    if (!pblocktree->WriteSnapshotBase(pindex->GetBlockHashPoW2(), nChainTx))
+        return AbortNode(state, "Failed to write to block index database");
+
+    // Nothing that was built on the previous tip applies to the snapshot.
+    mempool.clear();
+    witnessPoolIndex.Clear();
+    pcoinsTip->SetBestBlock(pindex->GetBlockHashPoW2());
+    ppow2witTip->SetBestBlock(pindex->GetBlockHashPoW2());
+    CBlockIndex* pindexOldTip = chainActive.Tip();
+    chainActive.SetTip(pindex);
+    PruneBlockIndexCandidates();
+    LogPrintf("%s: new best=%s height=%d tx=%lu date='%s'\n", __func__, pindex->GetBlockHashPoW2().ToString(), pindex->nHeight, (unsigned long)pindex->nChainTx,
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindex->GetBlockTime()));
+
+    if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS))
+        return false;
+
+    GetMainSignals().UpdatedBlockTip(pindex, pindexOldTip, IsInitialBlockDownload());
+    uiInterface.NotifyBlockTip(IsInitialBlockDownload(), pindex);
+    return true;
+}
+
 // May NOT be used after any connections are up as much
 // of the peer-processing logic assumes a consistent
 // block index state
@@ -3476,6 +4102,7 @@ void UnloadBlockIndex()
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
+    pindexSnapshotBase = NULL;
     mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -3484,14 +4111,14 @@ void UnloadBlockIndex()
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     versionbitscache.Clear();
+    witnessPoolIndex.Clear();
     for (int b = 0; b < VERSIONBITS_NUM_BITS; b++) {
         warningcache[b].clear();
     }
 
-    for(BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    mapBlockIndexLegacy.clear();
+    blockIndexArena.Clear();
     fHavePruned = false;
 }
 
@@ -3560,18 +4187,114 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
+/** Blocks read ahead by LoadExternalBlockFile so that their proof-of-work can be verified as one batch. */
+static const unsigned int MAX_EXTERNAL_BLOCK_READAHEAD = 64;
+
+/** Accept a single block read by LoadExternalBlockFile, along with any earlier read successors that were waiting for it. Returns false if the import should stop. */
+static bool ProcessExternalBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, CDiskBlockPos *dbp, std::multimap<uint256, CDiskBlockPos>& mapBlocksUnknownParent, int& nLoaded)
+{
+    try {
+        CBlock& block = *pblock;
+
+        // detect out of order blocks, and store them for later
+        uint256 hash = block.GetHashPoW2();
+        if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
+            if (dbp)
+                mapBlocksUnknownParent.insert(std::pair(block.hashPrevBlock, *dbp));
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+            LOCK(cs_main);
+            CValidationState state;
+            if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
+                nLoaded++;
+            if (state.IsError())
+                return false;
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+            LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+        }
+
+        // Activate the genesis block so normal node progress can continue
+        if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+            CValidationState state;
+            if (!ActivateBestChain(state, chainparams)) {
+                return false;
+            }
+        }
+
+        // Recursively process earlier encountered successors of this block
+        std::deque<uint256> queue;
+        queue.push_back(hash);
+        while (!queue.empty()) {
+            uint256 head = queue.front();
+            queue.pop_front();
+            std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+            while (range.first != range.second) {
+                std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                {
+                    LOCK(cs_main); // acquire cs_main here to protect ReadBlockFromDisk
+                    if (blockStore.ReadBlockFromDisk(*pblockrecursive, it->second, chainparams))
+                    {
+                        LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHashPoW2().ToString(),
+                                head.ToString());
+                        CValidationState dummy;
+                        if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
+                        {
+                            nLoaded++;
+                            queue.push_back(pblockrecursive->GetHashPoW2());
+                        }
+                    }
+                }
+                range.first++;
+                mapBlocksUnknownParent.erase(it);
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
+    // Blocks are read a run at a time so that the PoW of the whole run can be checked in parallel before they are accepted one by one.
+    const unsigned int nReadAhead = std::min(MAX_EXTERNAL_BLOCK_READAHEAD, std::max(1U, scrypt_1024_1_1_256_multi_lanes()) * std::max(1, nPoWCheckThreads));
+    std::vector<std::pair<std::shared_ptr<CBlock>, CDiskBlockPos>> vPending;
+    vPending.reserve(nReadAhead);
+
     int nLoaded = 0;
+    bool fAbort = false;
+    auto processPending = [&]() {
+        std::vector<const CBlockHeader*> vHeaders;
+        for (const auto& pending : vPending) {
+            uint256 hash = pending.first->GetHashPoW2();
+            if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0)
+                vHeaders.push_back(pending.first.get());
+        }
+        // Fills the PoW cache, AcceptBlock then only has to look the headers up.
+        if (vHeaders.size() > 1)
+            CheckProofOfWorkParallel(vHeaders, chainparams.GetConsensus());
+        for (auto& pending : vPending) {
+            if (!fAbort && !ProcessExternalBlock(chainparams, pending.first, dbp ? &pending.second : NULL, mapBlocksUnknownParent, nLoaded))
+                fAbort = true;
+        }
+        vPending.clear();
+    };
+
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        while (!blkdat.eof() && !fAbort) {
             boost::this_thread::interruption_point();
 
             blkdat.SetPos(nRewind);
@@ -3602,72 +4325,17 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
+                blkdat >> *pblock;
                 nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHashPoW2();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        {
-                            LOCK(cs_main); // acquire cs_main here to protect ReadBlockFromDisk
-                            if (blockStore.ReadBlockFromDisk(*pblockrecursive, it->second, chainparams))
-                            {
-                                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHashPoW2().ToString(),
-                                        head.ToString());
-                                CValidationState dummy;
-                                if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
-                                {
-                                    nLoaded++;
-                                    queue.push_back(pblockrecursive->GetHashPoW2());
-                                }
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                }
+                vPending.emplace_back(pblock, dbp ? *dbp : CDiskBlockPos());
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+            if (vPending.size() >= nReadAhead)
+                processPending();
         }
+        if (!fAbort)
+            processPending();
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -3717,8 +4385,19 @@ void static CheckBlockIndex(const Consensus::Params& consensusParams)
     CBlockIndex* pindexFirstNotTransactionsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TRANSACTIONS (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
+    // No block below a snapshot base was necessarily ever received or validated, so for the blocks built on the base the data and
+    // validity of their ancestors is only tracked from the base onwards. The values from below the base are kept here meanwhile.
+    CBlockIndex* vBelowSnapshotBase[5] = {NULL, NULL, NULL, NULL, NULL};
     while (pindex != NULL) {
         nNodes++;
+        if (pindex == pindexSnapshotBase) {
+            vBelowSnapshotBase[0] = pindexFirstMissing;
+            vBelowSnapshotBase[1] = pindexFirstNeverProcessed;
+            vBelowSnapshotBase[2] = pindexFirstNotTransactionsValid;
+            vBelowSnapshotBase[3] = pindexFirstNotChainValid;
+            vBelowSnapshotBase[4] = pindexFirstNotScriptsValid;
+            pindexFirstMissing = pindexFirstNeverProcessed = pindexFirstNotTransactionsValid = pindexFirstNotChainValid = pindexFirstNotScriptsValid = NULL;
+        }
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
         if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
@@ -3833,6 +4512,13 @@ void static CheckBlockIndex(const Consensus::Params& consensusParams)
             if (pindex == pindexFirstNotTransactionsValid) pindexFirstNotTransactionsValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
+            if (pindex == pindexSnapshotBase) {
+                pindexFirstMissing = vBelowSnapshotBase[0];
+                pindexFirstNeverProcessed = vBelowSnapshotBase[1];
+                pindexFirstNotTransactionsValid = vBelowSnapshotBase[2];
+                pindexFirstNotChainValid = vBelowSnapshotBase[3];
+                pindexFirstNotScriptsValid = vBelowSnapshotBase[4];
+            }
             // Find our parent.
             CBlockIndex* pindexPar = pindex->pprev;
             // Find which child we just visited.
@@ -3878,9 +4564,8 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        mapBlockIndexLegacy.clear();
+        blockIndexArena.Clear();
     }
 } instance_of_cmaincleanup;
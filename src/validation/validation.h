@@ -59,6 +59,8 @@ struct PrecomputedTransactionData;
 struct LockPoints;
 
 class CWitViewDB;
+class CCoinsStatsRecord;
+class CBlockUndo;
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -107,6 +109,16 @@ static const int64_t DUST_HARD_LIMIT = 1000;   // 0.00001 NLG mininput
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of proof-of-work checking threads allowed */
+static const int MAX_POWCHECK_THREADS = 16;
+/** -powpar default (number of proof-of-work checking threads, 0 = auto) */
+static const int DEFAULT_POWCHECK_THREADS = 0;
+/** Default for -incrementalflush, write the coins cache to disk in the background and keep it warm instead of emptying it */
+static const bool DEFAULT_INCREMENTAL_FLUSH = true;
+/** Default for -dbflushbatch, the number of modified coins (in thousands) that are written to disk together in incremental flush mode */
+static const int64_t DEFAULT_COINS_FLUSH_BATCH = 500;
+/** Default for -loadsnapshottimeout, the number of seconds to wait for the header of a -loadsnapshot block before syncing normally */
+static const int64_t DEFAULT_LOADSNAPSHOT_TIMEOUT = 600;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -190,6 +202,11 @@ extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** Legacy hash -> index of witnessed blocks (for blocks without a witness the legacy hash is the mapBlockIndex key). More than one witnessed block can share a legacy hash. */
+typedef std::unordered_multimap<uint256, CBlockIndex*, BlockHasher> BlockLegacyMap;
+extern BlockLegacyMap mapBlockIndexLegacy;
+/** Storage for the entries of mapBlockIndex */
+extern CBlockIndexArena blockIndexArena;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern uint64_t nLastBlockWeight;
@@ -200,12 +217,17 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern bool fReverseHeaders;
 extern int nScriptCheckThreads;
+extern int nPoWCheckThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Write the coins cache in the background without emptying it (see -incrementalflush) */
+extern bool fIncrementalFlush;
+/** Number of modified coins that triggers an incremental flush */
+extern size_t nCoinsFlushBatch;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -221,6 +243,15 @@ extern uint256 hashAssumeValid;
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
 
+/** The block a UTXO snapshot was loaded at, if any. There is no block data (and no undo data) below it, so the chain can not be disconnected past it. */
+extern CBlockIndex *pindexSnapshotBase;
+
+/** Height of the snapshot given with -loadsnapshot while it waits for its header, or -1. No blocks are downloaded meanwhile, as the snapshot replaces them; the wait is given up when the best header passes the snapshot height without it, or after -loadsnapshottimeout. */
+extern int nSnapshotPendingHeight;
+
+/** Set while LoadUTXOSnapshot replaces the coin databases, which it does without holding cs_main. Meanwhile no blocks are connected or disconnected and the chainstate is not written. */
+extern std::atomic<bool> fSnapshotLoading;
+
 extern int64_t nMinimumInputValue;
 
 /** Minimum disk space required - used in CheckDiskSpace() */
@@ -296,6 +327,14 @@ bool LoadBlockIndex(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the proof-of-work checking thread */
+void ThreadPoWCheck();
+/** Run an instance of the input prefetch thread */
+void ThreadCoinsPrefetch();
+/** Set status bits that record a fact about the block in the block index (and on disk at the next flush); entries that are not part of mapBlockIndex are left alone */
+void MarkBlockIndexStatus(const CBlockIndex* pindex, uint32_t nFlags);
+/** Record in the block index (and on disk at the next flush) that the PoW of this block has been checked */
+void MarkBlockIndexPoWVerified(const CBlockIndex* pindex);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -316,6 +355,8 @@ void PruneOneBlockFile(const int fileNumber);
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Abort with a message: log it, show it to the user and shut the node down. Can be called from any thread. */
+bool AbortNode(const std::string& strMessage, const std::string& userMessage="");
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 /** Prune block files up to a given height */
@@ -403,8 +444,97 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
-/** Functions for disk access for blocks */
+/** An input of a block whose coin is read ahead of ConnectBlock, and what was read */
+struct CCoinsPrefetchEntry
+{
+    COutPoint outpoint;
+    //! Read the coin from the chainstate, it is not in the coins tip cache.
+    bool fReadCoin;
+    //! Read the coin from the witness state if it is a witness output, it is not in the witness tip cache.
+    bool fReadWitnessCoin;
+    bool fCoinFound;
+    bool fWitnessCoinFound;
+    Coin coin;
+    Coin witnessCoin;
+
+    CCoinsPrefetchEntry(const COutPoint& outpointIn, bool fReadCoinIn, bool fReadWitnessCoinIn) : outpoint(outpointIn), fReadCoin(fReadCoinIn), fReadWitnessCoin(fReadWitnessCoinIn), fCoinFound(false), fWitnessCoinFound(false) {}
+};
+
+/**
+ * Closure representing the database reads for one input of a block. Used with CCheckQueue to read all the
+ * inputs of a block on several threads before the serial ConnectBlock. The entry must stay alive until the check has run.
+ */
+class CCoinsPrefetchCheck
+{
+private:
+    CCoinsPrefetchEntry* pEntry;
+    const CCoinsView* pCoinsDB;
+    const CCoinsView* pWitnessDB;
+
+public:
+    CCoinsPrefetchCheck() : pEntry(nullptr), pCoinsDB(nullptr), pWitnessDB(nullptr) {}
+    CCoinsPrefetchCheck(CCoinsPrefetchEntry& entryIn, const CCoinsView* pCoinsDBIn, const CCoinsView* pWitnessDBIn) : pEntry(&entryIn), pCoinsDB(pCoinsDBIn), pWitnessDB(pWitnessDBIn) {}
+
+    //! Never fails, a coin that could not be read is simply not prefetched and ConnectBlock reads it as before.
+    bool operator()();
+
+    void swap(CCoinsPrefetchCheck& check)
+    {
+        std::swap(pEntry, check.pEntry);
+        std::swap(pCoinsDB, check.pCoinsDB);
+        std::swap(pWitnessDB, check.pWitnessDB);
+    }
+};
+
+/** Inputs of connected blocks, by how the input prefetch dealt with them */
+struct CCoinsPrefetchStats {
+    uint64_t nBlocks;
+    uint64_t nInputs;
+    //! Already in the coins tip cache, nothing to read.
+    uint64_t nCached;
+    //! Spending an output of the same block.
+    uint64_t nInBlock;
+    //! Read ahead from the chainstate.
+    uint64_t nHits;
+    //! Read ahead from the witness state (witness outputs are in both).
+    uint64_t nWitnessHits;
+    //! Not in the chainstate, so ConnectBlock will reject the block.
+    uint64_t nMisses;
+};
+
+/** Get statistics on the input prefetch */
+void GetCoinsPrefetchStats(CCoinsPrefetchStats& stats);
+
+/** Writes of the coins cache to disk by FlushStateToDisk, times in microseconds */
+struct CCoinsFlushStats {
+    uint64_t nFlushes;
+    //! Time FlushStateToDisk spent on the coins, with cs_main held.
+    int64_t nLastFlushTime;
+    int64_t nTotalFlushTime;
+    //! Time the chainstate database spent writing them in the background (incremental flush mode).
+    int64_t nLastWriteTime;
+    int64_t nTotalWriteTime;
+    uint64_t nLastWritten;
+    uint64_t nEvicted;
+};
+
+/** Get statistics on coins cache flushes */
+void GetCoinsFlushStats(CCoinsFlushStats& stats);
+
+/** Read the coins spent by 'block' that are not cached in pcoinsTip yet from the chainstate (and witness state) database on the
+ *  prefetch threads, and put them in 'view', the cache on top of pcoinsTip (and its witness view) that the block is connected to.
+ *  ConnectBlock then finds every input in memory instead of reading them one after the other. Does nothing without -par threads. */
+void PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& view);
+
+/** Apply the coins 'block' (connected at height nHeight) spends, as recorded in its undo data, and creates to the unspent output
+ *  statistics 'record' of its parent; the witness coins among them are also applied to 'witnessRecord'. */
+void AddCoinsStatsDelta(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CCoinsStatsRecord& record, CCoinsStatsRecord& witnessRecord);
+
+/** Functions for disk access for blocks. ReadBlockFromDisk copies the block out of the block cache when it is there but does not add it */
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const CChainParams& params);
+/** Like ReadBlockFromDisk but hands out the (shared, immutable) copy in the block cache instead of copying it, adding the block to
+ *  the cache when it was not there. nullptr if the block can not be read */
+std::shared_ptr<const CBlock> ReadBlockFromDiskCached(const CBlockIndex* pindex, const CChainParams& params);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -420,6 +550,12 @@ bool IsSegSigEnabled(const CBlockIndex* pindexPrev);
 /** When there are blocks in the active chain with missing data, rewind the chainstate and remove them from the block index */
 bool RewindBlockIndex(const CChainParams& params);
 
+/**
+ * Make a block whose UTXO snapshot has just been written to the (emptied) coin databases the tip of the active chain: the block is stored,
+ * linked with the transaction count of the snapshot and recorded as the snapshot base. Requires cs_main.
+ */
+bool ActivateSnapshotBase(const CBlock& block, CBlockIndex* pindex, uint64_t nChainTx, const CChainParams& chainparams, CValidationState& state);
+
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
 class CVerifyDB {
 public:
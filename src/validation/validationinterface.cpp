@@ -32,6 +32,7 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn)
     g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1, _2));
     g_signals.ScriptForWitnessing.connect(boost::bind(&CValidationInterface::GetScriptForWitnessing, pwalletIn, _1, _2));
     g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    g_signals.AcceptedBlockHeader.connect(boost::bind(&CValidationInterface::AcceptedBlockHeader, pwalletIn, _1));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn)
@@ -47,6 +48,7 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn)
     g_signals.BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    g_signals.AcceptedBlockHeader.disconnect(boost::bind(&CValidationInterface::AcceptedBlockHeader, pwalletIn, _1));
 }
 
 void UnregisterAllValidationInterfaces()
@@ -62,4 +64,5 @@ void UnregisterAllValidationInterfaces()
     g_signals.BlockDisconnected.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
     g_signals.NewPoWValidBlock.disconnect_all_slots();
+    g_signals.AcceptedBlockHeader.disconnect_all_slots();
 }
@@ -53,6 +53,7 @@ protected:
     virtual void GetScriptForMining([[maybe_unused]] std::shared_ptr<CReserveKeyOrScript>&, [[maybe_unused]] CAccount* forAccount) {};
     virtual void GetScriptForWitnessing([[maybe_unused]] std::shared_ptr<CReserveKeyOrScript>&, [[maybe_unused]] CAccount* forAccount) {};
     virtual void NewPoWValidBlock([[maybe_unused]] const CBlockIndex *pindex, [[maybe_unused]] const std::shared_ptr<const CBlock>& block) {};
+    virtual void AcceptedBlockHeader([[maybe_unused]] const CBlockIndex *pindex) {};
     friend void ::RegisterValidationInterface([[maybe_unused]] CValidationInterface* interface);
     friend void ::UnregisterValidationInterface([[maybe_unused]] CValidationInterface* interface);
     friend void ::UnregisterAllValidationInterfaces();
@@ -93,6 +94,9 @@ struct CMainSignals {
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
+
+    //! Notifies listeners that a header we did not know about yet has been added to the block index (not fired during initial block download)
+    boost::signals2::signal<void (const CBlockIndex *)> AcceptedBlockHeader;
 };
 
 CMainSignals& GetMainSignals();
@@ -0,0 +1,204 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/witnesspool.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "util.h"
+#include <Gulden/util.h>
+
+#include <algorithm>
+
+CWitnessPoolIndex witnessPoolIndex;
+
+CWitnessPoolEntry::CWitnessPoolEntry(const COutPoint& outpoint_, const Coin& coin_)
+: outpoint(outpoint_)
+, coin(coin_)
+, nLockFromBlock(0)
+, nLockUntilBlock(0)
+{
+    nWeight = GetPoW2RawWeightForAmount(coin.out.nValue, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nLockFromBlock, nLockUntilBlock));
+}
+
+static bool EraseEntry(std::vector<CWitnessPoolEntry>& entries, const COutPoint& outpoint, CWitnessPoolEntry* erasedOut=nullptr)
+{
+    auto iter = std::lower_bound(entries.begin(), entries.end(), outpoint);
+    if (iter == entries.end() || iter->outpoint != outpoint)
+        return false;
+    if (erasedOut)
+        *erasedOut = std::move(*iter);
+    entries.erase(iter);
+    return true;
+}
+
+// Returns false if the entry replaced an existing one (only possible for duplicate coinbases), in which case the replaced entry is placed in 'replacedOut'.
+static bool InsertEntry(std::vector<CWitnessPoolEntry>& entries, CWitnessPoolEntry&& entry, CWitnessPoolEntry* replacedOut=nullptr)
+{
+    auto iter = std::lower_bound(entries.begin(), entries.end(), entry.outpoint);
+    if (iter != entries.end() && iter->outpoint == entry.outpoint)
+    {
+        if (replacedOut)
+            *replacedOut = std::move(*iter);
+        *iter = std::move(entry);
+        return false;
+    }
+    entries.insert(iter, std::move(entry));
+    return true;
+}
+
+void CWitnessPoolIndex::Clear()
+{
+    entries.clear();
+    history.clear();
+    pindexTip = nullptr;
+}
+
+void CWitnessPoolIndex::Load(const CBlockIndex* pindex, const CCoinsView& witnessView)
+{
+    int64_t nStart = GetTimeMillis();
+
+    Clear();
+    std::map<COutPoint, Coin> allWitnessCoins;
+    witnessView.GetAllCoins(allWitnessCoins);
+    // The map is already ordered by outpoint, so the vector is built sorted.
+    entries.reserve(allWitnessCoins.size());
+    for (const auto& coinIter : allWitnessCoins)
+    {
+        if (!coinIter.second.IsSpent())
+            entries.emplace_back(coinIter.first, coinIter.second);
+    }
+    pindexTip = pindex;
+
+    LogPrint(BCLog::WITNESS, "Witness pool index: loaded %u entries at height %d in %dms\n", entries.size(), pindex ? pindex->nHeight : -1, GetTimeMillis() - nStart);
+}
+
+void CWitnessPoolIndex::ApplyBlock(std::vector<CWitnessPoolEntry>& entriesInOut, const CBlock& block, int nHeight)
+{
+    ApplyBlock(entriesInOut, block, nHeight, nullptr);
+}
+
+// Mirrors the way UpdateCoins and CCoinsViewCache::AddCoin feed witness outputs into the witness coin view.
+void CWitnessPoolIndex::ApplyBlock(std::vector<CWitnessPoolEntry>& entriesInOut, const CBlock& block, int nHeight, CBlockDelta* delta)
+{
+    for (const auto& tx : block.vtx)
+    {
+        if (!tx->IsCoinBase() || tx->IsPoW2WitnessCoinBase())
+        {
+            for (const CTxIn& txin : tx->vin)
+            {
+                if (txin.prevout.IsNull())
+                    continue;
+                CWitnessPoolEntry erased;
+                if (!EraseEntry(entriesInOut, txin.prevout, delta ? &erased : nullptr) || !delta)
+                    continue;
+                // An output that is created and spent within the same block never has to be restored.
+                auto addedIter = std::find(delta->added.begin(), delta->added.end(), txin.prevout);
+                if (addedIter != delta->added.end())
+                    delta->added.erase(addedIter);
+                else
+                    delta->removed.push_back(std::move(erased));
+            }
+        }
+
+        bool fCoinbase = tx->IsCoinBase();
+        const uint256& txid = tx->GetHash();
+        for (unsigned int i = 0; i < tx->vout.size(); ++i)
+        {
+            const CTxOut& out = tx->vout[i];
+            if (!IsPow2WitnessOutput(out) || out.IsUnspendable())
+                continue;
+            COutPoint outpoint(txid, i);
+            CWitnessPoolEntry replaced;
+            if (!InsertEntry(entriesInOut, CWitnessPoolEntry(outpoint, Coin(out, nHeight, fCoinbase, !IsOldTransactionVersion(tx->nVersion))), delta ? &replaced : nullptr) && delta)
+                delta->removed.push_back(std::move(replaced));
+            if (delta)
+                delta->added.push_back(outpoint);
+        }
+    }
+}
+
+void CWitnessPoolIndex::UndoDelta(std::vector<CWitnessPoolEntry>& entriesInOut, const CBlockDelta& delta)
+{
+    for (const COutPoint& outpoint : delta.added)
+        EraseEntry(entriesInOut, outpoint);
+    for (const CWitnessPoolEntry& entry : delta.removed)
+        InsertEntry(entriesInOut, CWitnessPoolEntry(entry));
+}
+
+void CWitnessPoolIndex::ConnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // If we missed a block (or were never built) there is nothing to update, the next query rebuilds the index from the witness coin database.
+    if (!pindexTip || pindexTip != pindex->pprev)
+    {
+        Clear();
+        return;
+    }
+
+    CBlockDelta delta;
+    delta.pindex = pindex;
+    ApplyBlock(entries, block, pindex->nHeight, &delta);
+    history.push_back(std::move(delta));
+    while (history.size() > WITNESS_POOL_HISTORY_DEPTH)
+        history.pop_front();
+    pindexTip = pindex;
+}
+
+void CWitnessPoolIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, const CCoinsView& witnessView)
+{
+    if (!pindexTip || pindexTip != pindex)
+    {
+        Clear();
+        return;
+    }
+
+    if (!history.empty() && history.back().pindex == pindex)
+    {
+        UndoDelta(entries, history.back());
+        history.pop_back();
+    }
+    else
+    {
+        // Block is older than our history, take the restored coins from the witness view instead.
+        for (auto txIter = block.vtx.rbegin(); txIter != block.vtx.rend(); ++txIter)
+        {
+            const CTransaction& tx = **txIter;
+            const uint256& txid = tx.GetHash();
+            for (unsigned int i = 0; i < tx.vout.size(); ++i)
+            {
+                if (IsPow2WitnessOutput(tx.vout[i]))
+                    EraseEntry(entries, COutPoint(txid, i));
+            }
+            if (!tx.IsCoinBase() || tx.IsPoW2WitnessCoinBase())
+            {
+                for (const CTxIn& txin : tx.vin)
+                {
+                    Coin coin;
+                    if (txin.prevout.IsNull() || !witnessView.GetCoin(txin.prevout, coin) || coin.IsSpent() || !IsPow2WitnessOutput(coin.out))
+                        continue;
+                    InsertEntry(entries, CWitnessPoolEntry(txin.prevout, coin));
+                }
+            }
+        }
+    }
+    pindexTip = pindex->pprev;
+}
+
+bool CWitnessPoolIndex::GetWitnessEntries(const CBlockIndex* pindex, std::vector<CWitnessPoolEntry>& entriesOut) const
+{
+    if (!pindexTip || !pindex || pindex->nHeight > pindexTip->nHeight || pindexTip->nHeight - pindex->nHeight > (int)history.size())
+        return false;
+    if (pindexTip->GetAncestor(pindex->nHeight) != pindex)
+        return false;
+
+    entriesOut = entries;
+    const CBlockIndex* pindexCurrent = pindexTip;
+    for (auto deltaIter = history.rbegin(); pindexCurrent != pindex; ++deltaIter)
+    {
+        assert(deltaIter != history.rend() && deltaIter->pindex == pindexCurrent);
+        UndoDelta(entriesOut, *deltaIter);
+        pindexCurrent = pindexCurrent->pprev;
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_WITNESS_POOL_H
+#define GULDEN_WITNESS_POOL_H
+
+#include "coins.h"
+#include "primitives/transaction.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+
+//! Number of most recently connected blocks for which the witness pool keeps enough information to answer queries at that height.
+static const unsigned int WITNESS_POOL_HISTORY_DEPTH = 100;
+
+/** A single unspent witness output along with the values that the witness selection needs from it. */
+class CWitnessPoolEntry
+{
+public:
+    CWitnessPoolEntry() : nWeight(0), nLockFromBlock(0), nLockUntilBlock(0) {}
+    CWitnessPoolEntry(const COutPoint& outpoint_, const Coin& coin_);
+
+    COutPoint outpoint;
+    Coin coin;
+    //! Raw (uncapped) witness weight of the output.
+    int64_t nWeight;
+    //! Lock period of the output, the age of an entry at a given height is that height minus coin.nHeight.
+    uint64_t nLockFromBlock;
+    uint64_t nLockUntilBlock;
+
+    friend inline bool operator<(const CWitnessPoolEntry& a, const CWitnessPoolEntry& b)
+    {
+        return a.outpoint < b.outpoint;
+    }
+    friend inline bool operator<(const CWitnessPoolEntry& a, const COutPoint& b)
+    {
+        return a.outpoint < b;
+    }
+};
+
+/**
+ * All unspent witness outputs of the chain that ends in Tip(), sorted by outpoint.
+ * The index is built once from the witness coin database (witstate/) and from then on kept up to date by ConnectTip/DisconnectTip,
+ * so that witness selection and network weight queries for the tip (or a recent ancestor of it) become a lookup instead of a chain clone and replay.
+ * All access is protected by cs_main.
+ */
+class CWitnessPoolIndex
+{
+public:
+    CWitnessPoolIndex() : pindexTip(nullptr) {}
+
+    //! The block the index is currently at, or nullptr if it has not been built (or has been invalidated).
+    const CBlockIndex* Tip() const { return pindexTip; }
+    const std::vector<CWitnessPoolEntry>& Entries() const { return entries; }
+
+    void Clear();
+
+    //! (Re)build the index from all coins in 'witnessView', which must be at 'pindex'.
+    void Load(const CBlockIndex* pindex, const CCoinsView& witnessView);
+
+    //! Apply a block that has just been connected on top of Tip().
+    void ConnectBlock(const CBlock& block, const CBlockIndex* pindex);
+
+    //! Undo Tip(), which has just been disconnected; 'witnessView' must already have the spent witness coins of the block restored.
+    void DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, const CCoinsView& witnessView);
+
+    //! Retrieve the witness pool as it was at 'pindex', which has to be Tip() or one of its last WITNESS_POOL_HISTORY_DEPTH ancestors.
+    bool GetWitnessEntries(const CBlockIndex* pindex, std::vector<CWitnessPoolEntry>& entriesOut) const;
+
+    //! Apply the transactions of a (not yet connected) block at height 'nHeight' to a copy of the pool.
+    static void ApplyBlock(std::vector<CWitnessPoolEntry>& entriesInOut, const CBlock& block, int nHeight);
+
+private:
+    //! Witness outputs created and spent by a connected block, used to step the pool back to a previous height.
+    struct CBlockDelta
+    {
+        const CBlockIndex* pindex;
+        std::vector<COutPoint> added;
+        std::vector<CWitnessPoolEntry> removed;
+    };
+
+    static void ApplyBlock(std::vector<CWitnessPoolEntry>& entriesInOut, const CBlock& block, int nHeight, CBlockDelta* delta);
+    static void UndoDelta(std::vector<CWitnessPoolEntry>& entriesInOut, const CBlockDelta& delta);
+
+    std::vector<CWitnessPoolEntry> entries;
+    std::deque<CBlockDelta> history;
+    const CBlockIndex* pindexTip;
+};
+
+/** Global witness pool for chainActive (protected by cs_main) */
+extern CWitnessPoolIndex witnessPoolIndex;
+
+#endif // GULDEN_WITNESS_POOL_H
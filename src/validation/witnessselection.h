@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_WITNESS_SELECTION_H
+#define GULDEN_WITNESS_SELECTION_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Fenwick (binary indexed) tree over the weights of the witness selection pool, in selection order.
+ * Entries that are not eligible simply have a weight of zero, so they are skipped by the selection without having to be removed.
+ * Build is O(n), changing a single weight and finding the entry a roulette seed lands on are O(log n).
+ */
+class CWitnessSelectionTree
+{
+public:
+    void Build(const std::vector<uint64_t>& vWeightsIn)
+    {
+        vWeights = vWeightsIn;
+        vTree.assign(vWeights.size() + 1, 0);
+        for (size_t i = 1; i < vTree.size(); ++i)
+        {
+            vTree[i] += vWeights[i - 1];
+            size_t nParent = i + (i & (~i + 1));
+            if (nParent < vTree.size())
+                vTree[nParent] += vTree[i];
+        }
+    }
+
+    size_t Size() const
+    {
+        return vWeights.size();
+    }
+
+    uint64_t Weight(size_t nIndex) const
+    {
+        return vWeights[nIndex];
+    }
+
+    void Update(size_t nIndex, uint64_t nWeight)
+    {
+        assert(nIndex < vWeights.size());
+        uint64_t nOld = vWeights[nIndex];
+        vWeights[nIndex] = nWeight;
+        // Unsigned wrap around gives the right result for decreases as well.
+        for (size_t i = nIndex + 1; i < vTree.size(); i += (i & (~i + 1)))
+            vTree[i] += nWeight - nOld;
+    }
+
+    //! Sum of the weights of entries [0, nCount).
+    uint64_t PrefixSum(size_t nCount) const
+    {
+        uint64_t nSum = 0;
+        for (size_t i = nCount; i > 0; i -= (i & (~i + 1)))
+            nSum += vTree[i];
+        return nSum;
+    }
+
+    uint64_t Total() const
+    {
+        return PrefixSum(vWeights.size());
+    }
+
+    //! Index of the first entry whose cumulative weight (its own weight included) is at least nTarget; Size() if there is none.
+    //! Same as std::lower_bound over the cumulative weights, so for a non zero target it never lands on an entry with a weight of zero.
+    size_t LowerBound(uint64_t nTarget) const
+    {
+        size_t nStep = 1;
+        while (nStep * 2 < vTree.size())
+            nStep *= 2;
+        size_t nPos = 0;
+        for (; nStep > 0; nStep /= 2)
+        {
+            if (nPos + nStep < vTree.size() && vTree[nPos + nStep] < nTarget)
+            {
+                nPos += nStep;
+                nTarget -= vTree[nPos];
+            }
+        }
+        return nPos;
+    }
+
+private:
+    std::vector<uint64_t> vWeights;
+    std::vector<uint64_t> vTree;
+};
+
+#endif // GULDEN_WITNESS_SELECTION_H
@@ -7,6 +7,8 @@
 
 #include "validation/validation.h"
 #include "validation/witnessvalidation.h"
+#include "validation/witnesspool.h"
+#include "validation/witnessselection.h"
 #include <consensus/validation.h>
 #include <Gulden/util.h>
 #include "timedata.h" // GetAdjustedTime()
@@ -89,16 +91,15 @@ std::vector<CBlockIndex*> GetTopLevelWitnessOrphans(const int64_t nHeight)
 CBlockIndex* GetWitnessOrphanForBlock(const int64_t nHeight, const uint256& prevHash, const uint256& powHash)
 {
     LOCK(cs_main);
-    for (const auto candidateIter : setBlockIndexCandidates)
+    auto range = mapBlockIndexLegacy.equal_range(powHash);
+    for (auto iter = range.first; iter != range.second; ++iter)
     {
-        if (candidateIter->nVersionPoW2Witness != 0)
+        CBlockIndex* candidateIter = iter->second;
+        if (candidateIter->nHeight == nHeight && candidateIter->pprev && *candidateIter->pprev->phashBlock == prevHash)
         {
-            if (candidateIter->nHeight == nHeight && candidateIter->pprev && *candidateIter->pprev->phashBlock == prevHash)
+            if (setBlockIndexCandidates.count(candidateIter) > 0)
             {
-                if (candidateIter->GetBlockHashLegacy() == powHash)
-                {
-                    return candidateIter;
-                }
+                return candidateIter;
             }
         }
     }
@@ -249,6 +250,77 @@ uint64_t estimatedWitnessBlockPeriod(uint64_t nWeight, uint64_t networkTotalWeig
 }
 
 
+static void StripWitnessFromBlock(CBlock& block)
+{
+    if (block.nVersionPoW2Witness != 0)
+    {
+        for (unsigned int i = 1; i < block.vtx.size(); i++)
+        {
+            if (block.vtx[i]->IsCoinBase() && block.vtx[i]->IsPoW2WitnessCoinBase())
+            {
+                while (block.vtx.size() > i)
+                {
+                    block.vtx.pop_back();
+                }
+                break;
+            }
+        }
+        block.nVersionPoW2Witness = 0;
+        block.nTimePoW2Witness = 0;
+        block.hashMerkleRootPoW2Witness = uint256();
+        block.witnessHeaderPoW2Sig.clear();
+    }
+}
+
+// Look the witness coins up in the witness pool index instead of cloning and replaying the chain.
+// Only possible for the active chain tip (optionally with a new block on top of it) or one of its recent ancestors; returns false if the caller has to fall back to the replay.
+static bool getAllUnspentWitnessCoinsFromPool(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain, std::map<COutPoint, Coin>& allWitnessCoins, CBlock* newBlock, CCoinsViewCache* viewOverride, bool& fResult)
+{
+    AssertLockHeld(cs_main);
+
+    // A view override carries changes that have not been flushed to the tip yet, which the index knows nothing about.
+    if (viewOverride || &chain != &chainActive || !ppow2witTip || !chainActive.Tip())
+        return false;
+    if (newBlock && pPreviousIndexChain != chainActive.Tip())
+        return false;
+    // For phase 3 the pool is taken at the PoW block that is embedded in the tip, which the index does not track.
+    if (pPreviousIndexChain->nVersionPoW2Witness != 0 && !IsPow2Phase4Active(pPreviousIndexChain->pprev, chainParams, chain))
+        return false;
+
+    if (witnessPoolIndex.Tip() != chainActive.Tip())
+    {
+        if (pcoinsTip->GetBestBlock() != chainActive.Tip()->GetBlockHashPoW2())
+            return false;
+        witnessPoolIndex.Load(chainActive.Tip(), *ppow2witTip);
+    }
+
+    std::vector<CWitnessPoolEntry> poolEntries;
+    if (!witnessPoolIndex.GetWitnessEntries(pPreviousIndexChain, poolEntries))
+        return false;
+
+    if (newBlock)
+    {
+        StripWitnessFromBlock(*newBlock);
+
+        CValidationState state;
+        CCoinsViewCache viewNew(pcoinsTip);
+        CBlockIndex indexDummy(*newBlock);
+        indexDummy.pprev = const_cast<CBlockIndex*>(pPreviousIndexChain);
+        indexDummy.nHeight = pPreviousIndexChain->nHeight + 1;
+        if (!ConnectBlock(chain, *newBlock, state, &indexDummy, viewNew, chainParams, true, false))
+        {
+            fResult = false;
+            return true;
+        }
+        CWitnessPoolIndex::ApplyBlock(poolEntries, *newBlock, indexDummy.nHeight);
+    }
+
+    for (const auto& entry : poolEntries)
+        allWitnessCoins.emplace_hint(allWitnessCoins.end(), entry.outpoint, entry.coin);
+    fResult = true;
+    return true;
+}
+
 bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain_, std::map<COutPoint, Coin>& allWitnessCoins, CBlock* newBlock, CCoinsViewCache* viewOverride)
 {
     DO_BENCHMARK("WIT: getAllUnspentWitnessCoins", BCLog::BENCH|BCLog::WITNESS);
@@ -268,7 +340,10 @@ bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, c
     if (pPreviousIndexChain_->nHeight < GetPow2ValidationCloneHeight())
         return true;
 
-    // fixme: (2.1) SBSU - We really don't need to clone the entire chain here, could we clone just the last 1000 or something?
+    bool fResult = false;
+    if (getAllUnspentWitnessCoinsFromPool(chain, chainParams, pPreviousIndexChain_, allWitnessCoins, newBlock, viewOverride, fResult))
+        return fResult;
+
     // We work on a clone of the chain to prevent modifying the actual chain.
     CBlockIndex* pPreviousIndexChain = nullptr;
     CCloneChain tempChain(chain, GetPow2ValidationCloneHeight(), pPreviousIndexChain_, pPreviousIndexChain);
@@ -294,24 +369,7 @@ bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, c
     if (newBlock)
     {
         // Strip any witness information from the block we have been given we want a non-witness block as the tip in order to calculate the witness for it.
-        if (newBlock->nVersionPoW2Witness != 0)
-        {
-            for (unsigned int i = 1; i < newBlock->vtx.size(); i++)
-            {
-                if (newBlock->vtx[i]->IsCoinBase() && newBlock->vtx[i]->IsPoW2WitnessCoinBase())
-                {
-                    while (newBlock->vtx.size() > i)
-                    {
-                        newBlock->vtx.pop_back();
-                    }
-                    break;
-                }
-            }
-            newBlock->nVersionPoW2Witness = 0;
-            newBlock->nTimePoW2Witness = 0;
-            newBlock->hashMerkleRootPoW2Witness = uint256();
-            newBlock->witnessHeaderPoW2Sig.clear();
-        }
+        StripWitnessFromBlock(*newBlock);
 
         // Place the block in question at the tip of the chain.
         CBlockIndex indexDummy(*newBlock);
@@ -338,43 +396,56 @@ bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, c
 
 //fixme: (2.0.1) Improve error handling.
 //fixme: (2.1) Handle nodes with excessive pruning. //pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
-bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight, bool fPopulateFilteredPool)
 {
     DO_BENCHMARK("WIT: GetWitnessHelper", BCLog::BENCH|BCLog::WITNESS);
 
     LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
 
+    const std::vector<RouletteItem>& pool = witnessInfo.witnessSelectionPoolUnfiltered;
+
+    /** Ensure the pool is sorted deterministically **/
+    std::vector<uint32_t> vOrder(pool.size());
+    for (uint32_t i = 0; i < vOrder.size(); ++i)
+        vOrder[i] = i;
+    std::sort(vOrder.begin(), vOrder.end(), [&](uint32_t a, uint32_t b){ return pool[a] < pool[b]; });
+
     /** Generate the pool of potential witnesses for the given block index **/
     /** Addresses older than 10000 blocks or younger than 100 blocks are discarded **/
+    /** Eliminate addresses that have witnessed within the last `gMinimumParticipationAge` blocks **/
+    /** Eliminate addresses that have not witnessed within the expected period of time that they should have **/
+    /** Eliminate addresses that are within 100 blocks from lock period expiring, or whose lock period has expired. **/
+    // An address that has not expired remains eligible for as long as both its age and its remaining lock period exceed the minimum age.
+    // So the minimum age at which it drops out only needs to be computed once, and trying a smaller minimum age is just a count.
+    std::vector<uint64_t> vEligibleUntil(vOrder.size(), 0);
+    std::vector<uint64_t> vSortedEligibleUntil;
+    vSortedEligibleUntil.reserve(vOrder.size());
+    for (size_t i = 0; i < vOrder.size(); ++i)
+    {
+        const RouletteItem& item = pool[vOrder[i]];
+        if (witnessHasExpired(item.nAge, item.nWeight, witnessInfo.nTotalWeight))
+            continue;
+        CTxOutPoW2Witness details;
+        GetPow2WitnessOutput(item.coin.out, details);
+        vEligibleUntil[i] = std::min(item.nAge, GetPoW2RemainingLockLengthInBlocks(details.lockUntilBlock, nBlockHeight));
+        vSortedEligibleUntil.push_back(vEligibleUntil[i]);
+    }
+    std::sort(vSortedEligibleUntil.begin(), vSortedEligibleUntil.end());
+
     uint64_t nMinAge = gMinimumParticipationAge;
+    size_t nNumEligible = 0;
     while (true)
     {
-        witnessInfo.witnessSelectionPoolFiltered.clear();
-        witnessInfo.witnessSelectionPoolFiltered = witnessInfo.witnessSelectionPoolUnfiltered;
-
-        //LogPrint(BCLog::WITNESS, "Witness pool size1b: %d minage: %d\n", witnessInfo.witnessSelectionPoolFiltered.size(), nMinAge);
-        /** Eliminate addresses that have witnessed within the last `gMinimumParticipationAge` blocks **/
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ return (x.nAge <= nMinAge); }), witnessInfo.witnessSelectionPoolFiltered.end());
-        //LogPrint(BCLog::WITNESS, "Witness pool size1a %d minage: %d\n", witnessInfo.witnessSelectionPoolFiltered.size(), nMinAge);
-
-        /** Eliminate addresses that have not witnessed within the expected period of time that they should have **/
-        //LogPrint(BCLog::WITNESS, "Witness pool size2b: %d minage: %d\n", witnessInfo.witnessSelectionPoolFiltered.size(), nMinAge);
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ return witnessHasExpired(x.nAge, x.nWeight, witnessInfo.nTotalWeight); }), witnessInfo.witnessSelectionPoolFiltered.end());
-        //LogPrint(BCLog::WITNESS, "Witness pool size2a: %d minage: %d\n", witnessInfo.witnessSelectionPoolFiltered.size(), nMinAge);
-
-        /** Eliminate addresses that are within 100 blocks from lock period expiring, or whose lock period has expired. **/
-        //LogPrint(BCLog::WITNESS, "Witness pool size3b: %d minage: %d\n", witnessInfo.witnessSelectionPoolFiltered.size(), nMinAge);
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ CTxOutPoW2Witness details; GetPow2WitnessOutput(x.coin.out, details); return (GetPoW2RemainingLockLengthInBlocks(details.lockUntilBlock, nBlockHeight) <= nMinAge); }), witnessInfo.witnessSelectionPoolFiltered.end());
-        //LogPrint(BCLog::WITNESS, "Witness pool size3a: %d minage: %d\n", witnessInfo.witnessSelectionPoolFiltered.size(), nMinAge);
+        nNumEligible = vSortedEligibleUntil.end() - std::upper_bound(vSortedEligibleUntil.begin(), vSortedEligibleUntil.end(), nMinAge);
 
         // We must have at least 100 accounts to keep odds of being selected down below 1% at all times.
-        if (witnessInfo.witnessSelectionPoolFiltered.size() < 100)
+        if (nNumEligible < 100)
         {
             //fixme: (2.1) activate warning
             // if(!fTestnet)
             // CAlert::Notify("Warning network is experiencing low levels of witnessing participants!");
             // NB!! This part of the code should (ideally) never actually be used, it exists only for instances where there are a shortage of witnesses paticipating on the network.
-            if (nMinAge == 0 || (nMinAge <= 10 && witnessInfo.witnessSelectionPoolFiltered.size() > 5))
+            if (nMinAge == 0 || (nMinAge <= 10 && nNumEligible > 5))
             {
                 break;
             }
@@ -390,26 +461,43 @@ bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t
         }
     }
 
-    if (witnessInfo.witnessSelectionPoolFiltered.size() == 0)
+    witnessInfo.witnessSelectionPoolFiltered.clear();
+    if (nNumEligible == 0)
     {
         return error("Unable to determine any witnesses for block.");
     }
 
-    /** Ensure the pool is sorted deterministically **/
-    std::sort(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end());
-
     /** Reduce larger weightings to a maximum weighting of 1% of network weight. **/
     /** NB!! this actually will end up a little bit more than 1% as the overall network weight will also be reduced as a result. **/
     /** This is however unimportant as 1% is in and of itself also somewhat arbitrary, simpler code is favoured here over exactness. **/
     /** So we delibritely make no attempt to compensate for this. **/
     witnessInfo.nMaxIndividualWeight = witnessInfo.nTotalWeight / 100;
-    witnessInfo.nReducedTotalWeight = 0;
-    for (auto& item : witnessInfo.witnessSelectionPoolFiltered)
+    std::vector<uint64_t> vWeights(vOrder.size(), 0);
+    size_t nFirstEligible = vOrder.size();
+    for (size_t i = 0; i < vOrder.size(); ++i)
+    {
+        if (vEligibleUntil[i] <= nMinAge)
+            continue;
+        if (nFirstEligible == vOrder.size())
+            nFirstEligible = i;
+        vWeights[i] = std::min(pool[vOrder[i]].nWeight, witnessInfo.nMaxIndividualWeight);
+        if (fPopulateFilteredPool)
+        {
+            witnessInfo.witnessSelectionPoolFiltered.push_back(pool[vOrder[i]]);
+            witnessInfo.witnessSelectionPoolFiltered.back().nWeight = vWeights[i];
+        }
+    }
+    CWitnessSelectionTree selectionTree;
+    selectionTree.Build(vWeights);
+    witnessInfo.nReducedTotalWeight = selectionTree.Total();
+    if (fPopulateFilteredPool)
     {
-        if (item.nWeight > witnessInfo.nMaxIndividualWeight)
-            item.nWeight = witnessInfo.nMaxIndividualWeight;
-        witnessInfo.nReducedTotalWeight += item.nWeight;
-        item.nCumulativeWeight = witnessInfo.nReducedTotalWeight;
+        uint64_t nCumulativeWeight = 0;
+        for (auto& item : witnessInfo.witnessSelectionPoolFiltered)
+        {
+            nCumulativeWeight += item.nWeight;
+            item.nCumulativeWeight = nCumulativeWeight;
+        }
     }
 
     /** sha256 as random roulette spin/seed - NB! We deliritely use sha256 and -not- the normal PoW hash here as the normal PoW hash is biased towards certain number ranges by -design- (block target) so is not a good RNG... **/
@@ -430,11 +518,16 @@ bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t
     }
     //LogPrint(BCLog::WITNESS, "RNG2 %d %d\n", rouletteSelectionSeed.GetLow64(), witnessInfo.nReducedTotalWeight);
 
-    auto selectedWitness = std::lower_bound(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), rouletteSelectionSeed.GetLow64());
-    //LogPrint(BCLog::WITNESS, "Selected witness age %d\n", selectedWitness->nAge);
-    witnessInfo.selectedWitnessTransaction = selectedWitness->coin.out;
-    witnessInfo.selectedWitnessBlockHeight = selectedWitness->coin.nHeight;
-    witnessInfo.selectedWitnessOutpoint = selectedWitness->outpoint;
+    // A seed of zero lands on the first eligible witness, whatever its weight.
+    uint64_t nSeed = rouletteSelectionSeed.GetLow64();
+    size_t nSelected = nSeed == 0 ? nFirstEligible : selectionTree.LowerBound(nSeed);
+    if (nSelected >= vOrder.size())
+        return error("Unable to determine any witnesses for block.");
+    const RouletteItem& selectedWitness = pool[vOrder[nSelected]];
+    //LogPrint(BCLog::WITNESS, "Selected witness age %d\n", selectedWitness.nAge);
+    witnessInfo.selectedWitnessTransaction = selectedWitness.coin.out;
+    witnessInfo.selectedWitnessBlockHeight = selectedWitness.coin.nHeight;
+    witnessInfo.selectedWitnessOutpoint = selectedWitness.outpoint;
 
     return true;
 }
@@ -480,7 +573,8 @@ bool GetWitness(CChain& chain, const CChainParams& chainParams, CCoinsViewCache*
     if (!GetWitnessInfo(chain, chainParams, viewOverride, pPreviousIndexChain, block, witnessInfo, nBlockHeight))
         return false;
 
-    return GetWitnessHelper(block.GetHashLegacy(), witnessInfo, nBlockHeight);
+    // Nothing on this path looks at the filtered pool, so don't spend time materialising it.
+    return GetWitnessHelper(block.GetHashLegacy(), witnessInfo, nBlockHeight, false);
 }
 
 // Ideally this should have been some hybrid of witInfo.nTotalWeight / witInfo.nReducedTotalWeight - as both independantly aren't perfect.
@@ -617,7 +711,6 @@ bool WitnessCoinbaseInfoIsValid(CChain& chain, int nWitnessCoinbaseIndex, const
     }
 
     // Now test that the reconstructed witness block is valid, if it is then the 'witness coinbase info' of this PoW block is valid.
-    // fixme: (2.1) SBSU - We really don't need to clone the entire chain here, could we clone just the last 1000 or something?
     // We work on a clone of the chain to prevent modifying the actual chain.
     {
         CBlockIndex* pPreviousIndexChain = nullptr;
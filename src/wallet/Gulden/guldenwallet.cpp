@@ -247,6 +247,24 @@ isminetype IsMine(const CWallet &wallet, const CTxOut& out)
     LOCK(wallet.cs_wallet);
 
     isminetype ret = isminetype::ISMINE_NO;
+    CKeyID spendingKeyID;
+    CKeyID witnessKeyID;
+    if (fWitnessHosting && CWitnessKeyIndex::GetWitnessKeyIDs(out, spendingKeyID, witnessKeyID))
+    {
+        // Witness only accounts hold nothing but keys, so for a witness output the index answers for all of them at once.
+        if (wallet.witnessKeyIndex.Find(spendingKeyID) || wallet.witnessKeyIndex.Find(witnessKeyID))
+            return ISMINE_SPENDABLE;
+        for (const auto& account : wallet.witnessKeyIndex.GetOtherAccounts())
+        {
+            isminetype temp = IsMine(*account, out);
+            if (temp > ret)
+                ret = temp;
+            if (ret >= ISMINE_SPENDABLE)
+                return ret;
+        }
+        return ret;
+    }
+
     for (const auto& [accountUUID, account] : wallet.mapAccounts)
     {
         (unused)accountUUID;
@@ -501,6 +519,7 @@ void CGuldenWallet::deleteAccount(CAccount* account, bool shouldPurge)
 
         mapAccountLabels.erase(mapAccountLabels.find(account->getUUID()));
         mapAccounts.erase(mapAccounts.find(account->getUUID()));
+        witnessKeyIndex.RemoveAccount(account);
 
         // Make sure we are no longer the active account
         if(getActiveAccount()->getUUID() == account->getUUID())
@@ -555,6 +574,7 @@ void CGuldenWallet::addAccount(CAccount* account, const std::string& newName, bo
             throw std::runtime_error("Writing account failed");
         }
         mapAccounts[account->getUUID()] = account;
+        witnessKeyIndex.AddAccount(account);
         changeAccountName(account, newName, false);
     }
     NotifyAccountAdded(static_cast<CWallet*>(this), account);
@@ -1120,6 +1140,7 @@ bool CGuldenWallet::AddHDKeyPubKey(int64_t HDKeyIndex, const CPubKey &pubkey, CA
 bool CGuldenWallet::LoadHDKey(int64_t HDKeyIndex, int64_t keyChain, const CPubKey &pubkey, const std::string& forAccount)
 {
     LOCK(cs_wallet);
+    witnessKeyIndex.SetDirty();
     return mapAccounts[getUUIDFromString(forAccount)]->AddKeyPubKey(HDKeyIndex, pubkey, keyChain);
 }
 
@@ -1142,5 +1163,6 @@ CPubKey CWallet::GenerateNewKey(CAccount& forAccount, int keyChain)
 bool CWallet::LoadKey(const CKey& key, const CPubKey &pubkey, const std::string& forAccount, int64_t nKeyChain)
 {
     LOCK(cs_wallet);
+    witnessKeyIndex.SetDirty();
     return mapAccounts[getUUIDFromString(forAccount)]->AddKeyPubKey(key, pubkey, nKeyChain);
 }
@@ -30,6 +30,7 @@
 
 //Gulden specific includes
 #include "wallet/walletdberrors.h"
+#include "wallet/Gulden/witnesskeyindex.h"
 #include "account.h"
 
 #include <boost/thread.hpp>
@@ -83,6 +84,7 @@ public:
             if (!seedPair.second->Lock())
                 ret = false;
         }
+        witnessKeyIndex.ForgetKeys();
         return ret;
     }
 
@@ -147,6 +149,19 @@ public:
     virtual bool GetKey(const CKeyID &address, CKey& keyOut) const
     {
         LOCK(cs_wallet);
+        if (fWitnessHosting)
+        {
+            if (witnessKeyIndex.GetKey(address, keyOut))
+                return true;
+            if (witnessKeyIndex.Find(address))
+                return false;
+            for (const auto& account : witnessKeyIndex.GetOtherAccounts())
+            {
+                if (account->GetKey(address, keyOut))
+                    return true;
+            }
+            return false;
+        }
         for (auto accountPair : mapAccounts)
         {
             if (accountPair.second->GetKey(address, keyOut))
@@ -216,6 +231,17 @@ public:
     virtual bool HaveKey(const CKeyID &address) const
     {
         LOCK(cs_wallet);
+        if (fWitnessHosting)
+        {
+            if (witnessKeyIndex.Find(address))
+                return true;
+            for (const auto& account : witnessKeyIndex.GetOtherAccounts())
+            {
+                if (account->HaveKey(address))
+                    return true;
+            }
+            return false;
+        }
         for (auto accountPair : mapAccounts)
         {
             if (accountPair.second->HaveKey(address))
@@ -289,6 +315,8 @@ public:
 
     std::map<boost::uuids::uuid, CHDSeed*> mapSeeds;
     std::map<boost::uuids::uuid, CAccount*> mapAccounts;
+    //! Witness key index over mapAccounts, only used with -witnesshosting.
+    mutable CWitnessKeyIndex witnessKeyIndex{mapAccounts};
     std::map<boost::uuids::uuid, std::string> mapAccountLabels;
     std::map<uint256, CWalletTx> mapWallet;
 
@@ -0,0 +1,190 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "wallet/Gulden/witnesskeyindex.h"
+
+#include "account.h"
+#include "primitives/transaction.h"
+#include "script/standard.h"
+#include "util.h"
+
+#include <algorithm>
+
+bool fWitnessHosting = DEFAULT_WITNESS_HOSTING;
+
+void CWitnessKeyIndex::SetDirty()
+{
+    fDirty = true;
+    index.clear();
+    otherAccounts.clear();
+}
+
+void CWitnessKeyIndex::Rebuild()
+{
+    index.clear();
+    otherAccounts.clear();
+    for (const auto& [accountUUID, account] : accounts)
+    {
+        (unused)accountUUID;
+        IndexAccount(account);
+    }
+    fDirty = false;
+}
+
+void CWitnessKeyIndex::IndexAccount(CAccount* account)
+{
+    if (account->m_Type != WitnessOnlyWitnessAccount)
+    {
+        if (std::find(otherAccounts.begin(), otherAccounts.end(), account) == otherAccounts.end())
+            otherAccounts.push_back(account);
+        return;
+    }
+
+    std::set<CKeyID> setKeyIDs;
+    account->GetKeys(setKeyIDs);
+    bool fUnlocked = !account->IsLocked();
+    for (const auto& keyID : setKeyIDs)
+    {
+        CEntry& entry = index[keyID];
+        entry.account = account;
+        entry.key.reset();
+        if (fUnlocked)
+        {
+            entry.key.reset(new CKey());
+            if (!account->GetKey(keyID, *entry.key))
+                entry.key.reset();
+        }
+    }
+}
+
+void CWitnessKeyIndex::AddAccount(CAccount* account)
+{
+    if (fDirty)
+        return;
+    IndexAccount(account);
+}
+
+void CWitnessKeyIndex::RemoveAccount(CAccount* account)
+{
+    if (fDirty)
+        return;
+    for (auto iter = index.begin(); iter != index.end();)
+    {
+        if (iter->second.account == account)
+            iter = index.erase(iter);
+        else
+            ++iter;
+    }
+    otherAccounts.erase(std::remove(otherAccounts.begin(), otherAccounts.end(), account), otherAccounts.end());
+}
+
+void CWitnessKeyIndex::AddKey(CAccount* account, const CKeyID& keyID)
+{
+    if (fDirty || account->m_Type != WitnessOnlyWitnessAccount)
+        return;
+    // Keys are imported into a new account before it is added to the wallet, AddAccount picks those up.
+    auto accountIter = accounts.find(account->getUUID());
+    if (accountIter == accounts.end() || accountIter->second != account)
+        return;
+    CEntry& entry = index[keyID];
+    entry.account = account;
+    entry.key.reset();
+}
+
+void CWitnessKeyIndex::ForgetKeys()
+{
+    for (auto& [keyID, entry] : index)
+    {
+        (unused)keyID;
+        entry.key.reset();
+    }
+}
+
+CAccount* CWitnessKeyIndex::Find(const CKeyID& keyID)
+{
+    if (fDirty)
+        Rebuild();
+    auto findIter = index.find(keyID);
+    if (findIter == index.end())
+        return nullptr;
+    return findIter->second.account;
+}
+
+CAccount* CWitnessKeyIndex::Find(const CTxOut& out)
+{
+    CKeyID spendingKeyID;
+    CKeyID witnessKeyID;
+    if (!GetWitnessKeyIDs(out, spendingKeyID, witnessKeyID))
+        return nullptr;
+    CAccount* account = Find(spendingKeyID);
+    if (!account)
+        account = Find(witnessKeyID);
+    return account;
+}
+
+bool CWitnessKeyIndex::GetKey(const CKeyID& keyID, CKey& keyOut)
+{
+    if (fDirty)
+        Rebuild();
+    auto findIter = index.find(keyID);
+    if (findIter == index.end())
+        return false;
+
+    CEntry& entry = findIter->second;
+    // Never hand out a key for an account that has been locked in the meantime.
+    if (entry.account->IsLocked())
+    {
+        entry.key.reset();
+        return false;
+    }
+    if (!entry.key)
+    {
+        std::unique_ptr<CKey> key(new CKey());
+        if (!entry.account->GetKey(keyID, *key))
+            return false;
+        entry.key = std::move(key);
+    }
+    keyOut = *entry.key;
+    return true;
+}
+
+const std::vector<CAccount*>& CWitnessKeyIndex::GetOtherAccounts()
+{
+    if (fDirty)
+        Rebuild();
+    return otherAccounts;
+}
+
+size_t CWitnessKeyIndex::Size()
+{
+    if (fDirty)
+        Rebuild();
+    return index.size();
+}
+
+bool CWitnessKeyIndex::IsWitnessOutput(const CTxOut& out)
+{
+    return out.GetType() == CTxOutType::PoW2WitnessOutput || (out.GetType() <= CTxOutType::ScriptLegacyOutput && out.output.scriptPubKey.IsPoW2Witness());
+}
+
+bool CWitnessKeyIndex::GetWitnessKeyIDs(const CTxOut& out, CKeyID& spendingKeyID, CKeyID& witnessKeyID)
+{
+    if (out.GetType() == CTxOutType::PoW2WitnessOutput)
+    {
+        spendingKeyID = out.output.witnessDetails.spendingKeyID;
+        witnessKeyID = out.output.witnessDetails.witnessKeyID;
+        return true;
+    }
+    if (IsWitnessOutput(out))
+    {
+        std::vector<std::vector<unsigned char>> vSolutions;
+        txnouttype whichType;
+        if (!Solver(out.output.scriptPubKey, whichType, vSolutions) || whichType != TX_PUBKEYHASH_POW2WITNESS)
+            return false;
+        spendingKeyID = CKeyID(uint160(vSolutions[0]));
+        witnessKeyID = CKeyID(uint160(vSolutions[1]));
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_WALLET_WITNESSKEYINDEX_H
+#define GULDEN_WALLET_WITNESSKEYINDEX_H
+
+#include "crypto/common.h"
+#include "key.h"
+#include "pubkey.h"
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <boost/uuid/uuid.hpp>
+
+class CAccount;
+class CTxOut;
+
+//! Default for -witnesshosting
+static const bool DEFAULT_WITNESS_HOSTING = false;
+
+/** Set by -witnesshosting, see CWitnessKeyIndex */
+extern bool fWitnessHosting;
+
+struct KeyIDHasher
+{
+    size_t operator()(const CKeyID& keyID) const { return ReadLE64(keyID.begin()); }
+};
+
+/**
+ * Key ID -> account index over the "witness only" accounts of a wallet, used in witness hosting mode (-witnesshosting).
+ * A node that witnesses for thousands of imported witness only accounts would otherwise ask every account in turn whether it holds a key,
+ * for every candidate block and for every witness coin when preparing coinbase templates. With the index the witness only accounts are
+ * a single lookup and only the (few) accounts of other types are still asked one by one.
+ *
+ * While an indexed account is unlocked its private keys are held here already decrypted, so signing as witness does not have to decrypt
+ * the key again; CKey keeps the key material in locked memory. ForgetKeys drops them again when the wallet is locked.
+ *
+ * The index is built from the accounts on first use after SetDirty and kept up to date incrementally after that.
+ * All methods have to be called with cs_wallet of the owning wallet held.
+ */
+class CWitnessKeyIndex
+{
+public:
+    explicit CWitnessKeyIndex(const std::map<boost::uuids::uuid, CAccount*>& accounts_) : accounts(accounts_), fDirty(true) {}
+
+    //! Throw the index away, it is rebuilt from the accounts the next time it is used.
+    void SetDirty();
+
+    //! Account was added to the wallet.
+    void AddAccount(CAccount* account);
+
+    //! Account was purged from the wallet.
+    void RemoveAccount(CAccount* account);
+
+    //! Key was added to an account that is already part of the wallet.
+    void AddKey(CAccount* account, const CKeyID& keyID);
+
+    //! Drop all decrypted keys.
+    void ForgetKeys();
+
+    //! The witness only account that holds 'keyID', nullptr if there is none.
+    CAccount* Find(const CKeyID& keyID);
+
+    //! The witness only account that holds the spending or the witness key of witness output 'out', nullptr if there is none or 'out' is not a witness output.
+    CAccount* Find(const CTxOut& out);
+
+    //! Private key for 'keyID' if it belongs to a witness only account and that account is unlocked.
+    bool GetKey(const CKeyID& keyID, CKey& keyOut);
+
+    //! All accounts that are not witness only accounts; these are not indexed and have to be checked individually.
+    const std::vector<CAccount*>& GetOtherAccounts();
+
+    //! Number of indexed keys.
+    size_t Size();
+
+    //! True if 'out' is a witness output (either segsig or legacy script).
+    static bool IsWitnessOutput(const CTxOut& out);
+
+    //! Extract spending and witness key IDs from a witness output (either segsig or legacy script).
+    static bool GetWitnessKeyIDs(const CTxOut& out, CKeyID& spendingKeyID, CKeyID& witnessKeyID);
+
+private:
+    struct CEntry
+    {
+        CAccount* account;
+        std::unique_ptr<CKey> key;
+    };
+
+    void Rebuild();
+    void IndexAccount(CAccount* account);
+
+    const std::map<boost::uuids::uuid, CAccount*>& accounts;
+    std::unordered_map<CKeyID, CEntry, KeyIDHasher> index;
+    std::vector<CAccount*> otherAccounts;
+    bool fDirty;
+};
+
+#endif // GULDEN_WALLET_WITNESSKEYINDEX_H
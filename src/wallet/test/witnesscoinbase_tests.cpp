@@ -0,0 +1,199 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "chain.h"
+#include "consensus/merkle.h"
+#include "generation/witness.h"
+#include "validation/validation.h"
+#include "wallet/wallet.h"
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(witnesscoinbase_tests, BasicTestingSetup)
+
+static const CAmount TEST_WITNESS_SUBSIDY = 30 * COIN;
+static const CAmount TEST_WITNESS_FEES = 7 * COIN;
+
+// The witness thread signs with the active wallet, so the tests have to make theirs active for the duration.
+struct CActiveWalletScope
+{
+    CActiveWalletScope(CWallet* pwallet) : pwalletPrevious(pactiveWallet) { pactiveWallet = pwallet; }
+    ~CActiveWalletScope() { pactiveWallet = pwalletPrevious; }
+    CWalletRef pwalletPrevious;
+};
+
+static CTxOut TestWitnessOutput(const CKey& key, uint64_t nLockFromBlock, uint64_t nFailCount)
+{
+    CTxOutPoW2Witness details;
+    details.spendingKeyID = key.GetPubKey().GetID();
+    details.witnessKeyID = key.GetPubKey().GetID();
+    details.lockFromBlock = nLockFromBlock;
+    details.lockUntilBlock = 500000;
+    details.failCount = nFailCount;
+    details.actionNonce = 3;
+    return CTxOut(20000 * COIN, details);
+}
+
+// Give 'wallet' the transaction that funds 'witnessOutput', as CWallet::SignTransaction looks the spent output up there.
+static COutPoint AddWitnessOutputToWallet(CWallet& wallet, const CTxOut& witnessOutput)
+{
+    CMutableTransaction fund(CTransaction::SEGSIG_ACTIVATION_VERSION);
+    fund.vin.resize(1);
+    fund.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    fund.vout.push_back(witnessOutput);
+    CWalletTx wtx(&wallet, MakeTransactionRef(std::move(fund)));
+    LOCK(wallet.cs_wallet);
+    wallet.LoadToWallet(wtx);
+    return COutPoint(wtx.GetHash(), 0);
+}
+
+static void CheckSameSignature(const CTxIn& a, const CTxIn& b)
+{
+    BOOST_CHECK(a.scriptSig == b.scriptSig);
+    BOOST_CHECK(a.segregatedSignatureData.stack == b.segregatedSignatureData.stack);
+}
+
+static std::shared_ptr<CBlock> SignedWitnessBlock(const CMutableTransaction& coinbaseTx, const CTxOut& witnessOutput)
+{
+    std::shared_ptr<CBlock> pBlock = std::make_shared<CBlock>();
+    pBlock->nVersionPoW2Witness = 1;
+    pBlock->nTimePoW2Witness = 1000000;
+    pBlock->vtx.push_back(MakeTransactionRef(coinbaseTx));
+    pBlock->hashMerkleRootPoW2Witness = BlockMerkleRoot(pBlock->vtx.begin(), pBlock->vtx.end());
+    BOOST_REQUIRE(SignBlockAsWitness(pBlock, witnessOutput));
+    return pBlock;
+}
+
+// Build the witness coinbase for 'witnessOutput' both from a prepared template and directly, check that the two (and the blocks signed with them) are identical,
+// and return the coinbase for the checks of the case at hand.
+static CMutableTransaction CheckTemplateMatchesDirect(CWallet& wallet, CAccount* account, CTxOut witnessOutput, std::shared_ptr<CReserveKeyOrScript> coinbaseScript, CBlockIndex* pindexPrev)
+{
+    COutPoint outpoint = AddWitnessOutputToWallet(wallet, witnessOutput);
+    const int nWitnessHeight = pindexPrev->nHeight + 1;
+    const unsigned int nSelectedWitnessBlockHeight = pindexPrev->nHeight - 50;
+
+    CWitnessCoinbaseTemplate coinbaseTemplate;
+    BOOST_REQUIRE(CreateWitnessCoinbaseTemplate(coinbaseTemplate, nWitnessHeight, IsSegSigEnabled(pindexPrev), outpoint, account, coinbaseScript));
+    BOOST_CHECK(coinbaseTemplate.accountUUID == account->getUUID());
+    BOOST_CHECK(coinbaseTemplate.coinbaseScript == coinbaseScript);
+    BOOST_CHECK(coinbaseTemplate.coinbaseTx.vout.empty());
+
+    const auto& [fDirect, directTx] = CreateWitnessCoinbase(nWitnessHeight, pindexPrev, 4, coinbaseScript, TEST_WITNESS_SUBSIDY, TEST_WITNESS_FEES, witnessOutput, outpoint, nSelectedWitnessBlockHeight, account, nullptr);
+    const auto& [fTemplate, templateTx] = CreateWitnessCoinbase(nWitnessHeight, pindexPrev, 4, coinbaseScript, TEST_WITNESS_SUBSIDY, TEST_WITNESS_FEES, witnessOutput, outpoint, nSelectedWitnessBlockHeight, account, &coinbaseTemplate.coinbaseTx);
+    BOOST_REQUIRE(fDirect);
+    BOOST_REQUIRE(fTemplate);
+    BOOST_CHECK(directTx.GetHash() == templateTx.GetHash());
+    BOOST_REQUIRE_EQUAL(directTx.vin.size(), templateTx.vin.size());
+    for (unsigned int i = 0; i < directTx.vin.size(); ++i)
+        CheckSameSignature(directTx.vin[i], templateTx.vin[i]);
+    BOOST_CHECK(directTx.vout == templateTx.vout);
+    BOOST_CHECK(!templateTx.vin[1].segregatedSignatureData.stack.empty() || !templateTx.vin[1].scriptSig.empty());
+
+    std::shared_ptr<CBlock> pDirectBlock = SignedWitnessBlock(directTx, witnessOutput);
+    std::shared_ptr<CBlock> pTemplateBlock = SignedWitnessBlock(templateTx, witnessOutput);
+    BOOST_CHECK(pDirectBlock->GetHashPoW2() == pTemplateBlock->GetHashPoW2());
+    BOOST_CHECK(pDirectBlock->witnessHeaderPoW2Sig == pTemplateBlock->witnessHeaderPoW2Sig);
+    CPubKey pubkey;
+    BOOST_REQUIRE(pubkey.RecoverCompact(pTemplateBlock->GetHashPoW2(), pTemplateBlock->witnessHeaderPoW2Sig));
+    BOOST_CHECK(pubkey.GetID() == witnessOutput.output.witnessDetails.witnessKeyID);
+
+    return directTx;
+}
+
+struct WitnessCoinbaseSetup
+{
+    WitnessCoinbaseSetup() : activeWallet(&wallet)
+    {
+        account = new CAccount();
+        account->m_Type = Desktop;
+        key.MakeNewKey(true);
+        account->AddKeyPubKey(key, key.GetPubKey(), KEYCHAIN_EXTERNAL);
+        wallet.mapAccounts[account->getUUID()] = account;
+
+        CKey rewardKey;
+        rewardKey.MakeNewKey(true);
+        rewardScript = GetScriptForDestination(rewardKey.GetPubKey().GetID());
+        coinbaseScript = std::make_shared<CReserveKeyOrScript>(rewardScript);
+
+        indexPrev.nHeight = 1000;
+        indexPrev.nVersionPoW2Witness = 1;
+    }
+
+    CWallet wallet;
+    CActiveWalletScope activeWallet;
+    CAccount* account;
+    CKey key;
+    CScript rewardScript;
+    std::shared_ptr<CReserveKeyOrScript> coinbaseScript;
+    CBlockIndex indexPrev;
+};
+
+BOOST_AUTO_TEST_CASE(witness_coinbase_template_compounding)
+{
+    WitnessCoinbaseSetup setup;
+    CTxOut witnessOutput = TestWitnessOutput(setup.key, 100, 0);
+
+    // Compound everything.
+    setup.account->setCompounding(0, nullptr);
+    CMutableTransaction coinbaseTx = CheckTemplateMatchesDirect(setup.wallet, setup.account, witnessOutput, setup.coinbaseScript, &setup.indexPrev);
+    BOOST_REQUIRE_EQUAL(coinbaseTx.vout.size(), 1U);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[0].nValue, witnessOutput.nValue + TEST_WITNESS_SUBSIDY + TEST_WITNESS_FEES);
+
+    // Compound the first 10, pay out the rest.
+    setup.account->setCompounding(10 * COIN, nullptr);
+    coinbaseTx = CheckTemplateMatchesDirect(setup.wallet, setup.account, witnessOutput, setup.coinbaseScript, &setup.indexPrev);
+    BOOST_REQUIRE_EQUAL(coinbaseTx.vout.size(), 2U);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[0].nValue, witnessOutput.nValue + 10 * COIN);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[1].nValue, TEST_WITNESS_SUBSIDY + TEST_WITNESS_FEES - 10 * COIN);
+
+    // Pay out the first 5, compound the rest.
+    setup.account->setCompounding(-5 * COIN, nullptr);
+    coinbaseTx = CheckTemplateMatchesDirect(setup.wallet, setup.account, witnessOutput, setup.coinbaseScript, &setup.indexPrev);
+    BOOST_REQUIRE_EQUAL(coinbaseTx.vout.size(), 2U);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[0].nValue, witnessOutput.nValue + TEST_WITNESS_SUBSIDY + TEST_WITNESS_FEES - 5 * COIN);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[1].nValue, 5 * COIN);
+}
+
+BOOST_AUTO_TEST_CASE(witness_coinbase_template_reward_script)
+{
+    WitnessCoinbaseSetup setup;
+    CTxOut witnessOutput = TestWitnessOutput(setup.key, 100, 0);
+
+    // Pay out more than the reward, so all of it goes to the reward script.
+    setup.account->setCompounding(-1000 * COIN, nullptr);
+    CMutableTransaction coinbaseTx = CheckTemplateMatchesDirect(setup.wallet, setup.account, witnessOutput, setup.coinbaseScript, &setup.indexPrev);
+    BOOST_REQUIRE_EQUAL(coinbaseTx.vout.size(), 2U);
+    BOOST_CHECK(coinbaseTx.vout[1].GetType() == CTxOutType::ScriptLegacyOutput);
+    BOOST_CHECK(coinbaseTx.vout[1].output.scriptPubKey == setup.rewardScript);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[0].nValue, witnessOutput.nValue);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[1].nValue, TEST_WITNESS_SUBSIDY + TEST_WITNESS_FEES);
+}
+
+BOOST_AUTO_TEST_CASE(witness_coinbase_template_lock_renewal)
+{
+    WitnessCoinbaseSetup setup;
+    setup.account->setCompounding(0, nullptr);
+
+    // The first time an output witnesses its lock starts at the height it was selected at, and every witnessed block takes one off the fail count.
+    CTxOut witnessOutput = TestWitnessOutput(setup.key, 0, 2);
+    CMutableTransaction coinbaseTx = CheckTemplateMatchesDirect(setup.wallet, setup.account, witnessOutput, setup.coinbaseScript, &setup.indexPrev);
+    BOOST_REQUIRE_EQUAL(coinbaseTx.vout.size(), 1U);
+    BOOST_REQUIRE(coinbaseTx.vout[0].GetType() == CTxOutType::PoW2WitnessOutput);
+    const CTxOutPoW2Witness& renewed = coinbaseTx.vout[0].output.witnessDetails;
+    BOOST_CHECK_EQUAL(renewed.lockFromBlock, (uint64_t)(setup.indexPrev.nHeight - 50));
+    BOOST_CHECK_EQUAL(renewed.lockUntilBlock, witnessOutput.output.witnessDetails.lockUntilBlock);
+    BOOST_CHECK_EQUAL(renewed.failCount, 1U);
+    BOOST_CHECK_EQUAL(renewed.actionNonce, witnessOutput.output.witnessDetails.actionNonce + 1);
+    BOOST_CHECK(renewed.witnessKeyID == witnessOutput.output.witnessDetails.witnessKeyID);
+    BOOST_CHECK(renewed.spendingKeyID == witnessOutput.output.witnessDetails.spendingKeyID);
+
+    // An output that witnessed before keeps its lock.
+    witnessOutput = TestWitnessOutput(setup.key, 100, 0);
+    coinbaseTx = CheckTemplateMatchesDirect(setup.wallet, setup.account, witnessOutput, setup.coinbaseScript, &setup.indexPrev);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[0].output.witnessDetails.lockFromBlock, 100U);
+    BOOST_CHECK_EQUAL(coinbaseTx.vout[0].output.witnessDetails.failCount, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
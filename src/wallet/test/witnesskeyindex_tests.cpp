@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "wallet/wallet.h"
+#include "wallet/Gulden/witnesskeyindex.h"
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(witnesskeyindex_tests, BasicTestingSetup)
+
+static CAccount* AddTestAccount(CWallet& wallet, AccountType type, CKey& key)
+{
+    CAccount* account = new CAccount();
+    account->m_Type = type;
+    key.MakeNewKey(true);
+    account->AddKeyPubKey(key, key.GetPubKey(), KEYCHAIN_EXTERNAL);
+    wallet.mapAccounts[account->getUUID()] = account;
+    return account;
+}
+
+static CTxOut TestWitnessOutput(const CKeyID& spendingKeyID, const CKeyID& witnessKeyID)
+{
+    CTxOutPoW2Witness details;
+    details.spendingKeyID = spendingKeyID;
+    details.witnessKeyID = witnessKeyID;
+    details.lockFromBlock = 1;
+    details.lockUntilBlock = 100000;
+    return CTxOut(10000 * COIN, details);
+}
+
+// With -witnesshosting the index has to give exactly the same answers as asking every account.
+BOOST_AUTO_TEST_CASE(witnesskeyindex_matches_linear_scan)
+{
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+
+    std::vector<CAccount*> witnessAccounts;
+    std::vector<CKey> witnessKeys;
+    for (int i = 0; i < 20; ++i)
+    {
+        CKey key;
+        witnessAccounts.push_back(AddTestAccount(wallet, WitnessOnlyWitnessAccount, key));
+        witnessKeys.push_back(key);
+    }
+    CKey spendingKey;
+    CAccount* spendingAccount = AddTestAccount(wallet, Desktop, spendingKey);
+    CKey unknownKey;
+    unknownKey.MakeNewKey(true);
+
+    std::vector<CTxOut> outputs;
+    outputs.push_back(TestWitnessOutput(unknownKey.GetPubKey().GetID(), witnessKeys[3].GetPubKey().GetID()));
+    outputs.push_back(TestWitnessOutput(spendingKey.GetPubKey().GetID(), unknownKey.GetPubKey().GetID()));
+    outputs.push_back(TestWitnessOutput(unknownKey.GetPubKey().GetID(), unknownKey.GetPubKey().GetID()));
+    outputs.push_back(CTxOut(COIN, GetScriptForDestination(witnessKeys[5].GetPubKey().GetID())));
+
+    std::vector<isminetype> expectedMine;
+    std::vector<CAccount*> expectedAccount;
+    fWitnessHosting = false;
+    for (const auto& out : outputs)
+    {
+        expectedMine.push_back(wallet.IsMine(out));
+        expectedAccount.push_back(wallet.FindAccountForTransaction(out));
+    }
+    BOOST_CHECK(expectedAccount[0] == witnessAccounts[3]);
+    BOOST_CHECK(expectedAccount[1] == spendingAccount);
+    BOOST_CHECK(expectedAccount[2] == nullptr);
+
+    fWitnessHosting = true;
+    for (unsigned int i = 0; i < outputs.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(wallet.IsMine(outputs[i]), expectedMine[i]);
+        BOOST_CHECK(wallet.FindAccountForTransaction(outputs[i]) == expectedAccount[i]);
+    }
+    BOOST_CHECK_EQUAL(wallet.witnessKeyIndex.Size(), witnessAccounts.size());
+    BOOST_CHECK_EQUAL(wallet.witnessKeyIndex.GetOtherAccounts().size(), 1U);
+
+    CKey key;
+    BOOST_CHECK(wallet.GetKey(witnessKeys[7].GetPubKey().GetID(), key));
+    BOOST_CHECK(key == witnessKeys[7]);
+    BOOST_CHECK(wallet.GetKey(spendingKey.GetPubKey().GetID(), key));
+    BOOST_CHECK(key == spendingKey);
+    BOOST_CHECK(!wallet.GetKey(unknownKey.GetPubKey().GetID(), key));
+    BOOST_CHECK(wallet.HaveKey(witnessKeys[0].GetPubKey().GetID()));
+    BOOST_CHECK(!wallet.HaveKey(unknownKey.GetPubKey().GetID()));
+
+    // Purged account.
+    wallet.mapAccounts.erase(witnessAccounts[3]->getUUID());
+    wallet.witnessKeyIndex.RemoveAccount(witnessAccounts[3]);
+    BOOST_CHECK_EQUAL(wallet.IsMine(outputs[0]), ISMINE_NO);
+    BOOST_CHECK(wallet.FindAccountForTransaction(outputs[0]) == nullptr);
+    delete witnessAccounts[3];
+
+    // Key added to an existing account.
+    BOOST_CHECK(witnessAccounts[4]->AddKeyPubKey(unknownKey, unknownKey.GetPubKey(), KEYCHAIN_EXTERNAL));
+    wallet.witnessKeyIndex.AddKey(witnessAccounts[4], unknownKey.GetPubKey().GetID());
+    BOOST_CHECK(wallet.FindAccountForTransaction(outputs[2]) == witnessAccounts[4]);
+
+    fWitnessHosting = DEFAULT_WITNESS_HOSTING;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
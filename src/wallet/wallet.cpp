@@ -117,6 +117,7 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey, CAccount&
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!forAccount.AddKeyPubKey(secret, pubkey, nKeyChain))
         return false;
+    witnessKeyIndex.AddKey(&forAccount, pubkey.GetID());
 
     // check if we need to remove from watch-only
     CScript script;
@@ -176,6 +177,7 @@ bool CWallet::LoadCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigne
     if (mapAccounts.find(getUUIDFromString(forAccount)) == mapAccounts.end())
         return false;
  
+    witnessKeyIndex.SetDirty();
     return mapAccounts[getUUIDFromString(forAccount)]->AddCryptedKeyWithChain(vchPubKey, vchCryptedSecret, nKeyChain);
 }
 
@@ -29,6 +29,11 @@ DBErrors CWallet::LoadWallet(WalletLoadState& nExtraLoadState)
 {
     nExtraLoadState = NEW_WALLET;
     DBErrors nLoadWalletRet = CWalletDB(*dbw,"cr+").LoadWallet(this, nExtraLoadState);
+    {
+        // Accounts are put straight into mapAccounts while loading, so the witness key index has to start over.
+        LOCK(cs_wallet);
+        witnessKeyIndex.SetDirty();
+    }
     if (nLoadWalletRet == DB_NEED_REWRITE)
     {
         if (dbw->Rewrite("\x04pool"))
@@ -84,6 +89,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-wallet=<file>", helptr("Specify wallet file (within data directory)") + " " + strprintf(helptr("(default: %s)"), DEFAULT_WALLET_DAT));
     strUsage += HelpMessageOpt("-walletbroadcast", helptr("Make the wallet broadcast transactions") + " " + strprintf(helptr("(default: %u)"), DEFAULT_WALLETBROADCAST));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", helptr("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
+    strUsage += HelpMessageOpt("-witnesshosting", strprintf(helptr("Index the keys of witness only accounts so that witnessing for a large number of imported witness accounts stays fast; decrypted witness keys are kept in memory while the wallet is unlocked (default: %u)"), DEFAULT_WITNESS_HOSTING));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", helptr("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
                                " " + helptr("(1 = keep tx meta data e.g. account owner and payment request information, 2 = drop tx meta data)"));
 
@@ -691,6 +697,7 @@ bool CWallet::ParameterInteraction()
     nTxConfirmTarget = GetArg("-txconfirmtarget", DEFAULT_TX_CONFIRM_TARGET);
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     fWalletRbf = GetBoolArg("-walletrbf", DEFAULT_WALLET_RBF);
+    fWitnessHosting = GetBoolArg("-witnesshosting", DEFAULT_WITNESS_HOSTING);
 
     return true;
 }
@@ -14,6 +14,7 @@
 #include "wallet/wallettx.h"
 
 #include "validation/validation.h"
+#include "blockstore.h"
 #include "net.h"
 #include "scheduler.h"
 #include "timedata.h"
@@ -147,9 +148,13 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
         uint64_t nWorkQuantity = nProgressTip - nProgressStart;
         while (pindex && !fAbortRescan && nWorkQuantity > 0)
         {
-            // Temporarily release lock to allow shadow key allocation a chance to do it's thing
+            CDiskBlockPos blockPos = pindex->GetBlockPos();
+
+            // Temporarily release lock to allow shadow key allocation a chance to do it's thing, the block is read in the meantime.
             LEAVE_CRITICAL_SECTION(cs_main)
             LEAVE_CRITICAL_SECTION(cs_wallet)
+            CBlock block;
+            bool fReadBlock = blockStore.ReadBlockFromDiskMapped(block, blockPos, pindex->GetBlockHashPoW2(), chainParams);
             nTransactionScanProgressPercent = ((pindex->nHeight-nProgressStart) / (nWorkQuantity)) * 100;
             nTransactionScanProgressPercent = std::max(1, std::min(99, nTransactionScanProgressPercent));
             if (pindex->nHeight % 100 == 0 && nProgressTip - nProgressStart > 0.0)
@@ -166,8 +171,7 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
             if (ShutdownRequested())
                 return ret;
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params())) {
+            if (fReadBlock) {
                 for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
                     AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
                 }
@@ -65,6 +65,20 @@ bool CWallet::SignTransaction(CAccount* fromAccount, CMutableTransaction &tx, Si
 
 CAccount* CWallet::FindAccountForTransaction(const CTxOut& out)
 {
+    LOCK(cs_wallet);
+    if (fWitnessHosting && CWitnessKeyIndex::IsWitnessOutput(out))
+    {
+        CAccount* witnessAccount = witnessKeyIndex.Find(out);
+        if (witnessAccount)
+            return witnessAccount;
+        for (const auto& childAccount : witnessKeyIndex.GetOtherAccounts())
+        {
+            if (::IsMine(*childAccount, out) == ISMINE_SPENDABLE)
+                return childAccount;
+        }
+        return NULL;
+    }
+
     for (const auto& accountItem : mapAccounts)
     {
         CAccount* childAccount = accountItem.second;
@@ -9,6 +9,7 @@
 // Distributed under the GULDEN software license, see the accompanying
 // file COPYING
 
+#include "blockstore.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "streams.h"
@@ -179,9 +180,13 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     {
-        LOCK(cs_main);// cs_main required for ReadBlockFromDisk.
+        CDiskBlockPos blockPos;
+        {
+            LOCK(cs_main);
+            blockPos = pindex->GetBlockPos();
+        }
         CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, Params()))
+        if(!blockStore.ReadBlockFromDiskMapped(block, blockPos, pindex->GetBlockHashPoW2(), Params()))
         {
             zmqError("Can't read block from disk");
             return false;
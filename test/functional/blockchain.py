@@ -13,8 +13,9 @@ Test the following RPCs:
     - getchaintxstats
     - getnetworkhashps
     - verifychain
+    - getnetworkweighthistory
 
-Tests correspond to code in rpc/blockchain.cpp.
+Tests correspond to code in rpc/blockchain.cpp and Gulden/rpcgulden.cpp.
 """
 
 from decimal import Decimal
@@ -41,6 +42,7 @@ class BlockchainTest(GuldenTestFramework):
         self._test_getblockheader()
         self._test_getdifficulty()
         self._test_getnetworkhashps()
+        self._test_getnetworkweighthistory()
         self.nodes[0].verifychain(4, 0)
 
     def _test_getchaintxstats(self):
@@ -67,6 +69,20 @@ class BlockchainTest(GuldenTestFramework):
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized_2']), 64)
 
+        self.log.info("Test that the kept statistics match the full scan")
+        res_muhash = node.gettxoutsetinfo("muhash")
+        assert_equal(res_muhash['height'], 200)
+        assert_equal(res_muhash['bestblock'], res['bestblock'])
+        assert_equal(res_muhash['txouts'], res['txouts'])
+        assert_equal(res_muhash['bogosize'], res['bogosize'])
+        assert_equal(res_muhash['total_amount'], res['total_amount'])
+        assert_equal(len(res_muhash['muhash']), 64)
+        assert_equal(res_muhash['witness']['txouts'], 0)
+        assert_equal(node.gettxoutsetinfo("muhash", 200), res_muhash)
+        assert_equal(node.gettxoutsetinfo("muhash", node.getblockhash(200)), res_muhash)
+        assert 'muhash' not in node.gettxoutsetinfo("none", 100)
+        assert_raises_jsonrpc(-8, "hash_serialized_2 can only be calculated for the tip", node.gettxoutsetinfo, "hash_serialized_2", 100)
+
         self.log.info("Test that gettxoutsetinfo() works for blockchain with just the genesis block")
         b1hash = node.getblockhash(1)
         node.invalidateblock(b1hash)
@@ -79,6 +95,7 @@ class BlockchainTest(GuldenTestFramework):
         assert_equal(res2['bogosize'], 0),
         assert_equal(res2['bestblock'], node.getblockhash(0))
         assert_equal(len(res2['hash_serialized_2']), 64)
+        assert_equal(node.gettxoutsetinfo("muhash")['txouts'], 0)
 
         self.log.info("Test that gettxoutsetinfo() returns the same result after invalidate/reconsider block")
         node.reconsiderblock(b1hash)
@@ -91,6 +108,7 @@ class BlockchainTest(GuldenTestFramework):
         assert_equal(res['bogosize'], res3['bogosize'])
         assert_equal(res['bestblock'], res3['bestblock'])
         assert_equal(res['hash_serialized_2'], res3['hash_serialized_2'])
+        assert_equal(node.gettxoutsetinfo("muhash"), res_muhash)
 
     def _test_getblockheader(self):
         node = self.nodes[0]
@@ -129,5 +147,35 @@ class BlockchainTest(GuldenTestFramework):
         # This should be 2 hashes every 10 minutes or 1/300
         assert abs(hashes_per_second * 300 - 1) < 0.0001
 
+    def _test_getnetworkweighthistory(self):
+        node = self.nodes[0]
+
+        res = node.getnetworkweighthistory(0)
+        assert_equal(len(res), 100)
+        assert_equal([r['height'] for r in res], list(range(100)))
+
+        res = node.getnetworkweighthistory(190, 5)
+        assert_equal(len(res), 5)
+        assert_equal(res[0]['height'], 190)
+        assert_equal(res[0]['hash'], node.getblockhash(190))
+        assert_equal(res[4]['height'], 194)
+        # There are no witnesses on the cached chain.
+        for r in res:
+            assert_equal(r['number_of_witnesses_raw'], 0)
+            assert_equal(r['total_witness_weight_raw'], 0)
+
+        # The range ends at the tip, also for counts that would overflow the end height.
+        res = node.getnetworkweighthistory(195, 100)
+        assert_equal([r['height'] for r in res], list(range(195, 201)))
+        res = node.getnetworkweighthistory(200, 2**31 - 1)
+        assert_equal(len(res), 1)
+        assert_equal(res[0]['hash'], node.getbestblockhash())
+        assert_equal(node.getnetworkweighthistory(201), [])
+        assert_equal(node.getnetworkweighthistory(2**31 - 1, 2**31 - 1), [])
+        assert_equal(node.getnetworkweighthistory(100, 0), [])
+
+        assert_raises_jsonrpc(-8, "must be non-negative", node.getnetworkweighthistory, -1)
+        assert_raises_jsonrpc(-8, "must be non-negative", node.getnetworkweighthistory, 0, -1)
+
 if __name__ == '__main__':
     BlockchainTest().main()
@@ -77,6 +77,7 @@ BASE_SCRIPTS= [
     'bip68-112-113-p2p.py',
     'rawtransactions.py',
     'reindex.py',
+    'utxo_snapshot.py',
     # vv Tests less than 30s vv
     "zmq_test.py",
     'mempool_resurrect_test.py',
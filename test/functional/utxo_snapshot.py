@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Gulden developers
+# Distributed under the GULDEN software license, see the accompanying
+# file COPYING
+"""Test the UTXO snapshot RPCs dumptxoutset and loadtxoutset, and -loadsnapshot.
+
+- node0 mines a chain and dumps a snapshot at its tip.
+- Loading that snapshot is refused by node0 (not ahead of its tip), and by node1 while it does
+  not know the header of the snapshot block, or when the file was tampered with.
+- node1 is restarted with -loadsnapshot and connected to node0. It syncs the headers, loads the
+  snapshot, downloads only the blocks after it, and ends up with the same UTXO set as node0.
+- node3 is started with -loadsnapshot and connected only to node2, which mined a chain of its own.
+  Once its best header is past the snapshot height without the snapshot block it gives up on the
+  snapshot and syncs node2's chain from genesis.
+"""
+
+import os
+import shutil
+
+from test_framework.test_framework import GuldenTestFramework
+from test_framework.util import *
+
+class UTXOSnapshotTest(GuldenTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.setup_clean_chain = True
+        self.num_nodes = 4
+
+    def setup_network(self):
+        # The nodes are connected by the test, once node1 should learn about node0's chain.
+        self.setup_nodes()
+
+    def run_test(self):
+        node0 = self.nodes[0]
+        node0.generate(110)
+
+        self.log.info("Dump a snapshot at the tip of node0")
+        res = node0.dumptxoutset("utxo.dat")
+        path = res['path']
+        assert_equal(path, os.path.join(self.options.tmpdir, "node0", "regtest", "utxo.dat"))
+        assert os.path.isfile(path)
+        assert_equal(res['base_height'], 110)
+        assert_equal(res['base_hash'], node0.getbestblockhash())
+        assert_equal(res['coins_written'], node0.gettxoutsetinfo()['txouts'])
+        assert_equal(len(res['content_hash']), 64)
+        assert_raises_jsonrpc(-8, "already exists", node0.dumptxoutset, "utxo.dat")
+
+        self.log.info("Refuse snapshots that can not be loaded")
+        assert_raises_jsonrpc(-1, "is not ahead of the tip of the active chain", node0.loadtxoutset, path)
+        assert_raises_jsonrpc(-1, "is not known yet", self.nodes[1].loadtxoutset, path)
+
+        tampered = os.path.join(self.options.tmpdir, "tampered.dat")
+        shutil.copyfile(path, tampered)
+        with open(tampered, "r+b") as f:
+            f.seek(os.path.getsize(tampered) // 2)
+            byte = f.read(1)
+            f.seek(-1, os.SEEK_CUR)
+            f.write(bytes([byte[0] ^ 0xff]))
+        assert_raises_jsonrpc(-1, "content hash mismatch", self.nodes[1].loadtxoutset, tampered)
+        assert_equal(self.nodes[1].getblockcount(), 0)
+
+        self.log.info("Start node1 from the snapshot")
+        node0.generate(10)
+        self.stop_node(1)
+        self.nodes[1] = self.start_node(1, self.options.tmpdir, ["-loadsnapshot=" + path])
+        connect_nodes_bi(self.nodes, 0, 1)
+        sync_blocks(self.nodes)
+        node1 = self.nodes[1]
+        assert_equal(node1.getbestblockhash(), node0.getbestblockhash())
+        # Only the blocks after the snapshot were downloaded.
+        assert_equal(node1.getchaintxstats(1)['txcount'], node0.getchaintxstats(1)['txcount'])
+        assert_equal(node1.gettxoutsetinfo("muhash", 110)['muhash'], node0.gettxoutsetinfo("muhash", 110)['muhash'])
+        assert_equal(node1.gettxoutsetinfo("muhash")['muhash'], node0.gettxoutsetinfo("muhash")['muhash'])
+
+        self.log.info("Keep validating blocks on top of the snapshot across a restart")
+        self.stop_node(1)
+        self.nodes[1] = self.start_node(1, self.options.tmpdir)
+        node1 = self.nodes[1]
+        assert_equal(node1.getbestblockhash(), node0.getbestblockhash())
+        connect_nodes_bi(self.nodes, 0, 1)
+        node1.generate(5)
+        sync_blocks(self.nodes)
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], node0.gettxoutsetinfo()['hash_serialized_2'])
+        assert_equal(node1.gettxoutsetinfo("muhash")['muhash'], node0.gettxoutsetinfo("muhash")['muhash'])
+
+        self.log.info("Give up on a snapshot that is not of the chain of our peers")
+        node2 = self.nodes[2]
+        node2.generate(120)
+        self.stop_node(3)
+        self.nodes[3] = self.start_node(3, self.options.tmpdir, ["-loadsnapshot=" + path])
+        node3 = self.nodes[3]
+        connect_nodes_bi(self.nodes, 2, 3)
+        # Without giving up node3 would not download any block before the snapshot height.
+        sync_blocks([node2, node3])
+        assert_equal(node3.getbestblockhash(), node2.getbestblockhash())
+        assert_equal(node3.getblockcount(), 120)
+        assert_equal(node3.gettxoutsetinfo()['hash_serialized_2'], node2.gettxoutsetinfo()['hash_serialized_2'])
+
+if __name__ == '__main__':
+    UTXOSnapshotTest().main()